@@ -0,0 +1,173 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+
+#include "channel_backend.h"
+#include "channel_mq.h"
+#include "channel_shm.h"
+#include "channel_stream.h"
+#include "ipc_metrics.h"
+#include "ipc_trace.h"
+
+// Typed record channel with the transport picked at compile time.
+// Channel<T, Backend> moves whole T records as raw bytes; the backend is a
+// plain member, so every call is resolved statically and inlined. Changing
+// an application's transport means changing the Backend argument.
+//
+// A backend provides:
+//   bool create(const char* name, ChannelRole role,
+//               const WireLayout& layout);
+//   bool open(const char* name, ChannelRole role, const WireLayout& layout);
+//   bool wait_peer(int timeout_ms);
+//   ssize_t write_records(const void* data, size_t size, size_t count);
+//   ssize_t read_records(void* data, size_t size, size_t max,
+//                        int timeout_ms);
+//   size_t queued() const;
+//   uint64_t position(ChannelRole role) const;
+//   int poll_fd() const;
+//   void close();
+//   static void unlink(const char* name);
+//   static constexpr const char* TRANSPORT;
+// write_records returns the number of records written (fewer than count
+// only when a signal cut a blocked write short) or -1 if none was written.
+// read_records returns the number of records read (at least one), 0 once
+// the writer is gone, or -1 with errno set: EAGAIN when the timeout
+// expired, EINTR when a signal interrupted the wait. Timeouts are in
+// milliseconds and -1 waits forever. queued() is the number of records
+// known to be waiting without asking the kernel. position() is the index
+// of the next record sent or received in the given role, counted the
+// same way on both ends (per connection for the stream transports), so
+// traces can match a receive to its send. poll_fd() is the descriptor
+// that turns readable when a receive can make progress, for event loops;
+// the shm ring has none and offers a signal word to park on instead.
+// Other calls return false with errno set on error.
+//
+// Every endpoint registers its counters in the ipc_metrics registry when
+// it attaches; the application adds drops, gaps and latencies through
+// metrics(). With IPC_TRACE set, sends and receives are also recorded in
+// the process's trace ring (ipc_trace.h).
+//
+// Both ends must agree on wire_layout<T>(). The shared memory ring keeps
+// it in its header and open() fails with EPROTO on a mismatch; the other
+// transports carry it ahead of the records and the reader fails with
+// EPROTO before handing out any of them.
+
+template <typename T, typename Backend>
+class Channel {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Channel records are copied as raw bytes");
+
+ public:
+  Channel() = default;
+  Channel(const Channel&) = delete;
+  Channel& operator=(const Channel&) = delete;
+  ~Channel() { close(); }
+
+  // Creates the named endpoint (replacing a stale one) and uses it in the
+  // given role.
+  bool create(const char* name, ChannelRole role) {
+    if (!backend_.create(name, role, wire_layout<T>())) return false;
+    attached(name, role);
+    return true;
+  }
+
+  // Attaches to an endpoint another process created.
+  bool open(const char* name, ChannelRole role) {
+    if (!backend_.open(name, role, wire_layout<T>())) return false;
+    attached(name, role);
+    return true;
+  }
+
+  // Switches the role after fork(), when the child uses the other end of
+  // an endpoint its parent created (a PipeBackend reader).
+  void assume_role(ChannelRole role) { attached(name_.c_str(), role); }
+
+  // Waits until the other side is attached where the transport has such
+  // a notion (a socket client, the other end of a FIFO). Sends and
+  // receives wait for it on their own; this only adds a timeout.
+  bool wait_peer(int timeout_ms = -1) { return backend_.wait_peer(timeout_ms); }
+
+  bool send(const T& record) { return send_n(&record, 1) == 1; }
+
+  ssize_t send_n(const T* records, size_t count) {
+    if (IPC_TRACING()) {
+      return traced(TraceKind::SEND, [&] { return write(records, count); });
+    }
+    return write(records, count);
+  }
+
+  // Returns 1, 0 at end of stream, or -1 (EAGAIN on timeout).
+  int receive(T& record, int timeout_ms = -1) {
+    return static_cast<int>(recv_n(&record, 1, timeout_ms));
+  }
+
+  ssize_t recv_n(T* records, size_t max, int timeout_ms = -1) {
+    if (IPC_TRACING()) {
+      return traced(TraceKind::RECV,
+                    [&] { return read(records, max, timeout_ms); });
+    }
+    return read(records, max, timeout_ms);
+  }
+
+  void close() {
+    backend_.close();
+    metrics_.detach();
+  }
+
+  static void unlink(const char* name) { Backend::unlink(name); }
+
+  Backend& backend() { return backend_; }
+  ChannelMetrics& metrics() { return metrics_; }
+
+ private:
+  void attached(const char* name, ChannelRole role) {
+    name_ = name ? name : "";
+    role_ = role;
+    metrics_.attach(name, role, Backend::TRANSPORT);
+    if (IPC_TRACING()) {
+      trace_channel_ = ipc_trace_channel(name, Backend::TRANSPORT, role);
+    }
+  }
+
+  ssize_t write(const T* records, size_t count) {
+    ssize_t sent = backend_.write_records(records, sizeof(T), count);
+    if (sent > 0 && metrics_) {
+      metrics_.record(static_cast<uint64_t>(sent), sent * sizeof(T));
+      metrics_.depth(backend_.queued());
+    }
+    return sent;
+  }
+
+  ssize_t read(T* records, size_t max, int timeout_ms) {
+    ssize_t received =
+        backend_.read_records(records, sizeof(T), max, timeout_ms);
+    if (received > 0 && metrics_) {
+      metrics_.record(static_cast<uint64_t>(received), received * sizeof(T));
+      metrics_.depth(backend_.queued());
+    }
+    return received;
+  }
+
+  // Records the call as one span; a receive that timed out or failed is
+  // kept too, with no records.
+  template <typename Call>
+  ssize_t traced(TraceKind kind, Call call) {
+    uint64_t position = backend_.position(role_);
+    uint64_t start = ipc_trace_ticks();
+    ssize_t moved = call();
+    ipc_trace_record(kind, trace_channel_, position,
+                     moved > 0 ? static_cast<uint64_t>(moved) : 0, start,
+                     ipc_trace_ticks());
+    return moved;
+  }
+
+  Backend backend_;
+  ChannelMetrics metrics_;
+  std::string name_;
+  ChannelRole role_ = ChannelRole::READER;
+  uint16_t trace_channel_ = IPC_TRACE_NO_CHANNEL;
+};
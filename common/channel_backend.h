@@ -0,0 +1,52 @@
+#pragma once
+
+#include <poll.h>
+#include <time.h>
+
+#include <cerrno>
+#include <cstdint>
+
+#include "wire_format.h"
+
+// Pieces shared by the Channel backends.
+
+enum class ChannelRole { WRITER, READER };
+
+inline uint64_t channel_now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000 +
+         static_cast<uint64_t>(ts.tv_nsec) / 1000000;
+}
+
+// Tracks what is left of a timeout across retries; -1 stays infinite.
+class ChannelDeadline {
+ public:
+  explicit ChannelDeadline(int timeout_ms)
+      : timeout_ms_(timeout_ms),
+        end_ms_(timeout_ms < 0 ? 0 : channel_now_ms() + timeout_ms) {}
+
+  int remaining_ms() const {
+    if (timeout_ms_ < 0) return -1;
+    uint64_t now = channel_now_ms();
+    return now >= end_ms_ ? 0 : static_cast<int>(end_ms_ - now);
+  }
+
+  bool expired() const { return remaining_ms() == 0; }
+
+ private:
+  int timeout_ms_;
+  uint64_t end_ms_;
+};
+
+// Waits for events on fd. Returns false with errno set to EAGAIN on
+// timeout, or to the poll error (EINTR included, so a signal handler that
+// clears a running flag gets its loop back).
+inline bool channel_poll(int fd, short events,
+                         const ChannelDeadline& deadline) {
+  struct pollfd pfd = {fd, events, 0};
+  int ready = poll(&pfd, 1, deadline.remaining_ms());
+  if (ready > 0) return true;
+  if (ready == 0) errno = EAGAIN;
+  return false;
+}
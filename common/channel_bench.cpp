@@ -0,0 +1,365 @@
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "channel.h"
+#include "latency_histogram.h"
+#include "rt_profile.h"
+
+// Streams the same records through every Channel backend, one writer
+// process and one forked reader, so the transports can be compared with
+// the application code unchanged.
+//
+// With -l the writer instead sends one record every interval and the
+// reader histograms how long each took to arrive; -R repeats every run
+// under the real-time profile (rt_profile.h) to show what it does to the
+// tail.
+
+struct BenchRecord {
+  uint64_t sequence;
+  uint64_t timestamp;
+  char payload[48];
+};
+
+constexpr uint64_t LATENCY_RECORDS = 20000;
+
+struct BenchConfig {
+  uint64_t count = 200000;
+  size_t batch = 1;
+  uint64_t interval_ns = 0;  // latency mode when non-zero
+};
+
+// Outcome of one run, in a shared mapping so that the forked reader (and
+// the process a real-time run is made in) can fill it in.
+struct BenchResult {
+  double rate;
+  LatencyHistogram latency;
+};
+
+uint64_t jitter_ns(const LatencyHistogram& latency) {
+  return latency.percentile(99.9) - latency.percentile(50);
+}
+
+// The highest n CPUs this process may run on, highest first.
+std::vector<int> last_allowed_cpus(size_t n) {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = CPU_SETSIZE - 1; cpu >= 0 && cpus.size() < n; --cpu) {
+      if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// Reads until end of stream; exits non-zero on a gap or a short count.
+template <typename Backend>
+void run_reader(Channel<BenchRecord, Backend>& channel,
+                const BenchConfig& config, BenchResult& result) {
+  std::vector<BenchRecord> records(config.batch);
+  uint64_t expected = 0;
+  while (true) {
+    ssize_t n = channel.recv_n(records.data(), records.size());
+    if (n == 0) break;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      _exit(2);
+    }
+    uint64_t now = config.interval_ns ? wire_timestamp_ns() : 0;
+    for (ssize_t i = 0; i < n; ++i) {
+      if (records[i].sequence != expected++) _exit(3);
+      if (now) result.latency.record(now - records[i].timestamp);
+    }
+  }
+  _exit(expected == config.count ? 0 : 4);
+}
+
+// Sends a record every interval, on an absolute schedule so a late wakeup
+// does not push back the ones after it.
+template <typename Backend>
+bool run_paced_writer(Channel<BenchRecord, Backend>& writer,
+                      const BenchConfig& config) {
+  BenchRecord record;
+  memset(&record, 0, sizeof(record));
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (uint64_t sent = 0; sent < config.count; ++sent) {
+    next.tv_nsec += static_cast<long>(config.interval_ns % 1000000000ULL);
+    next.tv_sec += static_cast<time_t>(config.interval_ns / 1000000000ULL);
+    if (next.tv_nsec >= 1000000000L) {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) ==
+           EINTR) {
+    }
+    record.sequence = sent;
+    record.timestamp = wire_timestamp_ns();
+    if (writer.send_n(&record, 1) != 1) return false;
+  }
+  return true;
+}
+
+// Writer on the first CPU of the profile, reader on the second if there
+// is one; SCHED_DEADLINE runs are left to the scheduler.
+void rt_pin_side(const RtProfile* rt, size_t side) {
+  if (!rt || rt->policy == SCHED_DEADLINE || rt->cpus.empty()) return;
+  rt_pin(rt->cpus[side < rt->cpus.size() ? side : 0]);
+}
+
+// Fills result.rate with the records per second, or a negative value on
+// failure. rt is the profile already applied to this process, if any.
+template <typename Backend>
+void run_backend(const char* name, const BenchConfig& config,
+                 BenchResult& result, const RtProfile* rt) {
+  result.rate = -1;
+  result.latency.reset();
+  Channel<BenchRecord, Backend> writer;
+  if (!writer.create(name, ChannelRole::WRITER)) {
+    std::cerr << "Failed to create " << name << ": " << strerror(errno)
+              << std::endl;
+    return;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    rt_pin_side(rt, 1);
+    if constexpr (std::is_same<Backend, PipeBackend>::value) {
+      writer.backend().keep(ChannelRole::READER);
+      writer.assume_role(ChannelRole::READER);
+      run_reader(writer, config, result);
+    } else {
+      Channel<BenchRecord, Backend> reader;
+      if (!reader.open(name, ChannelRole::READER)) _exit(1);
+      run_reader(reader, config, result);
+    }
+  }
+  if (pid < 0) {
+    std::cerr << "Failed to fork reader: " << strerror(errno) << std::endl;
+    return;
+  }
+  rt_pin_side(rt, 0);
+  if constexpr (std::is_same<Backend, PipeBackend>::value) {
+    writer.backend().keep(ChannelRole::WRITER);
+  }
+
+  uint64_t start = wire_timestamp_ns();
+  bool ok = true;
+  if (config.interval_ns) {
+    ok = run_paced_writer(writer, config);
+  } else {
+    std::vector<BenchRecord> records(config.batch);
+    memset(records.data(), 0, records.size() * sizeof(BenchRecord));
+    for (uint64_t sent = 0; sent < config.count && ok;) {
+      size_t n = config.count - sent < config.batch ? config.count - sent
+                                                    : config.batch;
+      for (size_t i = 0; i < n; ++i) {
+        records[i].sequence = sent + i;
+        records[i].timestamp = wire_timestamp_ns();
+      }
+      ssize_t written = writer.send_n(records.data(), n);
+      if (written <= 0) ok = false;
+      sent += written > 0 ? static_cast<uint64_t>(written) : 0;
+    }
+  }
+  writer.close();
+
+  int status;
+  waitpid(pid, &status, 0);
+  double seconds = (wire_timestamp_ns() - start) / 1e9;
+  Channel<BenchRecord, Backend>::unlink(name);
+  if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return;
+  result.rate = config.count / seconds;
+}
+
+// Runs the backend in a child that applies the real-time profile first,
+// so the parent and the runs after this one are unaffected.
+template <typename Backend>
+void run_backend_rt(const char* name, const BenchConfig& config,
+                    BenchResult& result, const RtProfile& profile) {
+  result.rate = -1;
+  std::cout << std::flush;
+  pid_t pid = fork();
+  if (pid == 0) {
+    rt_apply(profile, "channel_bench");
+    run_backend<Backend>(name, config, result, &profile);
+    std::cout << std::flush;
+    _exit(0);
+  }
+  if (pid < 0) {
+    std::cerr << "Failed to fork: " << strerror(errno) << std::endl;
+    return;
+  }
+  int status;
+  waitpid(pid, &status, 0);
+}
+
+void print_row(const char* label, const BenchResult& result,
+               const BenchConfig& config) {
+  std::cout << std::setw(8) << label;
+  if (result.rate < 0) {
+    std::cout << "  FAILED" << std::endl;
+    return;
+  }
+  std::cout << std::fixed << std::setprecision(1);
+  if (!config.interval_ns) {
+    std::cout << std::setw(14) << static_cast<uint64_t>(result.rate)
+              << std::setw(12) << result.rate * sizeof(BenchRecord) / 1e6
+              << std::endl;
+    return;
+  }
+  const LatencyHistogram& h = result.latency;
+  std::cout << std::setw(10) << h.percentile(50) / 1e3 << std::setw(10)
+            << h.percentile(99) / 1e3 << std::setw(10)
+            << h.percentile(99.9) / 1e3 << std::setw(10) << h.max() / 1e3
+            << std::setw(10) << jitter_ns(h) / 1e3 << std::endl;
+}
+
+template <typename Backend>
+void report(const char* label, const char* name, const BenchConfig& config,
+            const RtProfile* rt, BenchResult& result, int& status) {
+  run_backend<Backend>(name, config, result, nullptr);
+  print_row(label, result, config);
+  if (result.rate < 0) status = 1;
+  if (!rt) return;
+
+  BenchResult baseline = result;
+  run_backend_rt<Backend>(name, config, result, *rt);
+  std::string rt_label = std::string(label) + " rt";
+  print_row(rt_label.c_str(), result, config);
+  if (result.rate < 0) {
+    status = 1;
+    return;
+  }
+  if (config.interval_ns && jitter_ns(baseline.latency) > 0) {
+    double before = static_cast<double>(jitter_ns(baseline.latency));
+    double after = static_cast<double>(jitter_ns(result.latency));
+    std::cout << std::setw(8) << "" << "  jitter " << std::showpos
+              << std::setprecision(1) << (after - before) / before * 100
+              << std::noshowpos << "% under the real-time profile"
+              << std::endl;
+  }
+}
+
+void print_usage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " [-n records] [-b batch] [-t shm|mq|uds|fifo|pipe]"
+               " [-l interval_us] [-R]"
+            << std::endl;
+  std::cerr << "  -l sends one record per interval and reports latency"
+               " percentiles"
+            << std::endl;
+  std::cerr << "  -R repeats each run under the real-time profile (IPC_RT_*"
+               " settings, or SCHED_FIFO 50 with locked memory)"
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  BenchConfig config;
+  bool count_set = false;
+  bool compare_rt = false;
+  std::string only;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:b:t:l:R")) != -1) {
+    switch (opt) {
+      case 'n':
+        config.count = std::strtoull(optarg, nullptr, 0);
+        count_set = true;
+        break;
+      case 'b':
+        config.batch = std::strtoul(optarg, nullptr, 0);
+        break;
+      case 't':
+        only = optarg;
+        break;
+      case 'l':
+        config.interval_ns = std::strtoull(optarg, nullptr, 0) * 1000;
+        if (config.interval_ns == 0) {
+          std::cerr << "Interval must be positive" << std::endl;
+          return 1;
+        }
+        break;
+      case 'R':
+        compare_rt = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (config.interval_ns && !count_set) config.count = LATENCY_RECORDS;
+  if (config.count == 0 || config.batch == 0) {
+    std::cerr << "Record count and batch size must be positive" << std::endl;
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  RtProfile profile;
+  if (compare_rt) {
+    rt_profile_from_env(profile);
+    if (profile.cpus.empty()) profile.cpus = last_allowed_cpus(2);
+  }
+
+  void* shared = mmap(nullptr, sizeof(BenchResult), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    std::cerr << "Failed to map results: " << strerror(errno) << std::endl;
+    return 1;
+  }
+  BenchResult& result = *new (shared) BenchResult();
+
+  std::cout << config.count << " records of " << sizeof(BenchRecord);
+  if (config.interval_ns) {
+    std::cout << " bytes, one every " << config.interval_ns / 1000 << " us"
+              << std::endl;
+    std::cout << std::setw(8) << "chan" << std::setw(10) << "p50"
+              << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+              << std::setw(10) << "max" << std::setw(10) << "jitter"
+              << "  (us; jitter = p99.9 - p50)" << std::endl;
+  } else {
+    std::cout << " bytes, send_n/recv_n batches of " << config.batch
+              << std::endl;
+    std::cout << std::setw(8) << "chan" << std::setw(14) << "records/s"
+              << std::setw(12) << "MB/s" << std::endl;
+  }
+
+  int status = 0;
+  const RtProfile* rt = compare_rt ? &profile : nullptr;
+  auto wanted = [&](const char* label) {
+    return only.empty() || only == label;
+  };
+  if (wanted("shm")) {
+    report<ShmRingBackend>("shm", "/channel_bench", config, rt, result,
+                           status);
+  }
+  if (wanted("mq")) {
+    report<MqBackend>("mq", "/channel_bench", config, rt, result, status);
+  }
+  if (wanted("uds")) {
+    report<UdsBackend>("uds", "/tmp/channel_bench.sock", config, rt, result,
+                       status);
+  }
+  if (wanted("fifo")) {
+    report<FifoBackend>("fifo", "/tmp/channel_bench.fifo", config, rt,
+                        result, status);
+  }
+  if (wanted("pipe")) {
+    report<PipeBackend>("pipe", nullptr, config, rt, result, status);
+  }
+  munmap(shared, sizeof(BenchResult));
+  return status;
+}
@@ -0,0 +1,256 @@
+#include <fcntl.h>
+#include <mqueue.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "automotive_message.h"
+#include "channel.h"
+#include "io_runtime.h"
+#include "latency_histogram.h"
+#include "message_codec.h"
+#include "queue_metrics.h"
+#include "rt_profile.h"
+#include "wire_types.h"
+
+// One process and one thread consuming every demo producer at once: the
+// sensor shm ring, the vehicle socket, the diagnostic FIFO and the message
+// queue. Each source is a coroutine on an IoLoop that waits for its
+// producer and reconnects when it restarts. It takes the place of the
+// matching consumers (shm_consumer, socket_client, named_pipe_reader,
+// mq_receiver), since each of those channels has a single reader.
+
+constexpr const char* SHM_NAME = "/automotive_shm";
+constexpr const char* SOCKET_PATH = "/tmp/automotive_ipc_socket";
+constexpr const char* FIFO_PATH = "/tmp/automotive_fifo";
+constexpr int RECONNECT_MS = 1000;
+constexpr size_t RECEIVE_BATCH = 16;
+
+std::atomic<bool> running{true};
+bool quiet = false;
+
+void signal_handler(int signal) {
+  if (signal == SIGINT || signal == SIGTERM) {
+    running = false;
+  }
+}
+
+struct Source {
+  explicit Source(const char* source_name)
+      : name(source_name), latency(source_name) {}
+
+  const char* name;
+  uint64_t received = 0;
+  LatencyReport latency;
+};
+
+void received(Source& source, uint64_t timestamp, ChannelMetrics* metrics) {
+  source.received++;
+  uint64_t latency = source.latency.record_since(timestamp);
+  if (metrics) metrics->latency_ns(latency);
+  if (source.latency.due()) source.latency.print_period(std::cout);
+}
+
+void print_record(std::ostream& os, const SensorData& data) {
+  os << "SEQ " << data.sequence_number << " | Temp " << std::fixed
+     << std::setprecision(2) << data.temperature << " | Pressure "
+     << data.pressure;
+}
+
+void print_record(std::ostream& os, const VehicleData& data) {
+  os << "Speed " << std::fixed << std::setprecision(1) << data.speed
+     << " km/h | Gear " << data.gear;
+}
+
+void print_record(std::ostream& os, const DiagnosticEvent& event) {
+  os << "DTC 0x" << std::hex << event.dtc_code << std::dec << " | "
+     << event.module_name << " | " << event.description;
+}
+
+// Consumes one Channel source; recv_n batches amortize the wakeups.
+template <typename T, typename Backend>
+IoTask consume(IoLoop& loop, Source& source, const char* name) {
+  bool waiting_reported = false;
+  while (running) {
+    Channel<T, Backend> channel;
+    if (!channel.open(name, ChannelRole::READER)) {
+      if (!waiting_reported) {
+        std::cout << "[" << source.name << "] waiting for " << name
+                  << std::endl;
+        waiting_reported = true;
+      }
+      co_await loop.sleep_for(RECONNECT_MS);
+      continue;
+    }
+    std::cout << "[" << source.name << "] attached to " << name << " via "
+              << Backend::TRANSPORT << std::endl;
+    waiting_reported = false;
+
+    T records[RECEIVE_BATCH];
+    while (running) {
+      ssize_t n = co_await loop.receive(channel, records, RECEIVE_BATCH);
+      if (n == 0) {
+        std::cout << "[" << source.name << "] producer stopped" << std::endl;
+        break;
+      }
+      if (n < 0) {
+        if (errno == EPROTO) {
+          std::cerr << "[" << source.name << "] producer sends a different "
+                    << "record layout (expected version " << T::WIRE_VERSION
+                    << ")" << std::endl;
+        } else {
+          std::cerr << "[" << source.name << "] receive error: "
+                    << strerror(errno) << std::endl;
+        }
+        break;
+      }
+      for (ssize_t i = 0; i < n; ++i) {
+        received(source, records[i].timestamp, &channel.metrics());
+        if (!quiet) {
+          std::cout << "[" << source.name << "] ";
+          print_record(std::cout, records[i]);
+          std::cout << std::endl;
+        }
+      }
+    }
+    // A stale shm ring reads end of stream at once; give the producer
+    // time to replace it.
+    channel.close();
+    co_await loop.sleep_for(RECONNECT_MS);
+  }
+}
+
+// The message queue carries mq_sender's own encoding rather than a
+// Channel, so it is read through its descriptor; records are acked to the
+// sender's pacer as mq_receiver does.
+IoTask consume_queue(IoLoop& loop, Source& source) {
+  bool waiting_reported = false;
+  while (running) {
+    mqd_t mq = mq_open(MQ_NAME, O_RDONLY | O_NONBLOCK);
+    if (mq == (mqd_t)-1) {
+      if (!waiting_reported) {
+        std::cout << "[" << source.name << "] waiting for " << MQ_NAME
+                  << std::endl;
+        waiting_reported = true;
+      }
+      co_await loop.sleep_for(RECONNECT_MS);
+      continue;
+    }
+    std::cout << "[" << source.name << "] attached to " << MQ_NAME
+              << " via mq" << std::endl;
+    waiting_reported = false;
+    QueueMetricsMap metrics;
+    metrics.open(MQ_NAME);
+    ChannelMetrics stats;
+    stats.attach(MQ_NAME, ChannelRole::READER, "mq");
+
+    alignas(Message) char buffer[MAX_MSG_SIZE];
+    while (running) {
+      // Idle queues are rechecked now and then, since a restarted sender
+      // recreates the queue under the same name.
+      if (!co_await loop.readable(static_cast<int>(mq), RECONNECT_MS * 5)) {
+        struct stat st;
+        if (fstat(static_cast<int>(mq), &st) == 0 && st.st_nlink == 0) break;
+        continue;
+      }
+      ssize_t bytes;
+      while ((bytes = mq_receive(mq, buffer, sizeof(buffer), nullptr)) >= 0) {
+        int count = for_each_message(
+            buffer, static_cast<size_t>(bytes), [&](const Message& msg) {
+              received(source, msg.timestamp, &stats);
+              if (!quiet) {
+                std::cout << "[" << source.name << "] SEQ " << msg.sequence
+                          << " | " << message_type_to_string(msg.type)
+                          << " | ";
+                print_payload(std::cout, msg);
+                std::cout << std::endl;
+              }
+            });
+        if (metrics.get()) {
+          metrics.get()->acked.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (count < 0) {
+          stats.drop();
+        } else {
+          stats.record(static_cast<uint64_t>(count),
+                       static_cast<uint64_t>(bytes));
+        }
+      }
+      if (errno != EAGAIN) {
+        std::cerr << "[" << source.name << "] receive error: "
+                  << strerror(errno) << std::endl;
+        break;
+      }
+    }
+    mq_close(mq);
+  }
+}
+
+// Ends the run once a signal clears the running flag.
+IoTask watch_signals(IoLoop& loop) {
+  while (running) co_await loop.sleep_for(100);
+  loop.stop();
+}
+
+int main(int argc, char* argv[]) {
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+  rt_setup("channel_hub");
+
+  int opt;
+  while ((opt = getopt(argc, argv, "q")) != -1) {
+    if (opt == 'q') {
+      quiet = true;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-q]" << std::endl;
+      std::cerr << "  -q prints only connection changes and latency"
+                   " summaries"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  IoLoop loop;
+  if (!loop.ok()) {
+    std::cerr << "Failed to set up the event loop: " << strerror(errno)
+              << std::endl;
+    return 1;
+  }
+
+  Source sensors("sensors");
+  Source vehicle("vehicle");
+  Source diagnostics("diagnostics");
+  Source messages("messages");
+  loop.spawn(consume<SensorData, ShmRingBackend>(loop, sensors, SHM_NAME));
+  loop.spawn(consume<VehicleData, UdsBackend>(loop, vehicle, SOCKET_PATH));
+  loop.spawn(
+      consume<DiagnosticEvent, FifoBackend>(loop, diagnostics, FIFO_PATH));
+  loop.spawn(consume_queue(loop, messages));
+  loop.spawn(watch_signals(loop));
+
+  std::cout << "Channel hub consuming all demo producers on one thread"
+               " (Press Ctrl+C to stop)"
+            << std::endl;
+  std::cout << std::string(80, '-') << std::endl;
+  while (!loop.run()) {
+    if (errno != EINTR) {
+      std::cerr << "Event loop failed: " << strerror(errno) << std::endl;
+      break;
+    }
+    if (!running) break;
+  }
+
+  std::cout << "\nChannel hub stopped" << std::endl;
+  for (Source* source : {&sensors, &vehicle, &diagnostics, &messages}) {
+    std::cout << "  " << source->name << ": " << source->received
+              << " records" << std::endl;
+    source->latency.print_total(std::cout);
+  }
+  return 0;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <fcntl.h>
+#include <mqueue.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "channel_backend.h"
+
+// Default per-message size limit (/proc/sys/fs/mqueue/msgsize_max) and
+// queue depth limit for unprivileged processes.
+constexpr size_t MQ_CHANNEL_MESSAGE_BYTES = 8192;
+constexpr long MQ_CHANNEL_DEPTH = 10;
+
+// POSIX message queue backend. send_n packs as many records as fit into
+// one queue message behind the writer's WireLayout; the reader checks the
+// layout of every message and hands the records out from its buffer. A
+// writer that closes sends an empty message to mark the end of the stream.
+class MqBackend {
+ public:
+  static constexpr const char* TRANSPORT = "mq";
+
+  MqBackend() = default;
+  MqBackend(const MqBackend&) = delete;
+  MqBackend& operator=(const MqBackend&) = delete;
+  ~MqBackend() { close(); }
+
+  bool create(const char* name, ChannelRole role, const WireLayout& layout) {
+    if (layout.size > MQ_CHANNEL_MESSAGE_BYTES - sizeof(WireLayout)) {
+      errno = EMSGSIZE;
+      return false;
+    }
+    mq_unlink(name);
+    struct mq_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.mq_maxmsg = MQ_CHANNEL_DEPTH;
+    attr.mq_msgsize = static_cast<long>(
+        sizeof(WireLayout) +
+        (MQ_CHANNEL_MESSAGE_BYTES - sizeof(WireLayout)) / layout.size *
+            layout.size);
+    mq_ = mq_open(name, O_CREAT | O_RDWR, 0666, &attr);
+    return attach(role, layout);
+  }
+
+  // Fails with EINVAL when the queue was made for records of another size.
+  bool open(const char* name, ChannelRole role, const WireLayout& layout) {
+    mq_ = mq_open(name, role == ChannelRole::WRITER ? O_WRONLY : O_RDONLY);
+    return attach(role, layout);
+  }
+
+  bool wait_peer(int) { return mq_ != (mqd_t)-1; }
+
+  ssize_t write_records(const void* data, size_t size, size_t count) {
+    const char* in = static_cast<const char*>(data);
+    size_t done = 0;
+    while (done < count) {
+      size_t batch = count - done < per_message_ ? count - done : per_message_;
+      memcpy(buffer_.data(), &layout_, sizeof(layout_));
+      memcpy(buffer_.data() + sizeof(WireLayout), in + done * size,
+             batch * size);
+      if (mq_send(mq_, buffer_.data(), sizeof(WireLayout) + batch * size,
+                  0) < 0) {
+        return done > 0 ? static_cast<ssize_t>(done) : -1;
+      }
+      done += batch;
+      sent_ += batch;
+    }
+    wrote_ = true;
+    return static_cast<ssize_t>(count);
+  }
+
+  // Fails with EPROTO on a message from a writer of another layout.
+  ssize_t read_records(void* data, size_t size, size_t max, int timeout_ms) {
+    if (pending_ == consumed_) {
+      ssize_t bytes = receive(timeout_ms);
+      if (bytes <= 0) return bytes;
+      size_t length = static_cast<size_t>(bytes);
+      if (length < sizeof(WireLayout) ||
+          (length - sizeof(WireLayout)) % size != 0) {
+        errno = EBADMSG;
+        return -1;
+      }
+      WireLayout sender;
+      memcpy(&sender, buffer_.data(), sizeof(sender));
+      if (sender != layout_) {
+        errno = EPROTO;
+        return -1;
+      }
+      pending_ = (length - sizeof(WireLayout)) / size;
+      consumed_ = 0;
+    }
+    size_t count = pending_ - consumed_ < max ? pending_ - consumed_ : max;
+    memcpy(data, buffer_.data() + sizeof(WireLayout) + consumed_ * size,
+           count * size);
+    consumed_ += count;
+    received_ += count;
+    return static_cast<ssize_t>(count);
+  }
+
+  uint64_t position(ChannelRole role) const {
+    return role == ChannelRole::WRITER ? sent_ : received_;
+  }
+
+  size_t queued() const { return pending_ - consumed_; }
+
+  // Linux message queue descriptors can be polled.
+  int poll_fd() const { return static_cast<int>(mq_); }
+
+  void close() {
+    if (mq_ == (mqd_t)-1) return;
+    if (role_ == ChannelRole::WRITER && wrote_) {
+      // Bounded, so a full queue nobody reads cannot hang the writer.
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += 1;
+      mq_timedsend(mq_, "", 0, 0, &deadline);
+    }
+    mq_close(mq_);
+    mq_ = (mqd_t)-1;
+    wrote_ = false;
+  }
+
+  static void unlink(const char* name) { mq_unlink(name); }
+
+ private:
+  bool attach(ChannelRole role, const WireLayout& layout) {
+    if (mq_ == (mqd_t)-1) return false;
+    struct mq_attr attr;
+    size_t record_bytes = 0;
+    if (mq_getattr(mq_, &attr) == 0 &&
+        static_cast<size_t>(attr.mq_msgsize) > sizeof(WireLayout)) {
+      record_bytes = attr.mq_msgsize - sizeof(WireLayout);
+    }
+    if (record_bytes < layout.size || record_bytes % layout.size != 0) {
+      mq_close(mq_);
+      mq_ = (mqd_t)-1;
+      errno = EINVAL;
+      return false;
+    }
+    role_ = role;
+    layout_ = layout;
+    per_message_ = record_bytes / layout.size;
+    buffer_.resize(attr.mq_msgsize);
+    pending_ = consumed_ = 0;
+    return true;
+  }
+
+  ssize_t receive(int timeout_ms) {
+    if (timeout_ms < 0) {
+      return mq_receive(mq_, buffer_.data(), buffer_.size(), nullptr);
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    ssize_t bytes =
+        mq_timedreceive(mq_, buffer_.data(), buffer_.size(), nullptr,
+                        &deadline);
+    if (bytes < 0 && errno == ETIMEDOUT) errno = EAGAIN;
+    return bytes;
+  }
+
+  mqd_t mq_ = (mqd_t)-1;
+  ChannelRole role_ = ChannelRole::READER;
+  WireLayout layout_ = {0, 0, 1};
+  size_t per_message_ = 1;
+  std::vector<char> buffer_;
+  size_t pending_ = 0;
+  size_t consumed_ = 0;
+  uint64_t sent_ = 0;
+  uint64_t received_ = 0;
+  bool wrote_ = false;
+};
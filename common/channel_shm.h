@@ -0,0 +1,370 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#include "channel_backend.h"
+#include "ipc_trace.h"
+#include "rt_profile.h"
+#include "shm_map.h"
+
+constexpr uint32_t SHM_RING_MAGIC = 0x52494E48U;
+constexpr uint32_t SHM_RING_CAPACITY = 256;
+constexpr int SHM_RING_HEARTBEAT_MS = 100;
+constexpr uint64_t SHM_RING_WRITER_TIMEOUT_MS = 5 * SHM_RING_HEARTBEAT_MS;
+
+// Header of a single-producer single-consumer ring of fixed-size records
+// in shared memory; the records follow it. head and tail count records
+// ever written and read. Each side bumps a signal word after moving its
+// index and only makes the wake call when the other side said it is
+// parked there.
+//
+// The ring outlives its writer: a restarted writer opens it again and
+// carries on from head, bumping generation, so readers stay attached.
+// A writer that may restart stamps heartbeat_ms at least every
+// SHM_RING_HEARTBEAT_MS, which tells readers whether it is still there;
+// one silent for SHM_RING_WRITER_TIMEOUT_MS is taken to be gone.
+struct alignas(64) ShmRingHeader {
+  uint32_t magic;
+  uint32_t capacity;
+  WireLayout layout;
+  alignas(64) std::atomic<uint64_t> head;
+  std::atomic<uint32_t> head_signal;
+  std::atomic<uint32_t> reader_waiting;
+  alignas(64) std::atomic<uint64_t> tail;
+  std::atomic<uint32_t> tail_signal;
+  std::atomic<uint32_t> writer_waiting;
+  alignas(64) std::atomic<uint32_t> writer_closed;
+  std::atomic<uint32_t> generation;
+  std::atomic<int32_t> writer_pid;
+  std::atomic<uint64_t> heartbeat_ms;
+};
+
+class ShmRingBackend {
+ public:
+  static constexpr const char* TRANSPORT = "shm";
+
+  ShmRingBackend() = default;
+  ShmRingBackend(const ShmRingBackend&) = delete;
+  ShmRingBackend& operator=(const ShmRingBackend&) = delete;
+  ~ShmRingBackend() { close(); }
+
+  bool create(const char* name, ChannelRole role, const WireLayout& layout) {
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0) return false;
+    size_t size = sizeof(ShmRingHeader) + SHM_RING_CAPACITY * layout.size;
+    if (ftruncate(fd, size) < 0 || !map(fd, size)) {
+      ::close(fd);
+      shm_unlink(name);
+      return false;
+    }
+    ::close(fd);
+    rt_shared_region(ring_, size_, true);
+
+    ring_ = new (ring_) ShmRingHeader();
+    ring_->layout = layout;
+    ring_->capacity = SHM_RING_CAPACITY;
+    if (role == ChannelRole::WRITER) {
+      ring_->generation.store(1, std::memory_order_relaxed);
+      ring_->writer_pid.store(getpid(), std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    ring_->magic = SHM_RING_MAGIC;
+    attached(name, role);
+    return true;
+  }
+
+  // Fails with EPROTO when the ring holds records of another layout. A
+  // writer takes over the ring where the previous one stopped, or fails
+  // with EBUSY while that one is still running: its PID exists and, if it
+  // beats, its heartbeat is fresh, so a recycled PID does not count. Of
+  // writers taking over at once, one wins and the rest fail with EBUSY.
+  bool open(const char* name, ChannelRole role, const WireLayout& layout) {
+    void* base;
+    if (!shm_map_existing(name, sizeof(ShmRingHeader), true, &base, &size_)) {
+      return false;
+    }
+    ring_ = static_cast<ShmRingHeader*>(base);
+    rt_shared_region(ring_, size_, false);
+
+    if (ring_->magic != SHM_RING_MAGIC ||
+        size_ < sizeof(ShmRingHeader) + ring_->capacity * ring_->layout.size) {
+      close();
+      errno = EINVAL;
+      return false;
+    }
+    if (ring_->layout != layout) {
+      close();
+      errno = EPROTO;
+      return false;
+    }
+    if (role == ChannelRole::WRITER) {
+      pid_t writer = ring_->writer_pid.load();
+      if (writer > 0 && writer != getpid() && !ring_->writer_closed.load() &&
+          heartbeat_age_ms() <= SHM_RING_WRITER_TIMEOUT_MS &&
+          (kill(writer, 0) == 0 || errno == EPERM)) {
+        close();
+        errno = EBUSY;
+        return false;
+      }
+      // The heartbeat is cleared before the claim, so a writer racing
+      // this one sees the ring busy rather than a stale beat, and the new
+      // writer is judged by its own beats only.
+      ring_->heartbeat_ms.store(0);
+      if (!ring_->writer_pid.compare_exchange_strong(writer, getpid())) {
+        close();
+        errno = EBUSY;
+        return false;
+      }
+      ring_->generation.fetch_add(1);
+      ring_->writer_closed.store(0, std::memory_order_release);
+    }
+    attached(name, role);
+    return true;
+  }
+
+  bool wait_peer(int) { return ring_ != nullptr; }
+
+  ssize_t write_records(const void* data, size_t size, size_t count) {
+    const char* in = static_cast<const char*>(data);
+    size_t done = 0;
+    while (done < count) {
+      uint64_t head = ring_->head.load(std::memory_order_relaxed);
+      uint64_t free = ring_->capacity -
+                      (head - ring_->tail.load(std::memory_order_acquire));
+      if (free == 0) {
+        if (!wait(ring_->tail_signal, ring_->writer_waiting,
+                  [&] { return space_available(head); }, -1)) {
+          return done > 0 ? static_cast<ssize_t>(done) : -1;
+        }
+        continue;
+      }
+      size_t batch = count - done < free ? count - done : free;
+      copy_in(head, in + done * size, batch);
+      ring_->head.store(head + batch, std::memory_order_release);
+      done += batch;
+      signal(ring_->head_signal, ring_->reader_waiting);
+    }
+    return static_cast<ssize_t>(count);
+  }
+
+  ssize_t read_records(void* data, size_t, size_t max, int timeout_ms) {
+    ChannelDeadline deadline(timeout_ms);
+    while (true) {
+      uint64_t tail = ring_->tail.load(std::memory_order_relaxed);
+      uint64_t available = ring_->head.load(std::memory_order_acquire) - tail;
+      if (available > 0) {
+        size_t batch = available < max ? available : max;
+        copy_out(tail, static_cast<char*>(data), batch);
+        ring_->tail.store(tail + batch, std::memory_order_release);
+        signal(ring_->tail_signal, ring_->writer_waiting);
+        return static_cast<ssize_t>(batch);
+      }
+      if (ring_->writer_closed.load(std::memory_order_acquire)) return 0;
+      if (!wait(ring_->head_signal, ring_->reader_waiting,
+                [&] {
+                  return ring_->head.load() != tail ||
+                         ring_->writer_closed.load() != 0;
+                },
+                deadline.remaining_ms())) {
+        return -1;
+      }
+    }
+  }
+
+  uint64_t position(ChannelRole role) const {
+    return (role == ChannelRole::WRITER ? ring_->head : ring_->tail)
+        .load(std::memory_order_relaxed);
+  }
+
+  size_t queued() const {
+    return ring_->head.load(std::memory_order_relaxed) -
+           ring_->tail.load(std::memory_order_relaxed);
+  }
+
+  // The ring has no descriptor; an event loop parks a reader on its
+  // signal word instead (io_runtime.h). park_reader() asks the writer to
+  // wake that word and returns the value to wait on; check readable()
+  // after it, and call unpark_reader() once woken.
+  int poll_fd() const { return -1; }
+
+  uint32_t park_reader() {
+    ring_->reader_waiting.store(1);
+    return ring_->head_signal.load();
+  }
+
+  void unpark_reader() { ring_->reader_waiting.store(0); }
+
+  std::atomic<uint32_t>& reader_signal() { return ring_->head_signal; }
+
+  bool readable() const {
+    return ring_->head.load() != ring_->tail.load(std::memory_order_relaxed) ||
+           ring_->writer_closed.load() != 0;
+  }
+
+  // Newest record written, for a writer that resumes where the one
+  // before it stopped. False if the ring was never written to.
+  bool last_record(void* out) const {
+    uint64_t head = ring_->head.load(std::memory_order_acquire);
+    if (head == 0) return false;
+    size_t size = ring_->layout.size;
+    const char* base = reinterpret_cast<const char*>(ring_ + 1);
+    memcpy(out, base + (head - 1) % ring_->capacity * size, size);
+    return true;
+  }
+
+  uint32_t generation() const {
+    return ring_->generation.load(std::memory_order_acquire);
+  }
+
+  // A superseded writer no longer beats, so it cannot keep its successor
+  // looking alive.
+  void heartbeat() {
+    if (superseded()) return;
+    ring_->heartbeat_ms.store(channel_now_ms(), std::memory_order_relaxed);
+  }
+
+  // Milliseconds since the writer's last heartbeat; 0 if it never sent
+  // one, as writers that do not restart need not.
+  uint64_t heartbeat_age_ms() const {
+    uint64_t beat = ring_->heartbeat_ms.load(std::memory_order_relaxed);
+    uint64_t now = channel_now_ms();
+    return beat == 0 || beat > now ? 0 : now - beat;
+  }
+
+  // True once another writer has taken the ring over from this one,
+  // which happens if this one stopped beating for too long.
+  bool superseded() const {
+    return ring_->writer_pid.load(std::memory_order_acquire) != getpid();
+  }
+
+  // Leaves the ring to a restarted writer: unlike close(), readers keep
+  // waiting for more records instead of reading end of stream.
+  void detach() {
+    if (!ring_) return;
+    if (role_ == ChannelRole::WRITER) {
+      pid_t self = getpid();
+      ring_->writer_pid.compare_exchange_strong(self, 0);
+    }
+    munmap(ring_, size_);
+    ring_ = nullptr;
+  }
+
+  // A closing writer marks the stream ended; the reader drains what is
+  // left and then reads 0.
+  void close() {
+    if (!ring_) return;
+    if (role_ == ChannelRole::WRITER) {
+      ring_->writer_closed.store(1, std::memory_order_release);
+      signal(ring_->head_signal, ring_->reader_waiting);
+    }
+    munmap(ring_, size_);
+    ring_ = nullptr;
+  }
+
+  static void unlink(const char* name) { shm_unlink(name); }
+
+ private:
+  void attached(const char* name, ChannelRole role) {
+    role_ = role;
+    if (IPC_TRACING()) {
+      trace_channel_ = ipc_trace_channel(name, TRANSPORT, role);
+    }
+  }
+
+  bool map(int fd, size_t size) {
+    void* base =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return false;
+    ring_ = static_cast<ShmRingHeader*>(base);
+    size_ = size;
+    return true;
+  }
+
+  char* records() { return reinterpret_cast<char*>(ring_ + 1); }
+
+  bool space_available(uint64_t head) {
+    return head - ring_->tail.load() < ring_->capacity;
+  }
+
+  // Copies count records starting at ring position first, in at most two
+  // pieces when they wrap around the end.
+  void copy_in(uint64_t first, const char* in, size_t count) {
+    size_t size = ring_->layout.size;
+    size_t index = first % ring_->capacity;
+    size_t before_wrap = ring_->capacity - index;
+    size_t head_part = count < before_wrap ? count : before_wrap;
+    memcpy(records() + index * size, in, head_part * size);
+    memcpy(records(), in + head_part * size, (count - head_part) * size);
+  }
+
+  void copy_out(uint64_t first, char* out, size_t count) {
+    size_t size = ring_->layout.size;
+    size_t index = first % ring_->capacity;
+    size_t before_wrap = ring_->capacity - index;
+    size_t head_part = count < before_wrap ? count : before_wrap;
+    memcpy(out, records() + index * size, head_part * size);
+    memcpy(out + head_part * size, records(), (count - head_part) * size);
+  }
+
+  void signal(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiting) {
+    word.fetch_add(1);
+    if (waiting.load()) {
+      uint64_t start = IPC_TRACING() ? ipc_trace_ticks() : 0;
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1,
+              nullptr, nullptr, 0);
+      if (IPC_TRACING()) {
+        ipc_trace_record(TraceKind::WAKE, trace_channel_, position(role_), 0,
+                         start, ipc_trace_ticks());
+      }
+    }
+  }
+
+  // Parks on word until ready() holds. Returns false with errno EAGAIN on
+  // timeout or EINTR when interrupted.
+  template <typename Ready>
+  bool wait(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiting,
+            Ready ready, int timeout_ms) {
+    waiting.store(1);
+    uint32_t seen = word.load();
+    bool result = true;
+    if (!ready()) {
+      uint64_t start = IPC_TRACING() ? ipc_trace_ticks() : 0;
+      struct timespec timeout = {timeout_ms / 1000,
+                                 (timeout_ms % 1000) * 1000000L};
+      if (syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT,
+                  seen, timeout_ms < 0 ? nullptr : &timeout, nullptr,
+                  0) < 0 &&
+          errno != EAGAIN) {
+        if (errno == ETIMEDOUT) errno = EAGAIN;
+        result = false;
+      }
+      if (IPC_TRACING()) {
+        int saved = errno;
+        ipc_trace_record(TraceKind::WAIT, trace_channel_, position(role_), 0,
+                         start, ipc_trace_ticks());
+        errno = saved;
+      }
+    }
+    waiting.store(0);
+    return result;
+  }
+
+  ShmRingHeader* ring_ = nullptr;
+  size_t size_ = 0;
+  ChannelRole role_ = ChannelRole::READER;
+  uint16_t trace_channel_ = IPC_TRACE_NO_CHANNEL;
+};
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "channel_backend.h"
+
+// Record framing over a byte stream (socket or pipe). Each connection
+// starts with the writer's WireLayout, which the reader checks before the
+// first record. Reads go straight into the caller's buffer; the bytes of
+// a record that has only partly arrived are kept until the rest comes in.
+class StreamRecords {
+ public:
+  void set_layout(const WireLayout& layout) {
+    layout_ = layout;
+    reset();
+  }
+
+  // Writes all bytes of every record. A signal only stops the write
+  // between records, so the stream never carries half a record.
+  ssize_t write(int fd, bool socket, const void* data, size_t size,
+                size_t count) {
+    if (!layout_sent_) {
+      const char* header = reinterpret_cast<const char*>(&layout_);
+      while (header_sent_ < sizeof(layout_)) {
+        ssize_t n = send_some(fd, socket, header + header_sent_,
+                              sizeof(layout_) - header_sent_);
+        if (n < 0) {
+          if (errno == EINTR && header_sent_ > 0) continue;
+          return -1;
+        }
+        header_sent_ += static_cast<size_t>(n);
+      }
+      layout_sent_ = true;
+    }
+
+    const char* in = static_cast<const char*>(data);
+    size_t total = size * count;
+    size_t done = 0;
+    while (done < total) {
+      ssize_t n = send_some(fd, socket, in + done, total - done);
+      if (n < 0) {
+        if (errno == EINTR && done % size != 0) continue;
+        written_ += done / size;
+        return done >= size ? static_cast<ssize_t>(done / size) : -1;
+      }
+      done += static_cast<size_t>(n);
+    }
+    written_ += count;
+    return static_cast<ssize_t>(count);
+  }
+
+  // Fails with EPROTO, now and on every later call, when the writer's
+  // layout differs from ours.
+  ssize_t read(int fd, void* data, size_t size, size_t max, int timeout_ms) {
+    ChannelDeadline deadline(timeout_ms);
+    if (!layout_checked_) {
+      ssize_t result = read_layout(fd, timeout_ms, deadline);
+      if (result <= 0) return result;
+    }
+
+    char* out = static_cast<char*>(data);
+    size_t have = partial_.size();
+    memcpy(out, partial_.data(), have);
+    partial_.clear();
+
+    while (have < size) {
+      ssize_t n = -1;
+      if (timeout_ms < 0 || channel_poll(fd, POLLIN, deadline)) {
+        n = ::read(fd, out + have, max * size - have);
+      }
+      if (n == 0) return 0;
+      if (n < 0) {
+        partial_.assign(out, out + have);
+        return -1;
+      }
+      have += static_cast<size_t>(n);
+    }
+    size_t whole = have / size;
+    partial_.assign(out + whole * size, out + have);
+    read_ += whole;
+    return static_cast<ssize_t>(whole);
+  }
+
+  uint64_t position(ChannelRole role) const {
+    return role == ChannelRole::WRITER ? written_ : read_;
+  }
+
+  // Forgets the connection state, for the next peer.
+  void reset() {
+    partial_.clear();
+    written_ = read_ = 0;
+    header_sent_ = 0;
+    header_read_ = 0;
+    layout_sent_ = false;
+    layout_checked_ = false;
+    rejected_ = false;
+  }
+
+ private:
+  static ssize_t send_some(int fd, bool socket, const char* data,
+                           size_t bytes) {
+    return socket ? ::send(fd, data, bytes, MSG_NOSIGNAL)
+                  : ::write(fd, data, bytes);
+  }
+
+  ssize_t read_layout(int fd, int timeout_ms,
+                      const ChannelDeadline& deadline) {
+    if (rejected_) {
+      errno = EPROTO;
+      return -1;
+    }
+    char* header = reinterpret_cast<char*>(&peer_layout_);
+    while (header_read_ < sizeof(peer_layout_)) {
+      ssize_t n = -1;
+      if (timeout_ms < 0 || channel_poll(fd, POLLIN, deadline)) {
+        n = ::read(fd, header + header_read_,
+                   sizeof(peer_layout_) - header_read_);
+      }
+      if (n <= 0) return n;
+      header_read_ += static_cast<size_t>(n);
+    }
+    if (peer_layout_ != layout_) {
+      rejected_ = true;
+      errno = EPROTO;
+      return -1;
+    }
+    layout_checked_ = true;
+    return 1;
+  }
+
+  WireLayout layout_ = {0, 0, 0};
+  WireLayout peer_layout_ = {0, 0, 0};
+  size_t header_sent_ = 0;
+  size_t header_read_ = 0;
+  bool layout_sent_ = false;
+  bool layout_checked_ = false;
+  bool rejected_ = false;
+  uint64_t written_ = 0;
+  uint64_t read_ = 0;
+  std::vector<char> partial_;
+};
+
+// Unix domain stream socket. The creating side listens and serves one
+// peer at a time: sends and receives go to the accepted peer, and after
+// the peer goes away disconnect() lets the next one in.
+class UdsBackend {
+ public:
+  static constexpr const char* TRANSPORT = "uds";
+
+  UdsBackend() = default;
+  UdsBackend(const UdsBackend&) = delete;
+  UdsBackend& operator=(const UdsBackend&) = delete;
+  ~UdsBackend() { close(); }
+
+  bool create(const char* name, ChannelRole, const WireLayout& layout) {
+    stream_.set_layout(layout);
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) return false;
+    ::unlink(name);
+    struct sockaddr_un addr = address(name);
+    if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+             sizeof(addr)) < 0 ||
+        listen(listen_fd_, 5) < 0) {
+      close();
+      return false;
+    }
+    path_ = name;
+    return true;
+  }
+
+  bool open(const char* name, ChannelRole, const WireLayout& layout) {
+    stream_.set_layout(layout);
+    peer_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (peer_fd_ < 0) return false;
+    struct sockaddr_un addr = address(name);
+    if (connect(peer_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+                sizeof(addr)) < 0) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // On the listening side, accepts the next peer.
+  bool wait_peer(int timeout_ms) {
+    if (peer_fd_ >= 0) return true;
+    if (listen_fd_ < 0) {
+      errno = ENOTCONN;
+      return false;
+    }
+    if (!channel_poll(listen_fd_, POLLIN, ChannelDeadline(timeout_ms))) {
+      return false;
+    }
+    peer_fd_ = accept(listen_fd_, nullptr, nullptr);
+    return peer_fd_ >= 0;
+  }
+
+  ssize_t write_records(const void* data, size_t size, size_t count) {
+    if (!wait_peer(-1)) return -1;
+    return stream_.write(peer_fd_, true, data, size, count);
+  }
+
+  ssize_t read_records(void* data, size_t size, size_t max, int timeout_ms) {
+    if (!wait_peer(timeout_ms)) return -1;
+    return stream_.read(peer_fd_, data, size, max, timeout_ms);
+  }
+
+  // Drops the current peer; the listening socket stays open.
+  void disconnect() {
+    if (peer_fd_ >= 0) ::close(peer_fd_);
+    peer_fd_ = -1;
+    stream_.reset();
+  }
+
+  uint64_t position(ChannelRole role) const {
+    return stream_.position(role);
+  }
+
+  // Records still in the kernel are not counted.
+  size_t queued() const { return 0; }
+
+  // The peer, or the listening socket while waiting for one.
+  int poll_fd() const { return peer_fd_ >= 0 ? peer_fd_ : listen_fd_; }
+
+  void close() {
+    disconnect();
+    if (listen_fd_ >= 0) {
+      ::close(listen_fd_);
+      ::unlink(path_.c_str());
+    }
+    listen_fd_ = -1;
+  }
+
+  static void unlink(const char* name) { ::unlink(name); }
+
+ private:
+  static struct sockaddr_un address(const char* name) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, name, sizeof(addr.sun_path) - 1);
+    return addr;
+  }
+
+  int listen_fd_ = -1;
+  int peer_fd_ = -1;
+  std::string path_;
+  StreamRecords stream_;
+};
+
+// Named pipe. Opening one end blocks until the other is opened too, so the
+// open happens in wait_peer (or the first send/receive) where it can time
+// out; opening is otherwise non-blocking.
+class FifoBackend {
+ public:
+  static constexpr const char* TRANSPORT = "fifo";
+
+  FifoBackend() = default;
+  FifoBackend(const FifoBackend&) = delete;
+  FifoBackend& operator=(const FifoBackend&) = delete;
+  ~FifoBackend() { close(); }
+
+  bool create(const char* name, ChannelRole role, const WireLayout& layout) {
+    ::unlink(name);
+    if (mkfifo(name, 0666) < 0) return false;
+    created_ = true;
+    return open(name, role, layout);
+  }
+
+  bool open(const char* name, ChannelRole role, const WireLayout& layout) {
+    struct stat st;
+    if (stat(name, &st) < 0) return false;
+    if (!S_ISFIFO(st.st_mode)) {
+      errno = EINVAL;
+      return false;
+    }
+    path_ = name;
+    role_ = role;
+    stream_.set_layout(layout);
+    return true;
+  }
+
+  // The writer retries its non-blocking open until a reader has the FIFO
+  // open. The reader's open succeeds at once; it then waits for the first
+  // data (or for a writer that came and went).
+  bool wait_peer(int timeout_ms) {
+    if (connected_) return true;
+    ChannelDeadline deadline(timeout_ms);
+    if (role_ == ChannelRole::WRITER) {
+      while ((fd_ = ::open(path_.c_str(), O_WRONLY | O_NONBLOCK)) < 0) {
+        if (errno != ENXIO) return false;
+        if (deadline.expired()) {
+          errno = EAGAIN;
+          return false;
+        }
+        struct timespec pause = {0, 10000000};
+        if (nanosleep(&pause, nullptr) < 0) return false;
+      }
+    } else {
+      if (fd_ < 0) fd_ = ::open(path_.c_str(), O_RDONLY | O_NONBLOCK);
+      if (fd_ < 0) return false;
+      if (!channel_poll(fd_, POLLIN, deadline)) return false;
+    }
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_NONBLOCK);
+    connected_ = true;
+    return true;
+  }
+
+  // A writer whose reader went away gets EPIPE (SIGPIPE is delivered as
+  // usual, so ignore it to see the error).
+  ssize_t write_records(const void* data, size_t size, size_t count) {
+    if (!wait_peer(-1)) return -1;
+    return stream_.write(fd_, false, data, size, count);
+  }
+
+  ssize_t read_records(void* data, size_t size, size_t max, int timeout_ms) {
+    if (!wait_peer(timeout_ms)) return -1;
+    return stream_.read(fd_, data, size, max, timeout_ms);
+  }
+
+  uint64_t position(ChannelRole role) const {
+    return stream_.position(role);
+  }
+
+  // Records still in the kernel are not counted.
+  size_t queued() const { return 0; }
+
+  // Valid once a send or receive has tried to open the FIFO.
+  int poll_fd() const { return fd_; }
+
+  void close() {
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+    connected_ = false;
+    stream_.reset();
+    if (created_) ::unlink(path_.c_str());
+    created_ = false;
+  }
+
+  static void unlink(const char* name) { ::unlink(name); }
+
+ private:
+  std::string path_;
+  ChannelRole role_ = ChannelRole::READER;
+  int fd_ = -1;
+  bool connected_ = false;
+  bool created_ = false;
+  StreamRecords stream_;
+};
+
+// Anonymous pipe for a parent and the children it forks. create() makes
+// the pipe (the name is ignored) and keeps both ends; after fork() each
+// process calls keep() with its own role so the unused ends are closed
+// and the reader sees end of stream when the writer closes.
+class PipeBackend {
+ public:
+  static constexpr const char* TRANSPORT = "pipe";
+
+  PipeBackend() = default;
+  PipeBackend(const PipeBackend&) = delete;
+  PipeBackend& operator=(const PipeBackend&) = delete;
+  ~PipeBackend() { close(); }
+
+  bool create(const char*, ChannelRole, const WireLayout& layout) {
+    stream_.set_layout(layout);
+    int fds[2];
+    if (pipe(fds) < 0) return false;
+    read_fd_ = fds[0];
+    write_fd_ = fds[1];
+    return true;
+  }
+
+  // There is nothing to attach to by name.
+  bool open(const char*, ChannelRole, const WireLayout&) {
+    errno = ENOTSUP;
+    return false;
+  }
+
+  void keep(ChannelRole role) {
+    int& unused = role == ChannelRole::WRITER ? read_fd_ : write_fd_;
+    if (unused >= 0) ::close(unused);
+    unused = -1;
+  }
+
+  bool wait_peer(int) { return read_fd_ >= 0 || write_fd_ >= 0; }
+
+  ssize_t write_records(const void* data, size_t size, size_t count) {
+    return stream_.write(write_fd_, false, data, size, count);
+  }
+
+  ssize_t read_records(void* data, size_t size, size_t max, int timeout_ms) {
+    return stream_.read(read_fd_, data, size, max, timeout_ms);
+  }
+
+  uint64_t position(ChannelRole role) const {
+    return stream_.position(role);
+  }
+
+  // Records still in the kernel are not counted.
+  size_t queued() const { return 0; }
+
+  int poll_fd() const { return read_fd_ >= 0 ? read_fd_ : write_fd_; }
+
+  void close() {
+    keep(ChannelRole::WRITER);
+    keep(ChannelRole::READER);
+    stream_.reset();
+  }
+
+  static void unlink(const char*) {}
+
+ private:
+  int read_fd_ = -1;
+  int write_fd_ = -1;
+  StreamRecords stream_;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+
+// Shared (non-private) futex ops, so waiters in different processes find
+// each other through a shared mapping. relative is a timeout, or null to
+// wait until woken.
+inline long futex_wait(std::atomic<uint32_t>* addr, uint32_t expected,
+                       const struct timespec* relative = nullptr) {
+  return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT,
+                 expected, relative, nullptr, 0);
+}
+
+inline long futex_wake(std::atomic<uint32_t>* addr, int count) {
+  return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE,
+                 count, nullptr, nullptr, 0);
+}
@@ -0,0 +1,526 @@
+#pragma once
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "channel.h"
+#include "wire_types.h"
+
+// Coroutine event loop for consuming many channels from one thread (C++20).
+// Tasks co_await a receive on any Channel, a readable descriptor or a
+// sleep; a task that has to wait is parked and the thread moves on to
+// whichever task can run, so one process can serve sockets, FIFOs, POSIX
+// queues and shm rings together with no thread per channel and no polling
+// sleeps. Descriptors are watched with epoll. The shm ring has none, so
+// parked ring readers are handed to one helper thread that sleeps on all
+// their signal words at once with futex_waitv and reports the rings that
+// moved through an eventfd.
+//
+// An IoLoop and its tasks belong to the thread that runs it; loops share
+// nothing, so thread-per-core means one loop per pinned thread. One task
+// at a time may wait on a given channel or descriptor.
+
+class IoLoop;
+
+// Detached coroutine run by an IoLoop, started with IoLoop::spawn. It may
+// await the loop's operations but is not itself awaitable.
+class IoTask {
+ public:
+  struct promise_type {
+    IoLoop* loop = nullptr;
+
+    IoTask get_return_object() {
+      return IoTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void();
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  IoTask(IoTask&& other) noexcept
+      : handle_(std::exchange(other.handle_, nullptr)) {}
+  IoTask(const IoTask&) = delete;
+  IoTask& operator=(const IoTask&) = delete;
+  ~IoTask() {
+    if (handle_) handle_.destroy();
+  }
+
+ private:
+  friend class IoLoop;
+  explicit IoTask(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+// A suspended operation. retry() runs when what it waits on is ready and
+// returns false to keep waiting.
+struct IoWait {
+  virtual ~IoWait() = default;
+  virtual bool retry() { return true; }
+
+  std::coroutine_handle<> handle;
+  int fd = -1;
+  ShmRingBackend* shm = nullptr;
+  bool timed = false;
+  bool timed_out = false;
+  std::multimap<uint64_t, IoWait*>::iterator timer;
+};
+
+// Sleeps on the signal words of parked shm ring readers for an IoLoop.
+// The loop adds and removes waits under the mutex and bumps control_ so
+// the thread rebuilds its wait list; waits whose word moved are queued in
+// woken_ and the loop is told through notify_fd.
+class ShmWaitBridge {
+ public:
+  explicit ShmWaitBridge(int notify_fd) : notify_fd_(notify_fd) {}
+  ShmWaitBridge(const ShmWaitBridge&) = delete;
+  ShmWaitBridge& operator=(const ShmWaitBridge&) = delete;
+  ~ShmWaitBridge() { stop(); }
+
+  void add(IoWait* wait, uint32_t seen) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    parked_.push_back({&wait->shm->reader_signal(), seen, wait});
+    if (!thread_.joinable()) {
+      thread_ = std::thread([this] { run(); });
+    }
+    poke();
+  }
+
+  void remove(IoWait* wait) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    parked_.erase(std::remove_if(parked_.begin(), parked_.end(),
+                                 [wait](const Parked& p) {
+                                   return p.wait == wait;
+                                 }),
+                  parked_.end());
+    woken_.erase(std::remove(woken_.begin(), woken_.end(), wait),
+                 woken_.end());
+    poke();
+  }
+
+  std::vector<IoWait*> take_woken() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::exchange(woken_, {});
+  }
+
+  void stop() {
+    if (!thread_.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+      poke();
+    }
+    thread_.join();
+  }
+
+ private:
+  struct Parked {
+    std::atomic<uint32_t>* word;
+    uint32_t seen;
+    IoWait* wait;
+  };
+
+  void poke() {
+    control_.fetch_add(1);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&control_),
+            FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+  }
+
+  // Signals stay with the loop's thread.
+  void run() {
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+    std::vector<struct futex_waitv> waiters;
+    while (true) {
+      bool overflow;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) return;
+        waiters.clear();
+        waiters.push_back({control_.load(),
+                           reinterpret_cast<uintptr_t>(&control_),
+                           FUTEX_32 | FUTEX_PRIVATE_FLAG, 0});
+        for (const Parked& p : parked_) {
+          if (waiters.size() == FUTEX_WAITV_MAX) break;
+          waiters.push_back(
+              {p.seen, reinterpret_cast<uintptr_t>(p.word), FUTEX_32, 0});
+        }
+        overflow = waiters.size() - 1 < parked_.size();
+      }
+      sleep(waiters, overflow);
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      bool any = false;
+      for (auto it = parked_.begin(); it != parked_.end();) {
+        if (it->word->load() != it->seen) {
+          woken_.push_back(it->wait);
+          it = parked_.erase(it);
+          any = true;
+        } else {
+          ++it;
+        }
+      }
+      if (any) {
+        uint64_t one = 1;
+        ssize_t ignored = write(notify_fd_, &one, sizeof(one));
+        (void)ignored;
+      }
+    }
+  }
+
+  // Rings beyond the futex_waitv limit, or all of them on kernels without
+  // it, are rechecked every millisecond.
+  void sleep(const std::vector<struct futex_waitv>& waiters, bool overflow) {
+#ifdef SYS_futex_waitv
+    if (!no_waitv_) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_nsec += 1000000;
+      if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      if (syscall(SYS_futex_waitv, waiters.data(), waiters.size(), 0,
+                  overflow ? &deadline : nullptr, CLOCK_MONOTONIC) >= 0 ||
+          errno != ENOSYS) {
+        return;
+      }
+      no_waitv_ = true;
+    }
+#endif
+    struct timespec pause = {0, 1000000};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&control_),
+            FUTEX_WAIT_PRIVATE, static_cast<uint32_t>(waiters[0].val),
+            &pause, nullptr, 0);
+  }
+
+  int notify_fd_;
+  std::mutex mutex_;
+  std::vector<Parked> parked_;
+  std::vector<IoWait*> woken_;
+  std::atomic<uint32_t> control_{0};
+  bool stopping_ = false;
+  bool no_waitv_ = false;
+  std::thread thread_;
+};
+
+class IoLoop {
+ public:
+  IoLoop()
+      : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+        notify_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+        bridge_(notify_fd_) {
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = notify_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, notify_fd_, &event);
+  }
+
+  IoLoop(const IoLoop&) = delete;
+  IoLoop& operator=(const IoLoop&) = delete;
+
+  // Tasks still suspended are destroyed, which closes the channels they
+  // hold.
+  ~IoLoop() {
+    bridge_.stop();
+    for (auto& entry : fd_waits_) {
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, entry.first, nullptr);
+    }
+    fd_waits_.clear();
+    timers_.clear();
+    std::unordered_set<void*> tasks = std::move(tasks_);
+    for (void* address : tasks) {
+      auto handle = std::coroutine_handle<IoTask::promise_type>::from_address(
+          address);
+      handle.promise().loop = nullptr;
+      handle.destroy();
+    }
+    close(notify_fd_);
+    close(epoll_fd_);
+  }
+
+  bool ok() const { return epoll_fd_ >= 0 && notify_fd_ >= 0; }
+
+  // Takes over the task; it starts on the next turn of run().
+  void spawn(IoTask task) {
+    auto handle = std::exchange(task.handle_, nullptr);
+    handle.promise().loop = this;
+    tasks_.insert(handle.address());
+    ready_.push_back(handle);
+  }
+
+  size_t tasks() const { return tasks_.size(); }
+
+  // Runs until every task has finished or stop() was called. Returns
+  // false with errno set if the wait failed: EINTR when a signal arrived,
+  // after which run() can be called again to carry on.
+  bool run() {
+    stopped_ = false;
+    struct epoll_event events[64];
+    while (!stopped_) {
+      while (!ready_.empty() && !stopped_) {
+        std::coroutine_handle<> handle = ready_.front();
+        ready_.pop_front();
+        handle.resume();
+      }
+      if (stopped_ || tasks_.empty()) break;
+
+      int timeout = -1;
+      if (!timers_.empty()) {
+        uint64_t now = wire_timestamp_ns();
+        uint64_t due = timers_.begin()->first;
+        timeout = due <= now ? 0
+                             : static_cast<int>((due - now + 999999) / 1000000);
+      }
+      int count = epoll_wait(epoll_fd_, events, 64, timeout);
+      if (count < 0) return false;
+      for (int i = 0; i < count; ++i) {
+        if (events[i].data.fd == notify_fd_) {
+          wake_shm_waits();
+        } else {
+          wake_fd(events[i].data.fd);
+        }
+      }
+      expire_timers();
+    }
+    return true;
+  }
+
+  // Makes run() return after the current task suspends.
+  void stop() { stopped_ = true; }
+
+  // Operations below are awaitables; the loop must outlive them.
+
+  class Readable : public IoWait {
+   public:
+    Readable(IoLoop& loop, int descriptor, int timeout_ms)
+        : loop_(loop), timeout_ms_(timeout_ms) {
+      fd = descriptor;
+    }
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+      handle = h;
+      loop_.arm(*this, timeout_ms_);
+    }
+    // False when the timeout expired first.
+    bool await_resume() const { return !timed_out; }
+
+   private:
+    IoLoop& loop_;
+    int timeout_ms_;
+  };
+
+  class Sleep : public IoWait {
+   public:
+    Sleep(IoLoop& loop, int ms) : loop_(loop), ms_(ms) {}
+    bool await_ready() const { return ms_ <= 0; }
+    void await_suspend(std::coroutine_handle<> h) {
+      handle = h;
+      loop_.arm(*this, ms_);
+    }
+    void await_resume() const {}
+
+   private:
+    IoLoop& loop_;
+    int ms_;
+  };
+
+  // Receives up to max records. Yields what Channel::recv_n would with
+  // the same timeout, without blocking the thread.
+  template <typename T, typename Backend>
+  class Receive : public IoWait {
+   public:
+    Receive(IoLoop& loop, Channel<T, Backend>& channel, T* records,
+            size_t max, int timeout_ms)
+        : loop_(loop),
+          channel_(channel),
+          records_(records),
+          max_(max),
+          timeout_ms_(timeout_ms) {}
+
+    bool await_ready() { return attempt(); }
+    void await_suspend(std::coroutine_handle<> h) {
+      handle = h;
+      if constexpr (std::is_same<Backend, ShmRingBackend>::value) {
+        shm = &channel_.backend();
+      } else {
+        fd = channel_.backend().poll_fd();
+      }
+      loop_.arm(*this, timeout_ms_);
+    }
+    ssize_t await_resume() const {
+      if (timed_out) {
+        errno = EAGAIN;
+        return -1;
+      }
+      if (result_ < 0) errno = error_;
+      return result_;
+    }
+
+    bool retry() override { return attempt(); }
+
+   private:
+    bool attempt() {
+      result_ = channel_.recv_n(records_, max_, 0);
+      error_ = errno;
+      return result_ >= 0 || error_ != EAGAIN;
+    }
+
+    IoLoop& loop_;
+    Channel<T, Backend>& channel_;
+    T* records_;
+    size_t max_;
+    int timeout_ms_;
+    ssize_t result_ = -1;
+    int error_ = 0;
+  };
+
+  Readable readable(int fd, int timeout_ms = -1) {
+    return Readable(*this, fd, timeout_ms);
+  }
+
+  Sleep sleep_for(int ms) { return Sleep(*this, ms); }
+
+  template <typename T, typename Backend>
+  Receive<T, Backend> receive(Channel<T, Backend>& channel, T* records,
+                              size_t max = 1, int timeout_ms = -1) {
+    return Receive<T, Backend>(*this, channel, records, max, timeout_ms);
+  }
+
+ private:
+  friend struct IoTask::promise_type;
+
+  void task_finished(void* address) { tasks_.erase(address); }
+
+  void arm(IoWait& wait, int timeout_ms) {
+    wait.timed_out = false;
+    wait.timed = timeout_ms >= 0;
+    if (wait.timed) {
+      wait.timer = timers_.emplace(
+          wire_timestamp_ns() + static_cast<uint64_t>(timeout_ms) * 1000000ULL,
+          &wait);
+    }
+    watch(wait);
+  }
+
+  // Starts waiting on the descriptor or ring; a wait with neither only
+  // has its timer.
+  void watch(IoWait& wait) {
+    if (wait.shm) {
+      uint32_t seen = wait.shm->park_reader();
+      if (wait.shm->readable()) {
+        wait.shm->unpark_reader();
+        ready(wait);
+      } else {
+        bridge_.add(&wait, seen);
+      }
+    } else if (wait.fd >= 0) {
+      struct epoll_event event = {};
+      event.events = EPOLLIN | EPOLLONESHOT;
+      event.data.fd = wait.fd;
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, wait.fd, &event) < 0 &&
+          (errno != ENOENT ||
+           epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wait.fd, &event) < 0)) {
+        finish(wait);
+        return;
+      }
+      fd_waits_[wait.fd] = &wait;
+    } else if (!wait.timed) {
+      finish(wait);
+    }
+  }
+
+  // The awaited thing is ready: complete the operation or wait again.
+  void ready(IoWait& wait) {
+    if (wait.retry()) {
+      finish(wait);
+    } else {
+      watch(wait);
+    }
+  }
+
+  void finish(IoWait& wait) {
+    if (wait.timed) timers_.erase(wait.timer);
+    wait.timed = false;
+    ready_.push_back(wait.handle);
+  }
+
+  void wake_fd(int fd) {
+    auto found = fd_waits_.find(fd);
+    if (found == fd_waits_.end()) return;
+    IoWait* wait = found->second;
+    fd_waits_.erase(found);
+    ready(*wait);
+  }
+
+  void wake_shm_waits() {
+    uint64_t value;
+    while (read(notify_fd_, &value, sizeof(value)) > 0) {
+    }
+    for (IoWait* wait : bridge_.take_woken()) {
+      wait->shm->unpark_reader();
+      ready(*wait);
+    }
+  }
+
+  void expire_timers() {
+    uint64_t now = wire_timestamp_ns();
+    while (!timers_.empty() && timers_.begin()->first <= now) {
+      IoWait* wait = timers_.begin()->second;
+      timers_.erase(timers_.begin());
+      wait->timed = false;
+      if (wait->shm) {
+        bridge_.remove(wait);
+        wait->shm->unpark_reader();
+        wait->timed_out = true;
+      } else if (wait->fd >= 0) {
+        fd_waits_.erase(wait->fd);
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, wait->fd, nullptr);
+        wait->timed_out = true;
+      }
+      ready_.push_back(wait->handle);
+    }
+  }
+
+  int epoll_fd_;
+  int notify_fd_;
+  ShmWaitBridge bridge_;
+  bool stopped_ = false;
+  std::deque<std::coroutine_handle<>> ready_;
+  std::unordered_set<void*> tasks_;
+  std::unordered_map<int, IoWait*> fd_waits_;
+  std::multimap<uint64_t, IoWait*> timers_;
+};
+
+inline void IoTask::promise_type::return_void() {
+  if (loop) {
+    loop->task_finished(
+        std::coroutine_handle<promise_type>::from_promise(*this).address());
+  }
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#include "channel_backend.h"
+
+// System-wide registry of per-channel counters in one shared memory
+// segment. Every process claims a slot per channel endpoint it uses and
+// is the only writer of that slot, so the counters are bumped with plain
+// relaxed loads and stores instead of locked read-modify-writes. ipc_top
+// maps the segment read-only and turns the totals into rates. The
+// segment outlives the processes (ipc_top -u removes it); slots of
+// processes that died are reused by the next registration.
+constexpr const char* IPC_METRICS_SEGMENT = "/ipc_metrics";
+constexpr uint32_t IPC_METRICS_MAGIC = 0x49504D52U;
+constexpr unsigned IPC_METRICS_SLOTS = 64;
+
+// Bucket b counts latencies below 2^b ns; the last one is open-ended.
+constexpr unsigned IPC_LATENCY_BUCKETS = 40;
+
+// One channel endpoint of one process. The identity, the hot counters and
+// the histogram sit on separate cache lines, and slots never share one.
+struct alignas(64) IpcChannelSlot {
+  std::atomic<int32_t> owner;  // pid, 0 when free
+  std::atomic<uint32_t> ready;
+  std::atomic<uint32_t> generation;
+  uint32_t role;  // ChannelRole
+  char transport[8];
+  char channel[40];
+  alignas(64) std::atomic<uint64_t> messages;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> drops;
+  std::atomic<uint64_t> gaps;
+  std::atomic<uint64_t> depth;
+  alignas(64) std::atomic<uint64_t> latency[IPC_LATENCY_BUCKETS];
+};
+
+struct IpcMetricsSegment {
+  uint32_t magic;
+  uint32_t slots;
+  IpcChannelSlot slot[IPC_METRICS_SLOTS];
+};
+
+inline unsigned ipc_latency_bucket(uint64_t ns) {
+  if (ns == 0) return 0;
+  unsigned bucket = 64 - static_cast<unsigned>(__builtin_clzll(ns));
+  return bucket < IPC_LATENCY_BUCKETS ? bucket : IPC_LATENCY_BUCKETS - 1;
+}
+
+// Maps the registry, creating it on first use.
+class IpcMetricsMap {
+ public:
+  IpcMetricsMap() = default;
+  IpcMetricsMap(const IpcMetricsMap&) = delete;
+  IpcMetricsMap& operator=(const IpcMetricsMap&) = delete;
+  ~IpcMetricsMap() { close(); }
+
+  bool open_or_create() {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+      int fd = shm_open(IPC_METRICS_SEGMENT, O_RDWR, 0666);
+      if (fd >= 0) {
+        bool ok = attach(fd, true);
+        ::close(fd);
+        if (ok) return true;
+        if (errno != EAGAIN) return false;
+      } else if (errno == ENOENT) {
+        fd = shm_open(IPC_METRICS_SEGMENT, O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd >= 0) return initialize(fd);
+        if (errno != EEXIST) return false;
+        continue;
+      } else {
+        return false;
+      }
+      // Another process is still setting the segment up.
+      struct timespec pause = {0, 1000000};
+      nanosleep(&pause, nullptr);
+    }
+    errno = EAGAIN;
+    return false;
+  }
+
+  bool open_readonly() {
+    int fd = shm_open(IPC_METRICS_SEGMENT, O_RDONLY, 0);
+    if (fd < 0) return false;
+    bool ok = attach(fd, false);
+    ::close(fd);
+    return ok;
+  }
+
+  void close() {
+    if (segment_) munmap(segment_, sizeof(IpcMetricsSegment));
+    segment_ = nullptr;
+  }
+
+  static void unlink() { shm_unlink(IPC_METRICS_SEGMENT); }
+
+  const IpcMetricsSegment* get() const { return segment_; }
+  IpcMetricsSegment* get() { return segment_; }
+
+ private:
+  bool initialize(int fd) {
+    if (ftruncate(fd, sizeof(IpcMetricsSegment)) < 0 || !map(fd, true)) {
+      ::close(fd);
+      shm_unlink(IPC_METRICS_SEGMENT);
+      return false;
+    }
+    ::close(fd);
+    segment_ = new (segment_) IpcMetricsSegment();
+    segment_->slots = IPC_METRICS_SLOTS;
+    std::atomic_thread_fence(std::memory_order_release);
+    segment_->magic = IPC_METRICS_MAGIC;
+    return true;
+  }
+
+  // Fails with EAGAIN while the creator has not finished.
+  bool attach(int fd, bool writable) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) return false;
+    if (static_cast<size_t>(st.st_size) < sizeof(IpcMetricsSegment)) {
+      errno = EAGAIN;
+      return false;
+    }
+    if (!map(fd, writable)) return false;
+    if (segment_->magic != IPC_METRICS_MAGIC ||
+        segment_->slots != IPC_METRICS_SLOTS) {
+      close();
+      errno = EAGAIN;
+      return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+  }
+
+  bool map(int fd, bool writable) {
+    void* base = mmap(nullptr, sizeof(IpcMetricsSegment),
+                      writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return false;
+    segment_ = static_cast<IpcMetricsSegment*>(base);
+    return true;
+  }
+
+  IpcMetricsSegment* segment_ = nullptr;
+};
+
+// The registry mapping shared by every ChannelMetrics of this process, or
+// nullptr when it cannot be mapped.
+inline IpcMetricsSegment* ipc_metrics_registry() {
+  static IpcMetricsMap map;
+  static IpcMetricsSegment* segment =
+      map.open_or_create() ? map.get() : nullptr;
+  return segment;
+}
+
+// This process's counters for one channel endpoint. Every update is a
+// single branch while detached. Not thread-safe: one thread updates a
+// given endpoint.
+class ChannelMetrics {
+ public:
+  ChannelMetrics() = default;
+  ChannelMetrics(const ChannelMetrics&) = delete;
+  ChannelMetrics& operator=(const ChannelMetrics&) = delete;
+  ~ChannelMetrics() { detach(); }
+
+  // Claims a free slot, or one whose owner has died. A slot inherited
+  // across fork() is left to the parent.
+  bool attach(const char* channel, ChannelRole role, const char* transport) {
+    detach();
+    IpcMetricsSegment* registry = ipc_metrics_registry();
+    if (!registry) return false;
+
+    int32_t self = static_cast<int32_t>(getpid());
+    for (IpcChannelSlot& slot : registry->slot) {
+      int32_t owner = slot.owner.load(std::memory_order_relaxed);
+      if (owner != 0 && (kill(owner, 0) == 0 || errno != ESRCH)) continue;
+      if (!slot.owner.compare_exchange_strong(owner, self)) continue;
+
+      slot.ready.store(0, std::memory_order_relaxed);
+      slot.role = static_cast<uint32_t>(role);
+      copy_name(slot.transport, sizeof(slot.transport), transport);
+      copy_name(slot.channel, sizeof(slot.channel), channel);
+      slot.messages.store(0, std::memory_order_relaxed);
+      slot.bytes.store(0, std::memory_order_relaxed);
+      slot.drops.store(0, std::memory_order_relaxed);
+      slot.gaps.store(0, std::memory_order_relaxed);
+      slot.depth.store(0, std::memory_order_relaxed);
+      for (auto& bucket : slot.latency) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+      slot.generation.fetch_add(1, std::memory_order_relaxed);
+      slot.ready.store(1, std::memory_order_release);
+      slot_ = &slot;
+      return true;
+    }
+    errno = ENOSPC;
+    return false;
+  }
+
+  void detach() {
+    if (!slot_) return;
+    int32_t self = static_cast<int32_t>(getpid());
+    if (slot_->owner.load(std::memory_order_relaxed) == self) {
+      slot_->ready.store(0, std::memory_order_relaxed);
+      slot_->owner.store(0, std::memory_order_release);
+    }
+    slot_ = nullptr;
+  }
+
+  void record(uint64_t messages, uint64_t bytes) {
+    if (!slot_) return;
+    add(slot_->messages, messages);
+    add(slot_->bytes, bytes);
+  }
+
+  void drop(uint64_t count = 1) {
+    if (slot_) add(slot_->drops, count);
+  }
+
+  void gap(uint64_t missing) {
+    if (slot_) add(slot_->gaps, missing);
+  }
+
+  void depth(uint64_t records) {
+    if (slot_) slot_->depth.store(records, std::memory_order_relaxed);
+  }
+
+  void latency_ns(uint64_t ns) {
+    if (slot_) add(slot_->latency[ipc_latency_bucket(ns)], 1);
+  }
+
+  explicit operator bool() const { return slot_ != nullptr; }
+
+ private:
+  static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+  static void copy_name(char* out, size_t size, const char* name) {
+    strncpy(out, name ? name : "", size - 1);
+    out[size - 1] = '\0';
+  }
+
+  IpcChannelSlot* slot_ = nullptr;
+};
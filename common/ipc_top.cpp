@@ -0,0 +1,201 @@
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ipc_metrics.h"
+#include "latency_histogram.h"
+
+// Live view of every channel endpoint registered in the ipc_metrics
+// registry. Maps the registry read-only, so the processes it watches do
+// not notice it.
+
+std::atomic<bool> running{true};
+
+void signal_handler(int signal) {
+  if (signal == SIGINT || signal == SIGTERM) {
+    running = false;
+  }
+}
+
+struct SlotSnapshot {
+  int32_t owner;
+  uint32_t generation;
+  uint32_t role;
+  std::string transport;
+  std::string channel;
+  uint64_t messages;
+  uint64_t bytes;
+  uint64_t drops;
+  uint64_t gaps;
+  uint64_t depth;
+  uint64_t latency[IPC_LATENCY_BUCKETS];
+};
+
+// Copies the registered slots. The names are only read once ready is
+// seen, and a slot whose owner changed meanwhile is skipped.
+std::vector<SlotSnapshot> snapshot(const IpcMetricsSegment& registry) {
+  std::vector<SlotSnapshot> slots;
+  for (const IpcChannelSlot& slot : registry.slot) {
+    SlotSnapshot s;
+    s.owner = slot.owner.load(std::memory_order_acquire);
+    if (s.owner == 0 || !slot.ready.load(std::memory_order_acquire)) {
+      continue;
+    }
+    s.generation = slot.generation.load(std::memory_order_relaxed);
+    s.role = slot.role;
+    s.transport.assign(slot.transport,
+                       strnlen(slot.transport, sizeof(slot.transport)));
+    s.channel.assign(slot.channel,
+                     strnlen(slot.channel, sizeof(slot.channel)));
+    s.messages = slot.messages.load(std::memory_order_relaxed);
+    s.bytes = slot.bytes.load(std::memory_order_relaxed);
+    s.drops = slot.drops.load(std::memory_order_relaxed);
+    s.gaps = slot.gaps.load(std::memory_order_relaxed);
+    s.depth = slot.depth.load(std::memory_order_relaxed);
+    for (unsigned b = 0; b < IPC_LATENCY_BUCKETS; ++b) {
+      s.latency[b] = slot.latency[b].load(std::memory_order_relaxed);
+    }
+    if (slot.owner.load(std::memory_order_acquire) != s.owner ||
+        slot.generation.load(std::memory_order_relaxed) != s.generation) {
+      continue;
+    }
+    slots.push_back(std::move(s));
+  }
+  std::sort(slots.begin(), slots.end(),
+            [](const SlotSnapshot& a, const SlotSnapshot& b) {
+              if (a.channel != b.channel) return a.channel < b.channel;
+              if (a.role != b.role) return a.role < b.role;
+              return a.owner < b.owner;
+            });
+  return slots;
+}
+
+// Upper bound in microseconds of the bucket holding the quantile, or -1
+// when nothing was recorded.
+double latency_quantile_us(const uint64_t* counts, double quantile) {
+  unsigned b = histogram_quantile_bucket(counts, IPC_LATENCY_BUCKETS, quantile);
+  if (b == IPC_LATENCY_BUCKETS) return -1;
+  return (uint64_t{1} << b) / 1000.0;
+}
+
+void print_latency(double us) {
+  if (us < 0) {
+    std::cout << std::setw(9) << "-";
+  } else {
+    std::cout << std::setw(9) << std::fixed << std::setprecision(1) << us;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+
+  int interval_ms = 1000;
+  long iterations = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "i:n:u")) != -1) {
+    switch (opt) {
+      case 'i':
+        interval_ms = std::atoi(optarg);
+        if (interval_ms <= 0) opt = '?';
+        break;
+      case 'n':
+        iterations = std::atol(optarg);
+        break;
+      case 'u':
+        IpcMetricsMap::unlink();
+        std::cout << "Removed " << IPC_METRICS_SEGMENT << std::endl;
+        return 0;
+    }
+    if (opt == '?') {
+      std::cerr << "Usage: " << argv[0] << " [-i interval_ms] [-n updates]"
+                << " [-u]" << std::endl;
+      std::cerr << "  A PID marked ! exited without releasing its slot; -u"
+                   " removes the registry segment"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  IpcMetricsMap registry;
+  if (!registry.open_readonly()) {
+    std::cerr << "Failed to open " << IPC_METRICS_SEGMENT << ": "
+              << strerror(errno) << std::endl;
+    std::cerr << "Start a producer or consumer first" << std::endl;
+    return 1;
+  }
+
+  bool terminal = isatty(STDOUT_FILENO);
+  std::map<std::pair<int32_t, uint32_t>, SlotSnapshot> previous;
+  for (const SlotSnapshot& s : snapshot(*registry.get())) {
+    previous.emplace(std::make_pair(s.owner, s.generation), s);
+  }
+  auto last = std::chrono::steady_clock::now();
+  for (long update = 0; running && (iterations == 0 || update < iterations);
+       ++update) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last).count();
+    last = now;
+
+    std::vector<SlotSnapshot> slots = snapshot(*registry.get());
+    if (terminal) std::cout << "\033[H\033[2J";
+    // Columns are always space-separated; a longer channel name pushes
+    // the rest of its row along instead of running into it.
+    std::cout << std::left << std::setw(8) << "PID" << ' ' << std::setw(24)
+              << "CHANNEL" << ' ' << std::setw(6) << "VIA" << std::setw(7)
+              << "ROLE" << std::right << std::setw(10) << "msgs/s"
+              << std::setw(9) << "MB/s" << std::setw(12) << "total"
+              << std::setw(8) << "drops" << std::setw(8) << "gaps"
+              << std::setw(7) << "depth" << std::setw(9) << "p50 us"
+              << std::setw(9) << "p99 us" << std::endl;
+
+    std::map<std::pair<int32_t, uint32_t>, SlotSnapshot> current;
+    for (const SlotSnapshot& s : slots) {
+      auto key = std::make_pair(s.owner, s.generation);
+      auto before = previous.find(key);
+      uint64_t messages = s.messages;
+      uint64_t bytes = s.bytes;
+      if (before != previous.end()) {
+        messages -= before->second.messages;
+        bytes -= before->second.bytes;
+      }
+      bool alive = kill(s.owner, 0) == 0 || errno != ESRCH;
+
+      std::string pid = std::to_string(s.owner) + (alive ? "" : "!");
+      std::cout << std::left << std::setw(8) << pid << ' ' << std::setw(24)
+                << (s.channel.empty() ? "-" : s.channel) << ' '
+                << std::setw(6) << s.transport << std::setw(7)
+                << (s.role == static_cast<uint32_t>(ChannelRole::WRITER)
+                        ? "writer"
+                        : "reader")
+                << std::right << std::setw(10)
+                << static_cast<uint64_t>(messages / seconds) << std::setw(9)
+                << std::fixed << std::setprecision(2)
+                << bytes / seconds / 1e6 << std::setw(12) << s.messages
+                << std::setw(8) << s.drops << std::setw(8) << s.gaps
+                << std::setw(7) << s.depth;
+      print_latency(latency_quantile_us(s.latency, 0.50));
+      print_latency(latency_quantile_us(s.latency, 0.99));
+      std::cout << std::endl;
+      current.emplace(key, s);
+    }
+    if (slots.empty()) std::cout << "(no channels registered)" << std::endl;
+    if (!terminal) std::cout << std::endl;
+    previous.swap(current);
+  }
+  return 0;
+}
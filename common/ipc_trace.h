@@ -0,0 +1,228 @@
+#pragma once
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "channel_backend.h"
+#include "wire_types.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Per-process binary trace of channel traffic. With IPC_TRACE=1 in the
+// environment every process maps its own ring, /ipc_trace.<pid>, at
+// startup and the channels append fixed-size events to it: each send and
+// receive with its start and end ticks and the position of its first
+// record in the channel, plus the futex wakes and waits of the shm ring.
+// The ring overwrites its oldest events and stays behind when the process
+// exits; ipc_trace_export merges all rings into one Chrome/Perfetto trace.
+// Without IPC_TRACE, ipc_trace_ring is null and each trace point is one
+// branch on it.
+constexpr const char* IPC_TRACE_PREFIX = "/ipc_trace.";
+constexpr uint32_t IPC_TRACE_MAGIC = 0x54524143U;
+constexpr unsigned IPC_TRACE_CHANNELS = 32;
+constexpr uint64_t IPC_TRACE_DEFAULT_EVENTS = 65536;
+constexpr uint16_t IPC_TRACE_NO_CHANNEL = UINT16_MAX;
+
+enum class TraceKind : uint8_t { SEND = 1, RECV = 2, WAKE = 3, WAIT = 4 };
+
+struct IpcTraceEvent {
+  uint64_t start;
+  uint64_t end;
+  uint64_t position;
+  uint32_t count;
+  uint32_t thread;
+  uint16_t channel;
+  uint8_t kind;  // TraceKind
+  uint8_t reserved[5];
+};
+
+static_assert(sizeof(IpcTraceEvent) == 40, "IpcTraceEvent layout");
+
+struct IpcTraceChannel {
+  char name[40];
+  char transport[8];
+  uint32_t role;  // ChannelRole
+  uint32_t reserved;
+};
+
+// Ticks convert to CLOCK_MONOTONIC nanoseconds through base_ticks,
+// base_ns and ticks_per_ns, so the rings of different processes share
+// one time axis.
+struct alignas(64) IpcTraceHeader {
+  uint32_t magic;
+  int32_t pid;
+  uint64_t capacity;
+  double ticks_per_ns;
+  uint64_t base_ticks;
+  uint64_t base_ns;
+  char process[16];
+  alignas(64) std::atomic<uint64_t> head;
+  std::atomic<uint32_t> channel_count;
+  IpcTraceChannel channels[IPC_TRACE_CHANNELS];
+};
+
+inline uint64_t ipc_trace_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return wire_timestamp_ns();
+#endif
+}
+
+inline std::string ipc_trace_name(pid_t pid) {
+  return IPC_TRACE_PREFIX + std::to_string(pid);
+}
+
+inline IpcTraceEvent* ipc_trace_events(IpcTraceHeader* ring) {
+  return reinterpret_cast<IpcTraceEvent*>(ring + 1);
+}
+
+inline const IpcTraceEvent* ipc_trace_events(const IpcTraceHeader* ring) {
+  return reinterpret_cast<const IpcTraceEvent*>(ring + 1);
+}
+
+// Creates this process's ring. ticks_per_ns is measured over 20 ms unless
+// a parent already did (after fork the child reuses its rate).
+inline IpcTraceHeader* ipc_trace_create(uint64_t capacity,
+                                        double ticks_per_ns) {
+  std::string name = ipc_trace_name(getpid());
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+  if (fd < 0) return nullptr;
+  size_t size = sizeof(IpcTraceHeader) + capacity * sizeof(IpcTraceEvent);
+  void* base = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return nullptr;
+  }
+
+  if (ticks_per_ns <= 0) {
+    uint64_t first_ns = wire_timestamp_ns();
+    uint64_t first = ipc_trace_ticks();
+    struct timespec pause = {0, 20000000};
+    nanosleep(&pause, nullptr);
+    uint64_t ns = wire_timestamp_ns() - first_ns;
+    ticks_per_ns = ns > 0 ? (ipc_trace_ticks() - first) /
+                                static_cast<double>(ns)
+                          : 1.0;
+  }
+
+  IpcTraceHeader* ring = new (base) IpcTraceHeader();
+  ring->pid = static_cast<int32_t>(getpid());
+  ring->capacity = capacity;
+  ring->ticks_per_ns = ticks_per_ns;
+  ring->base_ns = wire_timestamp_ns();
+  ring->base_ticks = ipc_trace_ticks();
+  FILE* comm = fopen("/proc/self/comm", "r");
+  if (comm) {
+    if (fgets(ring->process, sizeof(ring->process), comm)) {
+      ring->process[strcspn(ring->process, "\n")] = '\0';
+    }
+    fclose(comm);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  ring->magic = IPC_TRACE_MAGIC;
+  return ring;
+}
+
+inline IpcTraceHeader* ipc_trace_start_from_env();
+
+// The ring of this process, or null when tracing is off.
+inline IpcTraceHeader* ipc_trace_ring = ipc_trace_start_from_env();
+
+inline thread_local uint32_t ipc_trace_thread = 0;
+
+// A forked child gets a ring of its own; it keeps the parent's channel
+// registrations, since it inherits their endpoints.
+inline void ipc_trace_after_fork() {
+  IpcTraceHeader* parent = ipc_trace_ring;
+  ipc_trace_thread = 0;
+  ipc_trace_ring = ipc_trace_create(parent->capacity, parent->ticks_per_ns);
+  if (!ipc_trace_ring) return;
+  uint32_t channels = parent->channel_count.load();
+  if (channels > IPC_TRACE_CHANNELS) channels = IPC_TRACE_CHANNELS;
+  memcpy(ipc_trace_ring->channels, parent->channels,
+         channels * sizeof(IpcTraceChannel));
+  ipc_trace_ring->channel_count.store(channels);
+}
+
+inline IpcTraceHeader* ipc_trace_start_from_env() {
+  const char* enabled = getenv("IPC_TRACE");
+  if (!enabled || !*enabled || strcmp(enabled, "0") == 0) return nullptr;
+  uint64_t capacity = IPC_TRACE_DEFAULT_EVENTS;
+  if (const char* events = getenv("IPC_TRACE_EVENTS")) {
+    uint64_t requested = strtoull(events, nullptr, 0);
+    if (requested > 0) capacity = requested;
+  }
+  IpcTraceHeader* ring = ipc_trace_create(capacity, 0);
+  if (ring) pthread_atfork(nullptr, nullptr, ipc_trace_after_fork);
+  return ring;
+}
+
+// Returns the id of a channel endpoint in this process's ring, adding it
+// on first use. Call only while tracing.
+inline uint16_t ipc_trace_channel(const char* name, const char* transport,
+                                  ChannelRole role) {
+  IpcTraceHeader* ring = ipc_trace_ring;
+  const char* label = name ? name : "";
+  uint32_t count = ring->channel_count.load(std::memory_order_acquire);
+  if (count > IPC_TRACE_CHANNELS) count = IPC_TRACE_CHANNELS;
+  for (uint32_t i = 0; i < count; ++i) {
+    const IpcTraceChannel& channel = ring->channels[i];
+    if (channel.role == static_cast<uint32_t>(role) &&
+        strncmp(channel.name, label, sizeof(channel.name) - 1) == 0 &&
+        strncmp(channel.transport, transport, sizeof(channel.transport)) ==
+            0) {
+      return static_cast<uint16_t>(i);
+    }
+  }
+  uint32_t index = ring->channel_count.fetch_add(1);
+  if (index >= IPC_TRACE_CHANNELS) return IPC_TRACE_NO_CHANNEL;
+  IpcTraceChannel& channel = ring->channels[index];
+  strncpy(channel.name, label, sizeof(channel.name) - 1);
+  strncpy(channel.transport, transport, sizeof(channel.transport) - 1);
+  channel.role = static_cast<uint32_t>(role);
+  return static_cast<uint16_t>(index);
+}
+
+// Call only while tracing.
+inline void ipc_trace_record(TraceKind kind, uint16_t channel,
+                             uint64_t position, uint64_t count,
+                             uint64_t start, uint64_t end) {
+  IpcTraceHeader* ring = ipc_trace_ring;
+  if (ipc_trace_thread == 0) {
+    ipc_trace_thread = static_cast<uint32_t>(syscall(SYS_gettid));
+  }
+  uint64_t slot = ring->head.fetch_add(1, std::memory_order_relaxed);
+  IpcTraceEvent& event = ipc_trace_events(ring)[slot % ring->capacity];
+  event.start = start;
+  event.end = end;
+  event.position = position;
+  event.count = static_cast<uint32_t>(count);
+  event.thread = ipc_trace_thread;
+  event.channel = channel;
+  event.kind = static_cast<uint8_t>(kind);
+}
+
+#define IPC_TRACING() __builtin_expect(ipc_trace_ring != nullptr, 0)
@@ -0,0 +1,259 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ipc_trace.h"
+
+// Merges the trace rings of every traced process (live or exited) into
+// one Chrome/Perfetto JSON trace. Sends, receives and shm futex calls
+// become slices on the thread that made them, and a flow arrow joins each
+// receive to the send that carried its first record.
+
+struct Span {
+  int32_t pid;
+  uint32_t thread;
+  TraceKind kind;
+  std::string channel;
+  std::string transport;
+  uint64_t start_ns;
+  uint64_t end_ns;
+  uint64_t position;
+  uint32_t count;
+};
+
+struct Process {
+  int32_t pid;
+  std::string name;
+  std::string segment;
+};
+
+// Reads one ring; returns false if the segment is not a trace ring.
+bool load_ring(const std::string& segment, std::vector<Span>& spans,
+               std::vector<Process>& processes) {
+  int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+  if (fd < 0) return false;
+  struct stat st;
+  void* base = MAP_FAILED;
+  if (fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) >= sizeof(IpcTraceHeader)) {
+    base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) return false;
+
+  const IpcTraceHeader* ring = static_cast<const IpcTraceHeader*>(base);
+  size_t size = static_cast<size_t>(st.st_size);
+  if (ring->magic != IPC_TRACE_MAGIC ||
+      size < sizeof(IpcTraceHeader) + ring->capacity * sizeof(IpcTraceEvent)) {
+    munmap(base, size);
+    return false;
+  }
+
+  processes.push_back({ring->pid,
+                       std::string(ring->process,
+                                   strnlen(ring->process,
+                                           sizeof(ring->process))),
+                       segment});
+  uint32_t channels = ring->channel_count.load();
+  if (channels > IPC_TRACE_CHANNELS) channels = IPC_TRACE_CHANNELS;
+  uint64_t head = ring->head.load();
+  uint64_t count = head < ring->capacity ? head : ring->capacity;
+  const IpcTraceEvent* events = ipc_trace_events(ring);
+
+  auto to_ns = [ring](uint64_t ticks) {
+    double offset = (static_cast<double>(ticks) -
+                     static_cast<double>(ring->base_ticks)) /
+                    ring->ticks_per_ns;
+    return static_cast<uint64_t>(static_cast<double>(ring->base_ns) +
+                                 offset);
+  };
+
+  for (uint64_t i = head - count; i < head; ++i) {
+    const IpcTraceEvent& event = events[i % ring->capacity];
+    if (event.kind < static_cast<uint8_t>(TraceKind::SEND) ||
+        event.kind > static_cast<uint8_t>(TraceKind::WAIT) ||
+        event.end < event.start) {
+      continue;
+    }
+    Span span;
+    span.pid = ring->pid;
+    span.thread = event.thread;
+    span.kind = static_cast<TraceKind>(event.kind);
+    if (event.channel < channels) {
+      const IpcTraceChannel& channel = ring->channels[event.channel];
+      span.channel.assign(channel.name,
+                          strnlen(channel.name, sizeof(channel.name)));
+      span.transport.assign(
+          channel.transport,
+          strnlen(channel.transport, sizeof(channel.transport)));
+    }
+    span.start_ns = to_ns(event.start);
+    span.end_ns = to_ns(event.end);
+    span.position = event.position;
+    span.count = event.count;
+    spans.push_back(span);
+  }
+  munmap(base, size);
+  return true;
+}
+
+std::string json_string(const std::string& text) {
+  std::string out = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') out += '\\';
+    if (static_cast<unsigned char>(c) >= 0x20) out += c;
+  }
+  return out + "\"";
+}
+
+const char* span_name(TraceKind kind) {
+  switch (kind) {
+    case TraceKind::SEND:
+      return "send";
+    case TraceKind::RECV:
+      return "recv";
+    case TraceKind::WAKE:
+      return "futex wake";
+    case TraceKind::WAIT:
+      return "futex wait";
+  }
+  return "?";
+}
+
+int main(int argc, char* argv[]) {
+  std::string output = "ipc_trace.json";
+  bool remove = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "o:u")) != -1) {
+    if (opt == 'o') {
+      output = optarg;
+    } else if (opt == 'u') {
+      remove = true;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-o trace.json] [-u]"
+                << std::endl;
+      std::cerr << "  -u removes the trace rings after exporting them"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  // POSIX shared memory objects are files in /dev/shm on Linux.
+  std::vector<Span> spans;
+  std::vector<Process> processes;
+  const char* prefix = IPC_TRACE_PREFIX + 1;
+  DIR* dir = opendir("/dev/shm");
+  if (!dir) {
+    std::cerr << "Failed to list /dev/shm: " << strerror(errno) << std::endl;
+    return 1;
+  }
+  while (struct dirent* entry = readdir(dir)) {
+    if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0) continue;
+    load_ring(std::string("/") + entry->d_name, spans, processes);
+  }
+  closedir(dir);
+  if (processes.empty()) {
+    std::cerr << "No trace rings found; run the processes with IPC_TRACE=1"
+              << std::endl;
+    return 1;
+  }
+
+  std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+    return a.start_ns < b.start_ns;
+  });
+  uint64_t origin = spans.empty() ? 0 : spans.front().start_ns;
+  auto micros = [origin](uint64_t ns) {
+    return std::to_string((ns - origin) / 1000) + "." +
+           std::to_string((ns - origin) % 1000 + 1000).substr(1);
+  };
+
+  std::ofstream out(output);
+  if (!out) {
+    std::cerr << "Failed to write " << output << std::endl;
+    return 1;
+  }
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+  const char* separator = "";
+  for (const Process& process : processes) {
+    out << separator << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":"
+        << process.pid << ",\"args\":{\"name\":"
+        << json_string(process.name + " " + std::to_string(process.pid))
+        << "}}";
+    separator = ",\n";
+  }
+
+  // Sends per channel in time order, for matching receives against.
+  using ChannelKey = std::pair<std::string, std::string>;
+  std::map<ChannelKey, std::vector<const Span*>> sends;
+  for (const Span& span : spans) {
+    std::string label = std::string(span_name(span.kind)) + " " +
+                        (span.channel.empty() ? span.transport : span.channel);
+    out << separator << "{\"ph\":\"X\",\"name\":" << json_string(label)
+        << ",\"cat\":" << json_string(span.transport)
+        << ",\"pid\":" << span.pid << ",\"tid\":" << span.thread
+        << ",\"ts\":" << micros(span.start_ns)
+        << ",\"dur\":" << micros(origin + span.end_ns - span.start_ns)
+        << ",\"args\":{\"position\":" << span.position
+        << ",\"records\":" << span.count << "}}";
+    if (span.kind == TraceKind::SEND && span.count > 0) {
+      sends[{span.channel, span.transport}].push_back(&span);
+    }
+  }
+
+  // A receive links to the latest send, not after it, whose records
+  // cover the receive's first position.
+  uint64_t flows = 0;
+  for (const Span& span : spans) {
+    if (span.kind != TraceKind::RECV || span.count == 0) continue;
+    auto found = sends.find({span.channel, span.transport});
+    if (found == sends.end()) continue;
+    const std::vector<const Span*>& candidates = found->second;
+    auto it = std::upper_bound(candidates.begin(), candidates.end(),
+                               span.end_ns,
+                               [](uint64_t ns, const Span* send) {
+                                 return ns < send->start_ns;
+                               });
+    const Span* match = nullptr;
+    for (int steps = 0; it != candidates.begin() && steps < 4096; ++steps) {
+      const Span* send = *--it;
+      if (send->position <= span.position &&
+          span.position < send->position + send->count) {
+        match = send;
+        break;
+      }
+    }
+    if (!match) continue;
+    ++flows;
+    out << separator << "{\"ph\":\"s\",\"name\":\"record\",\"cat\":\"flow\""
+        << ",\"id\":" << flows << ",\"pid\":" << match->pid
+        << ",\"tid\":" << match->thread
+        << ",\"ts\":" << micros(match->start_ns) << "}";
+    out << separator << "{\"ph\":\"f\",\"bp\":\"e\",\"name\":\"record\""
+        << ",\"cat\":\"flow\",\"id\":" << flows << ",\"pid\":" << span.pid
+        << ",\"tid\":" << span.thread << ",\"ts\":" << micros(span.start_ns)
+        << "}";
+  }
+  out << "\n]}\n";
+  out.close();
+
+  std::cout << "Wrote " << spans.size() << " events from "
+            << processes.size() << " process(es) and " << flows
+            << " flows to " << output << std::endl;
+  if (remove) {
+    for (const Process& process : processes) {
+      shm_unlink(process.segment.c_str());
+    }
+  }
+  return 0;
+}
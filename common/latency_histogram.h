@@ -0,0 +1,175 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <utility>
+
+#include "wire_types.h"
+
+// Log-linear latency histogram in the style of HdrHistogram: values below
+// 32 ns have a bucket each, and every power of two above that is split
+// into 32 sub-buckets, so a percentile is exact to within ~3% from
+// nanoseconds up to the 2^40 ns (~18 min) cap. Recording is a few integer
+// ops and never allocates.
+class LatencyHistogram {
+ public:
+  static constexpr unsigned SUB_BITS = 5;
+  static constexpr unsigned SUB_BUCKETS = 1u << SUB_BITS;
+  static constexpr unsigned MAX_BITS = 40;
+  static constexpr unsigned BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+  void record(uint64_t ns) {
+    if (ns >= (uint64_t{1} << MAX_BITS)) ns = (uint64_t{1} << MAX_BITS) - 1;
+    counts_[index(ns)]++;
+    if (count_ == 0 || ns < min_) min_ = ns;
+    if (ns > max_) max_ = ns;
+    sum_ += ns;
+    count_++;
+  }
+
+  void merge(const LatencyHistogram& other) {
+    if (other.count_ == 0) return;
+    for (unsigned i = 0; i < BUCKETS; ++i) counts_[i] += other.counts_[i];
+    if (count_ == 0 || other.min_ < min_) min_ = other.min_;
+    if (other.max_ > max_) max_ = other.max_;
+    sum_ += other.sum_;
+    count_ += other.count_;
+  }
+
+  void reset() { *this = LatencyHistogram(); }
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return min_; }
+  uint64_t max() const { return max_; }
+  double mean() const {
+    return count_ ? static_cast<double>(sum_) / count_ : 0;
+  }
+
+  // Highest value equivalent to the one at the given percentile (0-100),
+  // capped at the recorded maximum.
+  uint64_t percentile(double percent) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(percent / 100.0 * count_ + 0.5);
+    if (rank == 0) rank = 1;
+    if (rank > count_) rank = count_;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < BUCKETS; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        uint64_t value = highest_equivalent(i);
+        return value < max_ ? value : max_;
+      }
+    }
+    return max_;
+  }
+
+  // One line: count, then min/p50/p90/p99/p99.9/max in microseconds.
+  void print(std::ostream& os, const std::string& label) const {
+    os << label << ": n=" << count_;
+    if (count_ != 0) {
+      std::ios::fmtflags flags = os.flags();
+      std::streamsize precision = os.precision();
+      os << std::fixed << std::setprecision(1) << " min=" << min_ / 1e3
+         << " p50=" << percentile(50) / 1e3 << " p90=" << percentile(90) / 1e3
+         << " p99=" << percentile(99) / 1e3
+         << " p99.9=" << percentile(99.9) / 1e3 << " max=" << max_ / 1e3
+         << " us";
+      os.flags(flags);
+      os.precision(precision);
+    }
+    os << std::endl;
+  }
+
+ private:
+  static unsigned index(uint64_t ns) {
+    if (ns < SUB_BUCKETS) return static_cast<unsigned>(ns);
+    unsigned shift = 63 - __builtin_clzll(ns) - SUB_BITS;
+    return (shift + 1) * SUB_BUCKETS +
+           static_cast<unsigned>((ns >> shift) - SUB_BUCKETS);
+  }
+
+  static uint64_t highest_equivalent(unsigned index) {
+    if (index < SUB_BUCKETS) return index;
+    unsigned shift = index / SUB_BUCKETS - 1;
+    uint64_t base = SUB_BUCKETS + index % SUB_BUCKETS;
+    return ((base + 1) << shift) - 1;
+  }
+
+  std::array<uint64_t, BUCKETS> counts_{};
+  uint64_t count_ = 0;
+  uint64_t min_ = 0;
+  uint64_t max_ = 0;
+  uint64_t sum_ = 0;
+};
+
+// Index of the bucket holding the given quantile (0-1) of a histogram, by
+// nearest rank as in LatencyHistogram::percentile; buckets when it is
+// empty. For the log2 histograms of ipc_metrics and lock_profile.
+inline unsigned histogram_quantile_bucket(const uint64_t* counts,
+                                          unsigned buckets, double quantile) {
+  uint64_t total = 0;
+  for (unsigned b = 0; b < buckets; ++b) total += counts[b];
+  if (total == 0) return buckets;
+  uint64_t rank = static_cast<uint64_t>(std::ceil(quantile * total));
+  if (rank == 0) rank = 1;
+  if (rank > total) rank = total;
+  uint64_t seen = 0;
+  for (unsigned b = 0; b < buckets; ++b) {
+    seen += counts[b];
+    if (seen >= rank) return b;
+  }
+  return buckets - 1;
+}
+
+constexpr uint64_t LATENCY_REPORT_PERIOD_NS = 5000000000ULL;
+
+// Send-to-receive latency of one consumer, from the CLOCK_MONOTONIC stamp
+// the producer put on each record. Keeps the current period and the whole
+// run apart; the caller prints a period summary when due() and the run
+// summary at exit, under whatever lock guards its output.
+class LatencyReport {
+ public:
+  explicit LatencyReport(std::string label,
+                         uint64_t period_ns = LATENCY_REPORT_PERIOD_NS)
+      : label_(std::move(label)),
+        period_ns_(period_ns),
+        next_ns_(wire_timestamp_ns() + period_ns) {}
+
+  // Records the time since stamp_ns and returns it.
+  uint64_t record_since(uint64_t stamp_ns) {
+    uint64_t now = wire_timestamp_ns();
+    uint64_t latency = now > stamp_ns ? now - stamp_ns : 0;
+    period_.record(latency);
+    if (now >= next_ns_) due_ = true;
+    return latency;
+  }
+
+  bool due() const { return due_; }
+
+  void print_period(std::ostream& os) {
+    total_.merge(period_);
+    period_.print(os, "[" + label_ + "] latency, last " +
+                          std::to_string(period_ns_ / 1000000000ULL) + " s");
+    period_.reset();
+    due_ = false;
+    next_ns_ = wire_timestamp_ns() + period_ns_;
+  }
+
+  void print_total(std::ostream& os) {
+    total_.merge(period_);
+    period_.reset();
+    total_.print(os, "[" + label_ + "] latency, whole run");
+  }
+
+ private:
+  std::string label_;
+  uint64_t period_ns_;
+  uint64_t next_ns_;
+  bool due_ = false;
+  LatencyHistogram period_;
+  LatencyHistogram total_;
+};
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <alloca.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Real-time execution profile shared by the demo endpoints. A binary opts
+// in by calling rt_setup() first thing in main(); the profile itself is
+// switched on and shaped from the environment, like IPC_TRACE:
+//
+//   IPC_RT=1              enable (defaults below)
+//   IPC_RT_CPUS=2,3|2-5   restrict the process to these CPUs
+//   IPC_RT_SCHED=fifo:50  fifo:PRIO, rr:PRIO, other, or
+//                         deadline:RUNTIME/DEADLINE/PERIOD in microseconds
+//   IPC_RT_LOCK=0         skip mlockall
+//   IPC_RT_STACK_KB=512   stack prefaulted at setup
+//
+// Setup pins the process, locks current and future memory, prefaults the
+// main stack and switches the scheduling class; threads started later
+// inherit all of it. Shared regions the process creates afterwards are
+// bound to the NUMA node of its first CPU before they are touched, and
+// every shared region it maps is prefaulted (rt_shared_region).
+//
+// SCHED_DEADLINE needs the whole root domain, so it ignores IPC_RT_CPUS;
+// it is set to reset on fork, so forked children run SCHED_OTHER. Locking
+// with MCL_FUTURE makes each thread stack resident in full; without
+// CAP_IPC_LOCK and a finite memlock limit only current memory is locked.
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+constexpr size_t RT_DEFAULT_STACK_BYTES = 512 * 1024;
+constexpr uint64_t RT_SCHED_FLAG_RESET_ON_FORK = 0x01;
+constexpr int RT_MPOL_PREFERRED = 1;
+
+struct RtProfile {
+  std::vector<int> cpus;
+  int policy = SCHED_FIFO;
+  int priority = 50;
+  uint64_t runtime_ns = 0;
+  uint64_t deadline_ns = 0;
+  uint64_t period_ns = 0;
+  bool lock_memory = true;
+  size_t stack_bytes = RT_DEFAULT_STACK_BYTES;
+  int numa_node = -1;  // resolved by rt_apply
+};
+
+// The profile in force, or null; rt_shared_region is one branch on it.
+inline const RtProfile* rt_active = nullptr;
+
+struct RtSchedAttr {
+  uint32_t size;
+  uint32_t sched_policy;
+  uint64_t sched_flags;
+  int32_t sched_nice;
+  uint32_t sched_priority;
+  uint64_t sched_runtime;
+  uint64_t sched_deadline;
+  uint64_t sched_period;
+};
+
+// Parses a taskset-style list such as "0,2-3".
+inline bool rt_parse_cpus(const char* text, std::vector<int>& cpus) {
+  cpus.clear();
+  const char* p = text;
+  while (*p) {
+    char* end = nullptr;
+    long first = std::strtol(p, &end, 10);
+    if (end == p || first < 0 || first >= CPU_SETSIZE) return false;
+    long last = first;
+    if (*end == '-') {
+      p = end + 1;
+      last = std::strtol(p, &end, 10);
+      if (end == p || last < first || last >= CPU_SETSIZE) return false;
+    }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+    if (*end != ',' && *end != '\0') return false;
+    p = *end == ',' ? end + 1 : end;
+  }
+  return !cpus.empty();
+}
+
+inline bool rt_parse_sched(const char* text, RtProfile& profile) {
+  std::string spec = text;
+  std::string kind = spec.substr(0, spec.find(':'));
+  std::string args =
+      spec.find(':') == std::string::npos ? "" : spec.substr(kind.size() + 1);
+  if (kind == "other") {
+    profile.policy = SCHED_OTHER;
+    return true;
+  }
+  if (kind == "fifo" || kind == "rr") {
+    profile.policy = kind == "fifo" ? SCHED_FIFO : SCHED_RR;
+    if (!args.empty()) profile.priority = std::atoi(args.c_str());
+    return profile.priority >= 1 && profile.priority <= 99;
+  }
+  if (kind == "deadline") {
+    unsigned long long runtime = 0, deadline = 0, period = 0;
+    if (std::sscanf(args.c_str(), "%llu/%llu/%llu", &runtime, &deadline,
+                    &period) != 3 ||
+        runtime == 0 || runtime > deadline || deadline > period) {
+      return false;
+    }
+    profile.policy = SCHED_DEADLINE;
+    profile.runtime_ns = runtime * 1000;
+    profile.deadline_ns = deadline * 1000;
+    profile.period_ns = period * 1000;
+    return true;
+  }
+  return false;
+}
+
+// Fills profile from the environment. Returns false when IPC_RT is off;
+// malformed settings are reported and left at their defaults.
+inline bool rt_profile_from_env(RtProfile& profile) {
+  const char* enabled = getenv("IPC_RT");
+  if (!enabled || !*enabled || strcmp(enabled, "0") == 0) return false;
+  if (const char* cpus = getenv("IPC_RT_CPUS")) {
+    if (!rt_parse_cpus(cpus, profile.cpus)) {
+      std::cerr << "[rt] Ignoring IPC_RT_CPUS=" << cpus << std::endl;
+      profile.cpus.clear();
+    }
+  }
+  if (const char* sched = getenv("IPC_RT_SCHED")) {
+    RtProfile parsed = profile;
+    if (rt_parse_sched(sched, parsed)) {
+      profile = parsed;
+    } else {
+      std::cerr << "[rt] Ignoring IPC_RT_SCHED=" << sched << std::endl;
+    }
+  }
+  if (const char* lock = getenv("IPC_RT_LOCK")) {
+    profile.lock_memory = strcmp(lock, "0") != 0;
+  }
+  if (const char* stack = getenv("IPC_RT_STACK_KB")) {
+    profile.stack_bytes = std::strtoul(stack, nullptr, 0) * 1024;
+  }
+  return true;
+}
+
+inline int rt_cpu_node(int cpu) {
+  std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  DIR* dir = opendir(path.c_str());
+  if (!dir) return -1;
+  int node = -1;
+  while (struct dirent* entry = readdir(dir)) {
+    if (strncmp(entry->d_name, "node", 4) == 0 &&
+        entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+      node = std::atoi(entry->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+}
+
+// Touches every page of the next bytes of stack, then returns them; with
+// memory locked they stay resident.
+__attribute__((noinline)) inline void rt_prefault_stack(size_t bytes) {
+  volatile char* stack = static_cast<volatile char*>(alloca(bytes));
+  long page = sysconf(_SC_PAGESIZE);
+  for (size_t offset = 0; offset < bytes; offset += page) stack[offset] = 0;
+}
+
+// Faults in a mapping now rather than on first use.
+inline void rt_prefault(void* base, size_t size, bool writable) {
+#ifdef MADV_POPULATE_WRITE
+  if (madvise(base, size,
+              writable ? MADV_POPULATE_WRITE : MADV_POPULATE_READ) == 0) {
+    return;
+  }
+#endif
+  const volatile char* bytes = static_cast<const volatile char*>(base);
+  long page = sysconf(_SC_PAGESIZE);
+  for (size_t offset = 0; offset < size; offset += page) (void)bytes[offset];
+}
+
+// Called by the shm transports right after mmap. A region this process
+// just created is bound to the profile's node before anything touches it;
+// every region is then prefaulted.
+inline void rt_shared_region(void* base, size_t size, bool created,
+                             bool writable = true) {
+  const RtProfile* profile = rt_active;
+  if (!profile) return;
+  if (created && profile->numa_node >= 0 && profile->numa_node < 64) {
+    unsigned long nodes = 1UL << profile->numa_node;
+    syscall(SYS_mbind, base, size, RT_MPOL_PREFERRED, &nodes,
+            8 * sizeof(nodes), 0);
+  }
+  rt_prefault(base, size, writable);
+}
+
+inline bool rt_pin(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// Applies the profile to the calling process and makes it the active one.
+// Each step that fails is reported and skipped; returns false if any did.
+inline bool rt_apply(const RtProfile& requested, const char* who) {
+  static RtProfile profile;
+  profile = requested;
+  bool ok = true;
+  std::string summary;
+
+  bool deadline = profile.policy == SCHED_DEADLINE;
+  if (!profile.cpus.empty() && !deadline) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : profile.cpus) CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == 0) {
+      summary += " | CPUs " + std::to_string(profile.cpus.front());
+      for (size_t i = 1; i < profile.cpus.size(); ++i) {
+        summary += "," + std::to_string(profile.cpus[i]);
+      }
+    } else {
+      std::cerr << "[rt] " << who << ": Failed to set CPU affinity: "
+                << strerror(errno) << std::endl;
+      ok = false;
+    }
+  }
+  profile.numa_node = rt_cpu_node(
+      profile.cpus.empty() || deadline ? sched_getcpu() : profile.cpus[0]);
+  if (profile.numa_node >= 0) {
+    summary += " | NUMA node " + std::to_string(profile.numa_node);
+  }
+
+  if (profile.lock_memory) {
+    int flags = MCL_CURRENT | MCL_FUTURE;
+    struct rlimit limit;
+    if (geteuid() != 0 && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY) {
+      flags = MCL_CURRENT;
+    }
+    if (mlockall(flags) == 0) {
+      summary += flags & MCL_FUTURE ? " | memory locked"
+                                    : " | current memory locked";
+    } else {
+      std::cerr << "[rt] " << who << ": mlockall failed: " << strerror(errno)
+                << std::endl;
+      ok = false;
+    }
+  }
+  if (profile.stack_bytes > 0) {
+    rt_prefault_stack(profile.stack_bytes);
+    summary += " | " + std::to_string(profile.stack_bytes / 1024) +
+               " KiB stack prefaulted";
+  }
+
+  if (deadline) {
+    RtSchedAttr attr = {};
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_flags = RT_SCHED_FLAG_RESET_ON_FORK;
+    attr.sched_runtime = profile.runtime_ns;
+    attr.sched_deadline = profile.deadline_ns;
+    attr.sched_period = profile.period_ns;
+    if (syscall(SYS_sched_setattr, 0, &attr, 0) == 0) {
+      summary += " | SCHED_DEADLINE " +
+                 std::to_string(profile.runtime_ns / 1000) + "/" +
+                 std::to_string(profile.deadline_ns / 1000) + "/" +
+                 std::to_string(profile.period_ns / 1000) + " us";
+    } else {
+      std::cerr << "[rt] " << who << ": Failed to set SCHED_DEADLINE: "
+                << strerror(errno) << std::endl;
+      ok = false;
+    }
+  } else if (profile.policy != SCHED_OTHER) {
+    struct sched_param param = {};
+    param.sched_priority = profile.priority;
+    if (sched_setscheduler(0, profile.policy, &param) == 0) {
+      summary += std::string(profile.policy == SCHED_FIFO ? " | SCHED_FIFO "
+                                                          : " | SCHED_RR ") +
+                 std::to_string(profile.priority);
+    } else {
+      std::cerr << "[rt] " << who << ": Failed to set real-time priority: "
+                << strerror(errno) << std::endl;
+      ok = false;
+    }
+  }
+
+  rt_active = &profile;
+  std::cout << "[rt] " << who << summary << std::endl;
+  return ok;
+}
+
+// The opt-in for a binary: applies the environment's profile, if any.
+inline void rt_setup(const char* who) {
+  RtProfile profile;
+  if (rt_profile_from_env(profile)) rt_apply(profile, who);
+}
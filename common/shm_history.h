@@ -0,0 +1,287 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#include "rt_profile.h"
+#include "shm_map.h"
+#include "wire_format.h"
+
+constexpr uint32_t SHM_HISTORY_MAGIC = 0x54534948U;
+constexpr uint64_t SHM_HISTORY_CAPACITY = 1ULL << 18;
+constexpr uint32_t SHM_HISTORY_STRIDE = 64;
+
+// Header of a time-series history in shared memory: a ring of the last
+// capacity records, oldest overwritten first, followed by a sparse index
+// holding the timestamp of every stride-th record. One writer appends;
+// any number of readers query it in place without locks or copies.
+//
+// Readers work seqlock-style. claimed is bumped before a record (and its
+// index entry) is written and head after, so a reader takes head, looks
+// at the records, and then asks intact() whether the writer could have
+// reached any of them meanwhile.
+struct alignas(64) ShmHistoryHeader {
+  uint32_t magic;
+  uint32_t stride;
+  uint64_t capacity;
+  WireLayout layout;
+  uint64_t records_offset;
+  uint64_t index_offset;
+  alignas(64) std::atomic<uint64_t> claimed;
+  std::atomic<uint64_t> head;
+};
+
+// Records [begin, begin + size()) of a history, in place: at most two
+// pieces when they wrap around the end of the ring.
+template <typename T>
+struct HistoryView {
+  const T* first = nullptr;
+  size_t first_count = 0;
+  const T* second = nullptr;
+  size_t second_count = 0;
+  uint64_t begin = 0;
+
+  size_t size() const { return first_count + second_count; }
+  bool empty() const { return size() == 0; }
+
+  const T& operator[](size_t i) const {
+    return i < first_count ? first[i] : second[i - first_count];
+  }
+
+  template <typename Visit>
+  void for_each(Visit visit) const {
+    for (size_t i = 0; i < first_count; ++i) visit(first[i]);
+    for (size_t i = 0; i < second_count; ++i) visit(second[i]);
+  }
+};
+
+// T needs a uint64_t timestamp member, non-decreasing from one append to
+// the next (wire_types.h records qualify). The oldest stride records are
+// kept out of query results as headroom, so a reader that takes a moment
+// over a view of the whole history still finds it intact.
+template <typename T>
+class ShmHistory {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "history records are read in place as raw bytes");
+
+ public:
+  ShmHistory() = default;
+  ShmHistory(const ShmHistory&) = delete;
+  ShmHistory& operator=(const ShmHistory&) = delete;
+  ~ShmHistory() { close(); }
+
+  // Creates the history (replacing a stale one) for writing. capacity and
+  // stride are rounded up to powers of two, stride to at most capacity/2.
+  bool create(const char* name, uint64_t capacity = SHM_HISTORY_CAPACITY,
+              uint32_t stride = SHM_HISTORY_STRIDE) {
+    capacity = round_up(capacity < 4 ? 4 : capacity);
+    stride = static_cast<uint32_t>(round_up(stride < 1 ? 1 : stride));
+    if (stride > capacity / 2) stride = static_cast<uint32_t>(capacity / 2);
+
+    uint64_t records = align(sizeof(ShmHistoryHeader));
+    uint64_t index = align(records + capacity * sizeof(T));
+    size_t size = index + capacity / stride * sizeof(uint64_t);
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0) return false;
+    if (ftruncate(fd, size) < 0 || !map(fd, size)) {
+      ::close(fd);
+      shm_unlink(name);
+      return false;
+    }
+    ::close(fd);
+    rt_shared_region(header_, size_, true);
+
+    header_ = new (header_) ShmHistoryHeader();
+    header_->stride = stride;
+    header_->capacity = capacity;
+    header_->layout = wire_layout<T>();
+    header_->records_offset = records;
+    header_->index_offset = index;
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = SHM_HISTORY_MAGIC;
+    return true;
+  }
+
+  // Maps an existing history, read-only unless writable is set (a writer
+  // that restarted appends where it left off). Fails with EPROTO when it
+  // holds records of another layout.
+  bool open(const char* name, bool writable = false) {
+    void* base;
+    if (!shm_map_existing(name, sizeof(ShmHistoryHeader), writable, &base,
+                          &size_)) {
+      return false;
+    }
+    header_ = static_cast<ShmHistoryHeader*>(base);
+    rt_shared_region(header_, size_, false, writable);
+
+    const ShmHistoryHeader* h = header_;
+    if (h->magic != SHM_HISTORY_MAGIC || h->stride == 0 ||
+        h->capacity % h->stride != 0 ||
+        size_ < h->index_offset +
+                    h->capacity / h->stride * sizeof(uint64_t)) {
+      close();
+      errno = EINVAL;
+      return false;
+    }
+    if (h->layout != wire_layout<T>()) {
+      close();
+      errno = EPROTO;
+      return false;
+    }
+    return true;
+  }
+
+  void append(const T& record) {
+    uint64_t position = header_->head.load(std::memory_order_relaxed);
+    header_->claimed.store(position + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(const_cast<T*>(slot(position)), &record, sizeof(T));
+    if (position % header_->stride == 0) {
+      index_entry(position / header_->stride)
+          .store(record.timestamp, std::memory_order_relaxed);
+    }
+    header_->head.store(position + 1, std::memory_order_release);
+  }
+
+  // The newest n records (fewer if the history holds fewer).
+  HistoryView<T> last(uint64_t n) const {
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+    uint64_t oldest = oldest_readable(head);
+    if (n > head - oldest) n = head - oldest;
+    return view(head - n, head);
+  }
+
+  // Records stamped t0 <= timestamp <= t1. Binary search over the index
+  // finds the stride-sized block each bound falls in, then over the
+  // records of that block.
+  HistoryView<T> range(uint64_t t0, uint64_t t1) const {
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+    uint64_t oldest = oldest_readable(head);
+    if (t1 < t0 || oldest == head) return view(head, head);
+    uint64_t begin = partition(oldest, head, [t0](uint64_t ts) {
+      return ts < t0;
+    });
+    uint64_t end = partition(begin, head, [t1](uint64_t ts) {
+      return ts <= t1;
+    });
+    return view(begin, end);
+  }
+
+  // False if the writer may have overwritten a record of the view since
+  // it was taken. Check it after using the records; if it fails, take the
+  // view again.
+  bool intact(const HistoryView<T>& view) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t claimed = header_->claimed.load(std::memory_order_relaxed);
+    return view.empty() || view.begin + header_->capacity >= claimed;
+  }
+
+  uint64_t appended() const {
+    return header_->head.load(std::memory_order_acquire);
+  }
+  uint64_t capacity() const { return header_->capacity; }
+  uint32_t stride() const { return header_->stride; }
+  size_t mapped_bytes() const { return size_; }
+
+  void close() {
+    if (!header_) return;
+    munmap(header_, size_);
+    header_ = nullptr;
+  }
+
+  static void unlink(const char* name) { shm_unlink(name); }
+
+ private:
+  static uint64_t round_up(uint64_t value) {
+    uint64_t result = 1;
+    while (result < value) result <<= 1;
+    return result;
+  }
+
+  static uint64_t align(uint64_t offset) { return (offset + 63) & ~63ULL; }
+
+  bool map(int fd, size_t size) {
+    void* base =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return false;
+    header_ = static_cast<ShmHistoryHeader*>(base);
+    size_ = size;
+    return true;
+  }
+
+  const T* slot(uint64_t position) const {
+    const char* base = reinterpret_cast<const char*>(header_);
+    return reinterpret_cast<const T*>(base + header_->records_offset) +
+           (position & (header_->capacity - 1));
+  }
+
+  std::atomic<uint64_t>& index_entry(uint64_t entry) const {
+    char* base = reinterpret_cast<char*>(header_);
+    uint64_t entries = header_->capacity / header_->stride;
+    return reinterpret_cast<std::atomic<uint64_t>*>(
+        base + header_->index_offset)[entry & (entries - 1)];
+  }
+
+  uint64_t oldest_readable(uint64_t head) const {
+    uint64_t window = header_->capacity - header_->stride;
+    return head > window ? head - window : 0;
+  }
+
+  // First position in [lo, hi) whose timestamp fails before(), or hi.
+  template <typename Before>
+  uint64_t partition(uint64_t lo, uint64_t hi, Before before) const {
+    uint64_t stride = header_->stride;
+    uint64_t first = (lo + stride - 1) / stride;
+    uint64_t last = (hi + stride - 1) / stride;
+    while (first < last) {
+      uint64_t mid = first + (last - first) / 2;
+      if (before(index_entry(mid).load(std::memory_order_relaxed))) {
+        first = mid + 1;
+      } else {
+        last = mid;
+      }
+    }
+    // Indexed records before entry `first` are all before the bound and
+    // the one at it is not, so the answer lies in the block between.
+    if (first * stride < hi) hi = first * stride;
+    if (first > 0 && (first - 1) * stride > lo) lo = (first - 1) * stride;
+    while (lo < hi) {
+      uint64_t mid = lo + (hi - lo) / 2;
+      if (before(slot(mid)->timestamp)) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  HistoryView<T> view(uint64_t begin, uint64_t end) const {
+    HistoryView<T> result;
+    result.begin = begin;
+    uint64_t count = end - begin;
+    if (count == 0) return result;
+    uint64_t index = begin & (header_->capacity - 1);
+    uint64_t before_wrap = header_->capacity - index;
+    result.first = slot(begin);
+    result.first_count = count < before_wrap ? count : before_wrap;
+    result.second = slot(0);
+    result.second_count = count - result.first_count;
+    return result;
+  }
+
+  ShmHistoryHeader* header_ = nullptr;
+  size_t size_ = 0;
+};
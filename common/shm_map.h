@@ -0,0 +1,39 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+
+// Maps the whole of an existing shared memory object, read-only unless
+// writable is set. Fails with EINVAL when it is smaller than min_size;
+// otherwise errno is that of the call that failed.
+inline bool shm_map_existing(const char* name, size_t min_size, bool writable,
+                             void** base, size_t* size) {
+  int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+  if (fd < 0) return false;
+  struct stat st;
+  void* map = MAP_FAILED;
+  int error = 0;
+  if (fstat(fd, &st) < 0) {
+    error = errno;
+  } else if (static_cast<size_t>(st.st_size) < min_size) {
+    error = EINVAL;
+  } else {
+    map = mmap(nullptr, static_cast<size_t>(st.st_size),
+               writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd,
+               0);
+    if (map == MAP_FAILED) error = errno;
+  }
+  ::close(fd);
+  if (error != 0) {
+    errno = error;
+    return false;
+  }
+  *base = map;
+  *size = static_cast<size_t>(st.st_size);
+  return true;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounded single-producer single-consumer queue between two threads of
+// one process. head and tail sit on their own cache lines and each side
+// keeps a cached copy of the other's index, so the shared lines are only
+// read when that copy runs out. A side that finds the queue full or empty
+// spins briefly, then parks on a futex word the other side bumps, making
+// the wake call only when it was asked to.
+template <typename T>
+class SpscQueue {
+ public:
+  // The capacity is rounded up to a power of two.
+  explicit SpscQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  bool try_push(const T& item) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_cache_ > mask_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head - tail_cache_ > mask_) return false;
+    }
+    slots_[head & mask_] = item;
+    head_.store(head + 1, std::memory_order_release);
+    signal(pushed_, consumer_waiting_);
+    return true;
+  }
+
+  // Waits for room. Returns false if the queue was closed meanwhile.
+  bool push(const T& item) {
+    for (unsigned spin = 0;; ++spin) {
+      if (try_push(item)) return true;
+      if (closed_.load(std::memory_order_acquire)) return false;
+      if (spin >= SPIN_LIMIT) {
+        wait(popped_, producer_waiting_, [&] {
+          return head_.load(std::memory_order_relaxed) -
+                     tail_.load(std::memory_order_acquire) <=
+                 mask_;
+        });
+      }
+    }
+  }
+
+  // Moves up to max items out; returns how many.
+  size_t try_pop(T* out, size_t max) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_cache_ == tail) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (head_cache_ == tail) return 0;
+    }
+    size_t count = head_cache_ - tail < max ? head_cache_ - tail : max;
+    for (size_t i = 0; i < count; ++i) out[i] = slots_[(tail + i) & mask_];
+    tail_.store(tail + count, std::memory_order_release);
+    signal(popped_, producer_waiting_);
+    return count;
+  }
+
+  // Waits up to timeout_ms for at least one item. Returns 0 on timeout
+  // and once the queue is closed and drained (see drained()).
+  size_t pop(T* out, size_t max, int timeout_ms) {
+    for (unsigned spin = 0;; ++spin) {
+      size_t count = try_pop(out, max);
+      if (count > 0) return count;
+      if (closed_.load(std::memory_order_acquire)) return try_pop(out, max);
+      if (spin >= SPIN_LIMIT) {
+        bool ready = wait(pushed_, consumer_waiting_, [&] {
+          return head_.load(std::memory_order_acquire) !=
+                     tail_.load(std::memory_order_relaxed) ||
+                 closed_.load(std::memory_order_acquire);
+        }, timeout_ms);
+        if (!ready) return 0;
+      }
+    }
+  }
+
+  // The producer is done; the consumer drains what is left.
+  void close() {
+    closed_.store(true, std::memory_order_release);
+    signal(pushed_, consumer_waiting_);
+    signal(popped_, producer_waiting_);
+  }
+
+  bool drained() const {
+    return closed_.load(std::memory_order_acquire) &&
+           head_.load(std::memory_order_acquire) ==
+               tail_.load(std::memory_order_relaxed);
+  }
+
+  size_t size() const {
+    return head_.load(std::memory_order_relaxed) -
+           tail_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr unsigned SPIN_LIMIT = 256;
+
+  static void signal(std::atomic<uint32_t>& word,
+                     std::atomic<uint32_t>& waiting) {
+    word.fetch_add(1, std::memory_order_release);
+    if (waiting.load()) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word),
+              FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+  }
+
+  // Parks until ready() holds or timeout_ms passes; false on timeout.
+  template <typename Ready>
+  static bool wait(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiting,
+                   Ready ready, int timeout_ms = -1) {
+    waiting.store(1);
+    uint32_t seen = word.load();
+    bool result = true;
+    if (!ready()) {
+      struct timespec timeout = {timeout_ms / 1000,
+                                 (timeout_ms % 1000) * 1000000L};
+      if (syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word),
+                  FUTEX_WAIT_PRIVATE, seen,
+                  timeout_ms < 0 ? nullptr : &timeout, nullptr, 0) < 0 &&
+          errno == ETIMEDOUT) {
+        result = ready();
+      }
+    }
+    waiting.store(0);
+    return result;
+  }
+
+  std::vector<T> slots_;
+  size_t mask_ = 0;
+  alignas(64) std::atomic<uint64_t> head_{0};
+  std::atomic<uint32_t> pushed_{0};
+  std::atomic<uint32_t> consumer_waiting_{0};
+  uint64_t tail_cache_ = 0;  // producer's view of tail_
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  std::atomic<uint32_t> popped_{0};
+  std::atomic<uint32_t> producer_waiting_{0};
+  uint64_t head_cache_ = 0;  // consumer's view of head_
+  alignas(64) std::atomic<bool> closed_{false};
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+// Identity of a record type on the wire. A record struct names itself with
+// static WIRE_ID and WIRE_VERSION members (see wire_types.h); a Channel
+// stamps the layout into the endpoint, or sends it ahead of the records,
+// and the other side refuses to attach when it differs from its own.
+// Types without the members get id and version 0 and are matched by size
+// only.
+struct WireLayout {
+  uint32_t id;
+  uint16_t version;
+  uint16_t size;
+};
+
+static_assert(sizeof(WireLayout) == 8, "WireLayout is sent as 8 bytes");
+
+inline bool operator==(const WireLayout& a, const WireLayout& b) {
+  return a.id == b.id && a.version == b.version && a.size == b.size;
+}
+
+inline bool operator!=(const WireLayout& a, const WireLayout& b) {
+  return !(a == b);
+}
+
+constexpr uint32_t wire_id(char a, char b, char c, char d) {
+  return static_cast<uint32_t>(static_cast<uint8_t>(a)) |
+         static_cast<uint32_t>(static_cast<uint8_t>(b)) << 8 |
+         static_cast<uint32_t>(static_cast<uint8_t>(c)) << 16 |
+         static_cast<uint32_t>(static_cast<uint8_t>(d)) << 24;
+}
+
+template <typename T, typename = void>
+struct WireIdentity {
+  static constexpr uint32_t id = 0;
+  static constexpr uint16_t version = 0;
+};
+
+template <typename T>
+struct WireIdentity<T, std::void_t<decltype(T::WIRE_ID)>> {
+  static constexpr uint32_t id = T::WIRE_ID;
+  static constexpr uint16_t version = T::WIRE_VERSION;
+};
+
+template <typename T>
+constexpr WireLayout wire_layout() {
+  static_assert(sizeof(T) <= UINT16_MAX, "record too large for WireLayout");
+  return WireLayout{WireIdentity<T>::id, WireIdentity<T>::version,
+                    static_cast<uint16_t>(sizeof(T))};
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <time.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "wire_format.h"
+
+// Records exchanged between the demo processes, shared by both ends.
+// Fields are ordered largest first so no compiler padding is left; spare
+// bytes are named reserved fields that start out zero. The asserts pin
+// every offset, so a change that moves a field fails to compile until
+// WIRE_VERSION is bumped and the asserts are updated with it.
+//
+// Every timestamp field holds CLOCK_MONOTONIC nanoseconds taken just
+// before the send (version 3; earlier versions used wall-clock ms). All
+// processes on a host share that clock, so a receiver subtracts it from
+// its own reading to get the latency, and NTP steps cannot skew it.
+
+inline uint64_t wire_timestamp_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+struct SensorData {
+  static constexpr uint32_t WIRE_ID = wire_id('S', 'E', 'N', 'S');
+  static constexpr uint16_t WIRE_VERSION = 3;
+
+  uint64_t timestamp;
+  uint32_t sequence_number;
+  float temperature;
+  float pressure;
+  float voltage;
+  int32_t error_code;
+  uint8_t valid;
+  uint8_t reserved[3] = {};
+};
+
+static_assert(offsetof(SensorData, timestamp) == 0, "SensorData layout");
+static_assert(offsetof(SensorData, sequence_number) == 8, "SensorData layout");
+static_assert(offsetof(SensorData, temperature) == 12, "SensorData layout");
+static_assert(offsetof(SensorData, pressure) == 16, "SensorData layout");
+static_assert(offsetof(SensorData, voltage) == 20, "SensorData layout");
+static_assert(offsetof(SensorData, error_code) == 24, "SensorData layout");
+static_assert(offsetof(SensorData, valid) == 28, "SensorData layout");
+static_assert(sizeof(SensorData) == 32, "SensorData layout");
+
+struct VehicleData {
+  static constexpr uint32_t WIRE_ID = wire_id('V', 'E', 'H', 'C');
+  static constexpr uint16_t WIRE_VERSION = 3;
+
+  uint64_t timestamp;
+  float speed;
+  float rpm;
+  float fuel_level;
+  int16_t gear;
+  uint8_t engine_on;
+  uint8_t reserved = 0;
+};
+
+static_assert(offsetof(VehicleData, timestamp) == 0, "VehicleData layout");
+static_assert(offsetof(VehicleData, speed) == 8, "VehicleData layout");
+static_assert(offsetof(VehicleData, rpm) == 12, "VehicleData layout");
+static_assert(offsetof(VehicleData, fuel_level) == 16, "VehicleData layout");
+static_assert(offsetof(VehicleData, gear) == 20, "VehicleData layout");
+static_assert(offsetof(VehicleData, engine_on) == 22, "VehicleData layout");
+static_assert(sizeof(VehicleData) == 24, "VehicleData layout");
+
+struct DiagnosticEvent {
+  static constexpr uint32_t WIRE_ID = wire_id('D', 'I', 'A', 'G');
+  static constexpr uint16_t WIRE_VERSION = 3;
+
+  uint64_t timestamp;
+  uint32_t dtc_code;
+  uint8_t severity;
+  uint8_t reserved[3] = {};
+  char module_name[32];
+  char description[128];
+};
+
+static_assert(offsetof(DiagnosticEvent, timestamp) == 0,
+              "DiagnosticEvent layout");
+static_assert(offsetof(DiagnosticEvent, dtc_code) == 8,
+              "DiagnosticEvent layout");
+static_assert(offsetof(DiagnosticEvent, severity) == 12,
+              "DiagnosticEvent layout");
+static_assert(offsetof(DiagnosticEvent, module_name) == 16,
+              "DiagnosticEvent layout");
+static_assert(offsetof(DiagnosticEvent, description) == 48,
+              "DiagnosticEvent layout");
+static_assert(sizeof(DiagnosticEvent) == 176, "DiagnosticEvent layout");
+
+// A classic CAN frame. The 3 bytes after data_length keep data on an
+// 8-byte boundary; frames are packed back to back in pipe writes, so the
+// record size stays a multiple of the timestamp alignment.
+struct CANMessage {
+  static constexpr uint32_t WIRE_ID = wire_id('C', 'A', 'N', 'F');
+  static constexpr uint16_t WIRE_VERSION = 3;
+
+  uint32_t can_id;
+  uint8_t data_length;
+  uint8_t reserved[3] = {};
+  uint8_t data[8];
+  uint64_t timestamp;
+};
+
+static_assert(offsetof(CANMessage, can_id) == 0, "CANMessage layout");
+static_assert(offsetof(CANMessage, data_length) == 4, "CANMessage layout");
+static_assert(offsetof(CANMessage, data) == 8, "CANMessage layout");
+static_assert(offsetof(CANMessage, timestamp) == 16, "CANMessage layout");
+static_assert(sizeof(CANMessage) == 24, "CANMessage layout");
+
+// One physical value decoded from a CAN frame by can_gateway. signal_id
+// indexes the gateway's signal table (can_signals.h); timestamp is the
+// stamp of the frame it came from, so readers see end-to-end latency.
+struct CANSignal {
+  static constexpr uint32_t WIRE_ID = wire_id('C', 'S', 'I', 'G');
+  static constexpr uint16_t WIRE_VERSION = 1;
+
+  uint64_t timestamp;
+  double value;
+  uint32_t can_id;
+  uint16_t signal_id;
+  uint16_t reserved = 0;
+};
+
+static_assert(offsetof(CANSignal, timestamp) == 0, "CANSignal layout");
+static_assert(offsetof(CANSignal, value) == 8, "CANSignal layout");
+static_assert(offsetof(CANSignal, can_id) == 16, "CANSignal layout");
+static_assert(offsetof(CANSignal, signal_id) == 20, "CANSignal layout");
+static_assert(sizeof(CANSignal) == 24, "CANSignal layout");
+
+enum class MessageType : uint8_t {
+  DIAGNOSTIC = 1,
+  CONTROL = 2,
+  STATUS = 3,
+  ALERT = 4
+};
+
+// Message queue record. Only the header and the payload bytes its type
+// uses are sent (see message_codec.h), so every message carries the
+// layout version for the receiver to check.
+constexpr uint8_t MESSAGE_WIRE_VERSION = 3;
+
+struct Message {
+  MessageType type;
+  uint8_t version = MESSAGE_WIRE_VERSION;
+  uint16_t reserved = 0;
+  uint32_t sequence;
+  uint64_t timestamp;
+  char payload[200];
+};
+
+static_assert(offsetof(Message, type) == 0, "Message layout");
+static_assert(offsetof(Message, version) == 1, "Message layout");
+static_assert(offsetof(Message, sequence) == 4, "Message layout");
+static_assert(offsetof(Message, timestamp) == 8, "Message layout");
+static_assert(offsetof(Message, payload) == 16, "Message layout");
+static_assert(sizeof(Message) == 216, "Message layout");
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "wire_types.h"
+
+constexpr const char* MQ_NAME = "/automotive_mq";
+constexpr size_t MAX_MSG_SIZE = 1024;
+constexpr size_t MAX_MESSAGES = 10;
+
+constexpr unsigned NUM_MESSAGE_TYPES = 4;
+
+inline const char* message_type_to_string(MessageType type) {
+  switch (type) {
+    case MessageType::DIAGNOSTIC:
+      return "DIAGNOSTIC";
+    case MessageType::CONTROL:
+      return "CONTROL";
+    case MessageType::STATUS:
+      return "STATUS";
+    case MessageType::ALERT:
+      return "ALERT";
+    default:
+      return "UNKNOWN";
+  }
+}
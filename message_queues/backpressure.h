@@ -0,0 +1,125 @@
+#pragma once
+
+#include <mqueue.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+
+#include "message_transport.h"
+#include "queue_metrics.h"
+#include "wire_types.h"
+
+// Time a single mq_timedsend may block before it counts as a stall.
+constexpr long SEND_STALL_TIMEOUT_NS = 5000000;
+
+// Paces a sender against the queue depth instead of overflowing it. An
+// AIMD window bounds the records the sender lets sit in the queue: every
+// send that goes through grows it by 1/window (one record per window's
+// worth of sends), and every stall (a timed send that hit a full queue)
+// halves it. While the depth is at the window the sender sleeps for
+// roughly the time the receiver needs to drain the excess, estimated
+// from the acknowledged receive rate the receivers publish.
+class AdaptivePacer {
+ public:
+  AdaptivePacer(MessageTransport& transport, QueueMetrics* metrics,
+                const std::atomic<bool>& running)
+      : transport_(transport), metrics_(metrics), running_(running) {
+    struct mq_attr attr;
+    capacity_ = transport_.get_attr(attr) && attr.mq_maxmsg > 0
+                    ? static_cast<double>(attr.mq_maxmsg)
+                    : 1.0;
+    window_ = std::max(1.0, capacity_ / 2);
+    last_sample_ns_ = wire_timestamp_ns();
+  }
+
+  // Returns 0 once the record is queued, or -1 with errno set on a send
+  // error. Once the sender is stopping, a record gets one timed attempt.
+  int send(const char* data, size_t len, unsigned priority) {
+    while (true) {
+      uint64_t depth = sample_depth();
+      if (depth >= static_cast<uint64_t>(window_) && running_) {
+        metrics_->throttled.fetch_add(1, std::memory_order_relaxed);
+        wait_for_drain(depth);
+        continue;
+      }
+
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += SEND_STALL_TIMEOUT_NS;
+      if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+
+      uint64_t start = wire_timestamp_ns();
+      if (transport_.send(data, len, priority, &deadline) == 0) {
+        metrics_->sent.fetch_add(1, std::memory_order_relaxed);
+        window_ = std::min(capacity_, window_ + 1.0 / window_);
+        publish_window();
+        return 0;
+      }
+      if (errno != ETIMEDOUT && errno != EAGAIN) return -1;
+
+      metrics_->stalls.fetch_add(1, std::memory_order_relaxed);
+      metrics_->stall_ns.fetch_add(wire_timestamp_ns() - start,
+                                   std::memory_order_relaxed);
+      window_ = std::max(1.0, window_ / 2);
+      publish_window();
+      if (!running_) return -1;
+    }
+  }
+
+  double window() const { return window_; }
+  double ack_rate() const { return ack_rate_; }
+
+ private:
+  uint64_t sample_depth() {
+    struct mq_attr attr;
+    uint64_t depth = transport_.get_attr(attr) && attr.mq_curmsgs > 0
+                         ? static_cast<uint64_t>(attr.mq_curmsgs)
+                         : 0;
+    metrics_->depth.store(depth, std::memory_order_relaxed);
+    store_max(metrics_->max_depth, depth);
+    return depth;
+  }
+
+  // Updates the EWMA of records acknowledged per second, at most every
+  // 10 ms so the estimate is not dominated by timer noise.
+  void update_ack_rate() {
+    uint64_t now = wire_timestamp_ns();
+    uint64_t elapsed = now - last_sample_ns_;
+    if (elapsed < 10000000) return;
+
+    uint64_t acked = metrics_->acked.load(std::memory_order_relaxed);
+    double rate = (acked - last_acked_) * 1e9 / elapsed;
+    ack_rate_ = ack_rate_ == 0 ? rate : 0.8 * ack_rate_ + 0.2 * rate;
+    last_acked_ = acked;
+    last_sample_ns_ = now;
+  }
+
+  void wait_for_drain(uint64_t depth) {
+    update_ack_rate();
+    double excess = static_cast<double>(depth) - window_ + 1;
+    long ns = ack_rate_ > 0 ? static_cast<long>(excess * 1e9 / ack_rate_)
+                            : 1000000;
+    struct timespec pause = {0, std::min(5000000L, std::max(50000L, ns))};
+    nanosleep(&pause, nullptr);
+  }
+
+  void publish_window() {
+    metrics_->window.store(static_cast<uint64_t>(window_),
+                           std::memory_order_relaxed);
+  }
+
+  MessageTransport& transport_;
+  QueueMetrics* metrics_;
+  const std::atomic<bool>& running_;
+  double capacity_;
+  double window_;
+  double ack_rate_ = 0;
+  uint64_t last_acked_ = 0;
+  uint64_t last_sample_ns_;
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <queue>
+#include <vector>
+
+#include "automotive_message.h"
+#include "worker_pool.h"
+
+enum class MissAction { DEGRADE, DROP };
+
+struct DeadlinePolicy {
+  uint32_t relative_ms;
+  MissAction action;
+};
+
+// Stale STATUS is superseded by the next one and a stale CONTROL command
+// must not be applied, so both are dropped. Late ALERT and DIAGNOSTIC
+// messages are still delivered, flagged late so the handler can cut work.
+inline DeadlinePolicy default_deadline(MessageType type) {
+  switch (type) {
+    case MessageType::ALERT:
+      return {100, MissAction::DEGRADE};
+    case MessageType::CONTROL:
+      return {200, MissAction::DROP};
+    case MessageType::STATUS:
+      return {1000, MissAction::DROP};
+    default:
+      return {5000, MissAction::DEGRADE};
+  }
+}
+
+// Bucket b counts misses with lateness below 2^b ms; the last is open.
+constexpr unsigned LATENESS_BUCKETS = 16;
+
+struct DeadlineStats {
+  uint64_t on_time = 0;
+  uint64_t late = 0;
+  uint64_t dropped = 0;
+  uint64_t max_lateness_ms = 0;
+  uint64_t lateness[LATENESS_BUCKETS] = {};
+};
+
+// Buffers received messages and releases them earliest absolute deadline
+// first, where the deadline is the sender timestamp (monotonic ns, taken
+// to ms) plus the per-type relative deadline. Ties keep arrival order.
+class EdfScheduler {
+ public:
+  EdfScheduler() {
+    for (unsigned t = 0; t < NUM_MESSAGE_TYPES; ++t) {
+      policy_[t] = default_deadline(static_cast<MessageType>(t + 1));
+    }
+  }
+
+  void set_deadline(MessageType type, DeadlinePolicy policy) {
+    policy_[static_cast<unsigned>(type) - 1] = policy;
+  }
+
+  const DeadlinePolicy& deadline(MessageType type) const {
+    return policy_[static_cast<unsigned>(type) - 1];
+  }
+
+  void push(const WorkItem& item) {
+    uint64_t due = item.msg.timestamp / 1000000 +
+                   deadline(item.msg.type).relative_ms;
+    heap_.push(Entry{due, arrival_++, item});
+  }
+
+  // Pops the earliest-deadline message still worth delivering, setting
+  // its lateness. Expired messages of DROP types are discarded on the way.
+  bool pop(WorkItem& item, uint64_t now_ms) {
+    while (!heap_.empty()) {
+      Entry entry = heap_.top();
+      heap_.pop();
+
+      unsigned type = static_cast<unsigned>(entry.item.msg.type) - 1;
+      DeadlineStats& stats = stats_[type];
+      if (now_ms <= entry.due_ms) {
+        stats.on_time++;
+        item = entry.item;
+        item.lateness_ms = 0;
+        return true;
+      }
+
+      uint64_t lateness = now_ms - entry.due_ms;
+      record_miss(stats, lateness);
+      if (policy_[type].action == MissAction::DROP) {
+        stats.dropped++;
+        continue;
+      }
+      stats.late++;
+      item = entry.item;
+      item.lateness_ms = static_cast<uint32_t>(lateness);
+      return true;
+    }
+    return false;
+  }
+
+  size_t size() const { return heap_.size(); }
+  bool empty() const { return heap_.empty(); }
+
+  const DeadlineStats& stats(MessageType type) const {
+    return stats_[static_cast<unsigned>(type) - 1];
+  }
+
+  void report(std::ostream& os) const {
+    os << "Deadline report:" << std::endl;
+    for (unsigned t = 0; t < NUM_MESSAGE_TYPES; ++t) {
+      const DeadlineStats& stats = stats_[t];
+      os << "  " << std::setw(11)
+         << message_type_to_string(static_cast<MessageType>(t + 1))
+         << " (" << policy_[t].relative_ms << " ms): on time "
+         << stats.on_time << ", late " << stats.late << ", dropped "
+         << stats.dropped << ", max lateness " << stats.max_lateness_ms
+         << " ms" << std::endl;
+      if (stats.late + stats.dropped == 0) continue;
+
+      os << "    lateness ms:";
+      for (unsigned b = 0; b < LATENESS_BUCKETS; ++b) {
+        if (stats.lateness[b] == 0) continue;
+        os << " <" << (1u << b) << ":" << stats.lateness[b];
+      }
+      os << std::endl;
+    }
+  }
+
+ private:
+  struct Entry {
+    uint64_t due_ms;
+    uint64_t arrival;
+    WorkItem item;
+  };
+
+  struct Later {
+    bool operator()(const Entry& a, const Entry& b) const {
+      if (a.due_ms != b.due_ms) return a.due_ms > b.due_ms;
+      return a.arrival > b.arrival;
+    }
+  };
+
+  static void record_miss(DeadlineStats& stats, uint64_t lateness) {
+    unsigned bucket = 0;
+    while (bucket + 1 < LATENESS_BUCKETS && lateness >= (1ULL << bucket)) {
+      bucket++;
+    }
+    stats.lateness[bucket]++;
+    if (lateness > stats.max_lateness_ms) stats.max_lateness_ms = lateness;
+  }
+
+  DeadlinePolicy policy_[NUM_MESSAGE_TYPES];
+  DeadlineStats stats_[NUM_MESSAGE_TYPES];
+  std::priority_queue<Entry, std::vector<Entry>, Later> heap_;
+  uint64_t arrival_ = 0;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "automotive_message.h"
+#include "message_schema.h"
+
+// Wire encoding for Message records. A single message is sent as its
+// fixed header plus the schema payload of its type only. A batch
+// record starts with MessageBatchHeader and packs several encoded messages
+// at 8-byte aligned offsets, so the receiver can view them in place.
+constexpr size_t MESSAGE_HEADER_SIZE = offsetof(Message, payload);
+constexpr uint8_t MESSAGE_BATCH_MARKER = 0xBA;
+
+struct MessageBatchHeader {
+  uint8_t marker;
+  uint8_t count;
+  uint16_t length;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(MessageBatchHeader) % alignof(Message) == 0,
+              "batch entries must stay aligned for in-place views");
+static_assert(static_cast<uint8_t>(MessageType::ALERT) < MESSAGE_BATCH_MARKER,
+              "batch marker must not collide with a message type");
+
+constexpr size_t align_message(size_t size) {
+  return (size + alignof(Message) - 1) & ~(alignof(Message) - 1);
+}
+
+inline size_t encoded_size(const Message& msg) {
+  return MESSAGE_HEADER_SIZE + payload_size(msg.type);
+}
+
+// Accumulates messages into one record of at most `capacity` bytes. The
+// record priority is the highest message priority it carries.
+class MessageBatch {
+ public:
+  explicit MessageBatch(size_t capacity = MAX_MSG_SIZE)
+      : capacity_(capacity < MAX_MSG_SIZE ? capacity : MAX_MSG_SIZE) {
+    clear();
+  }
+
+  bool add(const Message& msg) {
+    size_t len = encoded_size(msg);
+    size_t offset = align_message(size_);
+    if (offset + len > capacity_ || count_ == UINT8_MAX) return false;
+
+    memcpy(buffer_ + offset, &msg, len);
+    size_ = offset + len;
+    count_++;
+    if (static_cast<unsigned>(msg.type) > priority_) {
+      priority_ = static_cast<unsigned>(msg.type);
+    }
+
+    MessageBatchHeader* header = reinterpret_cast<MessageBatchHeader*>(buffer_);
+    header->count = static_cast<uint8_t>(count_);
+    header->length = static_cast<uint16_t>(size_);
+    return true;
+  }
+
+  void clear() {
+    MessageBatchHeader header = {MESSAGE_BATCH_MARKER, 0, 0, 0};
+    memcpy(buffer_, &header, sizeof(header));
+    size_ = sizeof(header);
+    count_ = 0;
+    priority_ = 0;
+  }
+
+  bool empty() const { return count_ == 0; }
+  unsigned count() const { return count_; }
+  unsigned priority() const { return priority_; }
+  const char* data() const { return buffer_; }
+  size_t size() const { return size_; }
+
+ private:
+  alignas(Message) char buffer_[MAX_MSG_SIZE];
+  size_t capacity_;
+  size_t size_;
+  unsigned count_;
+  unsigned priority_;
+};
+
+// Returns the message encoded at `data` or nullptr if the bytes do not hold
+// a known type with its complete payload in this build's layout version.
+// `data` must be 8-byte aligned.
+inline const Message* view_message(const char* data, size_t bytes) {
+  if (bytes < MESSAGE_HEADER_SIZE) return nullptr;
+  const Message* msg = reinterpret_cast<const Message*>(data);
+  if (msg->version != MESSAGE_WIRE_VERSION) return nullptr;
+  size_t payload = payload_size(msg->type);
+  if (payload == 0 || bytes < MESSAGE_HEADER_SIZE + payload) return nullptr;
+  return msg;
+}
+
+// Calls visit(const Message&) for every message in a received record,
+// single or batched, without copying. Returns the number of messages, or
+// -1 if the record is malformed (messages before the defect are visited).
+template <typename Visitor>
+int for_each_message(const char* record, size_t bytes, Visitor&& visit) {
+  if (bytes >= sizeof(MessageBatchHeader) &&
+      static_cast<uint8_t>(record[0]) == MESSAGE_BATCH_MARKER) {
+    const MessageBatchHeader* header =
+        reinterpret_cast<const MessageBatchHeader*>(record);
+    if (header->length > bytes) return -1;
+
+    size_t offset = sizeof(MessageBatchHeader);
+    for (unsigned i = 0; i < header->count; ++i) {
+      offset = align_message(offset);
+      if (offset >= header->length) return -1;
+      const Message* msg =
+          view_message(record + offset, header->length - offset);
+      if (!msg) return -1;
+      visit(*msg);
+      offset += encoded_size(*msg);
+    }
+    return header->count;
+  }
+
+  const Message* msg = view_message(record, bytes);
+  if (!msg) return -1;
+  visit(*msg);
+  return 1;
+}
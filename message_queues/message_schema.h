@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <ostream>
+#include <type_traits>
+
+#include "automotive_message.h"
+
+// Binary payload layouts, one per MessageType. This list is the single
+// definition: the structs, their size/layout checks, payload_size() and
+// print_payload() are all generated from it. Fields are ordered so that
+// no layout needs padding.
+#define STATUS_PAYLOAD_FIELDS(FIELD) \
+  FIELD(float, speed_kmh)            \
+  FIELD(float, fuel_percent)
+
+#define DIAGNOSTIC_PAYLOAD_FIELDS(FIELD) \
+  FIELD(uint16_t, dtc)                   \
+  FIELD(uint16_t, module)
+
+#define CONTROL_PAYLOAD_FIELDS(FIELD) \
+  FIELD(uint32_t, mode)               \
+  FIELD(uint32_t, param)
+
+#define ALERT_PAYLOAD_FIELDS(FIELD) \
+  FIELD(uint16_t, condition)        \
+  FIELD(uint16_t, level)
+
+#define MESSAGE_SCHEMA(PAYLOAD)                                  \
+  PAYLOAD(DIAGNOSTIC, DiagnosticPayload, DIAGNOSTIC_PAYLOAD_FIELDS) \
+  PAYLOAD(CONTROL, ControlPayload, CONTROL_PAYLOAD_FIELDS)       \
+  PAYLOAD(STATUS, StatusPayload, STATUS_PAYLOAD_FIELDS)          \
+  PAYLOAD(ALERT, AlertPayload, ALERT_PAYLOAD_FIELDS)
+
+enum AlertCondition : uint16_t { ALERT_LOW_FUEL = 1, ALERT_MAINTENANCE = 2 };
+
+#define SCHEMA_DECLARE_FIELD(type, name) type name;
+#define SCHEMA_FIELD_SIZE(type, name) +sizeof(type)
+
+#define SCHEMA_DEFINE_PAYLOAD(tag, Name, FIELDS)                              \
+  struct Name {                                                               \
+    static constexpr MessageType TYPE = MessageType::tag;                     \
+    FIELDS(SCHEMA_DECLARE_FIELD)                                              \
+  };                                                                          \
+  static_assert(std::is_trivially_copyable<Name>::value,                      \
+                #Name " must be trivially copyable");                         \
+  static_assert(sizeof(Name) == 0 FIELDS(SCHEMA_FIELD_SIZE),                  \
+                #Name " must not contain padding");                           \
+  static_assert(sizeof(Name) <= sizeof(Message::payload),                     \
+                #Name " does not fit in Message::payload");                   \
+  static_assert(alignof(Name) <= alignof(Message) &&                          \
+                    offsetof(Message, payload) % alignof(Name) == 0,          \
+                #Name " views would be misaligned");
+
+MESSAGE_SCHEMA(SCHEMA_DEFINE_PAYLOAD)
+
+// Bytes of payload carried by a message of this type, 0 if unknown.
+inline size_t payload_size(MessageType type) {
+  switch (type) {
+#define SCHEMA_SIZE_CASE(tag, Name, FIELDS) \
+  case MessageType::tag:                    \
+    return sizeof(Name);
+    MESSAGE_SCHEMA(SCHEMA_SIZE_CASE)
+#undef SCHEMA_SIZE_CASE
+  }
+  return 0;
+}
+
+// Typed view over a message buffer; no copy is made. Returns nullptr if
+// the message carries a different payload type.
+template <typename Payload>
+const Payload* payload_view(const Message& msg) {
+  if (msg.type != Payload::TYPE) return nullptr;
+  return reinterpret_cast<const Payload*>(msg.payload);
+}
+
+// Sets the message type and returns the payload to fill in place.
+template <typename Payload>
+Payload& payload_init(Message& msg) {
+  msg.type = Payload::TYPE;
+  return *new (msg.payload) Payload();
+}
+
+inline void print_payload(std::ostream& os, const Message& msg) {
+  switch (msg.type) {
+#define SCHEMA_PRINT_FIELD(type, name) \
+  os << (first ? "" : ", ") << #name "=" << +p->name, first = false;
+#define SCHEMA_PRINT_CASE(tag, Name, FIELDS)     \
+  case MessageType::tag: {                       \
+    const Name* p = payload_view<Name>(msg);     \
+    bool first = true;                           \
+    FIELDS(SCHEMA_PRINT_FIELD)                   \
+    return;                                      \
+  }
+    MESSAGE_SCHEMA(SCHEMA_PRINT_CASE)
+#undef SCHEMA_PRINT_CASE
+#undef SCHEMA_PRINT_FIELD
+  }
+  os << "<unknown payload>";
+}
+
+#undef SCHEMA_DEFINE_PAYLOAD
+#undef SCHEMA_FIELD_SIZE
+#undef SCHEMA_DECLARE_FIELD
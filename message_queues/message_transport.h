@@ -0,0 +1,135 @@
+#pragma once
+
+#include <fcntl.h>
+#include <mqueue.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include "automotive_message.h"
+#include "shm_queue.h"
+
+enum class TransportKind { POSIX_MQ, SHM };
+
+inline bool parse_transport(const char* text, TransportKind& kind) {
+  if (strcmp(text, "mq") == 0) {
+    kind = TransportKind::POSIX_MQ;
+  } else if (strcmp(text, "shm") == 0) {
+    kind = TransportKind::SHM;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+inline const char* transport_to_string(TransportKind kind) {
+  return kind == TransportKind::SHM ? "shm" : "mq";
+}
+
+// Thin switch between a kernel POSIX message queue and ShmQueue with the
+// same call shapes, so the sender and receiver loops stay unchanged.
+class MessageTransport {
+ public:
+  MessageTransport() = default;
+  MessageTransport(const MessageTransport&) = delete;
+  MessageTransport& operator=(const MessageTransport&) = delete;
+  ~MessageTransport() { close(); }
+
+  bool create(TransportKind kind, const char* name, bool nonblocking) {
+    kind_ = kind;
+    name_ = name;
+    if (kind_ == TransportKind::SHM) {
+      if (!shm_.create(name)) return false;
+      shm_.set_nonblocking(nonblocking);
+      open_ = true;
+      return true;
+    }
+
+    mq_unlink(name);
+    struct mq_attr attr;
+    attr.mq_flags = 0;
+    attr.mq_maxmsg = MAX_MESSAGES;
+    attr.mq_msgsize = MAX_MSG_SIZE;
+    attr.mq_curmsgs = 0;
+    int flags = O_CREAT | O_WRONLY | (nonblocking ? O_NONBLOCK : 0);
+    mq_ = mq_open(name, flags, 0666, &attr);
+    open_ = mq_ != (mqd_t)-1;
+    return open_;
+  }
+
+  bool open(TransportKind kind, const char* name, bool nonblocking,
+            bool writer = false) {
+    kind_ = kind;
+    name_ = name;
+    if (kind_ == TransportKind::SHM) {
+      if (!shm_.open(name)) return false;
+      shm_.set_nonblocking(nonblocking);
+      open_ = true;
+      return true;
+    }
+
+    int flags = (writer ? O_WRONLY : O_RDONLY) | (nonblocking ? O_NONBLOCK : 0);
+    mq_ = mq_open(name, flags);
+    open_ = mq_ != (mqd_t)-1;
+    return open_;
+  }
+
+  void close() {
+    if (!open_) return;
+    if (kind_ == TransportKind::SHM) {
+      shm_.close();
+    } else {
+      mq_close(mq_);
+    }
+    open_ = false;
+  }
+
+  void unlink() {
+    if (kind_ == TransportKind::SHM) {
+      ShmQueue::unlink(name_.c_str());
+    } else {
+      mq_unlink(name_.c_str());
+    }
+  }
+
+  int send(const char* data, size_t len, unsigned priority,
+           const struct timespec* abs_timeout = nullptr) {
+    if (kind_ == TransportKind::SHM) {
+      return shm_.send(data, len, priority, abs_timeout);
+    }
+    return abs_timeout ? mq_timedsend(mq_, data, len, priority, abs_timeout)
+                       : mq_send(mq_, data, len, priority);
+  }
+
+  ssize_t receive(char* data, size_t len, unsigned* priority,
+                  const struct timespec* abs_timeout = nullptr) {
+    if (kind_ == TransportKind::SHM) {
+      return shm_.receive(data, len, priority, abs_timeout);
+    }
+    return abs_timeout ? mq_timedreceive(mq_, data, len, priority, abs_timeout)
+                       : mq_receive(mq_, data, len, priority);
+  }
+
+  // Fills max/size/current depth; mq_flags is not meaningful for shm.
+  bool get_attr(struct mq_attr& attr) const {
+    if (kind_ == TransportKind::SHM) {
+      attr.mq_flags = 0;
+      attr.mq_maxmsg = shm_.capacity();
+      attr.mq_msgsize = MAX_MSG_SIZE;
+      attr.mq_curmsgs = static_cast<long>(shm_.depth());
+      return true;
+    }
+    return mq_getattr(mq_, &attr) == 0;
+  }
+
+  TransportKind kind() const { return kind_; }
+  mqd_t mq() const { return mq_; }
+
+ private:
+  TransportKind kind_ = TransportKind::POSIX_MQ;
+  std::string name_;
+  mqd_t mq_ = (mqd_t)-1;
+  ShmQueue shm_;
+  bool open_ = false;
+};
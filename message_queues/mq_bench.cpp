@@ -0,0 +1,199 @@
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "automotive_message.h"
+#include "message_codec.h"
+#include "message_transport.h"
+
+constexpr const char* BENCH_QUEUE_NAME = "/automotive_mq_bench";
+
+struct BenchCounters {
+  std::atomic<uint64_t> received;
+};
+
+timespec deadline_after_ms(long ms) {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (ms % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  return ts;
+}
+
+int producer(TransportKind kind, int id, uint64_t count, unsigned batch_limit) {
+  MessageTransport transport;
+  if (!transport.open(kind, BENCH_QUEUE_NAME, false, true)) {
+    std::cerr << "[Producer " << id << "] Failed to open queue: "
+              << strerror(errno) << std::endl;
+    return 1;
+  }
+  Message msg{};
+  MessageBatch batch;
+  for (uint64_t i = 0; i < count; ++i) {
+    msg.type = static_cast<MessageType>(1 + i % NUM_MESSAGE_TYPES);
+    msg.sequence = static_cast<uint32_t>(i);
+    if (batch_limit == 1) {
+      if (transport.send(reinterpret_cast<const char*>(&msg),
+                         encoded_size(msg),
+                         static_cast<unsigned>(msg.type)) < 0) {
+        return 1;
+      }
+      continue;
+    }
+
+    if (!batch.add(msg)) {
+      if (transport.send(batch.data(), batch.size(), batch.priority()) < 0) {
+        return 1;
+      }
+      batch.clear();
+      batch.add(msg);
+    }
+    if (batch.count() >= batch_limit) {
+      if (transport.send(batch.data(), batch.size(), batch.priority()) < 0) {
+        return 1;
+      }
+      batch.clear();
+    }
+  }
+  if (!batch.empty() &&
+      transport.send(batch.data(), batch.size(), batch.priority()) < 0) {
+    return 1;
+  }
+  return 0;
+}
+
+int consumer(TransportKind kind, BenchCounters* counters, uint64_t total) {
+  MessageTransport transport;
+  if (!transport.open(kind, BENCH_QUEUE_NAME, false)) return 1;
+
+  alignas(Message) char buffer[MAX_MSG_SIZE];
+  while (counters->received.load(std::memory_order_relaxed) < total) {
+    unsigned priority;
+    timespec timeout = deadline_after_ms(100);
+    ssize_t bytes = transport.receive(buffer, sizeof(buffer), &priority,
+                                      &timeout);
+    if (bytes < 0) {
+      if (errno == ETIMEDOUT || errno == EINTR) continue;
+      return 1;
+    }
+    int messages = for_each_message(buffer, static_cast<size_t>(bytes),
+                                    [](const Message&) {});
+    if (messages < 0) return 1;
+    counters->received.fetch_add(static_cast<uint64_t>(messages),
+                                 std::memory_order_relaxed);
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  TransportKind kind = TransportKind::SHM;
+  int producers = 1;
+  int consumers = 1;
+  uint64_t count = 1000000;
+  unsigned batch_limit = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:p:c:n:b:")) != -1) {
+    switch (opt) {
+      case 't':
+        if (!parse_transport(optarg, kind)) opt = '?';
+        break;
+      case 'p':
+        producers = std::atoi(optarg);
+        break;
+      case 'c':
+        consumers = std::atoi(optarg);
+        break;
+      case 'n':
+        count = std::strtoull(optarg, nullptr, 0);
+        break;
+      case 'b':
+        batch_limit = static_cast<unsigned>(std::atoi(optarg));
+        if (batch_limit == 0) opt = '?';
+        break;
+    }
+    if (opt == '?') {
+      std::cerr << "Usage: " << argv[0]
+                << " [-t mq|shm] [-p producers] [-c consumers] [-n messages]"
+                   " [-b batch]"
+                << std::endl;
+      return 1;
+    }
+  }
+  if (producers < 1 || consumers < 1 || count == 0) {
+    std::cerr << "Producer, consumer and message counts must be positive"
+              << std::endl;
+    return 1;
+  }
+
+  MessageTransport queue;
+  if (!queue.create(kind, BENCH_QUEUE_NAME, false)) {
+    std::cerr << "Failed to create queue: " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  BenchCounters* counters = static_cast<BenchCounters*>(
+      mmap(nullptr, sizeof(BenchCounters), PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+  if (counters == MAP_FAILED) {
+    std::cerr << "Failed to map counters: " << strerror(errno) << std::endl;
+    queue.unlink();
+    return 1;
+  }
+  new (counters) BenchCounters();
+
+  uint64_t per_producer = count / producers;
+  uint64_t total = per_producer * producers;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<pid_t> pids;
+  for (int c = 0; c < consumers; ++c) {
+    pid_t pid = fork();
+    if (pid == 0) _exit(consumer(kind, counters, total));
+    if (pid > 0) pids.push_back(pid);
+  }
+  for (int p = 0; p < producers; ++p) {
+    pid_t pid = fork();
+    if (pid == 0) _exit(producer(kind, p, per_producer, batch_limit));
+    if (pid > 0) pids.push_back(pid);
+  }
+
+  bool failed = pids.size() != static_cast<size_t>(producers + consumers);
+  for (pid_t pid : pids) {
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = true;
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  queue.close();
+  queue.unlink();
+
+  std::cout << "Transport: " << transport_to_string(kind)
+            << " | producers: " << producers << " | consumers: " << consumers
+            << " | batch: " << batch_limit << std::endl;
+  std::cout << "Messages: " << counters->received.load() << " in " << seconds
+            << " s (" << static_cast<uint64_t>(total / seconds) << " msg/s)"
+            << std::endl;
+  munmap(counters, sizeof(BenchCounters));
+
+  if (failed) {
+    std::cerr << "One or more benchmark processes failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}
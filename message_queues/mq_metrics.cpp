@@ -0,0 +1,96 @@
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "automotive_message.h"
+#include "latency_histogram.h"
+#include "queue_metrics.h"
+
+std::atomic<bool> running{true};
+
+void signal_handler(int signal) {
+  if (signal == SIGINT || signal == SIGTERM) {
+    running = false;
+  }
+}
+
+// Upper bound in ms of the bucket holding the given quantile, or 0 when
+// nothing was recorded.
+uint64_t time_in_queue_quantile(const uint64_t* counts, double quantile) {
+  unsigned b =
+      histogram_quantile_bucket(counts, TIME_IN_QUEUE_BUCKETS, quantile);
+  return b == TIME_IN_QUEUE_BUCKETS ? 0 : 1ULL << b;
+}
+
+int main(int argc, char* argv[]) {
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+
+  const char* queue_name = MQ_NAME;
+  int interval_ms = 1000;
+  int opt;
+  while ((opt = getopt(argc, argv, "q:i:")) != -1) {
+    if (opt == 'q') {
+      queue_name = optarg;
+    } else if (opt == 'i' && std::atoi(optarg) > 0) {
+      interval_ms = std::atoi(optarg);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-q name] [-i interval_ms]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  QueueMetricsMap metrics;
+  if (!metrics.open(queue_name)) {
+    std::cerr << "Failed to open metrics for " << queue_name << ": "
+              << strerror(errno) << std::endl;
+    std::cerr << "Make sure the sender is running first" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Queue " << queue_name << " (capacity " << metrics->capacity
+            << ")" << std::endl;
+  std::cout << std::setw(7) << "depth" << std::setw(7) << "max"
+            << std::setw(7) << "window" << std::setw(10) << "sent/s"
+            << std::setw(10) << "acked/s" << std::setw(10) << "throttle"
+            << std::setw(8) << "stalls" << std::setw(9) << "q p50ms"
+            << std::setw(9) << "q p99ms" << std::setw(9) << "q maxms"
+            << std::endl;
+
+  uint64_t last_sent = metrics->sent.load();
+  uint64_t last_acked = metrics->acked.load();
+  while (running) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+
+    uint64_t counts[TIME_IN_QUEUE_BUCKETS];
+    for (unsigned b = 0; b < TIME_IN_QUEUE_BUCKETS; ++b) {
+      counts[b] = metrics->time_in_queue[b].load(std::memory_order_relaxed);
+    }
+    uint64_t sent = metrics->sent.load();
+    uint64_t acked = metrics->acked.load();
+    double seconds = interval_ms / 1000.0;
+
+    std::cout << std::setw(7) << metrics->depth.load() << std::setw(7)
+              << metrics->max_depth.load() << std::setw(7)
+              << metrics->window.load() << std::setw(10)
+              << static_cast<uint64_t>((sent - last_sent) / seconds)
+              << std::setw(10)
+              << static_cast<uint64_t>((acked - last_acked) / seconds)
+              << std::setw(10) << metrics->throttled.load() << std::setw(8)
+              << metrics->stalls.load() << std::setw(9)
+              << time_in_queue_quantile(counts, 0.5) << std::setw(9)
+              << time_in_queue_quantile(counts, 0.99) << std::setw(9)
+              << metrics->max_time_in_queue_ms.load() << std::endl;
+    last_sent = sent;
+    last_acked = acked;
+  }
+  return 0;
+}
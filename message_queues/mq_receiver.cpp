@@ -1,14 +1,31 @@
-#include <mqueue.h>
+#include <strings.h>
 #include <unistd.h>
 
 #include <atomic>
+#include <chrono>
 #include <csignal>
 #include <cstring>
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
-constexpr const char* MQ_NAME = "/automotive_mq";
-constexpr size_t MAX_MSG_SIZE = 256;
+#include "automotive_message.h"
+#include "edf_scheduler.h"
+#include "ipc_metrics.h"
+#include "latency_histogram.h"
+#include "message_codec.h"
+#include "message_schema.h"
+#include "message_transport.h"
+#include "queue_metrics.h"
+#include "queue_set.h"
+#include "rt_profile.h"
+#include "worker_pool.h"
 
 std::atomic<bool> running{true};
 
@@ -18,123 +35,469 @@ void signal_handler(int signal) {
   }
 }
 
-enum class MessageType : uint8_t {
-  DIAGNOSTIC = 1,
-  CONTROL = 2,
-  STATUS = 3,
-  ALERT = 4
+struct SequenceState {
+  uint32_t last_sequence = 0;
+  bool first_message = true;
 };
 
-struct Message {
-  MessageType type;
-  uint32_t sequence;
-  uint64_t timestamp;
-  char payload[200];
+// Simulated handler cost for DIAGNOSTIC messages (-c), to show how the
+// worker pool keeps slow handlers from delaying alerts.
+int diagnostic_cost_ms = 0;
+std::mutex output_mutex;
+
+void check_sequence(SequenceState& state, ChannelMetrics& stats,
+                    const Message& msg) {
+  if (!state.first_message && msg.sequence != state.last_sequence + 1) {
+    if (msg.sequence > state.last_sequence) {
+      stats.gap(msg.sequence - state.last_sequence - 1);
+    }
+    std::lock_guard<std::mutex> lock(output_mutex);
+    std::cout << "\n[WARNING] Missed messages! Expected: "
+              << (state.last_sequence + 1) << ", Got: " << msg.sequence
+              << std::endl;
+  }
+  state.first_message = false;
+  state.last_sequence = msg.sequence;
+}
+
+// A message delivered past its deadline is degraded: the simulated
+// diagnostic work is skipped and the output is flagged.
+void handle_message(const WorkItem& item) {
+  const Message& msg = item.msg;
+  if (msg.type == MessageType::DIAGNOSTIC && diagnostic_cost_ms > 0 &&
+      item.lateness_ms == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(diagnostic_cost_ms));
+  }
+
+  std::lock_guard<std::mutex> lock(output_mutex);
+  if (!item.source->empty()) {
+    std::cout << "[" << *item.source << "] ";
+  }
+  std::cout << "[SEQ: " << std::setw(5) << msg.sequence << "] "
+            << "Type: " << std::setw(11) << message_type_to_string(msg.type)
+            << " | " << "Priority: " << item.priority << " | "
+            << "Payload: ";
+  print_payload(std::cout, msg);
+
+  if (msg.type == MessageType::ALERT) {
+    std::cout << " [!]";
+  }
+  if (item.lateness_ms > 0) {
+    std::cout << " [LATE +" << item.lateness_ms << " ms]";
+  }
+
+  std::cout << std::endl;
+}
+
+// Messages kept waiting in the EDF scheduler before the receive loop
+// stops draining the queues and dispatches.
+constexpr size_t EDF_WINDOW = 256;
+
+// Where unpacked messages go: to the worker pool or an inline handler,
+// optionally ordered by the EDF scheduler first.
+struct Delivery {
+  WorkerPool* pool = nullptr;
+  EdfScheduler* edf = nullptr;
 };
 
-const char* message_type_to_string(MessageType type) {
-  switch (type) {
-    case MessageType::DIAGNOSTIC:
-      return "DIAGNOSTIC";
-    case MessageType::CONTROL:
-      return "CONTROL";
-    case MessageType::STATUS:
-      return "STATUS";
-    case MessageType::ALERT:
-      return "ALERT";
-    default:
-      return "UNKNOWN";
+// On the senders' timestamp clock, for comparing against deadlines.
+uint64_t now_ms() { return wire_timestamp_ns() / 1000000; }
+
+void deliver(const Delivery& delivery, const WorkItem& item) {
+  if (delivery.pool) {
+    delivery.pool->submit(item);
+  } else {
+    handle_message(item);
   }
 }
 
-int main() {
-  std::signal(SIGINT, signal_handler);
-  std::signal(SIGTERM, signal_handler);
+void dispatch_next(const Delivery& delivery) {
+  WorkItem item;
+  if (delivery.edf->pop(item, now_ms())) deliver(delivery, item);
+}
 
-  std::cout << "Waiting for message queue to be created..." << std::endl;
+// Releases whatever the scheduler still holds and waits for the pool.
+// Queued work refers to the caller's source names, so this must run
+// before they go out of scope.
+void finish(const Delivery& delivery) {
+  while (delivery.edf && !delivery.edf->empty()) dispatch_next(delivery);
+  if (delivery.pool) delivery.pool->stop();
+}
+
+// Acks the record to the sender's pacer and records how long each of its
+// messages waited since the sender stamped it.
+void record_time_in_queue(QueueMetrics& metrics, const Message& msg,
+                          uint64_t received_ns) {
+  uint64_t waited = received_ns > msg.timestamp
+                        ? (received_ns - msg.timestamp) / 1000000
+                        : 0;
+  metrics.time_in_queue[time_in_queue_bucket(waited)].fetch_add(
+      1, std::memory_order_relaxed);
+  store_max(metrics.max_time_in_queue_ms, waited);
+}
+
+// Unpacks a single or batched record in place and delivers each message,
+// or queues it for EDF dispatch. Returns the number of messages the
+// record carried.
+int process_record(const std::string& source, SequenceState& state,
+                   ChannelMetrics& stats, LatencyReport& latency,
+                   const char* buffer, ssize_t bytes_read,
+                   unsigned int priority, const Delivery& delivery,
+                   QueueMetrics* metrics) {
+  uint64_t received_ns = wire_timestamp_ns();
+  int count = for_each_message(
+      buffer, static_cast<size_t>(bytes_read), [&](const Message& msg) {
+        check_sequence(state, stats, msg);
+        stats.latency_ns(latency.record_since(msg.timestamp));
+        if (metrics) record_time_in_queue(*metrics, msg, received_ns);
+        WorkItem item;
+        memcpy(&item.msg, &msg, encoded_size(msg));
+        item.priority = priority;
+        item.source = &source;
+        item.lateness_ms = 0;
+        if (delivery.edf) {
+          delivery.edf->push(item);
+        } else {
+          deliver(delivery, item);
+        }
+      });
+  if (metrics) metrics->acked.fetch_add(1, std::memory_order_relaxed);
+  if (latency.due()) {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    latency.print_period(std::cout);
+  }
+  if (count < 0) {
+    stats.drop();
+    std::lock_guard<std::mutex> lock(output_mutex);
+    std::cout << "\n[WARNING] Received incomplete or incompatible message"
+              << std::endl;
+    return 0;
+  }
+  stats.record(static_cast<uint64_t>(count),
+               static_cast<uint64_t>(bytes_read));
+  return count;
+}
 
-  mqd_t mq = (mqd_t)-1;
+// Single shm queue: blocks on the queue's futex with a timeout so the
+// running flag is still observed. With EDF messages pending it only polls.
+int receive_shm(const char* name, const Delivery& delivery) {
+  MessageTransport transport;
+  bool opened = false;
   for (int i = 0; i < 10 && running; ++i) {
-    mq = mq_open(MQ_NAME, O_RDONLY | O_NONBLOCK);
-    if (mq != (mqd_t)-1) break;
+    opened = transport.open(TransportKind::SHM, name, false);
+    if (opened) break;
     sleep(1);
   }
 
-  if (mq == (mqd_t)-1) {
+  if (!opened) {
     std::cerr << "Failed to open message queue: " << strerror(errno)
               << std::endl;
     std::cerr << "Make sure the sender is running first" << std::endl;
     return 1;
   }
 
-  struct mq_attr attr;
-  if (mq_getattr(mq, &attr) < 0) {
-    std::cerr << "Failed to get queue attributes: " << strerror(errno)
-              << std::endl;
-    mq_close(mq);
-    return 1;
-  }
+  // Without the metrics segment (older sender) the receiver still works,
+  // it just does not ack or record time in queue.
+  QueueMetricsMap metrics;
+  metrics.open(name);
+  ChannelMetrics stats;
+  stats.attach(name, ChannelRole::READER, "shm");
+  LatencyReport latency(name);
 
-  std::cout << "Connected to message queue" << std::endl;
+  struct mq_attr attr;
+  transport.get_attr(attr);
+  std::cout << "Connected to message queue (transport: shm)" << std::endl;
   std::cout << "Queue info: max_msgs=" << attr.mq_maxmsg
             << ", max_msgsize=" << attr.mq_msgsize << std::endl;
   std::cout << "Receiving messages... (Press Ctrl+C to stop)" << std::endl;
   std::cout << std::string(80, '-') << std::endl;
 
-  char buffer[MAX_MSG_SIZE];
-  uint32_t last_sequence = 0;
+  alignas(Message) char buffer[MAX_MSG_SIZE];
+  const std::string no_source;
+  SequenceState state;
   int messages_received = 0;
-  bool first_message = true;
+  int records_received = 0;
 
   while (running) {
-    unsigned int priority;
-    ssize_t bytes_read = mq_receive(mq, buffer, MAX_MSG_SIZE, &priority);
-
-    if (bytes_read < 0) {
-      if (errno == EAGAIN) {
-        usleep(100000);
-        continue;
-      } else if (errno == EINTR) {
-        continue;
-      } else {
-        std::cerr << "\nError receiving message: " << strerror(errno)
-                  << std::endl;
-        break;
+    bool backlog = delivery.edf && !delivery.edf->empty();
+    struct timespec timeout = {0, 0};
+    if (!backlog) {
+      clock_gettime(CLOCK_REALTIME, &timeout);
+      timeout.tv_nsec += 100000000;
+      if (timeout.tv_nsec >= 1000000000) {
+        timeout.tv_sec++;
+        timeout.tv_nsec -= 1000000000;
       }
     }
 
-    if (bytes_read < static_cast<ssize_t>(sizeof(Message))) {
-      std::cout << "\n[WARNING] Received incomplete message" << std::endl;
-      continue;
+    unsigned int priority;
+    ssize_t bytes_read =
+        transport.receive(buffer, MAX_MSG_SIZE, &priority, &timeout);
+    if (bytes_read >= 0) {
+      records_received++;
+      messages_received +=
+          process_record(no_source, state, stats, latency, buffer,
+                         bytes_read, priority, delivery, metrics.get());
+      if (!delivery.edf || delivery.edf->size() < EDF_WINDOW) continue;
+    } else if (errno == ETIMEDOUT || errno == EINTR) {
+      if (!backlog) continue;
+    } else {
+      std::cerr << "\nError receiving message: " << strerror(errno)
+                << std::endl;
+      break;
     }
 
-    Message* msg = reinterpret_cast<Message*>(buffer);
-    messages_received++;
+    dispatch_next(delivery);
+  }
+
+  finish(delivery);
+  std::cout << "\nReceiver stopped (received " << messages_received
+            << " messages in " << records_received << " records)"
+            << std::endl;
+  latency.print_total(std::cout);
+  return 0;
+}
+
+int receive_mq(const std::vector<std::pair<std::string, unsigned>>& queues,
+               DrainPolicy policy, const Delivery& delivery) {
+  // SIGINT/SIGTERM stay blocked except inside epoll_pwait, so a signal
+  // can never slip in between checking `running` and going to sleep.
+  sigset_t blocked;
+  sigset_t wait_mask;
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGINT);
+  sigaddset(&blocked, SIGTERM);
+  sigprocmask(SIG_BLOCK, &blocked, &wait_mask);
+
+  std::unique_ptr<QueueSet> opened;
+  for (int i = 0; i < 10 && running; ++i) {
+    opened.reset(new QueueSet(policy));
+    for (const auto& queue : queues) {
+      if (!opened->add(queue.first, queue.second)) break;
+    }
+    if (opened->size() == queues.size()) break;
+    sleep(1);
+  }
 
-    if (!first_message && msg->sequence != last_sequence + 1) {
-      std::cout << "\n[WARNING] Missed messages! Expected: "
-                << (last_sequence + 1) << ", Got: " << msg->sequence
+  if (!opened || opened->size() != queues.size()) {
+    std::cerr << "Failed to open message queue: " << strerror(errno)
+              << std::endl;
+    std::cerr << "Make sure the sender is running first" << std::endl;
+    return 1;
+  }
+
+  QueueSet& queue_set = *opened;
+  std::vector<QueueMetricsMap> metrics(queue_set.size());
+  std::vector<ChannelMetrics> stats(queue_set.size());
+  std::vector<LatencyReport> latency;
+  for (size_t i = 0; i < queue_set.size(); ++i) {
+    metrics[i].open(queue_set[i].name.c_str());
+    stats[i].attach(queue_set[i].name.c_str(), ChannelRole::READER, "mq");
+    latency.emplace_back(queue_set[i].name);
+  }
+  std::cout << "Connected to " << queues.size() << " message queue(s), "
+            << (policy == DrainPolicy::STRICT ? "strict-priority"
+                                              : "weighted-fair")
+            << " draining" << std::endl;
+  for (size_t i = 0; i < queue_set.size(); ++i) {
+    struct mq_attr attr;
+    queue_set[i].transport.get_attr(attr);
+    std::cout << "Queue " << queue_set[i].name
+              << ": max_msgs=" << attr.mq_maxmsg
+              << ", max_msgsize=" << attr.mq_msgsize
+              << ", weight=" << queue_set[i].weight << std::endl;
+  }
+  std::cout << "Receiving messages... (Press Ctrl+C to stop)" << std::endl;
+  std::cout << std::string(80, '-') << std::endl;
+
+  alignas(Message) char buffer[MAX_MSG_SIZE];
+  const std::string no_source;
+  std::vector<SequenceState> states(queue_set.size());
+  int messages_received = 0;
+  int records_received = 0;
+
+  // With EDF the loop drains every ready queue into the scheduler (up to
+  // EDF_WINDOW messages) and dispatches one message whenever nothing else
+  // is immediately available.
+  while (running) {
+    bool backlog = delivery.edf && !delivery.edf->empty();
+    unsigned int priority;
+    ssize_t bytes_read;
+    int index = queue_set.receive(buffer, MAX_MSG_SIZE, &bytes_read,
+                                  &priority, &wait_mask, backlog ? 0 : -1);
+    if (index >= 0) {
+      records_received++;
+      messages_received += process_record(
+          queue_set.size() > 1 ? queue_set[index].name : no_source,
+          states[index], stats[index], latency[index], buffer, bytes_read,
+          priority, delivery, metrics[index].get());
+      if (!delivery.edf || delivery.edf->size() < EDF_WINDOW) continue;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno != EAGAIN) {
+      std::cerr << "\nError receiving message: " << strerror(errno)
                 << std::endl;
+      break;
     }
-    first_message = false;
-    last_sequence = msg->sequence;
 
-    std::cout << "[SEQ: " << std::setw(5) << msg->sequence << "] "
-              << "Type: " << std::setw(11) << message_type_to_string(msg->type)
-              << " | " << "Priority: " << priority << " | "
-              << "Payload: " << msg->payload;
+    dispatch_next(delivery);
+  }
 
-    if (msg->type == MessageType::ALERT) {
-      std::cout << " [!]";
+  finish(delivery);
+  std::cout << "\nReceiver stopped (received " << messages_received
+            << " messages in " << records_received << " records)"
+            << std::endl;
+  for (size_t i = 0; i < queue_set.size(); ++i) {
+    std::cout << "  " << queue_set[i].name << ": " << queue_set[i].received
+              << " records" << std::endl;
+  }
+  for (LatencyReport& report : latency) report.print_total(std::cout);
+  return 0;
+}
+
+// Parses "type=ms[:drop|degrade]", e.g. "status=500:drop".
+bool parse_deadline(EdfScheduler& edf, const char* spec) {
+  const char* equals = strchr(spec, '=');
+  if (!equals) return false;
+
+  std::string name(spec, static_cast<size_t>(equals - spec));
+  for (unsigned t = 1; t <= NUM_MESSAGE_TYPES; ++t) {
+    MessageType type = static_cast<MessageType>(t);
+    if (strcasecmp(name.c_str(), message_type_to_string(type)) != 0) continue;
+
+    char* end = nullptr;
+    DeadlinePolicy policy = edf.deadline(type);
+    policy.relative_ms = static_cast<uint32_t>(strtoul(equals + 1, &end, 10));
+    if (end == equals + 1) return false;
+    if (strcmp(end, ":drop") == 0) {
+      policy.action = MissAction::DROP;
+    } else if (strcmp(end, ":degrade") == 0) {
+      policy.action = MissAction::DEGRADE;
+    } else if (*end != '\0') {
+      return false;
     }
+    edf.set_deadline(type, policy);
+    return true;
+  }
+  return false;
+}
 
-    std::cout << std::endl;
+void print_usage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " [-t mq|shm] [-p strict|fair] [-q name[:weight]]..."
+               " [-w workers] [-c diag_cost_ms] [-e]"
+               " [-d type=ms[:drop|degrade]]"
+            << std::endl;
+  std::cerr << "  Queues are ranked in the order given; multiple queues"
+               " require the mq transport"
+            << std::endl;
+  std::cerr << "  -w N hands messages to N worker threads plus a reserved"
+               " ALERT/CONTROL worker (default: handle inline)"
+            << std::endl;
+  std::cerr << "  -e dispatches earliest deadline first; -d overrides a"
+               " type's deadline and implies -e"
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+  rt_setup("mq_receiver");
+
+  TransportKind transport_kind = TransportKind::POSIX_MQ;
+  DrainPolicy policy = DrainPolicy::STRICT;
+  std::vector<std::pair<std::string, unsigned>> queues;
+  int workers = 0;
+  std::unique_ptr<EdfScheduler> edf;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:p:q:w:c:ed:")) != -1) {
+    switch (opt) {
+      case 't':
+        if (!parse_transport(optarg, transport_kind)) opt = '?';
+        break;
+      case 'p':
+        if (strcmp(optarg, "strict") == 0) {
+          policy = DrainPolicy::STRICT;
+        } else if (strcmp(optarg, "fair") == 0) {
+          policy = DrainPolicy::WEIGHTED_FAIR;
+        } else {
+          opt = '?';
+        }
+        break;
+      case 'q': {
+        std::string spec = optarg;
+        size_t colon = spec.find(':');
+        unsigned weight = 1;
+        if (colon != std::string::npos) {
+          weight = static_cast<unsigned>(std::atoi(spec.c_str() + colon + 1));
+          spec.resize(colon);
+        }
+        if (spec.empty() || weight == 0) opt = '?';
+        queues.push_back({spec, weight});
+        break;
+      }
+      case 'w':
+        workers = std::atoi(optarg);
+        if (workers < 0) opt = '?';
+        break;
+      case 'c':
+        diagnostic_cost_ms = std::atoi(optarg);
+        break;
+      case 'e':
+        if (!edf) edf.reset(new EdfScheduler());
+        break;
+      case 'd':
+        if (!edf) edf.reset(new EdfScheduler());
+        if (!parse_deadline(*edf, optarg)) opt = '?';
+        break;
+    }
+    if (opt == '?') {
+      print_usage(argv[0]);
+      return 1;
+    }
   }
+  if (queues.empty()) queues.push_back({MQ_NAME, 1});
 
-  mq_close(mq);
+  if (transport_kind == TransportKind::SHM && queues.size() != 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
 
-  std::cout << "\nReceiver stopped (received " << messages_received
-            << " messages)" << std::endl;
+  // Workers start with SIGINT/SIGTERM blocked so the signals always reach
+  // the receive loop.
+  std::unique_ptr<WorkerPool> pool;
+  if (workers > 0) {
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    pool.reset(new WorkerPool(static_cast<unsigned>(workers), handle_message));
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+  }
 
-  return 0;
+  std::cout << "Waiting for message queue to be created..." << std::endl;
+
+  Delivery delivery;
+  delivery.pool = pool.get();
+  delivery.edf = edf.get();
+  int result = transport_kind == TransportKind::SHM
+                   ? receive_shm(queues[0].first.c_str(), delivery)
+                   : receive_mq(queues, policy, delivery);
+
+  if (edf) edf->report(std::cout);
+  if (pool) {
+    pool->stop();
+    for (size_t w = 0; w < pool->size(); ++w) {
+      const WorkerStats& stats = pool->stats(w);
+      std::cout << "  Worker " << w << ": processed=" << stats.processed
+                << ", stolen=" << stats.stolen << ", fast=" << stats.fast
+                << std::endl;
+    }
+    std::cout << "  Fast lane worker: processed="
+              << pool->fast_stats().processed << std::endl;
+  }
+  return result;
 }
@@ -1,16 +1,21 @@
-#include <mqueue.h>
 #include <unistd.h>
 
 #include <atomic>
 #include <chrono>
 #include <csignal>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <thread>
 
-constexpr const char* MQ_NAME = "/automotive_mq";
-constexpr size_t MAX_MSG_SIZE = 256;
-constexpr size_t MAX_MESSAGES = 10;
+#include "automotive_message.h"
+#include "backpressure.h"
+#include "ipc_metrics.h"
+#include "message_codec.h"
+#include "message_schema.h"
+#include "message_transport.h"
+#include "queue_metrics.h"
+#include "rt_profile.h"
 
 std::atomic<bool> running{true};
 
@@ -20,55 +25,86 @@ void signal_handler(int signal) {
   }
 }
 
-enum class MessageType : uint8_t {
-  DIAGNOSTIC = 1,
-  CONTROL = 2,
-  STATUS = 3,
-  ALERT = 4
-};
-
-struct Message {
-  MessageType type;
-  uint32_t sequence;
-  uint64_t timestamp;
-  char payload[200];
-};
-
-const char* message_type_to_string(MessageType type) {
-  switch (type) {
-    case MessageType::DIAGNOSTIC:
-      return "DIAGNOSTIC";
-    case MessageType::CONTROL:
-      return "CONTROL";
-    case MessageType::STATUS:
-      return "STATUS";
-    case MessageType::ALERT:
-      return "ALERT";
-    default:
-      return "UNKNOWN";
+bool send_record(AdaptivePacer& pacer, ChannelMetrics& stats,
+                 const char* data, size_t len, unsigned int priority,
+                 unsigned messages) {
+  if (pacer.send(data, len, priority) < 0) {
+    std::cerr << "\nFailed to send message: " << strerror(errno)
+              << std::endl;
+    return false;
   }
+  stats.record(messages, len);
+  return true;
+}
+
+bool flush_batch(AdaptivePacer& pacer, ChannelMetrics& stats,
+                 MessageBatch& batch) {
+  if (batch.empty()) return true;
+  std::cout << "[BATCH] " << batch.count() << " messages in " << batch.size()
+            << " bytes" << std::endl;
+  bool sent = send_record(pacer, stats, batch.data(), batch.size(),
+                          batch.priority(), batch.count());
+  batch.clear();
+  return sent;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
   std::signal(SIGINT, signal_handler);
   std::signal(SIGTERM, signal_handler);
+  rt_setup("mq_sender");
+
+  TransportKind transport_kind = TransportKind::POSIX_MQ;
+  const char* queue_name = MQ_NAME;
+  unsigned batch_limit = 1;
+  int interval_ms = 800;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:q:b:d:")) != -1) {
+    switch (opt) {
+      case 't':
+        if (!parse_transport(optarg, transport_kind)) opt = '?';
+        break;
+      case 'q':
+        queue_name = optarg;
+        break;
+      case 'b':
+        batch_limit = static_cast<unsigned>(std::atoi(optarg));
+        if (batch_limit == 0) opt = '?';
+        break;
+      case 'd':
+        interval_ms = std::atoi(optarg);
+        break;
+    }
+    if (opt == '?') {
+      std::cerr << "Usage: " << argv[0]
+                << " [-t mq|shm] [-q name] [-b batch] [-d interval_ms]"
+                << std::endl;
+      return 1;
+    }
+  }
 
-  mq_unlink(MQ_NAME);
+  MessageTransport transport;
+  if (!transport.create(transport_kind, queue_name, false)) {
+    std::cerr << "Failed to create message queue: " << strerror(errno)
+              << std::endl;
+    return 1;
+  }
 
   struct mq_attr attr;
-  attr.mq_flags = 0;
-  attr.mq_maxmsg = MAX_MESSAGES;
-  attr.mq_msgsize = MAX_MSG_SIZE;
-  attr.mq_curmsgs = 0;
-
-  mqd_t mq = mq_open(MQ_NAME, O_CREAT | O_WRONLY, 0666, &attr);
-  if (mq == (mqd_t)-1) {
-    std::cerr << "Failed to create message queue: " << strerror(errno)
+  transport.get_attr(attr);
+  QueueMetricsMap metrics;
+  if (!metrics.create(queue_name, static_cast<uint32_t>(attr.mq_maxmsg))) {
+    std::cerr << "Failed to create queue metrics: " << strerror(errno)
               << std::endl;
+    transport.unlink();
     return 1;
   }
+  AdaptivePacer pacer(transport, metrics.get(), running);
+  ChannelMetrics stats;
+  stats.attach(queue_name, ChannelRole::WRITER,
+               transport_to_string(transport_kind));
 
-  std::cout << "Message queue sender started" << std::endl;
+  std::cout << "Message queue sender started (transport: "
+            << transport_to_string(transport_kind) << ")" << std::endl;
   std::cout << "Sending messages... (Press Ctrl+C to stop)" << std::endl;
   std::cout << std::string(80, '-') << std::endl;
 
@@ -76,67 +112,87 @@ int main() {
   const MessageType types[] = {MessageType::STATUS, MessageType::DIAGNOSTIC,
                                MessageType::CONTROL, MessageType::ALERT};
 
+  MessageBatch batch;
   while (running) {
     Message msg;
-    msg.type = types[sequence % 4];
     msg.sequence = sequence;
-    msg.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-                        std::chrono::system_clock::now().time_since_epoch())
-                        .count();
-
-    switch (msg.type) {
-      case MessageType::STATUS:
-        snprintf(msg.payload, sizeof(msg.payload),
-                 "Vehicle status: Speed=%.1f km/h, Fuel=%.1f%%",
-                 50.0f + (sequence % 50), 75.0f - (sequence % 50) * 0.5f);
+    msg.timestamp = wire_timestamp_ns();
+
+    switch (types[sequence % 4]) {
+      case MessageType::STATUS: {
+        StatusPayload& status = payload_init<StatusPayload>(msg);
+        status.speed_kmh = 50.0f + (sequence % 50);
+        status.fuel_percent = 75.0f - (sequence % 50) * 0.5f;
         break;
-      case MessageType::DIAGNOSTIC:
-        snprintf(msg.payload, sizeof(msg.payload),
-                 "Diagnostic code: DTC-%04d, Module: ECU-%d",
-                 1000 + (sequence % 100), (sequence % 5) + 1);
+      }
+      case MessageType::DIAGNOSTIC: {
+        DiagnosticPayload& diagnostic = payload_init<DiagnosticPayload>(msg);
+        diagnostic.dtc = static_cast<uint16_t>(1000 + (sequence % 100));
+        diagnostic.module = static_cast<uint16_t>((sequence % 5) + 1);
         break;
-      case MessageType::CONTROL:
-        snprintf(msg.payload, sizeof(msg.payload),
-                 "Control command: SET_MODE=%d, PARAM=%d", (sequence % 3),
-                 sequence % 100);
+      }
+      case MessageType::CONTROL: {
+        ControlPayload& control = payload_init<ControlPayload>(msg);
+        control.mode = sequence % 3;
+        control.param = sequence % 100;
         break;
-      case MessageType::ALERT:
-        snprintf(
-            msg.payload, sizeof(msg.payload), "Alert: %s - Priority: %d",
-            (sequence % 2 == 0) ? "Low fuel warning" : "Maintenance required",
-            (sequence % 3) + 1);
+      }
+      case MessageType::ALERT: {
+        AlertPayload& alert = payload_init<AlertPayload>(msg);
+        alert.condition = (sequence % 2 == 0) ? ALERT_LOW_FUEL
+                                              : ALERT_MAINTENANCE;
+        alert.level = static_cast<uint16_t>((sequence % 3) + 1);
         break;
+      }
     }
 
     unsigned int priority = static_cast<unsigned int>(msg.type);
 
-    if (mq_send(mq, reinterpret_cast<const char*>(&msg), sizeof(msg),
-                priority) < 0) {
-      if (errno == EAGAIN) {
-        std::cout << "[WARNING] Queue full, waiting..." << std::endl;
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        continue;
-      } else {
-        std::cerr << "\nFailed to send message: " << strerror(errno)
-                  << std::endl;
+    // Only the payload bytes of this type go on the wire. In batch mode
+    // messages are packed until the record is full or the limit is hit;
+    // alerts flush immediately so they are never held back.
+    if (batch_limit == 1) {
+      if (!send_record(pacer, stats, reinterpret_cast<const char*>(&msg),
+                       encoded_size(msg), priority, 1)) {
+        break;
+      }
+    } else {
+      if (!batch.add(msg)) {
+        if (!flush_batch(pacer, stats, batch)) break;
+        batch.add(msg);
+      }
+      if ((batch.count() >= batch_limit || msg.type == MessageType::ALERT) &&
+          !flush_batch(pacer, stats, batch)) {
         break;
       }
     }
 
+    stats.depth(metrics->depth.load(std::memory_order_relaxed));
     std::cout << "[SEQ: " << msg.sequence << "] "
               << "Type: " << message_type_to_string(msg.type) << " | "
-              << "Priority: " << priority << " | " << "Payload: " << msg.payload
-              << std::endl;
+              << "Priority: " << priority << " | " << "Payload: ";
+    print_payload(std::cout, msg);
+    std::cout << std::endl;
 
     sequence++;
-    std::this_thread::sleep_for(std::chrono::milliseconds(800));
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
   }
 
-  mq_close(mq);
-  mq_unlink(MQ_NAME);
+  flush_batch(pacer, stats, batch);
+  transport.close();
+  transport.unlink();
 
   std::cout << "\nSender stopped (sent " << sequence << " messages)"
             << std::endl;
+  std::cout << "  Records: " << metrics->sent.load()
+            << ", throttled: " << metrics->throttled.load()
+            << ", stalls: " << metrics->stalls.load() << " ("
+            << metrics->stall_ns.load() / 1000000 << " ms)"
+            << ", max depth: " << metrics->max_depth.load() << "/"
+            << metrics->capacity << ", window: " << pacer.window()
+            << std::endl;
+  metrics.close();
+  QueueMetricsMap::unlink(queue_name);
 
   return 0;
 }
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <new>
+#include <string>
+
+#include "shm_map.h"
+
+constexpr uint32_t QUEUE_METRICS_MAGIC = 0x4D514D54U;
+
+// Bucket b counts messages that spent less than 2^b ms in the queue; the
+// last bucket is open-ended.
+constexpr unsigned TIME_IN_QUEUE_BUCKETS = 16;
+
+// Live counters for one queue, shared between its sender, its receivers
+// and mq_metrics. The sender owns the first block and the receivers the
+// second, so they do not bounce one cache line between them.
+struct alignas(64) QueueMetrics {
+  uint32_t magic;
+  uint32_t capacity;
+  alignas(64) std::atomic<uint64_t> sent;
+  std::atomic<uint64_t> throttled;
+  std::atomic<uint64_t> stalls;
+  std::atomic<uint64_t> stall_ns;
+  std::atomic<uint64_t> window;
+  std::atomic<uint64_t> depth;
+  std::atomic<uint64_t> max_depth;
+  alignas(64) std::atomic<uint64_t> acked;
+  std::atomic<uint64_t> max_time_in_queue_ms;
+  std::atomic<uint64_t> time_in_queue[TIME_IN_QUEUE_BUCKETS];
+};
+
+inline std::string queue_metrics_name(const char* queue_name) {
+  return std::string(queue_name) + ".metrics";
+}
+
+inline unsigned time_in_queue_bucket(uint64_t ms) {
+  unsigned bucket = 0;
+  while (bucket + 1 < TIME_IN_QUEUE_BUCKETS && ms >= (1ULL << bucket)) {
+    bucket++;
+  }
+  return bucket;
+}
+
+inline void store_max(std::atomic<uint64_t>& max, uint64_t value) {
+  uint64_t current = max.load(std::memory_order_relaxed);
+  while (value > current &&
+         !max.compare_exchange_weak(current, value,
+                                    std::memory_order_relaxed)) {
+  }
+}
+
+// Maps the metrics segment that belongs to a queue name.
+class QueueMetricsMap {
+ public:
+  QueueMetricsMap() = default;
+  QueueMetricsMap(const QueueMetricsMap&) = delete;
+  QueueMetricsMap& operator=(const QueueMetricsMap&) = delete;
+  ~QueueMetricsMap() { close(); }
+
+  bool create(const char* queue_name, uint32_t capacity) {
+    std::string name = queue_metrics_name(queue_name);
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0) return false;
+    if (ftruncate(fd, sizeof(QueueMetrics)) < 0 || !map(fd)) {
+      ::close(fd);
+      shm_unlink(name.c_str());
+      return false;
+    }
+    ::close(fd);
+
+    metrics_ = new (metrics_) QueueMetrics();
+    metrics_->capacity = capacity;
+    std::atomic_thread_fence(std::memory_order_release);
+    metrics_->magic = QUEUE_METRICS_MAGIC;
+    return true;
+  }
+
+  bool open(const char* queue_name) {
+    void* base;
+    if (!shm_map_existing(queue_metrics_name(queue_name).c_str(),
+                          sizeof(QueueMetrics), true, &base, &size_)) {
+      return false;
+    }
+    metrics_ = static_cast<QueueMetrics*>(base);
+
+    if (metrics_->magic != QUEUE_METRICS_MAGIC) {
+      close();
+      errno = EINVAL;
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (metrics_) munmap(metrics_, size_);
+    metrics_ = nullptr;
+  }
+
+  static void unlink(const char* queue_name) {
+    shm_unlink(queue_metrics_name(queue_name).c_str());
+  }
+
+  QueueMetrics* get() const { return metrics_; }
+  QueueMetrics* operator->() const { return metrics_; }
+  explicit operator bool() const { return metrics_ != nullptr; }
+
+ private:
+  bool map(int fd) {
+    void* base = mmap(nullptr, sizeof(QueueMetrics), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return false;
+    metrics_ = static_cast<QueueMetrics*>(base);
+    size_ = sizeof(QueueMetrics);
+    return true;
+  }
+
+  QueueMetrics* metrics_ = nullptr;
+  size_t size_ = 0;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <signal.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "message_transport.h"
+
+enum class DrainPolicy { STRICT, WEIGHTED_FAIR };
+
+struct QueueSource {
+  std::string name;
+  unsigned weight;
+  MessageTransport transport;
+  bool ready;
+  uint64_t received;
+};
+
+// Services several POSIX message queues from one thread. Linux mqd_t are
+// pollable descriptors, so the set sleeps in epoll until any queue has
+// data and then drains them by rank (STRICT: earlier queues always first)
+// or by deficit round robin using each queue's weight (WEIGHTED_FAIR).
+class QueueSet {
+ public:
+  explicit QueueSet(DrainPolicy policy) : policy_(policy) {}
+  QueueSet(const QueueSet&) = delete;
+  QueueSet& operator=(const QueueSet&) = delete;
+  ~QueueSet() {
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+  }
+
+  bool add(const std::string& name, unsigned weight) {
+    if (epoll_fd_ < 0) {
+      epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+      if (epoll_fd_ < 0) return false;
+    }
+
+    auto source = std::make_unique<QueueSource>();
+    source->name = name;
+    source->weight = weight == 0 ? 1 : weight;
+    source->ready = true;
+    source->received = 0;
+    if (!source->transport.open(TransportKind::POSIX_MQ, name.c_str(), true)) {
+      return false;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = sources_.size();
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, source->transport.mq(), &event) <
+        0) {
+      return false;
+    }
+
+    sources_.push_back(std::move(source));
+    if (sources_.size() == 1) credit_ = sources_[0]->weight;
+    return true;
+  }
+
+  size_t size() const { return sources_.size(); }
+  const QueueSource& operator[](size_t i) const { return *sources_[i]; }
+
+  // Returns the index of the queue the message came from, or -1 with errno
+  // set. Blocks in epoll_pwait with wait_mask installed, so signals blocked
+  // elsewhere interrupt the wait with EINTR without a wakeup race. A
+  // timeout_ms of 0 polls: -1 with EAGAIN if no queue has data.
+  int receive(char* buffer, size_t len, ssize_t* bytes, unsigned* priority,
+              const sigset_t* wait_mask, int timeout_ms = -1) {
+    while (true) {
+      int index = drain_one(buffer, len, bytes, priority);
+      if (index != -1 || errno != EAGAIN) return index;
+
+      struct epoll_event events[16];
+      int ready = epoll_pwait(epoll_fd_, events, 16, timeout_ms, wait_mask);
+      if (ready < 0) return -1;
+      if (ready == 0) {
+        errno = EAGAIN;
+        return -1;
+      }
+      for (int i = 0; i < ready; ++i) {
+        sources_[events[i].data.u64]->ready = true;
+      }
+    }
+  }
+
+ private:
+  int drain_one(char* buffer, size_t len, ssize_t* bytes, unsigned* priority) {
+    size_t count = sources_.size();
+    for (size_t attempt = 0; attempt < count; ++attempt) {
+      size_t index = policy_ == DrainPolicy::STRICT ? attempt : cursor_;
+      QueueSource& source = *sources_[index];
+
+      if (source.ready) {
+        *bytes = source.transport.receive(buffer, len, priority);
+        if (*bytes >= 0) {
+          source.received++;
+          if (policy_ == DrainPolicy::WEIGHTED_FAIR && --credit_ == 0) {
+            advance();
+          }
+          return static_cast<int>(index);
+        }
+        if (errno != EAGAIN) return -1;
+        source.ready = false;
+      }
+
+      if (policy_ == DrainPolicy::WEIGHTED_FAIR) advance();
+    }
+    errno = EAGAIN;
+    return -1;
+  }
+
+  void advance() {
+    cursor_ = (cursor_ + 1) % sources_.size();
+    credit_ = sources_[cursor_]->weight;
+  }
+
+  DrainPolicy policy_;
+  int epoll_fd_ = -1;
+  std::vector<std::unique_ptr<QueueSource>> sources_;
+  size_t cursor_ = 0;
+  unsigned credit_ = 0;
+};
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#include "automotive_message.h"
+#include "futex.h"
+#include "rt_profile.h"
+#include "shm_map.h"
+
+constexpr uint32_t SHM_QUEUE_MAGIC = 0x4D51534DU;
+constexpr uint32_t SHM_LANE_CAPACITY = 1024;
+constexpr unsigned SHM_QUEUE_LANES = NUM_MESSAGE_TYPES;
+
+struct ShmSlot {
+  std::atomic<uint64_t> sequence;
+  uint32_t length;
+  char data[MAX_MSG_SIZE];
+};
+
+// Bounded MPMC ring (Vyukov): each slot's sequence tells producers and
+// consumers whose turn it is, so no lock is held across the copy.
+struct alignas(64) ShmLane {
+  alignas(64) std::atomic<uint64_t> enqueue_pos;
+  alignas(64) std::atomic<uint64_t> dequeue_pos;
+};
+
+struct alignas(64) ShmQueueHeader {
+  uint32_t magic;
+  uint32_t lane_capacity;
+  uint32_t slot_size;
+  uint32_t lanes;
+  alignas(64) std::atomic<uint32_t> recv_futex;
+  std::atomic<uint32_t> recv_waiters;
+  alignas(64) std::atomic<uint32_t> send_futex;
+  std::atomic<uint32_t> send_waiters;
+  ShmLane lane[SHM_QUEUE_LANES];
+};
+
+// Shared-memory counterpart of a POSIX message queue with one lane per
+// MessageType priority. send/receive follow mq_timedsend/mq_timedreceive:
+// -1 with errno EAGAIN (non-blocking), ETIMEDOUT, EMSGSIZE or EINVAL.
+class ShmQueue {
+ public:
+  ShmQueue() = default;
+  ShmQueue(const ShmQueue&) = delete;
+  ShmQueue& operator=(const ShmQueue&) = delete;
+  ~ShmQueue() { close(); }
+
+  bool create(const char* name, uint32_t lane_capacity = SHM_LANE_CAPACITY) {
+    if (lane_capacity == 0 || (lane_capacity & (lane_capacity - 1)) != 0) {
+      errno = EINVAL;
+      return false;
+    }
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0) return false;
+
+    size_t size = segment_size(lane_capacity);
+    if (ftruncate(fd, static_cast<off_t>(size)) < 0 || !map(fd, size)) {
+      ::close(fd);
+      shm_unlink(name);
+      return false;
+    }
+    ::close(fd);
+    rt_shared_region(base_, size_, true);
+
+    header_ = new (base_) ShmQueueHeader();
+    header_->lane_capacity = lane_capacity;
+    header_->slot_size = sizeof(ShmSlot);
+    header_->lanes = SHM_QUEUE_LANES;
+    for (unsigned l = 0; l < SHM_QUEUE_LANES; ++l) {
+      for (uint32_t i = 0; i < lane_capacity; ++i) {
+        new (&slot(l, i)) ShmSlot();
+        slot(l, i).sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = SHM_QUEUE_MAGIC;
+    return true;
+  }
+
+  bool open(const char* name) {
+    if (!shm_map_existing(name, sizeof(ShmQueueHeader), true, &base_,
+                          &size_)) {
+      return false;
+    }
+    rt_shared_region(base_, size_, false);
+
+    header_ = reinterpret_cast<ShmQueueHeader*>(base_);
+    if (header_->magic != SHM_QUEUE_MAGIC ||
+        header_->slot_size != sizeof(ShmSlot) ||
+        header_->lanes != SHM_QUEUE_LANES ||
+        segment_size(header_->lane_capacity) > size_) {
+      close();
+      errno = EINVAL;
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (base_) munmap(base_, size_);
+    base_ = nullptr;
+    header_ = nullptr;
+    size_ = 0;
+  }
+
+  static void unlink(const char* name) { shm_unlink(name); }
+
+  void set_nonblocking(bool nonblocking) { nonblocking_ = nonblocking; }
+
+  uint32_t capacity() const {
+    return header_->lane_capacity * SHM_QUEUE_LANES;
+  }
+
+  uint64_t depth() const {
+    uint64_t total = 0;
+    for (const ShmLane& lane : header_->lane) {
+      uint64_t head = lane.dequeue_pos.load(std::memory_order_relaxed);
+      uint64_t tail = lane.enqueue_pos.load(std::memory_order_relaxed);
+      total += tail > head ? tail - head : 0;
+    }
+    return total;
+  }
+
+  int send(const void* data, size_t len, unsigned priority,
+           const struct timespec* abs_timeout = nullptr) {
+    if (len > MAX_MSG_SIZE) {
+      errno = EMSGSIZE;
+      return -1;
+    }
+    if (priority < 1 || priority > SHM_QUEUE_LANES) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (!try_push(priority - 1, data, len) &&
+        !wait(header_->send_futex, header_->send_waiters, abs_timeout,
+              [&] { return try_push(priority - 1, data, len); })) {
+      return -1;
+    }
+    notify(header_->recv_futex, header_->recv_waiters);
+    return 0;
+  }
+
+  ssize_t receive(void* data, size_t len, unsigned* priority,
+                  const struct timespec* abs_timeout = nullptr) {
+    if (len < MAX_MSG_SIZE) {
+      errno = EMSGSIZE;
+      return -1;
+    }
+
+    ssize_t received = try_pop(data, priority);
+    if (received < 0 &&
+        !wait(header_->recv_futex, header_->recv_waiters, abs_timeout,
+              [&] { return (received = try_pop(data, priority)) >= 0; })) {
+      return -1;
+    }
+    notify(header_->send_futex, header_->send_waiters);
+    return received;
+  }
+
+ private:
+  static size_t segment_size(uint32_t lane_capacity) {
+    return sizeof(ShmQueueHeader) +
+           static_cast<size_t>(SHM_QUEUE_LANES) * lane_capacity *
+               sizeof(ShmSlot);
+  }
+
+  bool map(int fd, size_t size) {
+    void* base =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return false;
+    base_ = base;
+    size_ = size;
+    return true;
+  }
+
+  ShmSlot& slot(unsigned lane, uint64_t pos) {
+    ShmSlot* slots = reinterpret_cast<ShmSlot*>(
+        static_cast<char*>(base_) + sizeof(ShmQueueHeader));
+    return slots[static_cast<size_t>(lane) * header_->lane_capacity +
+                 (pos & (header_->lane_capacity - 1))];
+  }
+
+  bool try_push(unsigned lane, const void* data, size_t len) {
+    std::atomic<uint64_t>& tail = header_->lane[lane].enqueue_pos;
+    uint64_t pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+      ShmSlot& s = slot(lane, pos);
+      uint64_t seq = s.sequence.load(std::memory_order_acquire);
+      int64_t diff = static_cast<int64_t>(seq - pos);
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed)) {
+          memcpy(s.data, data, len);
+          s.length = static_cast<uint32_t>(len);
+          s.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Drains the highest-priority non-empty lane first, like mq_receive.
+  ssize_t try_pop(void* data, unsigned* priority) {
+    for (unsigned lane = SHM_QUEUE_LANES; lane-- > 0;) {
+      std::atomic<uint64_t>& head = header_->lane[lane].dequeue_pos;
+      uint64_t pos = head.load(std::memory_order_relaxed);
+      while (true) {
+        ShmSlot& s = slot(lane, pos);
+        uint64_t seq = s.sequence.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq - (pos + 1));
+        if (diff == 0) {
+          if (head.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+            size_t len = s.length;
+            memcpy(data, s.data, len);
+            s.sequence.store(pos + header_->lane_capacity,
+                             std::memory_order_release);
+            if (priority) *priority = lane + 1;
+            return static_cast<ssize_t>(len);
+          }
+        } else if (diff < 0) {
+          break;
+        } else {
+          pos = head.load(std::memory_order_relaxed);
+        }
+      }
+    }
+    return -1;
+  }
+
+  // Registers as a waiter, re-checks the queue and parks on the futex until
+  // the other side bumps it. Returns false with errno set on timeout or
+  // when the queue is non-blocking.
+  template <typename Retry>
+  bool wait(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiters,
+            const struct timespec* abs_timeout, Retry&& retry) {
+    if (nonblocking_) {
+      errno = EAGAIN;
+      return false;
+    }
+
+    while (true) {
+      uint32_t observed = word.load(std::memory_order_acquire);
+      waiters.fetch_add(1, std::memory_order_seq_cst);
+      if (retry()) {
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+
+      struct timespec relative;
+      struct timespec* timeout = nullptr;
+      if (abs_timeout) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        int64_t ns = (abs_timeout->tv_sec - now.tv_sec) * 1000000000LL +
+                     (abs_timeout->tv_nsec - now.tv_nsec);
+        if (ns <= 0) {
+          waiters.fetch_sub(1, std::memory_order_relaxed);
+          errno = ETIMEDOUT;
+          return false;
+        }
+        relative.tv_sec = static_cast<time_t>(ns / 1000000000LL);
+        relative.tv_nsec = static_cast<long>(ns % 1000000000LL);
+        timeout = &relative;
+      }
+
+      futex_wait(&word, observed, timeout);
+      waiters.fetch_sub(1, std::memory_order_relaxed);
+      if (retry()) return true;
+    }
+  }
+
+  static void notify(std::atomic<uint32_t>& word,
+                     std::atomic<uint32_t>& waiters) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) == 0) return;
+    word.fetch_add(1, std::memory_order_release);
+    futex_wake(&word, INT_MAX);
+  }
+
+  void* base_ = nullptr;
+  size_t size_ = 0;
+  ShmQueueHeader* header_ = nullptr;
+  bool nonblocking_ = false;
+};
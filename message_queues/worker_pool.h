@@ -0,0 +1,290 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "automotive_message.h"
+
+enum class DispatchLane { NORMAL, FAST };
+
+struct TypeDispatch {
+  DispatchLane lane;
+  bool ordered;
+};
+
+// ALERT and CONTROL go through the fast lane. CONTROL and STATUS must be
+// handled in send order; DIAGNOSTIC and ALERT handlers may run in parallel.
+inline TypeDispatch default_dispatch(MessageType type) {
+  switch (type) {
+    case MessageType::ALERT:
+      return {DispatchLane::FAST, false};
+    case MessageType::CONTROL:
+      return {DispatchLane::FAST, true};
+    case MessageType::STATUS:
+      return {DispatchLane::NORMAL, true};
+    default:
+      return {DispatchLane::NORMAL, false};
+  }
+}
+
+struct WorkItem {
+  Message msg;
+  unsigned priority;
+  const std::string* source;
+  uint32_t lateness_ms;
+};
+
+struct WorkerStats {
+  uint64_t processed = 0;
+  uint64_t stolen = 0;
+  uint64_t fast = 0;
+};
+
+// Runs message handlers on a pool of threads. Normal-lane jobs are dealt
+// round robin into per-worker deques; an idle worker takes from the back
+// of its own deque and steals from the front of the others. Fast-lane jobs
+// sit in a shared queue that every worker checks first, and one extra
+// worker serves nothing else, so a slow handler never delays an ALERT.
+// Ordered types run through a per-type strand: at most one job for the
+// type is queued or running at any time and it drains the type in order.
+class WorkerPool {
+ public:
+  using Handler = std::function<void(const WorkItem&)>;
+
+  WorkerPool(unsigned workers, Handler handler)
+      : handler_(std::move(handler)), queues_(workers == 0 ? 1 : workers) {
+    for (auto& queue : queues_) queue.reset(new WorkerQueue());
+    for (unsigned t = 0; t < NUM_MESSAGE_TYPES; ++t) {
+      dispatch_[t] = default_dispatch(static_cast<MessageType>(t + 1));
+    }
+    for (size_t w = 0; w < queues_.size(); ++w) {
+      threads_.emplace_back([this, w] { run_worker(w); });
+    }
+    threads_.emplace_back([this] { run_fast_worker(); });
+  }
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+  ~WorkerPool() { stop(); }
+
+  void submit(const WorkItem& item) {
+    Job job;
+    job.strand = -1;
+    job.item = item;
+
+    unsigned type = static_cast<unsigned>(item.msg.type) - 1;
+    const TypeDispatch& dispatch = dispatch_[type];
+    if (dispatch.ordered) {
+      Strand& strand = strands_[type];
+      std::lock_guard<std::mutex> lock(strand.mutex);
+      strand.items.push_back(job.item);
+      if (strand.scheduled) return;
+      strand.scheduled = true;
+      job.strand = static_cast<int>(type);
+    }
+    enqueue(job, dispatch.lane);
+  }
+
+  // Finishes every job already submitted, then joins the threads.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(idle_mutex_);
+      if (stopping_) return;
+      stopping_ = true;
+    }
+    work_cv_.notify_all();
+    fast_cv_.notify_all();
+    for (auto& thread : threads_) thread.join();
+  }
+
+  size_t size() const { return queues_.size(); }
+  const WorkerStats& stats(size_t worker) const {
+    return queues_[worker]->stats;
+  }
+  const WorkerStats& fast_stats() const { return fast_stats_; }
+
+ private:
+  static constexpr unsigned STRAND_BURST = 8;
+
+  struct Job {
+    int strand;
+    WorkItem item;
+  };
+
+  struct alignas(64) WorkerQueue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+    WorkerStats stats;
+  };
+
+  struct Strand {
+    std::mutex mutex;
+    std::deque<WorkItem> items;
+    bool scheduled = false;
+  };
+
+  void enqueue(const Job& job, DispatchLane lane) {
+    if (lane == DispatchLane::FAST) {
+      {
+        std::lock_guard<std::mutex> lock(fast_mutex_);
+        fast_jobs_.push_back(job);
+      }
+      signal(fast_pending_);
+      fast_cv_.notify_one();
+      work_cv_.notify_one();
+      return;
+    }
+
+    size_t next = next_queue_.fetch_add(1, std::memory_order_relaxed);
+    WorkerQueue& queue = *queues_[next % queues_.size()];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.jobs.push_back(job);
+    }
+    signal(normal_pending_);
+    work_cv_.notify_one();
+  }
+
+  void signal(std::atomic<int64_t>& pending) {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    pending.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  bool take_fast(Job& job) {
+    std::lock_guard<std::mutex> lock(fast_mutex_);
+    if (fast_jobs_.empty()) return false;
+    job = fast_jobs_.front();
+    fast_jobs_.pop_front();
+    fast_pending_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  bool take_own(size_t w, Job& job) {
+    WorkerQueue& queue = *queues_[w];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty()) return false;
+    job = queue.jobs.back();
+    queue.jobs.pop_back();
+    normal_pending_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  bool steal(size_t w, Job& job) {
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      WorkerQueue& victim = *queues_[(w + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (victim.jobs.empty()) continue;
+      job = victim.jobs.front();
+      victim.jobs.pop_front();
+      normal_pending_.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  void run(const Job& job, WorkerStats& stats) {
+    if (job.strand < 0) {
+      handler_(job.item);
+      stats.processed++;
+      return;
+    }
+
+    Strand& strand = strands_[job.strand];
+    for (unsigned n = 0; n < STRAND_BURST; ++n) {
+      WorkItem item;
+      {
+        std::lock_guard<std::mutex> lock(strand.mutex);
+        if (strand.items.empty()) {
+          strand.scheduled = false;
+          return;
+        }
+        item = strand.items.front();
+        strand.items.pop_front();
+      }
+      handler_(item);
+      stats.processed++;
+    }
+
+    // Yield after a burst so one busy type cannot monopolize a worker.
+    {
+      std::lock_guard<std::mutex> lock(strand.mutex);
+      if (strand.items.empty()) {
+        strand.scheduled = false;
+        return;
+      }
+    }
+    enqueue(job, dispatch_[job.strand].lane);
+  }
+
+  void run_worker(size_t w) {
+    WorkerStats& stats = queues_[w]->stats;
+    Job job;
+    while (true) {
+      if (take_fast(job)) {
+        stats.fast++;
+      } else if (!take_own(w, job)) {
+        if (steal(w, job)) {
+          stats.stolen++;
+        } else {
+          std::unique_lock<std::mutex> lock(idle_mutex_);
+          work_cv_.wait(lock, [this] {
+            return stopping_ ||
+                   normal_pending_.load(std::memory_order_relaxed) > 0 ||
+                   fast_pending_.load(std::memory_order_relaxed) > 0;
+          });
+          if (stopping_ &&
+              normal_pending_.load(std::memory_order_relaxed) <= 0 &&
+              fast_pending_.load(std::memory_order_relaxed) <= 0) {
+            return;
+          }
+          continue;
+        }
+      }
+      run(job, stats);
+    }
+  }
+
+  void run_fast_worker() {
+    Job job;
+    while (true) {
+      if (take_fast(job)) {
+        fast_stats_.fast++;
+        run(job, fast_stats_);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(idle_mutex_);
+      fast_cv_.wait(lock, [this] {
+        return stopping_ || fast_pending_.load(std::memory_order_relaxed) > 0;
+      });
+      if (stopping_ && fast_pending_.load(std::memory_order_relaxed) <= 0) {
+        return;
+      }
+    }
+  }
+
+  Handler handler_;
+  TypeDispatch dispatch_[NUM_MESSAGE_TYPES];
+  Strand strands_[NUM_MESSAGE_TYPES];
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> next_queue_{0};
+
+  std::mutex fast_mutex_;
+  std::deque<Job> fast_jobs_;
+  WorkerStats fast_stats_;
+
+  std::mutex idle_mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable fast_cv_;
+  std::atomic<int64_t> normal_pending_{0};
+  std::atomic<int64_t> fast_pending_{0};
+  bool stopping_ = false;
+};
@@ -1,144 +1,576 @@
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <chrono>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
 
-struct CANMessage {
-  uint32_t can_id;
-  uint8_t data_length;
-  uint8_t data[8];
-  uint64_t timestamp;
+#include "can_capture.h"
+#include "can_crc.h"
+#include "can_message.h"
+#include "can_router.h"
+#include "can_shard.h"
+#include "latency_histogram.h"
+#include "rt_profile.h"
+
+constexpr size_t GATEWAY_BATCH = 64;
+
+using RouteSpec = std::pair<std::string, std::vector<std::string>>;
+
+const std::vector<RouteSpec> DEFAULT_ROUTES = {
+    {"powertrain", {"0x100/0x7FC"}},
+    {"chassis", {"0x104-0x107"}},
+    {"j1939", {"0x18FE0000/0x1FFF0000x"}},
 };
 
-void parent_process(int write_fd, int read_fd) {
-  close(read_fd);
+void print_can_id(uint32_t can_id) {
+  if (can_id & CAN_EFF_FLAG) {
+    std::cout << "0x" << std::hex << std::setw(8) << std::setfill('0')
+              << (can_id & CAN_EFF_MASK) << std::dec;
+  } else {
+    std::cout << "0x" << std::hex << std::setw(3) << std::setfill('0')
+              << can_id << std::dec;
+  }
+}
 
-  std::cout << "[Parent] ECU Simulator - Sending CAN messages to child process"
-            << std::endl;
-  std::cout << std::string(80, '-') << std::endl;
+// Buffers frames per gateway child and writes each batch with a single
+// write(); GATEWAY_BATCH frames stay below PIPE_BUF so batches are atomic.
+class GatewayFeed {
+ public:
+  GatewayFeed(const std::vector<int>& write_fds, ShardStats* stats)
+      : write_fds_(write_fds),
+        sharder_(write_fds.size(), stats),
+        batches_(write_fds.size()) {}
 
-  for (int i = 0; i < 10; ++i) {
-    CANMessage msg;
-    msg.can_id = 0x100 + i;
-    msg.data_length = 8;
+  size_t send(const CANMessage& msg) {
+    size_t child = sharder_.pick(msg.can_id);
+    batches_[child].push_back(msg);
+    if (batches_[child].size() == GATEWAY_BATCH && !flush(child)) ok_ = false;
+    return child;
+  }
 
-    for (int j = 0; j < 8; ++j) {
-      msg.data[j] = static_cast<uint8_t>((i * 10 + j) % 256);
+  bool flush() {
+    for (size_t c = 0; c < batches_.size(); ++c) {
+      if (!flush(c)) ok_ = false;
     }
+    return ok_;
+  }
+
+  bool ok() const { return ok_; }
+  uint32_t weight(size_t child) const { return sharder_.weight(child); }
 
-    msg.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
-                        std::chrono::system_clock::now().time_since_epoch())
-                        .count();
+ private:
+  bool flush(size_t child) {
+    std::vector<CANMessage>& batch = batches_[child];
+    if (batch.empty()) return true;
+
+    size_t bytes = batch.size() * sizeof(CANMessage);
+    ssize_t written;
+    do {
+      written = write(write_fds_[child], batch.data(), bytes);
+    } while (written < 0 && errno == EINTR);
+    batch.clear();
 
-    ssize_t written = write(write_fd, &msg, sizeof(msg));
     if (written < 0) {
       std::cerr << "[Parent] Write error: " << strerror(errno) << std::endl;
-      break;
+      return false;
     }
+    return true;
+  }
 
-    std::cout << "[Parent] Sent CAN ID: 0x" << std::hex << std::setw(3)
-              << std::setfill('0') << msg.can_id << std::dec << " | Data: ";
-    for (int j = 0; j < msg.data_length; ++j) {
-      std::cout << std::hex << std::setw(2) << std::setfill('0')
-                << static_cast<int>(msg.data[j]) << " ";
+  const std::vector<int>& write_fds_;
+  CANSharder sharder_;
+  std::vector<std::vector<CANMessage>> batches_;
+  bool ok_ = true;
+};
+
+void print_sent(const CANMessage& msg, size_t child) {
+  std::cout << "[Parent] Sent CAN ID: ";
+  print_can_id(msg.can_id);
+  std::cout << " | Data: ";
+  for (int j = 0; j < msg.data_length; ++j) {
+    std::cout << std::hex << std::setw(2) << std::setfill('0')
+              << static_cast<int>(msg.data[j]) << " ";
+  }
+  std::cout << std::dec << "| TS: " << msg.timestamp << " -> Child " << child
+            << std::endl;
+}
+
+struct ParentOptions {
+  int message_count;
+  useconds_t interval_us;
+  bool quiet;
+  const char* record_path;
+  const char* replay_path;
+  double replay_speed;
+};
+
+void parent_process(const std::vector<int>& write_fds, ShardStats* stats,
+                    const ParentOptions& options) {
+  std::cout << "[Parent] ECU Simulator - Sending CAN messages to "
+            << write_fds.size() << " gateway children" << std::endl;
+  std::cout << std::string(80, '-') << std::endl;
+
+  GatewayFeed feed(write_fds, stats);
+
+  CaptureWriter recorder;
+  if (options.record_path && !recorder.open(options.record_path)) {
+    std::cerr << "[Parent] Failed to create capture " << options.record_path
+              << ": " << strerror(errno) << std::endl;
+  }
+
+  auto emit = [&](const CANMessage& msg) {
+    size_t child = feed.send(msg);
+    if (recorder.is_open() && !recorder.append(msg, wall_clock_us())) {
+      std::cerr << "[Parent] Capture write error: " << strerror(errno)
+                << std::endl;
+      recorder.close();
     }
-    std::cout << std::dec << "| TS: " << msg.timestamp << std::endl;
+    if (!options.quiet) print_sent(msg, child);
+  };
+
+  if (options.replay_path) {
+    CaptureReader capture;
+    if (!capture.open(options.replay_path)) {
+      std::cerr << "[Parent] Failed to open capture " << options.replay_path
+                << ": " << strerror(errno) << std::endl;
+    } else {
+      std::cout << "[Parent] Replaying " << capture.size() << " frames from "
+                << options.replay_path << " at "
+                << (options.replay_speed > 0
+                        ? std::to_string(options.replay_speed) + "x"
+                        : std::string("maximum speed"))
+                << std::endl;
+      auto start = std::chrono::steady_clock::now();
+      uint64_t replayed = replay_capture(capture, options.replay_speed, emit,
+                                         [&] { feed.flush(); });
+      double seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+      std::cout << "[Parent] Replayed " << replayed << " frames in "
+                << seconds << " s" << std::endl;
+    }
+  } else {
+    for (int i = 0; i < options.message_count && feed.ok(); ++i) {
+      CANMessage msg{};
+      msg.can_id = (i % 4 == 3) ? (CAN_EFF_FLAG | (0x18FEF100 + i % 64))
+                                : (0x100 + i % 16);
+      msg.data_length = 8;
 
-    usleep(500000);
+      for (int j = 0; j < 8; ++j) {
+        msg.data[j] = static_cast<uint8_t>((i * 10 + j) % 256);
+      }
+
+      msg.timestamp = wire_timestamp_ns();
+
+      emit(msg);
+
+      if (options.interval_us > 0) {
+        feed.flush();
+        usleep(options.interval_us);
+      }
+    }
+    feed.flush();
   }
 
-  close(write_fd);
+  if (recorder.is_open()) {
+    uint64_t recorded = recorder.record_count();
+    if (recorder.close()) {
+      std::cout << "[Parent] Recorded " << recorded << " frames to "
+                << options.record_path << std::endl;
+    } else {
+      std::cerr << "[Parent] Failed to finalize capture: " << strerror(errno)
+                << std::endl;
+    }
+  }
+
+  for (int fd : write_fds) {
+    close(fd);
+  }
   std::cout << "[Parent] Finished sending messages" << std::endl;
+  for (size_t c = 0; c < write_fds.size(); ++c) {
+    std::cout << "[Parent]   Child " << c
+              << ": ring weight=" << feed.weight(c) << std::endl;
+  }
 }
 
-void child_process(int write_fd, int read_fd) {
-  close(write_fd);
+void sink_process(const std::string& name, int read_fd) {
+  CANMessage msg;
+  int count = 0;
+
+  while (true) {
+    ssize_t bytes_read = read(read_fd, &msg, sizeof(msg));
+    if (bytes_read <= 0) {
+      if (bytes_read < 0 && errno == EINTR) continue;
+      break;
+    }
+    if (bytes_read != sizeof(msg)) {
+      std::cerr << "[Sink " << name << "] Incomplete message received"
+                << std::endl;
+      continue;
+    }
+
+    count++;
+    std::cout << "[Sink " << name << "] Delivered CAN ID: ";
+    print_can_id(msg.can_id);
+    std::cout << std::endl;
+  }
 
-  std::cout << "[Child] Gateway Process - Receiving CAN messages from parent"
+  close(read_fd);
+  std::cout << "[Sink " << name << "] Total messages delivered: " << count
             << std::endl;
-  std::cout << std::string(80, '-') << std::endl;
+}
 
-  CANMessage msg;
+void child_process(int child_id, int read_fd, const CANRouter& router,
+                   ShardStats& stats, bool quiet) {
+  std::string tag = "[Child " + std::to_string(child_id) + "] ";
+  std::cout << tag << "Gateway Process - Receiving CAN messages from parent"
+            << std::endl;
+
+  CANMessage batch[GATEWAY_BATCH];
+  uint32_t crcs[GATEWAY_BATCH];
+  size_t pending = 0;
+  uint32_t log_crc = 0;
   int count = 0;
+  int dropped = 0;
+  std::vector<int> routed(router.size(), 0);
+  LatencyReport latency("Child " + std::to_string(child_id));
 
   while (true) {
-    ssize_t bytes_read = read(read_fd, &msg, sizeof(msg));
+    char* buffer = reinterpret_cast<char*>(batch);
+    ssize_t bytes_read = read(read_fd, buffer + pending,
+                              sizeof(batch) - pending);
 
     if (bytes_read == 0) {
-      std::cout << "[Child] Parent closed pipe, exiting" << std::endl;
+      if (pending != 0) {
+        std::cerr << tag << "Incomplete message received" << std::endl;
+      }
+      std::cout << tag << "Parent closed pipe, exiting" << std::endl;
       break;
     }
 
     if (bytes_read < 0) {
-      std::cerr << "[Child] Read error: " << strerror(errno) << std::endl;
+      if (errno == EINTR) continue;
+      std::cerr << tag << "Read error: " << strerror(errno) << std::endl;
       break;
     }
 
-    if (bytes_read != sizeof(msg)) {
-      std::cerr << "[Child] Incomplete message received" << std::endl;
-      continue;
-    }
+    size_t available = pending + static_cast<size_t>(bytes_read);
+    size_t frames = available / sizeof(CANMessage);
+    pending = available % sizeof(CANMessage);
 
-    count++;
-    std::cout << "[Child] Received CAN ID: 0x" << std::hex << std::setw(3)
-              << std::setfill('0') << msg.can_id << std::dec << " | Data: ";
-    for (int j = 0; j < msg.data_length; ++j) {
-      std::cout << std::hex << std::setw(2) << std::setfill('0')
-                << static_cast<int>(msg.data[j]) << " ";
+    can_frame_crc_batch(CANCrc::CRC15, batch, frames, crcs);
+    log_crc = crc32c(log_crc, batch, frames * sizeof(CANMessage));
+
+    for (size_t k = 0; k < frames; ++k) {
+      const CANMessage& msg = batch[k];
+      count++;
+      latency.record_since(msg.timestamp);
+      if (!quiet) {
+        std::cout << tag << "Received CAN ID: ";
+        print_can_id(msg.can_id);
+        std::cout << " | Data: ";
+        for (int j = 0; j < msg.data_length; ++j) {
+          std::cout << std::hex << std::setw(2) << std::setfill('0')
+                    << static_cast<int>(msg.data[j]) << " ";
+        }
+        std::cout << std::dec << "| TS: " << msg.timestamp << std::endl;
+      }
+
+      uint8_t route = router.route(msg.can_id);
+      if (route == ROUTE_DROP) {
+        dropped++;
+        stats.filtered.fetch_add(1, std::memory_order_relaxed);
+        stats.processed.fetch_add(1, std::memory_order_release);
+        if (!quiet) {
+          std::cout << tag << "Filtered message #" << count
+                    << " | No matching route" << std::endl;
+        }
+        continue;
+      }
+
+      if (write(router[route].out_fd, &msg, sizeof(msg)) < 0) {
+        std::cerr << tag << "Forward error on route " << router[route].name
+                  << ": " << strerror(errno) << std::endl;
+        stats.processed.fetch_add(1, std::memory_order_release);
+        continue;
+      }
+      routed[route]++;
+      stats.forwarded.fetch_add(1, std::memory_order_relaxed);
+      stats.bytes.fetch_add(sizeof(msg), std::memory_order_relaxed);
+      stats.processed.fetch_add(1, std::memory_order_release);
+
+      if (!quiet) {
+        std::cout << tag << "Processed message #" << count
+                  << " | Route: " << router[route].name << " | CRC-15: 0x"
+                  << std::hex << std::setw(4) << std::setfill('0') << crcs[k]
+                  << std::dec << std::endl;
+      }
     }
-    std::cout << std::dec << "| TS: " << msg.timestamp << std::endl;
 
-    uint32_t checksum = 0;
-    for (int j = 0; j < msg.data_length; ++j) {
-      checksum += msg.data[j];
+    if (pending != 0) {
+      memmove(buffer, buffer + frames * sizeof(CANMessage), pending);
     }
-    std::cout << "[Child] Processed message #" << count
-              << " | Checksum: " << checksum << std::endl;
+    if (latency.due()) latency.print_period(std::cout);
   }
 
   close(read_fd);
-  std::cout << "[Child] Total messages received: " << count << std::endl;
+  for (size_t r = 0; r < router.size(); ++r) {
+    close(router[r].out_fd);
+  }
+
+  std::cout << tag << "Total messages received: " << count << std::endl;
+  for (size_t r = 0; r < router.size(); ++r) {
+    std::cout << tag << "  Route " << router[r].name << ": " << routed[r]
+              << std::endl;
+  }
+  std::cout << tag << "  Filtered: " << dropped << std::endl;
+  std::cout << tag << "  Log CRC-32C: 0x" << std::hex << std::setw(8)
+            << std::setfill('0') << log_crc << std::dec << " ("
+            << can_crc_backend().name << ")" << std::endl;
+  latency.print_total(std::cout);
+}
+
+bool parse_route_specs(int first, int argc, char* argv[],
+                       std::vector<RouteSpec>& specs) {
+  for (int i = first; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    if (eq == std::string::npos || eq == 0 || eq + 1 == arg.size()) {
+      return false;
+    }
+
+    RouteSpec spec{arg.substr(0, eq), {}};
+    size_t start = eq + 1;
+    while (start <= arg.size()) {
+      size_t comma = arg.find(',', start);
+      if (comma == std::string::npos) comma = arg.size();
+      spec.second.push_back(arg.substr(start, comma - start));
+      start = comma + 1;
+    }
+    specs.push_back(spec);
+  }
+  return true;
+}
+
+void print_usage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " [-n children] [-m messages] [-i interval_us] [-q]"
+               " [-w capture] [-r capture [-s speed]]"
+               " [name=filter[,filter...]]..."
+            << std::endl;
+  std::cerr << "  -w records the sent stream, -r replays a capture instead of"
+               " synthesizing frames (-s 0 = as fast as possible)"
+            << std::endl;
+  std::cerr << "  filter: ID/MASK, LO-HI or ID; append 'x' for 29-bit IDs"
+            << std::endl;
 }
 
-int main() {
-  int pipefd[2];
+int main(int argc, char* argv[]) {
+  rt_setup("anonymous_pipe");
+  int num_children = 2;
+  ParentOptions options{10, 500000, false, nullptr, nullptr, 1.0};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:m:i:qw:r:s:")) != -1) {
+    switch (opt) {
+      case 'n':
+        num_children = std::atoi(optarg);
+        break;
+      case 'm':
+        options.message_count = std::atoi(optarg);
+        break;
+      case 'i':
+        options.interval_us = static_cast<useconds_t>(std::atol(optarg));
+        break;
+      case 'q':
+        options.quiet = true;
+        break;
+      case 'w':
+        options.record_path = optarg;
+        break;
+      case 'r':
+        options.replay_path = optarg;
+        break;
+      case 's':
+        options.replay_speed = std::atof(optarg);
+        break;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  std::vector<RouteSpec> specs;
+  if (num_children < 1 || options.message_count < 0 ||
+      !parse_route_specs(optind, argc, argv, specs) ||
+      specs.size() > MAX_ROUTES) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (specs.empty()) specs = DEFAULT_ROUTES;
+
+  std::vector<int> route_read_fds;
+  CANRouter router;
+  for (const RouteSpec& spec : specs) {
+    int route_pipe[2];
+    if (pipe(route_pipe) < 0) {
+      std::cerr << "Failed to create route pipe: " << strerror(errno)
+                << std::endl;
+      return 1;
+    }
+    route_read_fds.push_back(route_pipe[0]);
+
+    int route = router.add_route(spec.first, route_pipe[1]);
+    for (const std::string& filter : spec.second) {
+      if (!parse_can_filter(router, route, filter)) {
+        std::cerr << "Invalid filter for route " << spec.first << ": "
+                  << filter << std::endl;
+        return 1;
+      }
+    }
+  }
+  router.build();
+  if (!router.verify()) {
+    std::cerr << "Route table disagrees with the filters" << std::endl;
+    return 1;
+  }
 
-  if (pipe(pipefd) < 0) {
-    std::cerr << "Failed to create pipe: " << strerror(errno) << std::endl;
+  std::vector<pid_t> sink_pids;
+  for (size_t r = 0; r < router.size(); ++r) {
+    pid_t sink_pid = fork();
+    if (sink_pid < 0) {
+      std::cerr << "Fork failed: " << strerror(errno) << std::endl;
+      return 1;
+    }
+
+    if (sink_pid == 0) {
+      for (size_t other = 0; other < router.size(); ++other) {
+        close(router[other].out_fd);
+        if (other != r) close(route_read_fds[other]);
+      }
+      sink_process(router[r].name, route_read_fds[r]);
+      return 0;
+    }
+    sink_pids.push_back(sink_pid);
+  }
+  for (int fd : route_read_fds) {
+    close(fd);
+  }
+
+  size_t stats_size = sizeof(ShardStats) * num_children;
+  ShardStats* stats = static_cast<ShardStats*>(
+      mmap(nullptr, stats_size, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+  if (stats == MAP_FAILED) {
+    std::cerr << "Failed to map shard statistics: " << strerror(errno)
+              << std::endl;
     return 1;
   }
+  for (int c = 0; c < num_children; ++c) {
+    new (&stats[c]) ShardStats();
+  }
+
+  std::vector<int> read_fds;
+  std::vector<int> write_fds;
+  for (int c = 0; c < num_children; ++c) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+      std::cerr << "Failed to create pipe: " << strerror(errno) << std::endl;
+      return 1;
+    }
+    read_fds.push_back(pipefd[0]);
+    write_fds.push_back(pipefd[1]);
+  }
 
   std::cout << "Anonymous Pipe Example - Parent/Child CAN Communication"
             << std::endl;
-  std::cout << "Pipe created: read_fd=" << pipefd[0]
-            << ", write_fd=" << pipefd[1] << std::endl;
+  for (int c = 0; c < num_children; ++c) {
+    std::cout << "Pipe " << c << " created: read_fd=" << read_fds[c]
+              << ", write_fd=" << write_fds[c] << std::endl;
+  }
+  for (const RouteSpec& spec : specs) {
+    std::cout << "Route " << spec.first << ":";
+    for (const std::string& filter : spec.second) {
+      std::cout << " " << filter;
+    }
+    std::cout << std::endl;
+  }
   std::cout << std::string(80, '=') << std::endl;
 
-  pid_t pid = fork();
+  std::vector<pid_t> child_pids;
+  for (int c = 0; c < num_children; ++c) {
+    pid_t pid = fork();
 
-  if (pid < 0) {
-    std::cerr << "Fork failed: " << strerror(errno) << std::endl;
-    close(pipefd[0]);
-    close(pipefd[1]);
-    return 1;
+    if (pid < 0) {
+      std::cerr << "Fork failed: " << strerror(errno) << std::endl;
+      for (int fd : write_fds) {
+        close(fd);
+      }
+      break;
+    }
+
+    if (pid == 0) {
+      for (int other = 0; other < num_children; ++other) {
+        close(write_fds[other]);
+        if (other != c) close(read_fds[other]);
+      }
+      child_process(c, read_fds[c], router, stats[c], options.quiet);
+      return 0;
+    }
+    child_pids.push_back(pid);
   }
 
-  if (pid == 0) {
-    child_process(pipefd[1], pipefd[0]);
-    return 0;
-  } else {
-    parent_process(pipefd[1], pipefd[0]);
+  for (size_t r = 0; r < router.size(); ++r) {
+    close(router[r].out_fd);
+  }
+  for (int fd : read_fds) {
+    close(fd);
+  }
+
+  if (child_pids.size() == static_cast<size_t>(num_children)) {
+    parent_process(write_fds, stats, options);
+  }
 
+  for (size_t c = 0; c < child_pids.size(); ++c) {
     int status;
-    waitpid(pid, &status, 0);
+    waitpid(child_pids[c], &status, 0);
+    std::cout << "Child " << c << " exit status: " << WEXITSTATUS(status)
+              << std::endl;
+  }
+  for (pid_t sink_pid : sink_pids) {
+    waitpid(sink_pid, nullptr, 0);
+  }
 
-    std::cout << std::string(80, '=') << std::endl;
-    std::cout << "Parent process completed. Child exit status: "
-              << WEXITSTATUS(status) << std::endl;
+  std::cout << std::string(80, '=') << std::endl;
+  std::cout << "Per-child statistics:" << std::endl;
+  uint64_t total_processed = 0;
+  uint64_t total_forwarded = 0;
+  uint64_t total_filtered = 0;
+  for (int c = 0; c < num_children; ++c) {
+    const ShardStats& s = stats[c];
+    std::cout << "  Child " << c << ": sent=" << s.sent
+              << " processed=" << s.processed.load()
+              << " forwarded=" << s.forwarded.load()
+              << " filtered=" << s.filtered.load()
+              << " bytes=" << s.bytes.load() << " max_lag=" << s.max_lag
+              << " migrations_in=" << s.migrations << std::endl;
+    total_processed += s.processed.load();
+    total_forwarded += s.forwarded.load();
+    total_filtered += s.filtered.load();
   }
+  std::cout << "  Total: processed=" << total_processed
+            << " forwarded=" << total_forwarded
+            << " filtered=" << total_filtered << std::endl;
+  std::cout << "Parent process completed." << std::endl;
 
+  munmap(stats, stats_size);
   return 0;
 }
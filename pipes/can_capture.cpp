@@ -0,0 +1,224 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "can_capture.h"
+#include "can_message.h"
+#include "can_router.h"
+
+void print_usage(const char* program) {
+  std::cerr << "Usage:" << std::endl;
+  std::cerr << "  " << program << " info <capture>" << std::endl;
+  std::cerr << "  " << program << " dump <capture> [from_us] [count]"
+            << std::endl;
+  std::cerr << "  " << program << " import <candump.log> <capture>"
+            << std::endl;
+  std::cerr << "  " << program << " synth <capture> <seconds> <frames/s>"
+            << std::endl;
+}
+
+bool open_reader(CaptureReader& reader, const char* path) {
+  if (!reader.open(path)) {
+    std::cerr << "Failed to open capture " << path << ": " << strerror(errno)
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int cmd_info(const char* path) {
+  CaptureReader reader;
+  if (!open_reader(reader, path)) return 1;
+
+  const CaptureHeader& h = reader.header();
+  double duration = (h.last_timestamp_us - h.first_timestamp_us) / 1e6;
+  std::cout << "Capture: " << path << std::endl;
+  std::cout << "  Records:     " << h.record_count << " x " << h.record_size
+            << " bytes" << std::endl;
+  std::cout << "  Index:       " << h.index_count << " entries, stride "
+            << h.index_stride << std::endl;
+  std::cout << "  First TS:    " << h.first_timestamp_us << std::endl;
+  std::cout << "  Last TS:     " << h.last_timestamp_us << std::endl;
+  std::cout << "  Duration:    " << std::fixed << std::setprecision(3)
+            << duration << " s" << std::endl;
+  if (duration > 0) {
+    std::cout << "  Average rate: " << std::setprecision(1)
+              << h.record_count / duration << " frames/s" << std::endl;
+  }
+  return 0;
+}
+
+int cmd_dump(const char* path, uint64_t from_us, uint64_t limit) {
+  CaptureReader reader;
+  if (!open_reader(reader, path)) return 1;
+
+  CaptureIndexEntry start = reader.seek(from_us);
+  uint64_t ts = start.timestamp_us;
+  uint64_t shown = 0;
+  for (uint64_t i = start.record; i < reader.size() && shown < limit; ++i) {
+    const CaptureRecord& record = reader.record(i);
+    if (i != start.record) ts += record.delta_us;
+    if (ts < from_us) continue;
+
+    std::cout << "(" << ts / 1000000 << "." << std::setw(6)
+              << std::setfill('0') << ts % 1000000 << ") " << std::hex
+              << std::uppercase;
+    if (record.can_id & CAN_EFF_FLAG) {
+      std::cout << std::setw(8) << (record.can_id & CAN_EFF_MASK);
+    } else {
+      std::cout << std::setw(3) << record.can_id;
+    }
+    std::cout << "#";
+    for (int j = 0; j < record.data_length; ++j) {
+      std::cout << std::setw(2) << static_cast<int>(record.data[j]);
+    }
+    std::cout << std::dec << std::nouppercase << std::setfill(' ')
+              << std::endl;
+    shown++;
+  }
+  return 0;
+}
+
+// Accepts candump -l lines: "(seconds.micros) iface ID#DATA". Remote and
+// CAN-FD frames are skipped.
+bool parse_candump_line(const std::string& line, CANMessage& msg,
+                        uint64_t& timestamp_us) {
+  unsigned long long seconds = 0;
+  unsigned long long micros = 0;
+  char frame[64];
+  if (sscanf(line.c_str(), "(%llu.%llu) %*s %63s", &seconds, &micros,
+             frame) != 3) {
+    return false;
+  }
+
+  char* hash = strchr(frame, '#');
+  if (!hash || hash[1] == '#' || hash[1] == 'R') return false;
+
+  size_t id_digits = static_cast<size_t>(hash - frame);
+  char* end = nullptr;
+  uint32_t id = static_cast<uint32_t>(strtoul(frame, &end, 16));
+  if (end != hash) return false;
+
+  msg = CANMessage{};
+  msg.can_id = id_digits > 3 ? (CAN_EFF_FLAG | (id & CAN_EFF_MASK))
+                             : (id & CAN_SFF_MASK);
+  timestamp_us = seconds * 1000000ULL + micros;
+
+  const char* data = hash + 1;
+  size_t digits = strlen(data);
+  if (digits % 2 != 0 || digits > 16) return false;
+  msg.data_length = static_cast<uint8_t>(digits / 2);
+  for (size_t j = 0; j < msg.data_length; ++j) {
+    char byte[3] = {data[2 * j], data[2 * j + 1], '\0'};
+    msg.data[j] = static_cast<uint8_t>(strtoul(byte, &end, 16));
+    if (*end != '\0') return false;
+  }
+  return true;
+}
+
+int cmd_import(const char* log_path, const char* path) {
+  std::ifstream log(log_path);
+  if (!log) {
+    std::cerr << "Failed to open " << log_path << std::endl;
+    return 1;
+  }
+
+  CaptureWriter writer;
+  if (!writer.open(path)) {
+    std::cerr << "Failed to create capture " << path << ": "
+              << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  std::string line;
+  uint64_t skipped = 0;
+  CANMessage msg;
+  uint64_t timestamp_us = 0;
+  while (std::getline(log, line)) {
+    if (!parse_candump_line(line, msg, timestamp_us)) {
+      skipped++;
+      continue;
+    }
+    if (!writer.append(msg, timestamp_us)) {
+      std::cerr << "Capture write error: " << strerror(errno) << std::endl;
+      return 1;
+    }
+  }
+
+  uint64_t imported = writer.record_count();
+  if (!writer.close()) {
+    std::cerr << "Failed to finalize capture: " << strerror(errno)
+              << std::endl;
+    return 1;
+  }
+  std::cout << "Imported " << imported << " frames (" << skipped
+            << " lines skipped)" << std::endl;
+  return 0;
+}
+
+int cmd_synth(const char* path, double seconds, double rate) {
+  if (seconds <= 0 || rate <= 0) {
+    std::cerr << "Duration and rate must be positive" << std::endl;
+    return 1;
+  }
+
+  CaptureWriter writer;
+  if (!writer.open(path)) {
+    std::cerr << "Failed to create capture " << path << ": "
+              << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  uint64_t frames = static_cast<uint64_t>(seconds * rate);
+  uint64_t base_us = 1700000000ULL * 1000000ULL;
+  CANMessage msg{};
+  for (uint64_t i = 0; i < frames; ++i) {
+    uint32_t n = static_cast<uint32_t>(i);
+    msg.can_id = (n % 4 == 3) ? (CAN_EFF_FLAG | (0x18FEF100 + n % 64))
+                              : (0x100 + n % 16);
+    msg.data_length = 8;
+    for (int j = 0; j < 8; ++j) {
+      msg.data[j] = static_cast<uint8_t>((i * 10 + j) % 256);
+    }
+    if (!writer.append(msg, base_us + static_cast<uint64_t>(i * 1e6 / rate))) {
+      std::cerr << "Capture write error: " << strerror(errno) << std::endl;
+      return 1;
+    }
+  }
+
+  if (!writer.close()) {
+    std::cerr << "Failed to finalize capture: " << strerror(errno)
+              << std::endl;
+    return 1;
+  }
+  std::cout << "Synthesized " << frames << " frames over " << seconds << " s"
+            << std::endl;
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  std::string command = argv[1];
+  if (command == "info") {
+    return cmd_info(argv[2]);
+  } else if (command == "dump") {
+    uint64_t from_us = argc > 3 ? strtoull(argv[3], nullptr, 0) : 0;
+    uint64_t limit = argc > 4 ? strtoull(argv[4], nullptr, 0) : UINT64_MAX;
+    return cmd_dump(argv[2], from_us, limit);
+  } else if (command == "import" && argc == 4) {
+    return cmd_import(argv[2], argv[3]);
+  } else if (command == "synth" && argc == 5) {
+    return cmd_synth(argv[2], atof(argv[3]), atof(argv[4]));
+  }
+
+  print_usage(argv[0]);
+  return 1;
+}
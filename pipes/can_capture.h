@@ -0,0 +1,323 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "can_message.h"
+
+// Capture file layout: CaptureHeader, record_count packed CaptureRecords
+// with microsecond deltas, then one CaptureIndexEntry per index_stride
+// records holding the absolute timestamp of that record.
+constexpr char CAPTURE_MAGIC[8] = {'C', 'A', 'N', 'C', 'A', 'P', '0', '1'};
+constexpr uint32_t CAPTURE_VERSION = 1;
+constexpr uint32_t CAPTURE_INDEX_STRIDE = 4096;
+constexpr size_t CAPTURE_GROW_BYTES = 16 << 20;
+constexpr size_t CAPTURE_PREFETCH_RECORDS = 1 << 16;
+constexpr uint64_t REPLAY_SLACK_NS = 50000;
+constexpr size_t REPLAY_CLOCK_INTERVAL = 64;
+
+struct CaptureHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t record_count;
+  uint64_t index_offset;
+  uint64_t index_count;
+  uint64_t first_timestamp_us;
+  uint64_t last_timestamp_us;
+  uint32_t index_stride;
+  uint32_t reserved;
+};
+
+struct __attribute__((packed)) CaptureRecord {
+  uint32_t delta_us;
+  uint32_t can_id;
+  uint8_t data_length;
+  uint8_t data[8];
+};
+
+struct CaptureIndexEntry {
+  uint64_t timestamp_us;
+  uint64_t record;
+};
+
+static_assert(sizeof(CaptureHeader) == 64, "CaptureHeader layout changed");
+static_assert(sizeof(CaptureRecord) == 17, "CaptureRecord must be packed");
+
+class CaptureWriter {
+ public:
+  CaptureWriter() = default;
+  CaptureWriter(const CaptureWriter&) = delete;
+  CaptureWriter& operator=(const CaptureWriter&) = delete;
+  ~CaptureWriter() { close(); }
+
+  bool open(const std::string& path) {
+    fd_ = ::open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0666);
+    if (fd_ < 0) return false;
+
+    used_ = sizeof(CaptureHeader);
+    if (!reserve(0)) {
+      ::close(fd_);
+      fd_ = -1;
+      return false;
+    }
+
+    memset(&header_, 0, sizeof(header_));
+    memcpy(header_.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    header_.version = CAPTURE_VERSION;
+    header_.record_size = sizeof(CaptureRecord);
+    header_.index_stride = CAPTURE_INDEX_STRIDE;
+    return true;
+  }
+
+  bool is_open() const { return fd_ >= 0; }
+
+  // Captures keep wall-clock microseconds, as candump logs do, so the
+  // caller passes the frame's time; the frame's own timestamp is a
+  // monotonic send stamp. Gaps longer than ~71 minutes are clamped to the
+  // largest delta.
+  bool append(const CANMessage& msg, uint64_t timestamp_us) {
+    if (!reserve(sizeof(CaptureRecord))) return false;
+
+    if (header_.record_count == 0) {
+      header_.first_timestamp_us = timestamp_us;
+      header_.last_timestamp_us = timestamp_us;
+    }
+    uint64_t delta = timestamp_us > header_.last_timestamp_us
+                         ? timestamp_us - header_.last_timestamp_us
+                         : 0;
+    delta = std::min<uint64_t>(delta, UINT32_MAX);
+    header_.last_timestamp_us += delta;
+
+    if (header_.record_count % CAPTURE_INDEX_STRIDE == 0) {
+      index_.push_back({header_.last_timestamp_us, header_.record_count});
+    }
+
+    CaptureRecord record;
+    record.delta_us = static_cast<uint32_t>(delta);
+    record.can_id = msg.can_id;
+    record.data_length = std::min<uint8_t>(msg.data_length, 8);
+    memcpy(record.data, msg.data, sizeof(record.data));
+    memcpy(map_ + used_, &record, sizeof(record));
+    used_ += sizeof(record);
+    header_.record_count++;
+    return true;
+  }
+
+  bool close() {
+    if (fd_ < 0) return true;
+
+    size_t index_bytes = index_.size() * sizeof(CaptureIndexEntry);
+    size_t padding = (8 - used_ % 8) % 8;
+    bool ok = reserve(padding + index_bytes);
+    if (ok) {
+      memset(map_ + used_, 0, padding);
+      used_ += padding;
+      header_.index_offset = used_;
+      header_.index_count = index_.size();
+      memcpy(map_ + used_, index_.data(), index_bytes);
+      used_ += index_bytes;
+      memcpy(map_, &header_, sizeof(header_));
+    }
+
+    munmap(map_, mapped_);
+    ok = ok && ftruncate(fd_, static_cast<off_t>(used_)) == 0;
+    ::close(fd_);
+    fd_ = -1;
+    map_ = nullptr;
+    mapped_ = 0;
+    index_.clear();
+    return ok;
+  }
+
+  uint64_t record_count() const { return header_.record_count; }
+
+ private:
+  bool reserve(size_t bytes) {
+    if (used_ + bytes <= mapped_) return true;
+
+    size_t size = std::max(mapped_ + CAPTURE_GROW_BYTES, used_ + bytes);
+    if (ftruncate(fd_, static_cast<off_t>(size)) < 0) return false;
+    void* map = map_ ? mremap(map_, mapped_, size, MREMAP_MAYMOVE)
+                     : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            fd_, 0);
+    if (map == MAP_FAILED) return false;
+    map_ = static_cast<uint8_t*>(map);
+    mapped_ = size;
+    return true;
+  }
+
+  int fd_ = -1;
+  uint8_t* map_ = nullptr;
+  size_t mapped_ = 0;
+  size_t used_ = 0;
+  CaptureHeader header_{};
+  std::vector<CaptureIndexEntry> index_;
+};
+
+class CaptureReader {
+ public:
+  CaptureReader() = default;
+  CaptureReader(const CaptureReader&) = delete;
+  CaptureReader& operator=(const CaptureReader&) = delete;
+  ~CaptureReader() { close(); }
+
+  // Fails with EINVAL when the file is not a well-formed capture.
+  bool open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+      ::close(fd);
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ < sizeof(CaptureHeader)) {
+      ::close(fd);
+      errno = EINVAL;
+      return false;
+    }
+
+    void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+    map_ = static_cast<const uint8_t*>(map);
+    madvise(map, size_, MADV_SEQUENTIAL);
+
+    const CaptureHeader& h = header();
+    uint64_t records_end =
+        sizeof(CaptureHeader) + h.record_count * sizeof(CaptureRecord);
+    if (memcmp(h.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0 ||
+        h.version != CAPTURE_VERSION ||
+        h.record_size != sizeof(CaptureRecord) || h.index_stride == 0 ||
+        records_end > h.index_offset ||
+        h.index_offset + h.index_count * sizeof(CaptureIndexEntry) > size_) {
+      close();
+      errno = EINVAL;
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (map_) munmap(const_cast<uint8_t*>(map_), size_);
+    map_ = nullptr;
+    size_ = 0;
+  }
+
+  const CaptureHeader& header() const {
+    return *reinterpret_cast<const CaptureHeader*>(map_);
+  }
+
+  uint64_t size() const { return header().record_count; }
+
+  const CaptureRecord& record(uint64_t i) const {
+    return *reinterpret_cast<const CaptureRecord*>(
+        map_ + sizeof(CaptureHeader) + i * sizeof(CaptureRecord));
+  }
+
+  const CaptureIndexEntry* index() const {
+    return reinterpret_cast<const CaptureIndexEntry*>(map_ +
+                                                      header().index_offset);
+  }
+
+  // Returns the index entry at or before timestamp_us; replay from there
+  // and skip records that are still earlier.
+  CaptureIndexEntry seek(uint64_t timestamp_us) const {
+    const CaptureIndexEntry* begin = index();
+    const CaptureIndexEntry* end = begin + header().index_count;
+    const CaptureIndexEntry* it = std::upper_bound(
+        begin, end, timestamp_us,
+        [](uint64_t ts, const CaptureIndexEntry& e) {
+          return ts < e.timestamp_us;
+        });
+    if (it == begin) return {header().first_timestamp_us, 0};
+    return *(it - 1);
+  }
+
+  void prefetch(uint64_t first, uint64_t count) const {
+    if (first >= size()) return;
+    count = std::min(count, size() - first);
+    uintptr_t start = reinterpret_cast<uintptr_t>(&record(first));
+    uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t aligned = start & ~(page - 1);
+    madvise(reinterpret_cast<void*>(aligned),
+            start - aligned + count * sizeof(CaptureRecord), MADV_WILLNEED);
+  }
+
+ private:
+  const uint8_t* map_ = nullptr;
+  size_t size_ = 0;
+};
+
+inline uint64_t wall_clock_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Feeds every record to emit(). With speed > 0 the original gaps are
+// divided by speed and flush() runs before each sleep so batched output
+// never waits on the schedule; speed <= 0 replays as fast as possible.
+// Replayed frames are stamped with their scheduled send time on the
+// CLOCK_MONOTONIC wire clock.
+template <typename Emit, typename Flush>
+uint64_t replay_capture(const CaptureReader& reader, double speed, Emit&& emit,
+                        Flush&& flush) {
+  uint64_t start_ns = wire_timestamp_ns();
+  uint64_t now_ns = 0;
+  uint64_t offset_us = 0;
+
+  uint64_t count = reader.size();
+  for (uint64_t i = 0; i < count; ++i) {
+    if (i % CAPTURE_PREFETCH_RECORDS == 0) {
+      reader.prefetch(i + CAPTURE_PREFETCH_RECORDS, CAPTURE_PREFETCH_RECORDS);
+    }
+
+    const CaptureRecord& record = reader.record(i);
+    if (i != 0) offset_us += record.delta_us;
+
+    uint64_t due_ns = 0;
+    if (speed > 0) {
+      due_ns = static_cast<uint64_t>(offset_us * 1000.0 / speed);
+      if (due_ns > now_ns) now_ns = wire_timestamp_ns() - start_ns;
+      if (due_ns > now_ns + REPLAY_SLACK_NS) {
+        flush();
+        uint64_t wake = start_ns + due_ns;
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(wake / 1000000000ULL);
+        ts.tv_nsec = static_cast<long>(wake % 1000000000ULL);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) ==
+               EINTR) {
+        }
+        now_ns = due_ns;
+      }
+    } else {
+      if (i % REPLAY_CLOCK_INTERVAL == 0) {
+        now_ns = wire_timestamp_ns() - start_ns;
+      }
+      due_ns = now_ns;
+    }
+
+    CANMessage msg{};
+    msg.can_id = record.can_id;
+    msg.data_length = record.data_length;
+    memcpy(msg.data, record.data, sizeof(msg.data));
+    msg.timestamp = start_ns + due_ns;
+    emit(msg);
+  }
+
+  flush();
+  return count;
+}
@@ -0,0 +1,244 @@
+#include "can_crc.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CAN_CRC_X86 1
+#endif
+
+namespace {
+
+struct CrcParams {
+  uint32_t poly;
+  unsigned width;
+};
+
+constexpr CrcParams CRC_PARAMS[] = {
+    {0x4599, 15},
+    {0x1685B, 17},
+    {0x102899, 21},
+};
+
+using CrcTable = std::array<uint32_t, 256>;
+
+constexpr CrcTable make_msb_table(CrcParams params) {
+  CrcTable table{};
+  uint32_t top = 1U << (params.width - 1);
+  uint32_t mask = (1U << params.width) - 1;
+  for (uint32_t b = 0; b < 256; ++b) {
+    uint32_t r = b << (params.width - 8);
+    for (int bit = 0; bit < 8; ++bit) {
+      r = (r & top) ? ((r << 1) ^ params.poly) : (r << 1);
+    }
+    table[b] = r & mask;
+  }
+  return table;
+}
+
+constexpr CrcTable make_crc32c_table() {
+  CrcTable table{};
+  for (uint32_t b = 0; b < 256; ++b) {
+    uint32_t r = b;
+    for (int bit = 0; bit < 8; ++bit) {
+      r = (r & 1) ? ((r >> 1) ^ 0x82F63B78U) : (r >> 1);
+    }
+    table[b] = r;
+  }
+  return table;
+}
+
+constexpr CrcTable CRC_TABLES[] = {
+    make_msb_table(CRC_PARAMS[0]),
+    make_msb_table(CRC_PARAMS[1]),
+    make_msb_table(CRC_PARAMS[2]),
+};
+
+constexpr CrcTable CRC32C_TABLE = make_crc32c_table();
+
+uint32_t portable_crc(CANCrc kind, const uint8_t* data, size_t len) {
+  const CrcParams& params = CRC_PARAMS[static_cast<size_t>(kind)];
+  const CrcTable& table = CRC_TABLES[static_cast<size_t>(kind)];
+  uint32_t mask = (1U << params.width) - 1;
+  unsigned shift = params.width - 8;
+
+  uint32_t r = 0;
+  for (size_t i = 0; i < len; ++i) {
+    r = ((r << 8) ^ table[((r >> shift) ^ data[i]) & 0xFF]) & mask;
+  }
+  return r;
+}
+
+void portable_frame_crc_batch(CANCrc kind, const CANMessage* frames,
+                              size_t count, uint32_t* out) {
+  uint8_t bytes[CAN_FRAME_CRC_BYTES];
+  for (size_t i = 0; i < count; ++i) {
+    size_t len = can_frame_serialize(frames[i], bytes);
+    out[i] = portable_crc(kind, bytes, len);
+  }
+}
+
+uint32_t portable_crc32c(uint32_t crc, const void* data, size_t len) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < len; ++i) {
+    crc = (crc >> 8) ^ CRC32C_TABLE[(crc ^ bytes[i]) & 0xFF];
+  }
+  return ~crc;
+}
+
+#ifdef CAN_CRC_X86
+
+// Barrett reduction with carry-less multiplies: for deg(A) < 64,
+// A mod P = A ^ (floor(floor(A / x^w) * mu / x^(64-w)) * P) with
+// mu = floor(x^64 / P).
+struct BarrettParams {
+  uint64_t poly;
+  uint64_t mu;
+  unsigned width;
+};
+
+constexpr BarrettParams make_barrett(CrcParams params) {
+  uint64_t full = (1ULL << params.width) | params.poly;
+  unsigned __int128 r = static_cast<unsigned __int128>(1) << 64;
+  uint64_t q = 0;
+  for (int i = 64 - static_cast<int>(params.width); i >= 0; --i) {
+    if ((r >> (i + params.width)) & 1) {
+      r ^= static_cast<unsigned __int128>(full) << i;
+      q |= 1ULL << i;
+    }
+  }
+  return {full, q, params.width};
+}
+
+constexpr BarrettParams BARRETT_PARAMS[] = {
+    make_barrett(CRC_PARAMS[0]),
+    make_barrett(CRC_PARAMS[1]),
+    make_barrett(CRC_PARAMS[2]),
+};
+
+__attribute__((target("pclmul,sse4.1"))) inline uint32_t barrett_step(
+    const BarrettParams& params, uint32_t r, uint32_t w, unsigned bits) {
+  uint64_t a = (static_cast<uint64_t>(r) << bits) ^
+               (static_cast<uint64_t>(w) << params.width);
+  __m128i t1 = _mm_cvtsi64_si128(static_cast<long long>(a >> params.width));
+  __m128i prod = _mm_clmulepi64_si128(
+      t1, _mm_cvtsi64_si128(static_cast<long long>(params.mu)), 0x00);
+  uint64_t lo = static_cast<uint64_t>(_mm_cvtsi128_si64(prod));
+  uint64_t hi = static_cast<uint64_t>(_mm_extract_epi64(prod, 1));
+  uint64_t q = (lo >> (64 - params.width)) | (hi << params.width);
+  __m128i qp = _mm_clmulepi64_si128(
+      _mm_cvtsi64_si128(static_cast<long long>(q)),
+      _mm_cvtsi64_si128(static_cast<long long>(params.poly)), 0x00);
+  uint64_t reduced = a ^ static_cast<uint64_t>(_mm_cvtsi128_si64(qp));
+  return static_cast<uint32_t>(reduced & ((1ULL << params.width) - 1));
+}
+
+__attribute__((target("pclmul,sse4.1"))) uint32_t clmul_crc(
+    CANCrc kind, const uint8_t* data, size_t len) {
+  const BarrettParams& params = BARRETT_PARAMS[static_cast<size_t>(kind)];
+  uint32_t r = 0;
+  size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    uint32_t w = (static_cast<uint32_t>(data[i]) << 24) |
+                 (static_cast<uint32_t>(data[i + 1]) << 16) |
+                 (static_cast<uint32_t>(data[i + 2]) << 8) | data[i + 3];
+    r = barrett_step(params, r, w, 32);
+  }
+  for (; i < len; ++i) {
+    r = barrett_step(params, r, data[i], 8);
+  }
+  return r;
+}
+
+// Frames are serialized into zero-padded 16-byte rows and reduced in
+// lockstep groups so the carry-less multiply chains of independent frames
+// overlap instead of serializing on each other.
+__attribute__((target("pclmul,sse4.1"))) void clmul_frame_crc_batch(
+    CANCrc kind, const CANMessage* frames, size_t count, uint32_t* out) {
+  constexpr size_t LANES = 4;
+  const BarrettParams& params = BARRETT_PARAMS[static_cast<size_t>(kind)];
+
+  size_t i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    uint8_t rows[LANES][16];
+    size_t lengths[LANES];
+    size_t longest = 0;
+    for (size_t lane = 0; lane < LANES; ++lane) {
+      lengths[lane] = can_frame_serialize(frames[i + lane], rows[lane]);
+      longest = std::max(longest, lengths[lane]);
+    }
+
+    uint32_t r[LANES] = {};
+    for (size_t pos = 0; pos + 4 <= longest; pos += 4) {
+      for (size_t lane = 0; lane < LANES; ++lane) {
+        if (pos + 4 > lengths[lane]) continue;
+        const uint8_t* b = rows[lane] + pos;
+        uint32_t w = (static_cast<uint32_t>(b[0]) << 24) |
+                     (static_cast<uint32_t>(b[1]) << 16) |
+                     (static_cast<uint32_t>(b[2]) << 8) | b[3];
+        r[lane] = barrett_step(params, r[lane], w, 32);
+      }
+    }
+    for (size_t lane = 0; lane < LANES; ++lane) {
+      for (size_t pos = lengths[lane] & ~size_t{3}; pos < lengths[lane];
+           ++pos) {
+        r[lane] = barrett_step(params, r[lane], rows[lane][pos], 8);
+      }
+      out[i + lane] = r[lane];
+    }
+  }
+
+  uint8_t bytes[CAN_FRAME_CRC_BYTES];
+  for (; i < count; ++i) {
+    size_t len = can_frame_serialize(frames[i], bytes);
+    out[i] = clmul_crc(kind, bytes, len);
+  }
+}
+
+__attribute__((target("sse4.2"))) uint32_t sse42_crc32c(uint32_t crc,
+                                                         const void* data,
+                                                         size_t len) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t state = ~crc;
+  for (; len >= 8; len -= 8, bytes += 8) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    state = _mm_crc32_u64(state, word);
+  }
+  uint32_t tail = static_cast<uint32_t>(state);
+  for (; len > 0; --len, ++bytes) {
+    tail = _mm_crc32_u8(tail, *bytes);
+  }
+  return ~tail;
+}
+
+#endif
+
+}  // namespace
+
+const CANCrcBackend& can_crc_portable() {
+  static const CANCrcBackend backend{"portable", portable_crc,
+                                     portable_frame_crc_batch,
+                                     portable_crc32c};
+  return backend;
+}
+
+const CANCrcBackend* can_crc_accelerated() {
+#ifdef CAN_CRC_X86
+  static const CANCrcBackend backend{"pclmul+sse4.2", clmul_crc,
+                                     clmul_frame_crc_batch, sse42_crc32c};
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.2")) {
+    return &backend;
+  }
+#endif
+  return nullptr;
+}
+
+const CANCrcBackend& can_crc_backend() {
+  static const CANCrcBackend* selected = can_crc_accelerated();
+  return selected ? *selected : can_crc_portable();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "can_message.h"
+
+// CRC-15/CAN for classic frames, CRC-17/CAN-FD and CRC-21/CAN-FD for FD
+// payloads up to and above 16 bytes. Computed MSB-first over the frame
+// serialized as big-endian can_id, data_length and the used data bytes.
+enum class CANCrc : uint8_t { CRC15, CRC17, CRC21 };
+
+constexpr size_t CAN_FRAME_CRC_BYTES = 4 + 1 + 8;
+
+struct CANCrcBackend {
+  const char* name;
+  uint32_t (*crc)(CANCrc kind, const uint8_t* data, size_t len);
+  void (*frame_crc_batch)(CANCrc kind, const CANMessage* frames, size_t count,
+                          uint32_t* out);
+  // Running CRC-32C (Castagnoli); pass 0 to start a new stream.
+  uint32_t (*crc32c)(uint32_t crc, const void* data, size_t len);
+};
+
+const CANCrcBackend& can_crc_portable();
+
+// Returns nullptr when the CPU lacks PCLMULQDQ or SSE4.2.
+const CANCrcBackend* can_crc_accelerated();
+
+// Backend picked once by CPU feature detection.
+const CANCrcBackend& can_crc_backend();
+
+inline size_t can_frame_serialize(const CANMessage& msg,
+                                  uint8_t out[CAN_FRAME_CRC_BYTES]) {
+  size_t length = msg.data_length > 8 ? 8 : msg.data_length;
+  out[0] = static_cast<uint8_t>(msg.can_id >> 24);
+  out[1] = static_cast<uint8_t>(msg.can_id >> 16);
+  out[2] = static_cast<uint8_t>(msg.can_id >> 8);
+  out[3] = static_cast<uint8_t>(msg.can_id);
+  out[4] = static_cast<uint8_t>(length);
+  for (size_t i = 0; i < length; ++i) {
+    out[5 + i] = msg.data[i];
+  }
+  return 5 + length;
+}
+
+inline void can_frame_crc_batch(CANCrc kind, const CANMessage* frames,
+                                size_t count, uint32_t* out) {
+  can_crc_backend().frame_crc_batch(kind, frames, count, out);
+}
+
+inline uint32_t crc32c(uint32_t crc, const void* data, size_t len) {
+  return can_crc_backend().crc32c(crc, data, len);
+}
@@ -0,0 +1,160 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "can_crc.h"
+#include "can_message.h"
+
+constexpr size_t DEFAULT_FRAMES = 1 << 20;
+constexpr int ROUNDS = 5;
+
+template <typename Fn>
+double best_ns_per_frame(size_t frames, Fn&& fn) {
+  double best = 0.0;
+  for (int round = 0; round < ROUNDS; ++round) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ns =
+        std::chrono::duration<double, std::nano>(elapsed).count() / frames;
+    if (round == 0 || ns < best) best = ns;
+  }
+  return best;
+}
+
+void report(const std::string& name, double ns_per_frame, double baseline) {
+  std::cout << "  " << std::left << std::setw(28) << name << std::right
+            << std::fixed << std::setprecision(2) << std::setw(8)
+            << ns_per_frame << " ns/frame  " << std::setw(8)
+            << (sizeof(CANMessage) / ns_per_frame) * 1000.0 << " MB/s  x"
+            << std::setprecision(2) << (baseline / ns_per_frame) << std::endl;
+}
+
+// Standard check values (CRC of "123456789"), so a bug shared by every
+// backend cannot pass as agreement between them.
+constexpr uint32_t CRC_CHECK_VALUES[] = {0x059E, 0x04F03, 0x0ED841};
+constexpr uint32_t CRC32C_CHECK_VALUE = 0xE3069283;
+
+bool check_backend(const CANCrcBackend& backend, const char* const names[],
+                   const CANMessage& frame) {
+  const char* input = "123456789";
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(input);
+  uint8_t serialized[CAN_FRAME_CRC_BYTES];
+  size_t serialized_len = can_frame_serialize(frame, serialized);
+  bool ok = true;
+  for (int k = 0; k < 3; ++k) {
+    CANCrc kind = static_cast<CANCrc>(k);
+    uint32_t crc = backend.crc(kind, bytes, strlen(input));
+    uint32_t batch = 0;
+    backend.frame_crc_batch(kind, &frame, 1, &batch);
+    if (crc != CRC_CHECK_VALUES[k] ||
+        batch != backend.crc(kind, serialized, serialized_len)) {
+      std::cerr << names[k] << ": " << backend.name
+                << " backend fails its check value" << std::endl;
+      ok = false;
+    }
+  }
+  if (backend.crc32c(0, input, strlen(input)) != CRC32C_CHECK_VALUE) {
+    std::cerr << "CRC-32C: " << backend.name
+              << " backend fails its check value" << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : DEFAULT_FRAMES;
+  if (count == 0) {
+    std::cerr << "Usage: " << argv[0] << " [frames]" << std::endl;
+    return 1;
+  }
+
+  std::vector<CANMessage> frames(count);
+  srand(42);
+  for (size_t i = 0; i < count; ++i) {
+    frames[i].can_id = 0x100 + (rand() & 0x6FF);
+    frames[i].data_length = 8;
+    for (int j = 0; j < 8; ++j) {
+      frames[i].data[j] = static_cast<uint8_t>(rand());
+    }
+    frames[i].timestamp = i;
+  }
+
+  const CANCrcBackend& portable = can_crc_portable();
+  const CANCrcBackend* accelerated = can_crc_accelerated();
+  std::vector<uint32_t> out(count);
+  std::vector<uint32_t> check(count);
+  volatile uint32_t sink = 0;
+
+  const char* names[] = {"CRC-15/CAN", "CRC-17/CAN-FD", "CRC-21/CAN-FD"};
+  if (!check_backend(portable, names, frames[0]) ||
+      (accelerated && !check_backend(*accelerated, names, frames[0]))) {
+    return 1;
+  }
+
+  std::cout << "CAN CRC benchmark - " << count << " frames, selected backend: "
+            << can_crc_backend().name << std::endl;
+  std::cout << std::string(80, '-') << std::endl;
+
+  double baseline = best_ns_per_frame(count, [&] {
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t checksum = 0;
+      for (int j = 0; j < frames[i].data_length; ++j) {
+        checksum += frames[i].data[j];
+      }
+      out[i] = checksum;
+    }
+    sink = out[count - 1];
+  });
+  report("scalar byte-sum", baseline, baseline);
+
+  for (int k = 0; k < 3; ++k) {
+    CANCrc kind = static_cast<CANCrc>(k);
+    report(std::string(names[k]) + " portable",
+           best_ns_per_frame(count,
+                             [&] {
+                               portable.frame_crc_batch(kind, frames.data(),
+                                                        count, check.data());
+                             }),
+           baseline);
+    if (accelerated) {
+      report(std::string(names[k]) + " " + accelerated->name,
+             best_ns_per_frame(count,
+                               [&] {
+                                 accelerated->frame_crc_batch(
+                                     kind, frames.data(), count, out.data());
+                               }),
+             baseline);
+      if (out != check) {
+        std::cerr << names[k] << ": backend results differ" << std::endl;
+        return 1;
+      }
+    }
+  }
+
+  size_t bytes = count * sizeof(CANMessage);
+  uint32_t expected = 0;
+  report("CRC-32C batch portable", best_ns_per_frame(count, [&] {
+           expected = portable.crc32c(0, frames.data(), bytes);
+         }),
+         baseline);
+  if (accelerated) {
+    uint32_t actual = 0;
+    report(std::string("CRC-32C batch ") + accelerated->name,
+           best_ns_per_frame(count, [&] {
+             actual = accelerated->crc32c(0, frames.data(), bytes);
+           }),
+           baseline);
+    if (actual != expected) {
+      std::cerr << "CRC-32C: backend results differ" << std::endl;
+      return 1;
+    }
+  }
+  (void)sink;
+
+  return 0;
+}
@@ -0,0 +1,635 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "can_message.h"
+#include "can_signals.h"
+#include "channel.h"
+#include "latency_histogram.h"
+#include "rt_profile.h"
+#include "spsc_queue.h"
+
+// Signal gateway: reads CANMessage streams from pipes, decodes them into
+// physical signals (can_signals.h) and publishes every signal twice, to a
+// shm ring for one local reader and to any number of socket subscribers.
+// Each stage runs on its own pinned thread and hands records on through
+// an SpscQueue:
+//
+//   ingest -> decode -+-> shm publisher    (/can_signals)
+//                     +-> socket fan-out   (/tmp/can_signals.sock)
+//
+// A stage's latency runs from the frame's send stamp to the moment that
+// stage passed the record on, so the step from one stage to the next is
+// the time spent in that stage and the queue in front of it. Neither
+// publisher waits for its readers: a full ring or a subscriber that falls
+// too far behind loses records, which are counted.
+
+constexpr const char* SIGNAL_SHM_NAME = "/can_signals";
+constexpr const char* SIGNAL_SOCKET_PATH = "/tmp/can_signals.sock";
+constexpr size_t STAGE_QUEUE_SIZE = 4096;
+constexpr size_t STAGE_BATCH = 64;
+constexpr int STAGE_POLL_MS = 100;
+constexpr size_t MAX_SUBSCRIBERS = 16;
+constexpr size_t SUBSCRIBER_BACKLOG = 64 * 1024;
+
+std::atomic<bool> running{true};
+std::mutex output_mutex;
+
+void signal_handler(int signal) {
+  if (signal == SIGINT || signal == SIGTERM) {
+    running = false;
+  }
+}
+
+// Counters of one stage. Only the stage's thread touches them until it
+// is joined; its period reports go out under output_mutex.
+struct Stage {
+  Stage(const char* stage_name, const char* item_name, const char* drops)
+      : name(stage_name), items_name(item_name), drop_name(drops),
+        latency(stage_name) {}
+
+  const char* name;
+  const char* items_name;
+  const char* drop_name;
+  int cpu = -1;
+  uint64_t items = 0;
+  uint64_t dropped = 0;
+  uint64_t period_items = 0;
+  uint64_t period_start_ns = wire_timestamp_ns();
+  LatencyReport latency;
+
+  void pin() {
+    if (cpu < 0) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    std::lock_guard<std::mutex> lock(output_mutex);
+    if (error != 0) {
+      std::cerr << "[" << name << "] Failed to pin to CPU " << cpu << ": "
+                << strerror(error) << std::endl;
+    } else {
+      std::cout << "[" << name << "] Pinned to CPU " << cpu << std::endl;
+    }
+  }
+
+  void done(uint64_t stamp_ns) {
+    items++;
+    period_items++;
+    latency.record_since(stamp_ns);
+  }
+
+  void report() {
+    if (!latency.due()) return;
+    uint64_t now = wire_timestamp_ns();
+    uint64_t elapsed = now > period_start_ns ? now - period_start_ns : 1;
+    std::lock_guard<std::mutex> lock(output_mutex);
+    std::cout << "[" << name << "] " << period_items * 1000000000ULL / elapsed
+              << " " << items_name << "/s";
+    if (drop_name) std::cout << ", " << dropped << " " << drop_name;
+    std::cout << std::endl;
+    latency.print_period(std::cout);
+    period_items = 0;
+    period_start_ns = now;
+  }
+
+  void print_total() {
+    std::cout << "[" << name << "] " << items << " " << items_name;
+    if (drop_name) std::cout << ", " << dropped << " " << drop_name;
+    std::cout << std::endl;
+    latency.print_total(std::cout);
+  }
+};
+
+struct Input {
+  std::string name;
+  int fd;
+  bool fifo;  // reopened when its writer goes away
+  CANMessage buffer[STAGE_BATCH];
+  size_t pending;
+};
+
+// Queues the whole frames of one read; keeps the bytes of a frame that
+// has only partly arrived. Returns what read() returned.
+ssize_t read_input(Input& input, SpscQueue<CANMessage>& frames,
+                   Stage& stage) {
+  char* buffer = reinterpret_cast<char*>(input.buffer);
+  ssize_t bytes = read(input.fd, buffer + input.pending,
+                       sizeof(input.buffer) - input.pending);
+  if (bytes <= 0) return bytes;
+
+  size_t available = input.pending + static_cast<size_t>(bytes);
+  size_t count = available / sizeof(CANMessage);
+  input.pending = available % sizeof(CANMessage);
+  for (size_t k = 0; k < count; ++k) {
+    CANMessage& msg = input.buffer[k];
+    if (msg.timestamp == 0) msg.timestamp = wire_timestamp_ns();
+    if (!frames.push(msg)) break;
+    stage.done(msg.timestamp);
+  }
+  if (input.pending != 0) {
+    memmove(buffer, buffer + count * sizeof(CANMessage), input.pending);
+  }
+  return bytes;
+}
+
+void ingest_stage(std::vector<Input>& inputs, SpscQueue<CANMessage>& frames,
+                  Stage& stage) {
+  stage.pin();
+  std::vector<struct pollfd> fds;
+  std::vector<Input*> polled;
+  while (running) {
+    fds.clear();
+    polled.clear();
+    for (Input& input : inputs) {
+      if (input.fd < 0) continue;
+      fds.push_back({input.fd, POLLIN, 0});
+      polled.push_back(&input);
+    }
+    if (fds.empty()) break;
+
+    int ready = poll(fds.data(), fds.size(), STAGE_POLL_MS);
+    if (ready < 0 && errno != EINTR) {
+      std::cerr << "[ingest] Poll error: " << strerror(errno) << std::endl;
+      break;
+    }
+    for (size_t i = 0; ready > 0 && i < fds.size(); ++i) {
+      if (fds[i].revents == 0) continue;
+      Input& input = *polled[i];
+      ssize_t bytes = read_input(input, frames, stage);
+      if (bytes < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+      if (bytes > 0) continue;
+
+      if (bytes < 0) {
+        std::cerr << "[ingest] Read error on " << input.name << ": "
+                  << strerror(errno) << std::endl;
+      } else if (input.pending != 0) {
+        std::cerr << "[ingest] Incomplete frame from " << input.name
+                  << std::endl;
+      }
+      close(input.fd);
+      input.fd = -1;
+      input.pending = 0;
+      // A FIFO outlives its writers, so wait for the next one.
+      if (bytes == 0 && input.fifo) {
+        input.fd = open(input.name.c_str(), O_RDONLY | O_NONBLOCK);
+      }
+      std::lock_guard<std::mutex> lock(output_mutex);
+      std::cout << "[ingest] " << input.name
+                << (input.fd >= 0 ? " writer left" : " ended") << std::endl;
+    }
+    stage.report();
+  }
+
+  for (Input& input : inputs) {
+    if (input.fd >= 0) close(input.fd);
+    input.fd = -1;
+  }
+  frames.close();
+}
+
+void decode_stage(SpscQueue<CANMessage>& frames,
+                  SpscQueue<CANSignal>& to_shm, SpscQueue<CANSignal>& to_uds,
+                  Stage& stage) {
+  stage.pin();
+  CANSignalDecoder decoder;
+  CANMessage batch[STAGE_BATCH];
+  std::vector<CANSignal> signals(decoder.max_per_frame());
+  while (!frames.drained()) {
+    size_t count = frames.pop(batch, STAGE_BATCH, STAGE_POLL_MS);
+    for (size_t k = 0; k < count; ++k) {
+      size_t decoded = decoder.decode(batch[k], signals.data());
+      if (decoded == 0) stage.dropped++;
+      for (size_t i = 0; i < decoded; ++i) {
+        to_shm.push(signals[i]);
+        to_uds.push(signals[i]);
+        stage.done(signals[i].timestamp);
+      }
+    }
+    stage.report();
+  }
+  to_shm.close();
+  to_uds.close();
+}
+
+// Sends only what fits in the ring, so a slow or absent reader never
+// holds up the gateway.
+void publish_stage(SpscQueue<CANSignal>& signals,
+                   Channel<CANSignal, ShmRingBackend>& channel,
+                   Stage& stage) {
+  stage.pin();
+  CANSignal batch[STAGE_BATCH];
+  while (!signals.drained()) {
+    size_t count = signals.pop(batch, STAGE_BATCH, STAGE_POLL_MS);
+    size_t free = SHM_RING_CAPACITY - channel.backend().queued();
+    size_t fits = count < free ? count : free;
+    ssize_t sent = fits > 0 ? channel.send_n(batch, fits) : 0;
+    if (sent < 0) sent = 0;
+    for (ssize_t i = 0; i < sent; ++i) stage.done(batch[i].timestamp);
+    if (count > static_cast<size_t>(sent)) {
+      stage.dropped += count - sent;
+      channel.metrics().drop(count - sent);
+    }
+    stage.report();
+  }
+  channel.close();
+}
+
+// A socket subscriber. Records wait in pending until the socket takes
+// them; only whole records are added, so dropping keeps the framing.
+struct Subscriber {
+  int fd;
+  std::vector<char> pending;
+  size_t offset;
+};
+
+// Returns false once the subscriber has gone. What was sent is dropped
+// from pending even when the socket fills up, so a subscriber that
+// always lags a little does not grow it without bound.
+bool flush_subscriber(Subscriber& subscriber) {
+  bool alive = true;
+  while (subscriber.offset < subscriber.pending.size()) {
+    const char* data = subscriber.pending.data() + subscriber.offset;
+    ssize_t n = send(subscriber.fd, data,
+                     subscriber.pending.size() - subscriber.offset,
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      alive = errno == EAGAIN;
+      break;
+    }
+    subscriber.offset += static_cast<size_t>(n);
+  }
+  subscriber.pending.erase(subscriber.pending.begin(),
+                           subscriber.pending.begin() + subscriber.offset);
+  subscriber.offset = 0;
+  return alive;
+}
+
+void accept_subscribers(int listen_fd, std::vector<Subscriber>& subscribers) {
+  int fd;
+  while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+    if (subscribers.size() >= MAX_SUBSCRIBERS) {
+      close(fd);
+      continue;
+    }
+    // Subscribers read with a UdsBackend channel, which expects the
+    // record layout first.
+    WireLayout layout = wire_layout<CANSignal>();
+    const char* header = reinterpret_cast<const char*>(&layout);
+    subscribers.push_back({fd, {header, header + sizeof(layout)}, 0});
+    std::lock_guard<std::mutex> lock(output_mutex);
+    std::cout << "[fanout] Subscriber connected (" << subscribers.size()
+              << " total)" << std::endl;
+  }
+}
+
+void fanout_stage(SpscQueue<CANSignal>& signals, int listen_fd,
+                  Stage& stage) {
+  stage.pin();
+  std::vector<Subscriber> subscribers;
+  CANSignal batch[STAGE_BATCH];
+  while (!signals.drained()) {
+    accept_subscribers(listen_fd, subscribers);
+    bool backlog = std::any_of(
+        subscribers.begin(), subscribers.end(),
+        [](const Subscriber& s) { return !s.pending.empty(); });
+    size_t count =
+        signals.pop(batch, STAGE_BATCH, backlog ? 1 : STAGE_POLL_MS);
+
+    const char* records = reinterpret_cast<const char*>(batch);
+    for (size_t s = 0; s < subscribers.size();) {
+      Subscriber& subscriber = subscribers[s];
+      size_t queued = subscriber.pending.size() - subscriber.offset;
+      size_t room = SUBSCRIBER_BACKLOG > queued
+                        ? (SUBSCRIBER_BACKLOG - queued) / sizeof(CANSignal)
+                        : 0;
+      size_t fits = count < room ? count : room;
+      subscriber.pending.insert(subscriber.pending.end(), records,
+                                records + fits * sizeof(CANSignal));
+      stage.dropped += count - fits;
+      if (flush_subscriber(subscriber)) {
+        ++s;
+        continue;
+      }
+      close(subscriber.fd);
+      subscribers.erase(subscribers.begin() + s);
+      std::lock_guard<std::mutex> lock(output_mutex);
+      std::cout << "[fanout] Subscriber left (" << subscribers.size()
+                << " total)" << std::endl;
+    }
+    for (size_t i = 0; i < count; ++i) stage.done(batch[i].timestamp);
+    stage.report();
+  }
+  for (Subscriber& subscriber : subscribers) close(subscriber.fd);
+}
+
+int create_listener(const char* path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (fd < 0) return -1;
+  unlink(path);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+double simulated_value(uint16_t signal_id, double t) {
+  switch (signal_id) {
+    case 1:
+      return 1900 + 1100 * std::sin(t * 0.5);
+    case 2:
+      return 88 + 4 * std::sin(t * 0.05);
+    case 3:
+      return 45 + 40 * std::sin(t * 0.5);
+    case 4:
+    case 7:
+      return 70 + 50 * std::sin(t * 0.1);
+    case 5:
+      return 45 * std::sin(t * 0.3);
+    case 6:
+      return std::max(0.0, 60 * std::sin(t * 0.2));
+    case 8:
+      return std::max(5.0, 80 - t * 0.01);
+  }
+  return 0;
+}
+
+// ECU stand-in: cycles through the frames of the signal table at rate
+// frames/s, writing whatever is due in one batch, until frames have been
+// sent (0 = until stopped) or the gateway closes the pipe.
+void ecu_simulator(int fd, double rate, uint64_t frames) {
+  std::vector<uint32_t> ids;
+  for (const CANSignalDef& def : CAN_SIGNALS) {
+    if (std::find(ids.begin(), ids.end(), def.can_id) == ids.end()) {
+      ids.push_back(def.can_id);
+    }
+  }
+
+  uint64_t period_ns = static_cast<uint64_t>(1e9 / rate);
+  if (period_ns == 0) period_ns = 1;
+  uint64_t start_ns = wire_timestamp_ns();
+  uint64_t sent = 0;
+  CANMessage batch[STAGE_BATCH];
+  while (running && (frames == 0 || sent < frames)) {
+    uint64_t due = (wire_timestamp_ns() - start_ns) / period_ns + 1;
+    if (due <= sent) {
+      uint64_t next_ns = start_ns + sent * period_ns;
+      struct timespec wake = {static_cast<time_t>(next_ns / 1000000000ULL),
+                              static_cast<long>(next_ns % 1000000000ULL)};
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr);
+      continue;
+    }
+    uint64_t count = std::min<uint64_t>(due - sent, STAGE_BATCH);
+    if (frames != 0) count = std::min(count, frames - sent);
+
+    double t = (wire_timestamp_ns() - start_ns) / 1e9;
+    for (uint64_t k = 0; k < count; ++k) {
+      CANMessage& msg = batch[k];
+      msg = CANMessage{};
+      msg.can_id = ids[(sent + k) % ids.size()];
+      msg.data_length = 8;
+      for (const CANSignalDef& def : CAN_SIGNALS) {
+        if (def.can_id == msg.can_id) {
+          encode_can_signal(def, simulated_value(def.id, t), msg.data);
+        }
+      }
+      msg.timestamp = wire_timestamp_ns();
+    }
+    ssize_t written;
+    do {
+      written = write(fd, batch, count * sizeof(CANMessage));
+    } while (written < 0 && errno == EINTR && running);
+    if (written < 0) break;
+    sent += count;
+  }
+  close(fd);
+  std::cout << "[ECU] Sent " << sent << " frames" << std::endl;
+}
+
+// Without -c the stages take the highest CPUs the process may use, one
+// each, leaving the low ones, where most interrupts land, to the rest.
+std::vector<int> default_cpus(size_t stages) {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = CPU_SETSIZE - 1; cpu >= 0; --cpu) {
+      if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+  }
+  std::vector<int> assigned(stages, -1);
+  for (size_t k = 0; k < stages && !cpus.empty(); ++k) {
+    assigned[k] = cpus[k % cpus.size()];
+  }
+  return assigned;
+}
+
+bool parse_cpus(const char* text, std::vector<int>& cpus) {
+  cpus.clear();
+  std::string list = text;
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t comma = list.find(',', start);
+    if (comma == std::string::npos) comma = list.size();
+    std::string item = list.substr(start, comma - start);
+    char* end = nullptr;
+    long cpu = std::strtol(item.c_str(), &end, 10);
+    if (item.empty() || *end != '\0' || cpu < -1 || cpu >= CPU_SETSIZE) {
+      return false;
+    }
+    cpus.push_back(static_cast<int>(cpu));
+    start = comma + 1;
+  }
+  return true;
+}
+
+bool open_input(const char* path, std::vector<Input>& inputs) {
+  Input input{path, -1, false, {}, 0};
+  if (strcmp(path, "-") == 0) {
+    input.name = "stdin";
+    input.fd = STDIN_FILENO;
+    inputs.push_back(input);
+    return true;
+  }
+  struct stat st;
+  if (stat(path, &st) < 0) {
+    if (errno != ENOENT || mkfifo(path, 0666) < 0) return false;
+    st.st_mode = S_IFIFO;
+  }
+  input.fifo = S_ISFIFO(st.st_mode);
+  input.fd = open(path, O_RDONLY | (input.fifo ? O_NONBLOCK : 0));
+  if (input.fd < 0) return false;
+  inputs.push_back(input);
+  return true;
+}
+
+void print_usage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " [-i input]... [-r frames_per_s] [-m frames]"
+               " [-c cpu,cpu,cpu,cpu]"
+            << std::endl;
+  std::cerr << "  -i reads CANMessage frames from a FIFO (created if"
+               " missing), a file or - for stdin;"
+            << std::endl;
+  std::cerr << "     without it a simulated ECU sends -m frames (0 = until"
+               " stopped) at -r frames/s"
+            << std::endl;
+  std::cerr << "  -c pins ingest, decode, shm and socket stages; -1 leaves"
+               " a stage unpinned"
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+  std::signal(SIGPIPE, SIG_IGN);
+  rt_setup("can_gateway");
+
+  std::vector<const char*> input_paths;
+  double rate = 2000;
+  long frames = 0;
+  std::vector<int> cpus = default_cpus(4);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:r:m:c:")) != -1) {
+    switch (opt) {
+      case 'i':
+        input_paths.push_back(optarg);
+        break;
+      case 'r':
+        rate = std::atof(optarg);
+        break;
+      case 'm':
+        frames = std::atol(optarg);
+        break;
+      case 'c':
+        if (!parse_cpus(optarg, cpus) || cpus.size() != 4) {
+          print_usage(argv[0]);
+          return 1;
+        }
+        break;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (rate <= 0 || frames < 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<Input> inputs;
+  for (const char* path : input_paths) {
+    if (!open_input(path, inputs)) {
+      std::cerr << "Failed to open input " << path << ": " << strerror(errno)
+                << std::endl;
+      return 1;
+    }
+  }
+
+  // The simulator is forked before any thread starts.
+  pid_t simulator = -1;
+  if (inputs.empty()) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+      std::cerr << "Failed to create pipe: " << strerror(errno) << std::endl;
+      return 1;
+    }
+    simulator = fork();
+    if (simulator < 0) {
+      std::cerr << "Fork failed: " << strerror(errno) << std::endl;
+      return 1;
+    }
+    if (simulator == 0) {
+      close(pipefd[0]);
+      ecu_simulator(pipefd[1], rate, static_cast<uint64_t>(frames));
+      return 0;
+    }
+    close(pipefd[1]);
+    inputs.push_back({"simulator", pipefd[0], false, {}, 0});
+  }
+
+  Channel<CANSignal, ShmRingBackend> shm;
+  int listen_fd = -1;
+  if (!shm.create(SIGNAL_SHM_NAME, ChannelRole::WRITER)) {
+    std::cerr << "Failed to create " << SIGNAL_SHM_NAME << ": "
+              << strerror(errno) << std::endl;
+  } else if ((listen_fd = create_listener(SIGNAL_SOCKET_PATH)) < 0) {
+    std::cerr << "Failed to listen on " << SIGNAL_SOCKET_PATH << ": "
+              << strerror(errno) << std::endl;
+  }
+  if (listen_fd < 0) {
+    if (simulator > 0) {
+      kill(simulator, SIGTERM);
+      waitpid(simulator, nullptr, 0);
+    }
+    return 1;
+  }
+
+  std::cout << "CAN Signal Gateway - " << inputs.size()
+            << " input(s) -> shm " << SIGNAL_SHM_NAME << " + socket "
+            << SIGNAL_SOCKET_PATH << " (Press Ctrl+C to stop)" << std::endl;
+  std::cout << std::string(80, '-') << std::endl;
+
+  Stage ingest("ingest", "frames", nullptr);
+  Stage decode("decode", "signals", "unknown frames");
+  Stage publish("shm", "signals", "dropped (ring full)");
+  Stage fanout("fanout", "signals", "dropped (slow subscribers)");
+  Stage* stages[] = {&ingest, &decode, &publish, &fanout};
+  for (size_t k = 0; k < 4; ++k) stages[k]->cpu = cpus[k];
+
+  SpscQueue<CANMessage> frame_queue(STAGE_QUEUE_SIZE);
+  SpscQueue<CANSignal> shm_queue(STAGE_QUEUE_SIZE);
+  SpscQueue<CANSignal> uds_queue(STAGE_QUEUE_SIZE);
+  std::thread fanout_thread(fanout_stage, std::ref(uds_queue), listen_fd,
+                            std::ref(fanout));
+  std::thread publish_thread(publish_stage, std::ref(shm_queue),
+                             std::ref(shm), std::ref(publish));
+  std::thread decode_thread(decode_stage, std::ref(frame_queue),
+                            std::ref(shm_queue), std::ref(uds_queue),
+                            std::ref(decode));
+  std::thread ingest_thread(ingest_stage, std::ref(inputs),
+                            std::ref(frame_queue), std::ref(ingest));
+
+  // Stages stop front to back: ingest closes its queue once the inputs
+  // end or a signal arrives, and each later stage drains its queue first.
+  ingest_thread.join();
+  decode_thread.join();
+  publish_thread.join();
+  fanout_thread.join();
+  close(listen_fd);
+  unlink(SIGNAL_SOCKET_PATH);
+  Channel<CANSignal, ShmRingBackend>::unlink(SIGNAL_SHM_NAME);
+  if (simulator > 0) {
+    kill(simulator, SIGTERM);
+    waitpid(simulator, nullptr, 0);
+  }
+
+  std::cout << "\nGateway stopped" << std::endl;
+  for (Stage* stage : stages) stage->print_total();
+  return 0;
+}
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// SocketCAN-style identifier layout: bit 31 marks a 29-bit extended frame.
+constexpr uint32_t CAN_EFF_FLAG = 0x80000000U;
+constexpr uint32_t CAN_SFF_MASK = 0x000007FFU;
+constexpr uint32_t CAN_EFF_MASK = 0x1FFFFFFFU;
+
+constexpr uint8_t ROUTE_DROP = 0xFF;
+constexpr size_t MAX_ROUTES = ROUTE_DROP;
+
+struct CANFilter {
+  uint32_t id;
+  uint32_t mask;
+  bool extended;
+};
+
+struct CANRange {
+  uint32_t lo;
+  uint32_t hi;
+  bool extended;
+};
+
+struct CANRoute {
+  std::string name;
+  int out_fd;
+  std::vector<CANFilter> filters;
+  std::vector<CANRange> ranges;
+};
+
+// Acceptance filter and route table. Filters are compiled once by build():
+// standard IDs into a direct-index table, extended IDs into an exact-match
+// hash plus sorted disjoint ranges, with non-prefix extended masks checked
+// last. Routes added first win on overlap, whichever kind of rule matches.
+class CANRouter {
+ public:
+  int add_route(const std::string& name, int out_fd) {
+    if (routes_.size() >= MAX_ROUTES) return -1;
+    routes_.push_back({name, out_fd, {}, {}});
+    return static_cast<int>(routes_.size() - 1);
+  }
+
+  void add_filter(int route, uint32_t id, uint32_t mask, bool extended) {
+    routes_[route].filters.push_back({id, mask, extended});
+  }
+
+  void add_range(int route, uint32_t lo, uint32_t hi, bool extended) {
+    uint32_t mask = extended ? CAN_EFF_MASK : CAN_SFF_MASK;
+    routes_[route].ranges.push_back(
+        {std::min(lo, hi) & mask, std::max(lo, hi) & mask, extended});
+  }
+
+  void build() {
+    std_table_.fill(ROUTE_DROP);
+    for (uint32_t id = 0; id <= CAN_SFF_MASK; ++id) {
+      std_table_[id] = match_slow(id, false);
+    }
+
+    std::vector<uint32_t> exact;
+    std::vector<std::pair<CANRange, uint8_t>> spans;
+    ext_masks_.clear();
+    for (size_t r = 0; r < routes_.size(); ++r) {
+      uint8_t route = static_cast<uint8_t>(r);
+      for (const CANFilter& f : routes_[r].filters) {
+        if (!f.extended) continue;
+        uint32_t mask = f.mask & CAN_EFF_MASK;
+        uint32_t id = f.id & mask;
+        if (mask == CAN_EFF_MASK) {
+          exact.push_back(id);
+        } else if (is_prefix_mask(mask)) {
+          spans.push_back({{id, id | (~mask & CAN_EFF_MASK), true}, route});
+        } else {
+          ext_masks_.push_back({{id, mask, true}, route});
+        }
+      }
+      for (const CANRange& range : routes_[r].ranges) {
+        if (range.extended) {
+          spans.push_back({range, route});
+        }
+      }
+    }
+
+    build_hash(exact);
+    build_ranges(spans);
+  }
+
+  // O(1) for standard IDs and exact extended IDs, O(log n) for extended
+  // ranges. Returns ROUTE_DROP when no filter accepts the frame.
+  uint8_t route(uint32_t can_id) const {
+    if (!(can_id & CAN_EFF_FLAG)) {
+      return std_table_[can_id & CAN_SFF_MASK];
+    }
+
+    uint32_t id = can_id & CAN_EFF_MASK;
+    if (!hash_keys_.empty()) {
+      for (size_t slot = hash_slot(id);; slot = (slot + 1) & hash_mask_) {
+        if (hash_keys_[slot] == id) return hash_routes_[slot];
+        if (hash_keys_[slot] == HASH_EMPTY) break;
+      }
+    }
+
+    uint8_t best = ROUTE_DROP;
+    auto it = std::upper_bound(range_lo_.begin(), range_lo_.end(), id);
+    if (it != range_lo_.begin()) {
+      size_t i = static_cast<size_t>(it - range_lo_.begin()) - 1;
+      if (id <= range_hi_[i]) best = range_routes_[i];
+    }
+
+    // Mask entries are in route order, so only those of earlier routes
+    // than the range match can still win.
+    for (const auto& entry : ext_masks_) {
+      if (entry.second >= best) break;
+      if ((id & entry.first.mask) == entry.first.id) return entry.second;
+    }
+    return best;
+  }
+
+  // Compares route() with a plain scan of the filters at the edges of
+  // every extended rule, where overlapping rules meet. Call after build().
+  bool verify() const {
+    std::vector<uint32_t> probes;
+    for (const CANRoute& r : routes_) {
+      for (const CANFilter& f : r.filters) {
+        if (!f.extended) continue;
+        uint32_t mask = f.mask & CAN_EFF_MASK;
+        uint32_t id = f.id & mask;
+        probes.insert(probes.end(), {id, id | (~mask & CAN_EFF_MASK)});
+      }
+      for (const CANRange& range : r.ranges) {
+        if (!range.extended) continue;
+        probes.insert(probes.end(), {range.lo, range.hi, range.lo - 1,
+                                     range.hi + 1});
+      }
+    }
+    for (uint32_t probe : probes) {
+      uint32_t id = probe & CAN_EFF_MASK;
+      if (route(id | CAN_EFF_FLAG) != match_slow(id, true)) return false;
+    }
+    return true;
+  }
+
+  size_t size() const { return routes_.size(); }
+  const CANRoute& operator[](size_t route) const { return routes_[route]; }
+
+ private:
+  static constexpr uint32_t HASH_EMPTY = 0xFFFFFFFFU;
+
+  static bool is_prefix_mask(uint32_t mask) {
+    uint32_t inverted = ~mask & CAN_EFF_MASK;
+    return (inverted & (inverted + 1)) == 0;
+  }
+
+  uint8_t match_slow(uint32_t id, bool extended) const {
+    for (size_t r = 0; r < routes_.size(); ++r) {
+      for (const CANFilter& f : routes_[r].filters) {
+        if (f.extended == extended && (id & f.mask) == (f.id & f.mask)) {
+          return static_cast<uint8_t>(r);
+        }
+      }
+      for (const CANRange& range : routes_[r].ranges) {
+        if (range.extended == extended && id >= range.lo && id <= range.hi) {
+          return static_cast<uint8_t>(r);
+        }
+      }
+    }
+    return ROUTE_DROP;
+  }
+
+  size_t hash_slot(uint32_t id) const {
+    return (id * 0x9E3779B1U) >> hash_shift_;
+  }
+
+  void build_hash(const std::vector<uint32_t>& exact) {
+    hash_keys_.clear();
+    hash_routes_.clear();
+    if (exact.empty()) return;
+
+    size_t capacity = 4;
+    hash_shift_ = 30;
+    while (capacity < exact.size() * 2) {
+      capacity <<= 1;
+      hash_shift_--;
+    }
+    hash_mask_ = capacity - 1;
+    hash_keys_.assign(capacity, HASH_EMPTY);
+    hash_routes_.assign(capacity, ROUTE_DROP);
+
+    for (uint32_t id : exact) {
+      size_t slot = hash_slot(id);
+      while (hash_keys_[slot] != HASH_EMPTY && hash_keys_[slot] != id) {
+        slot = (slot + 1) & hash_mask_;
+      }
+      if (hash_keys_[slot] == HASH_EMPTY) {
+        hash_keys_[slot] = id;
+        hash_routes_[slot] = match_slow(id, true);
+      }
+    }
+  }
+
+  // Splits possibly overlapping spans into disjoint intervals, each owned by
+  // the lowest-numbered route covering it, then merges neighbours.
+  void build_ranges(const std::vector<std::pair<CANRange, uint8_t>>& spans) {
+    range_lo_.clear();
+    range_hi_.clear();
+    range_routes_.clear();
+
+    std::vector<uint64_t> points;
+    for (const auto& span : spans) {
+      points.push_back(span.first.lo);
+      points.push_back(static_cast<uint64_t>(span.first.hi) + 1);
+    }
+    std::sort(points.begin(), points.end());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+
+    for (size_t i = 0; i + 1 < points.size(); ++i) {
+      uint8_t owner = ROUTE_DROP;
+      for (const auto& span : spans) {
+        if (span.first.lo <= points[i] && points[i] <= span.first.hi) {
+          owner = std::min(owner, span.second);
+        }
+      }
+      if (owner == ROUTE_DROP) continue;
+
+      uint32_t lo = static_cast<uint32_t>(points[i]);
+      uint32_t hi = static_cast<uint32_t>(points[i + 1] - 1);
+      if (!range_routes_.empty() && range_routes_.back() == owner &&
+          range_hi_.back() + 1 == lo) {
+        range_hi_.back() = hi;
+      } else {
+        range_lo_.push_back(lo);
+        range_hi_.push_back(hi);
+        range_routes_.push_back(owner);
+      }
+    }
+  }
+
+  std::vector<CANRoute> routes_;
+  std::array<uint8_t, CAN_SFF_MASK + 1> std_table_{};
+
+  std::vector<uint32_t> hash_keys_;
+  std::vector<uint8_t> hash_routes_;
+  size_t hash_mask_ = 0;
+  unsigned hash_shift_ = 30;
+
+  std::vector<uint32_t> range_lo_;
+  std::vector<uint32_t> range_hi_;
+  std::vector<uint8_t> range_routes_;
+
+  std::vector<std::pair<CANFilter, uint8_t>> ext_masks_;
+};
+
+// Parses "ID/MASK", "LO-HI" or "ID"; a trailing 'x' selects 29-bit IDs.
+inline bool parse_can_filter(CANRouter& router, int route,
+                             const std::string& spec) {
+  const char* text = spec.c_str();
+  char* end = nullptr;
+  uint32_t first = static_cast<uint32_t>(std::strtoul(text, &end, 0));
+  if (end == text) return false;
+
+  char op = *end;
+  uint32_t second = 0;
+  if (op == '/' || op == '-') {
+    const char* rest = end + 1;
+    second = static_cast<uint32_t>(std::strtoul(rest, &end, 0));
+    if (end == rest) return false;
+  }
+
+  bool extended = (*end == 'x');
+  if (extended) ++end;
+  if (*end != '\0') return false;
+  if (first > CAN_SFF_MASK || second > CAN_SFF_MASK) extended = true;
+
+  uint32_t full_mask = extended ? CAN_EFF_MASK : CAN_SFF_MASK;
+  if (op == '/') {
+    router.add_filter(route, first, second & full_mask, extended);
+  } else if (op == '-') {
+    router.add_range(route, first, second, extended);
+  } else {
+    router.add_filter(route, first, full_mask, extended);
+  }
+  return true;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "can_router.h"
+
+constexpr uint32_t SHARD_MAX_VNODES = 64;
+constexpr uint32_t SHARD_MIN_VNODES = 8;
+constexpr uint64_t SHARD_LAG_THRESHOLD = 64;
+constexpr uint64_t SHARD_REBALANCE_INTERVAL = 32;
+constexpr size_t SHARD_EXTENDED_SWEEP = 1024;
+
+// Per-child counters, placed in a MAP_SHARED region before fork so the
+// parent can observe child progress without another channel.
+struct alignas(64) ShardStats {
+  std::atomic<uint64_t> processed;
+  std::atomic<uint64_t> forwarded;
+  std::atomic<uint64_t> filtered;
+  std::atomic<uint64_t> bytes;
+  uint64_t sent;
+  uint64_t max_lag;
+  uint64_t migrations;
+};
+
+inline uint32_t shard_mix(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x85EBCA6BU;
+  x ^= x >> 13;
+  x *= 0xC2B2AE35U;
+  x ^= x >> 16;
+  return x;
+}
+
+// Consistent-hash ring with a variable number of virtual nodes per child, so
+// shrinking one child's weight only moves the IDs that child gives up.
+class ConsistentHashRing {
+ public:
+  explicit ConsistentHashRing(size_t children)
+      : weights_(children, SHARD_MAX_VNODES) {
+    rebuild();
+  }
+
+  size_t lookup(uint32_t can_id) const {
+    uint32_t h = shard_mix(can_id);
+    auto it = std::lower_bound(
+        ring_.begin(), ring_.end(), h,
+        [](const std::pair<uint32_t, uint32_t>& node, uint32_t value) {
+          return node.first < value;
+        });
+    if (it == ring_.end()) it = ring_.begin();
+    return it->second;
+  }
+
+  uint32_t weight(size_t child) const { return weights_[child]; }
+
+  void set_weight(size_t child, uint32_t vnodes) {
+    vnodes = std::clamp(vnodes, SHARD_MIN_VNODES, SHARD_MAX_VNODES);
+    if (weights_[child] == vnodes) return;
+    weights_[child] = vnodes;
+    rebuild();
+  }
+
+ private:
+  void rebuild() {
+    ring_.clear();
+    for (uint32_t child = 0; child < weights_.size(); ++child) {
+      for (uint32_t v = 0; v < weights_[child]; ++v) {
+        ring_.push_back({shard_mix((child << 16) ^ (v * 0x9E3779B1U)), child});
+      }
+    }
+    std::sort(ring_.begin(), ring_.end());
+  }
+
+  std::vector<uint32_t> weights_;
+  std::vector<std::pair<uint32_t, uint32_t>> ring_;
+};
+
+// Picks a child per frame. An ID stays pinned to its previous child until
+// that child has processed the last frame sent for it, so moving an ID after
+// a rebalance never reorders frames of the same ID.
+class CANSharder {
+ public:
+  CANSharder(size_t children, ShardStats* stats)
+      : ring_(children), stats_(stats), children_(children) {}
+
+  size_t pick(uint32_t can_id) {
+    Affinity& affinity = affinity_for(can_id);
+    size_t target = ring_.lookup(can_id);
+
+    if (affinity.last_seq != 0 && affinity.child != target) {
+      uint64_t processed =
+          stats_[affinity.child].processed.load(std::memory_order_acquire);
+      if (processed < affinity.last_seq) {
+        target = affinity.child;
+      } else {
+        stats_[target].migrations++;
+      }
+    }
+
+    affinity.child = static_cast<uint32_t>(target);
+    affinity.last_seq = ++stats_[target].sent;
+
+    if (++frames_ % SHARD_REBALANCE_INTERVAL == 0) rebalance();
+    return target;
+  }
+
+  uint32_t weight(size_t child) const { return ring_.weight(child); }
+
+ private:
+  struct Affinity {
+    uint32_t child;
+    uint64_t last_seq;
+  };
+
+  Affinity& affinity_for(uint32_t can_id) {
+    if (!(can_id & CAN_EFF_FLAG)) return standard_[can_id & CAN_SFF_MASK];
+    if (extended_.size() >= sweep_at_) sweep_extended();
+    return extended_[can_id];
+  }
+
+  // 29-bit IDs are too many for a table, so their entries are dropped
+  // once the child has processed their last frame and nothing pins them.
+  // Sweeping when the map doubles keeps the cost per frame constant.
+  void sweep_extended() {
+    for (auto it = extended_.begin(); it != extended_.end();) {
+      const Affinity& affinity = it->second;
+      if (stats_[affinity.child].processed.load(std::memory_order_acquire) >=
+          affinity.last_seq) {
+        it = extended_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    sweep_at_ = std::max(SHARD_EXTENDED_SWEEP, 2 * extended_.size());
+  }
+
+  // Halves the ring share of a child whose backlog exceeds the threshold
+  // and twice the average of the other children, and slowly restores it
+  // once it catches up.
+  void rebalance() {
+    uint64_t total_lag = 0;
+    std::vector<uint64_t> lags(children_);
+    for (size_t c = 0; c < children_; ++c) {
+      uint64_t processed = stats_[c].processed.load(std::memory_order_acquire);
+      lags[c] = stats_[c].sent - processed;
+      stats_[c].max_lag = std::max(stats_[c].max_lag, lags[c]);
+      total_lag += lags[c];
+    }
+
+    for (size_t c = 0; c < children_; ++c) {
+      uint64_t others =
+          children_ > 1 ? (total_lag - lags[c]) / (children_ - 1) : lags[c];
+      if (lags[c] > SHARD_LAG_THRESHOLD && lags[c] > 2 * others) {
+        ring_.set_weight(c, ring_.weight(c) / 2);
+      } else if (lags[c] < SHARD_LAG_THRESHOLD / 4) {
+        ring_.set_weight(c, ring_.weight(c) + SHARD_MIN_VNODES);
+      }
+    }
+  }
+
+  ConsistentHashRing ring_;
+  ShardStats* stats_;
+  size_t children_;
+  uint64_t frames_ = 0;
+  size_t sweep_at_ = SHARD_EXTENDED_SWEEP;
+  std::array<Affinity, CAN_SFF_MASK + 1> standard_{};
+  std::unordered_map<uint32_t, Affinity> extended_;
+};
@@ -0,0 +1,116 @@
+#include <unistd.h>
+
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "can_signals.h"
+#include "channel.h"
+#include "latency_histogram.h"
+#include "rt_profile.h"
+
+// Prints the signals can_gateway publishes, read from its shm ring or,
+// with -t uds, as one of its socket subscribers.
+
+constexpr const char* SIGNAL_SHM_NAME = "/can_signals";
+constexpr const char* SIGNAL_SOCKET_PATH = "/tmp/can_signals.sock";
+constexpr size_t RECEIVE_BATCH = 64;
+
+std::atomic<bool> running{true};
+
+void signal_handler(int signal) {
+  if (signal == SIGINT || signal == SIGTERM) {
+    running = false;
+  }
+}
+
+void print_signal(const CANSignal& signal) {
+  const CANSignalDef* def = find_can_signal(signal.signal_id);
+  std::cout << std::left << std::setw(16)
+            << (def ? def->name : std::to_string(signal.signal_id))
+            << std::right << std::fixed << std::setprecision(2)
+            << std::setw(10) << signal.value << " " << std::left
+            << std::setw(5) << (def ? def->unit : "") << std::right
+            << " | CAN ID 0x" << std::hex << (signal.can_id & CAN_EFF_MASK)
+            << std::dec << std::endl;
+}
+
+template <typename Backend>
+int monitor(const char* name, bool quiet) {
+  Channel<CANSignal, Backend> channel;
+  if (!channel.open(name, ChannelRole::READER)) {
+    std::cerr << "Failed to attach to " << name << ": " << strerror(errno)
+              << std::endl;
+    std::cerr << "Make sure can_gateway is running first" << std::endl;
+    return 1;
+  }
+  std::cout << "Reading signals from " << name << " via "
+            << Backend::TRANSPORT << " (Press Ctrl+C to stop)" << std::endl;
+  std::cout << std::string(80, '-') << std::endl;
+
+  CANSignal batch[RECEIVE_BATCH];
+  uint64_t received = 0;
+  LatencyReport latency("can_signal_monitor");
+  while (running) {
+    ssize_t n = channel.recv_n(batch, RECEIVE_BATCH, 500);
+    if (n == 0) {
+      std::cout << "\nGateway stopped" << std::endl;
+      break;
+    }
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EINTR) continue;
+      if (errno == EPROTO) {
+        std::cerr << "\nGateway sends a different CANSignal layout (expected "
+                  << "version " << CANSignal::WIRE_VERSION << ")" << std::endl;
+      } else {
+        std::cerr << "\nError receiving signals: " << strerror(errno)
+                  << std::endl;
+      }
+      break;
+    }
+    for (ssize_t i = 0; i < n; ++i) {
+      received++;
+      channel.metrics().latency_ns(latency.record_since(batch[i].timestamp));
+      if (!quiet) print_signal(batch[i]);
+    }
+    if (latency.due()) latency.print_period(std::cout);
+  }
+
+  channel.close();
+  std::cout << "Total signals received: " << received << std::endl;
+  latency.print_total(std::cout);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+  rt_setup("can_signal_monitor");
+
+  std::string transport = "shm";
+  bool quiet = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:q")) != -1) {
+    if (opt == 't') {
+      transport = optarg;
+    } else if (opt == 'q') {
+      quiet = true;
+    } else {
+      transport.clear();
+      break;
+    }
+  }
+
+  if (transport == "shm") {
+    return monitor<ShmRingBackend>(SIGNAL_SHM_NAME, quiet);
+  }
+  if (transport == "uds") {
+    return monitor<UdsBackend>(SIGNAL_SOCKET_PATH, quiet);
+  }
+  std::cerr << "Usage: " << argv[0] << " [-t shm|uds] [-q]" << std::endl;
+  std::cerr << "  -q prints only latency summaries" << std::endl;
+  return 1;
+}
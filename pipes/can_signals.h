@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "can_message.h"
+#include "can_router.h"
+
+// A scaled little-endian (Intel order) field of a CAN frame, as a DBC
+// file would describe it: physical = raw * scale + offset.
+struct CANSignalDef {
+  uint16_t id;
+  const char* name;
+  const char* unit;
+  uint32_t can_id;  // CAN_EFF_FLAG set for 29-bit frames
+  uint8_t start_byte;
+  uint8_t length;  // bytes
+  bool is_signed;
+  double scale;
+  double offset;
+};
+
+// The signals can_gateway decodes. J1939 frames (the 29-bit ones) match
+// on their PGN, whatever the priority and source address.
+const CANSignalDef CAN_SIGNALS[] = {
+    {1, "engine_speed", "rpm", 0x100, 0, 2, false, 0.25, 0},
+    {2, "coolant_temp", "degC", 0x100, 2, 1, false, 1, -40},
+    {3, "throttle", "%", 0x101, 0, 1, false, 0.4, 0},
+    {4, "vehicle_speed", "km/h", 0x102, 0, 2, false, 0.01, 0},
+    {5, "steering_angle", "deg", 0x104, 0, 2, true, 0.1, 0},
+    {6, "brake_pressure", "bar", 0x105, 0, 2, false, 0.1, 0},
+    {7, "wheel_speed", "km/h", CAN_EFF_FLAG | 0x18FEF100, 1, 2, false,
+     1.0 / 256, 0},
+    {8, "fuel_level", "%", CAN_EFF_FLAG | 0x18FEFC00, 1, 1, false, 0.4, 0},
+};
+
+constexpr uint32_t J1939_PGN_MASK = 0x03FFFF00U;
+
+inline uint32_t can_signal_key(uint32_t can_id) {
+  return (can_id & CAN_EFF_FLAG) ? CAN_EFF_FLAG | (can_id & J1939_PGN_MASK)
+                                 : can_id & CAN_SFF_MASK;
+}
+
+inline const CANSignalDef* find_can_signal(uint16_t id) {
+  for (const CANSignalDef& def : CAN_SIGNALS) {
+    if (def.id == id) return &def;
+  }
+  return nullptr;
+}
+
+inline double decode_can_signal(const CANSignalDef& def,
+                                const uint8_t* data) {
+  uint64_t raw = 0;
+  for (unsigned i = 0; i < def.length; ++i) {
+    raw |= static_cast<uint64_t>(data[def.start_byte + i]) << (8 * i);
+  }
+  int64_t value = static_cast<int64_t>(raw);
+  unsigned bits = 8 * def.length;
+  if (def.is_signed && bits < 64 && (raw >> (bits - 1)) & 1) {
+    value -= int64_t{1} << bits;
+  }
+  return static_cast<double>(value) * def.scale + def.offset;
+}
+
+// The inverse, for simulated frames; out-of-range values saturate.
+inline void encode_can_signal(const CANSignalDef& def, double physical,
+                              uint8_t* data) {
+  unsigned bits = 8 * def.length;
+  double lo = def.is_signed ? -std::ldexp(1.0, bits - 1) : 0;
+  double hi = def.is_signed ? std::ldexp(1.0, bits - 1) - 1
+                            : std::ldexp(1.0, bits) - 1;
+  double raw = std::round((physical - def.offset) / def.scale);
+  if (raw < lo) raw = lo;
+  if (raw > hi) raw = hi;
+  uint64_t bytes = static_cast<uint64_t>(static_cast<int64_t>(raw));
+  for (unsigned i = 0; i < def.length; ++i) {
+    data[def.start_byte + i] = static_cast<uint8_t>(bytes >> (8 * i));
+  }
+}
+
+// Looks up a frame's signals by its key and decodes them all.
+class CANSignalDecoder {
+ public:
+  CANSignalDecoder() {
+    for (const CANSignalDef& def : CAN_SIGNALS) {
+      frames_[can_signal_key(def.can_id)].push_back(&def);
+    }
+  }
+
+  // Appends the frame's signals to out; returns how many it had.
+  size_t decode(const CANMessage& msg, CANSignal* out) const {
+    auto found = frames_.find(can_signal_key(msg.can_id));
+    if (found == frames_.end()) return 0;
+    size_t count = 0;
+    for (const CANSignalDef* def : found->second) {
+      if (def->start_byte + def->length > msg.data_length) continue;
+      CANSignal& signal = out[count++];
+      signal = CANSignal{};
+      signal.timestamp = msg.timestamp;
+      signal.value = decode_can_signal(*def, msg.data);
+      signal.can_id = msg.can_id;
+      signal.signal_id = def->id;
+    }
+    return count;
+  }
+
+  // Most signals any one frame carries, for sizing decode buffers.
+  size_t max_per_frame() const {
+    size_t most = 0;
+    for (const auto& frame : frames_) {
+      if (frame.second.size() > most) most = frame.second.size();
+    }
+    return most;
+  }
+
+ private:
+  std::unordered_map<uint32_t, std::vector<const CANSignalDef*>> frames_;
+};
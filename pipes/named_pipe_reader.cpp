@@ -1,4 +1,3 @@
-#include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -8,6 +7,11 @@
 #include <iomanip>
 #include <iostream>
 
+#include "channel.h"
+#include "latency_histogram.h"
+#include "rt_profile.h"
+#include "wire_types.h"
+
 constexpr const char* FIFO_PATH = "/tmp/automotive_fifo";
 
 std::atomic<bool> running{true};
@@ -18,13 +22,7 @@ void signal_handler(int signal) {
   }
 }
 
-struct DiagnosticEvent {
-  uint32_t dtc_code;
-  uint8_t severity;
-  char module_name[32];
-  char description[128];
-  uint64_t timestamp;
-};
+using DiagnosticChannel = Channel<DiagnosticEvent, FifoBackend>;
 
 const char* severity_to_string(uint8_t severity) {
   switch (severity) {
@@ -42,6 +40,7 @@ const char* severity_to_string(uint8_t severity) {
 int main() {
   std::signal(SIGINT, signal_handler);
   std::signal(SIGTERM, signal_handler);
+  rt_setup("named_pipe_reader");
 
   std::cout << "Named Pipe Reader - Diagnostic Event Subscriber" << std::endl;
   std::cout << "Waiting for FIFO at: " << FIFO_PATH << std::endl;
@@ -55,8 +54,8 @@ int main() {
   }
 
   std::cout << "Opening FIFO..." << std::endl;
-  int fd = open(FIFO_PATH, O_RDONLY);
-  if (fd < 0) {
+  DiagnosticChannel channel;
+  if (!channel.open(FIFO_PATH, ChannelRole::READER) || !channel.wait_peer()) {
     std::cerr << "Failed to open FIFO: " << strerror(errno) << std::endl;
     std::cerr << "Make sure the writer is running first" << std::endl;
     return 1;
@@ -69,29 +68,32 @@ int main() {
   DiagnosticEvent event;
   uint32_t event_count = 0;
   uint32_t high_severity_count = 0;
+  LatencyReport latency("named_pipe_reader");
 
   while (running) {
-    ssize_t bytes_read = read(fd, &event, sizeof(event));
+    int received = channel.receive(event);
 
-    if (bytes_read == 0) {
+    if (received == 0) {
       std::cout << "\nWriter closed pipe" << std::endl;
       break;
     }
 
-    if (bytes_read < 0) {
+    if (received < 0) {
       if (errno == EINTR) {
         continue;
       }
+      if (errno == EPROTO) {
+        std::cerr << "\nWriter sends a different DiagnosticEvent layout "
+                  << "(expected version " << DiagnosticEvent::WIRE_VERSION
+                  << ")" << std::endl;
+        break;
+      }
       std::cerr << "\nRead error: " << strerror(errno) << std::endl;
       break;
     }
 
-    if (bytes_read != sizeof(event)) {
-      std::cerr << "\nIncomplete event received" << std::endl;
-      continue;
-    }
-
     event_count++;
+    channel.metrics().latency_ns(latency.record_since(event.timestamp));
     if (event.severity == 3) {
       high_severity_count++;
     }
@@ -114,13 +116,15 @@ int main() {
           << "         >> Logging high-severity event to persistent storage"
           << std::endl;
     }
+    if (latency.due()) latency.print_period(std::cout);
   }
 
-  close(fd);
+  channel.close();
 
   std::cout << "\nReader stopped" << std::endl;
   std::cout << "Total events received: " << event_count << std::endl;
   std::cout << "High-severity events: " << high_severity_count << std::endl;
+  latency.print_total(std::cout);
 
   return 0;
 }
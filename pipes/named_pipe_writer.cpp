@@ -1,5 +1,3 @@
-#include <fcntl.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 #include <atomic>
@@ -9,6 +7,10 @@
 #include <iostream>
 #include <thread>
 
+#include "channel.h"
+#include "rt_profile.h"
+#include "wire_types.h"
+
 constexpr const char* FIFO_PATH = "/tmp/automotive_fifo";
 
 std::atomic<bool> running{true};
@@ -19,21 +21,17 @@ void signal_handler(int signal) {
   }
 }
 
-struct DiagnosticEvent {
-  uint32_t dtc_code;
-  uint8_t severity;
-  char module_name[32];
-  char description[128];
-  uint64_t timestamp;
-};
+using DiagnosticChannel = Channel<DiagnosticEvent, FifoBackend>;
 
 int main() {
   std::signal(SIGINT, signal_handler);
   std::signal(SIGTERM, signal_handler);
+  // Report a reader that went away as EPIPE instead of dying of SIGPIPE.
+  std::signal(SIGPIPE, SIG_IGN);
+  rt_setup("named_pipe_writer");
 
-  unlink(FIFO_PATH);
-
-  if (mkfifo(FIFO_PATH, 0666) < 0) {
+  DiagnosticChannel channel;
+  if (!channel.create(FIFO_PATH, ChannelRole::WRITER)) {
     std::cerr << "Failed to create FIFO: " << strerror(errno) << std::endl;
     return 1;
   }
@@ -42,10 +40,10 @@ int main() {
   std::cout << "FIFO created at: " << FIFO_PATH << std::endl;
   std::cout << "Waiting for reader to connect..." << std::endl;
 
-  int fd = open(FIFO_PATH, O_WRONLY);
-  if (fd < 0) {
-    std::cerr << "Failed to open FIFO: " << strerror(errno) << std::endl;
-    unlink(FIFO_PATH);
+  if (!channel.wait_peer()) {
+    if (errno != EINTR) {
+      std::cerr << "Failed to open FIFO: " << strerror(errno) << std::endl;
+    }
     return 1;
   }
 
@@ -75,12 +73,9 @@ int main() {
             sizeof(event.description) - 1);
     event.description[sizeof(event.description) - 1] = '\0';
 
-    event.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-                          std::chrono::system_clock::now().time_since_epoch())
-                          .count();
+    event.timestamp = wire_timestamp_ns();
 
-    ssize_t written = write(fd, &event, sizeof(event));
-    if (written < 0) {
+    if (!channel.send(event)) {
       if (errno == EPIPE) {
         std::cout << "\nReader disconnected" << std::endl;
         break;
@@ -99,8 +94,7 @@ int main() {
     std::this_thread::sleep_for(std::chrono::milliseconds(1000));
   }
 
-  close(fd);
-  unlink(FIFO_PATH);
+  channel.close();
 
   std::cout << "\nWriter stopped (sent " << event_count << " events)"
             << std::endl;
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "shm_map.h"
+#include "shm_sync.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Contention profile of the shared primitives. Every profiled primitive
+// gets an entry by name in a shared segment next to the primitives;
+// wrappers add a timestamp before and after each acquire and at release,
+// and fold the wait and hold times into log2 histograms of TSC ticks with
+// relaxed atomics. lock_stats reads the segment while the workers run or
+// after they are gone.
+
+constexpr uint32_t LOCK_PROFILE_MAGIC = 0x4C4B5046U;
+constexpr unsigned LOCK_PROFILE_ENTRIES = 16;
+constexpr unsigned LOCK_PROFILE_HOLDERS = 32;
+// Bucket b counts waits or holds shorter than 2^b ticks.
+constexpr unsigned LOCK_PROFILE_BUCKETS = 40;
+
+inline uint64_t profile_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+         static_cast<uint64_t>(ts.tv_nsec);
+#endif
+}
+
+// Ticks per nanosecond, measured against CLOCK_MONOTONIC over 20 ms.
+inline double calibrate_ticks_per_ns() {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint64_t first = profile_ticks();
+  struct timespec pause = {0, 20000000};
+  nanosleep(&pause, nullptr);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  uint64_t last = profile_ticks();
+  double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  return ns > 0 ? (last - first) / ns : 1.0;
+}
+
+inline unsigned profile_bucket(uint64_t ticks) {
+  unsigned bucket = ticks == 0 ? 0 : 64 - __builtin_clzll(ticks);
+  return bucket < LOCK_PROFILE_BUCKETS ? bucket : LOCK_PROFILE_BUCKETS - 1;
+}
+
+// What one process did with one primitive.
+struct LockHolderStats {
+  std::atomic<pid_t> pid;
+  std::atomic<uint32_t> holding;
+  std::atomic<uint64_t> acquisitions;
+  std::atomic<uint64_t> wait_ticks;
+  std::atomic<uint64_t> hold_ticks;
+};
+
+struct alignas(64) LockProfileEntry {
+  char name[32];
+  std::atomic<uint64_t> acquisitions;
+  std::atomic<uint64_t> contended;
+  std::atomic<uint64_t> wait_ticks;
+  std::atomic<uint64_t> hold_ticks;
+  std::atomic<uint64_t> max_wait_ticks;
+  std::atomic<uint64_t> max_hold_ticks;
+  std::atomic<uint64_t> wait_histogram[LOCK_PROFILE_BUCKETS];
+  std::atomic<uint64_t> hold_histogram[LOCK_PROFILE_BUCKETS];
+  // Acquisitions by processes that found every holder slot taken.
+  std::atomic<uint64_t> untracked;
+  LockHolderStats holders[LOCK_PROFILE_HOLDERS];
+};
+
+struct LockProfileSegment {
+  uint32_t magic;
+  double ticks_per_ns;
+  ShmMutex registration;
+  std::atomic<uint32_t> entries;
+  LockProfileEntry entry[LOCK_PROFILE_ENTRIES];
+};
+
+inline std::string lock_profile_name(const char* segment) {
+  return std::string(segment) + ".profile";
+}
+
+inline void profile_store_max(std::atomic<uint64_t>& max, uint64_t value) {
+  uint64_t current = max.load(std::memory_order_relaxed);
+  while (value > current &&
+         !max.compare_exchange_weak(current, value,
+                                    std::memory_order_relaxed)) {
+  }
+}
+
+// Maps the profile segment that belongs to a sync segment name.
+class LockProfileMap {
+ public:
+  LockProfileMap() = default;
+  LockProfileMap(const LockProfileMap&) = delete;
+  LockProfileMap& operator=(const LockProfileMap&) = delete;
+  ~LockProfileMap() { close(); }
+
+  bool create(const char* segment) {
+    std::string name = lock_profile_name(segment);
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0) return false;
+    if (ftruncate(fd, sizeof(LockProfileSegment)) < 0 || !map(fd)) {
+      ::close(fd);
+      shm_unlink(name.c_str());
+      return false;
+    }
+    ::close(fd);
+
+    profile_ = new (profile_) LockProfileSegment();
+    profile_->registration.init();
+    profile_->ticks_per_ns = calibrate_ticks_per_ns();
+    std::atomic_thread_fence(std::memory_order_release);
+    profile_->magic = LOCK_PROFILE_MAGIC;
+    return true;
+  }
+
+  bool open(const char* segment) {
+    void* base;
+    if (!shm_map_existing(lock_profile_name(segment).c_str(),
+                          sizeof(LockProfileSegment), true, &base, &size_)) {
+      return false;
+    }
+    profile_ = static_cast<LockProfileSegment*>(base);
+
+    if (profile_->magic != LOCK_PROFILE_MAGIC) {
+      close();
+      errno = EINVAL;
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (profile_) munmap(profile_, size_);
+    profile_ = nullptr;
+  }
+
+  static void unlink(const char* segment) {
+    shm_unlink(lock_profile_name(segment).c_str());
+  }
+
+  // Registers a primitive by name, or finds the entry another process
+  // registered. Entries are only ever added, so the name is stable once
+  // the count covers it. Returns nullptr when the table is full.
+  LockProfileEntry* entry(const char* name) {
+    while (true) {
+      uint32_t count = profile_->entries.load(std::memory_order_acquire);
+      for (uint32_t i = 0; i < count; ++i) {
+        if (strncmp(profile_->entry[i].name, name,
+                    sizeof(profile_->entry[i].name)) == 0) {
+          return &profile_->entry[i];
+        }
+      }
+      if (count == LOCK_PROFILE_ENTRIES) return nullptr;
+      // Fill the next entry before publishing it; a racing registration
+      // makes us rescan.
+      profile_->registration.lock();
+      bool added = false;
+      if (profile_->entries.load(std::memory_order_acquire) == count) {
+        strncpy(profile_->entry[count].name, name,
+                sizeof(profile_->entry[count].name) - 1);
+        profile_->entries.store(count + 1, std::memory_order_release);
+        added = true;
+      }
+      profile_->registration.unlock();
+      if (added) return &profile_->entry[count];
+    }
+  }
+
+  LockProfileSegment* get() const { return profile_; }
+  LockProfileSegment* operator->() const { return profile_; }
+  explicit operator bool() const { return profile_ != nullptr; }
+
+ private:
+  bool map(int fd) {
+    void* base = mmap(nullptr, sizeof(LockProfileSegment),
+                      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return false;
+    profile_ = static_cast<LockProfileSegment*>(base);
+    size_ = sizeof(LockProfileSegment);
+    return true;
+  }
+
+  LockProfileSegment* profile_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Times the acquisitions and releases of one primitive for the calling
+// process; with a null entry it only forwards. Hold times assume one
+// holder per process at a time, as in single-threaded workers.
+class LockProbe {
+ public:
+  explicit LockProbe(LockProfileEntry* entry) : entry_(entry) {
+    if (!entry_) return;
+    pid_t self = getpid();
+    for (unsigned i = 0; i < LOCK_PROFILE_HOLDERS && !holder_; ++i) {
+      pid_t pid = entry_->holders[i].pid.load();
+      if (pid == self ||
+          (pid == 0 && entry_->holders[i].pid.compare_exchange_strong(
+                           pid, self))) {
+        holder_ = &entry_->holders[i];
+      }
+    }
+  }
+
+  uint64_t begin() const { return entry_ ? profile_ticks() : 0; }
+
+  void acquired(uint64_t start, bool contended) {
+    if (!entry_) return;
+    acquired_at_ = profile_ticks();
+    uint64_t wait = acquired_at_ - start;
+    entry_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (contended) entry_->contended.fetch_add(1, std::memory_order_relaxed);
+    entry_->wait_ticks.fetch_add(wait, std::memory_order_relaxed);
+    entry_->wait_histogram[profile_bucket(wait)].fetch_add(
+        1, std::memory_order_relaxed);
+    profile_store_max(entry_->max_wait_ticks, wait);
+    if (holder_) {
+      holder_->holding.fetch_add(1, std::memory_order_relaxed);
+      holder_->acquisitions.fetch_add(1, std::memory_order_relaxed);
+      holder_->wait_ticks.fetch_add(wait, std::memory_order_relaxed);
+    } else {
+      entry_->untracked.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void releasing() {
+    if (!entry_) return;
+    uint64_t hold = profile_ticks() - acquired_at_;
+    entry_->hold_ticks.fetch_add(hold, std::memory_order_relaxed);
+    entry_->hold_histogram[profile_bucket(hold)].fetch_add(
+        1, std::memory_order_relaxed);
+    profile_store_max(entry_->max_hold_ticks, hold);
+    if (holder_) {
+      holder_->holding.fetch_sub(1, std::memory_order_relaxed);
+      holder_->hold_ticks.fetch_add(hold, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  LockProfileEntry* entry_;
+  LockHolderStats* holder_ = nullptr;
+  uint64_t acquired_at_ = 0;
+};
+
+// Profiling wrapper over a shm_sync.h primitive. An acquire that the
+// primitive's try path grants at once counts as uncontended. Only the
+// operations the wrapped type has can be used.
+template <typename Primitive>
+class Profiled {
+ public:
+  Profiled(Primitive& primitive, LockProfileEntry* entry)
+      : primitive_(primitive), probe_(entry) {}
+
+  void lock() {
+    uint64_t start = probe_.begin();
+    bool contended = !primitive_.try_lock();
+    if (contended) primitive_.lock();
+    probe_.acquired(start, contended);
+  }
+
+  void unlock() {
+    probe_.releasing();
+    primitive_.unlock();
+  }
+
+  void lock_shared() {
+    uint64_t start = probe_.begin();
+    bool contended = !primitive_.try_lock_shared();
+    if (contended) primitive_.lock_shared();
+    probe_.acquired(start, contended);
+  }
+
+  void unlock_shared() {
+    probe_.releasing();
+    primitive_.unlock_shared();
+  }
+
+  void wait() {
+    uint64_t start = probe_.begin();
+    bool contended = !primitive_.try_wait();
+    if (contended) primitive_.wait();
+    probe_.acquired(start, contended);
+  }
+
+  void post() {
+    probe_.releasing();
+    primitive_.post();
+  }
+
+  // For ShmSlotPool; the wait for a free slot is what gets timed.
+  auto acquire() {
+    uint64_t start = probe_.begin();
+    auto slot = primitive_.try_acquire();
+    bool contended = !slot;
+    if (contended) slot = primitive_.acquire();
+    probe_.acquired(start, contended);
+    return slot;
+  }
+
+  template <typename Slot>
+  void release(const Slot& slot) {
+    probe_.releasing();
+    primitive_.release(slot);
+  }
+
+ private:
+  Primitive& primitive_;
+  LockProbe probe_;
+};
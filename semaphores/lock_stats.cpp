@@ -0,0 +1,155 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "latency_histogram.h"
+#include "lock_profile.h"
+
+std::atomic<bool> running{true};
+
+void signal_handler(int signal) {
+  if (signal == SIGINT || signal == SIGTERM) {
+    running = false;
+  }
+}
+
+// Upper bound in ticks of the bucket holding the given quantile, capped
+// at the largest value seen.
+uint64_t histogram_quantile(const std::atomic<uint64_t>* histogram,
+                            const std::atomic<uint64_t>& max,
+                            double quantile) {
+  uint64_t counts[LOCK_PROFILE_BUCKETS];
+  for (unsigned b = 0; b < LOCK_PROFILE_BUCKETS; ++b) {
+    counts[b] = histogram[b].load(std::memory_order_relaxed);
+  }
+  unsigned b =
+      histogram_quantile_bucket(counts, LOCK_PROFILE_BUCKETS, quantile);
+  if (b == LOCK_PROFILE_BUCKETS) return 0;
+  return std::min(uint64_t{1} << b, max.load());
+}
+
+void dump(const LockProfileSegment& profile) {
+  double us = profile.ticks_per_ns * 1000;
+  uint32_t count = profile.entries.load(std::memory_order_acquire);
+
+  // Worst offenders first: total time workers spent waiting.
+  std::vector<const LockProfileEntry*> entries;
+  uint64_t total_wait = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    entries.push_back(&profile.entry[i]);
+    total_wait += profile.entry[i].wait_ticks.load();
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const LockProfileEntry* a, const LockProfileEntry* b) {
+              return a->wait_ticks.load() > b->wait_ticks.load();
+            });
+
+  std::cout << std::setw(18) << "primitive" << std::setw(8) << "acq"
+            << std::setw(7) << "cont%" << std::setw(10) << "wait ms"
+            << std::setw(7) << "share" << std::setw(10) << "w p50us"
+            << std::setw(10) << "w p99us" << std::setw(10) << "w maxus"
+            << std::setw(10) << "h p50us" << std::setw(10) << "h p99us"
+            << std::setw(10) << "h maxus" << std::endl;
+  std::cout << std::fixed;
+  for (const LockProfileEntry* entry : entries) {
+    auto wait_us = [&](double quantile) {
+      return histogram_quantile(entry->wait_histogram, entry->max_wait_ticks,
+                                quantile) / us;
+    };
+    auto hold_us = [&](double quantile) {
+      return histogram_quantile(entry->hold_histogram, entry->max_hold_ticks,
+                                quantile) / us;
+    };
+    uint64_t acquisitions = entry->acquisitions.load();
+    uint64_t wait = entry->wait_ticks.load();
+    std::cout << std::setw(18) << entry->name << std::setw(8) << acquisitions
+              << std::setprecision(1) << std::setw(7)
+              << (acquisitions ? 100.0 * entry->contended.load() /
+                                     acquisitions
+                               : 0.0)
+              << std::setw(10) << wait / us / 1000 << std::setw(6)
+              << (total_wait ? 100.0 * wait / total_wait : 0.0) << "%"
+              << std::setw(10) << wait_us(0.5) << std::setw(10)
+              << wait_us(0.99) << std::setw(10)
+              << entry->max_wait_ticks.load() / us << std::setw(10)
+              << hold_us(0.5) << std::setw(10) << hold_us(0.99)
+              << std::setw(10) << entry->max_hold_ticks.load() / us
+              << std::endl;
+  }
+
+  std::cout << std::endl
+            << std::setw(18) << "primitive" << std::setw(8) << "pid"
+            << std::setw(8) << "acq" << std::setw(10) << "wait ms"
+            << std::setw(10) << "hold ms" << std::setw(9) << "holding"
+            << std::endl;
+  for (const LockProfileEntry* entry : entries) {
+    for (const LockHolderStats& holder : entry->holders) {
+      pid_t pid = holder.pid.load();
+      if (pid == 0) continue;
+      std::cout << std::setw(18) << entry->name << std::setw(8) << pid
+                << std::setw(8) << holder.acquisitions.load()
+                << std::setw(10) << holder.wait_ticks.load() / us / 1000
+                << std::setw(10) << holder.hold_ticks.load() / us / 1000
+                << std::setw(9) << holder.holding.load() << std::endl;
+    }
+    if (entry->untracked.load() > 0) {
+      std::cout << std::setw(18) << entry->name << "  "
+                << entry->untracked.load()
+                << " acquisitions by untracked processes" << std::endl;
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+
+  const char* segment = "/automotive_sync";
+  int interval_ms = 0;
+  bool remove = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:i:u")) != -1) {
+    if (opt == 's') {
+      segment = optarg;
+    } else if (opt == 'i' && std::atoi(optarg) > 0) {
+      interval_ms = std::atoi(optarg);
+    } else if (opt == 'u') {
+      remove = true;
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [-s segment] [-i interval_ms] [-u]" << std::endl;
+      return 1;
+    }
+  }
+
+  LockProfileMap profile;
+  if (!profile.open(segment)) {
+    std::cerr << "Failed to open lock profile "
+              << lock_profile_name(segment) << ": " << strerror(errno)
+              << std::endl;
+    std::cerr << "Run semaphore_demo -p first" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Lock profile " << lock_profile_name(segment) << " ("
+            << std::setprecision(2) << std::fixed << profile->ticks_per_ns
+            << " ticks/ns)" << std::endl;
+  dump(*profile.get());
+  while (interval_ms > 0 && running) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    std::cout << std::endl;
+    dump(*profile.get());
+  }
+
+  if (remove) LockProfileMap::unlink(segment);
+  return 0;
+}
@@ -0,0 +1,228 @@
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "shm_sync.h"
+#include "task_scheduler.h"
+#include "wire_types.h"
+
+// Offline CAN log decoding spread over forked workers by the work-stealing
+// scheduler. The log is split into chunks of very different sizes, so a
+// static split leaves most workers idle at the end; big chunks are also
+// split further as they run so thieves have something to take.
+
+constexpr const char* DECODE_SEGMENT = "/automotive_log_decode";
+constexpr uint32_t MAX_CHUNKS = 4096;
+constexpr uint32_t SPLIT_FRAMES = 2048;
+
+struct LogJob {
+  uint32_t chunks;
+  uint32_t frames[MAX_CHUNKS];
+  std::atomic<uint64_t> decoded[MAX_CHUNKS];
+  std::atomic<uint64_t> checksum[MAX_CHUNKS];
+};
+
+struct DecodeSegment {
+  TaskScheduler scheduler;
+  LogJob job;
+};
+
+uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53ULL;
+  return x ^ (x >> 33);
+}
+
+// Chunks hold 256 to 32768 frames.
+uint32_t chunk_frames(uint32_t chunk) { return 256U << (mix(chunk) % 8); }
+
+// Task word: chunk in the top 24 bits, then the frame range [begin, end).
+uint64_t make_task(uint64_t chunk, uint64_t begin, uint64_t end) {
+  return chunk << 40 | begin << 20 | end;
+}
+
+// Regenerates each recorded frame and decodes its signals: the 11-bit ID
+// selects a scaling, every data byte is a signal value.
+uint64_t decode_frames(uint32_t chunk, uint32_t begin, uint32_t end) {
+  uint64_t checksum = 0;
+  for (uint32_t f = begin; f < end; ++f) {
+    uint64_t raw = mix(static_cast<uint64_t>(chunk) << 32 | f);
+    uint32_t can_id = raw & 0x7FF;
+    uint32_t dlc = (raw >> 11) % 9;
+    uint64_t data = mix(raw);
+    uint64_t signals = 0;
+    for (uint32_t b = 0; b < dlc; ++b) {
+      uint64_t value = (data >> (8 * b)) & 0xFF;
+      signals += value * (can_id % 7 + 1) + (signals >> 3);
+    }
+    checksum += signals ^ can_id;
+  }
+  return checksum;
+}
+
+void decode_task(TaskScheduler& scheduler, LogJob& job, uint32_t w,
+                 uint64_t task) {
+  uint32_t chunk = static_cast<uint32_t>(task >> 40);
+  uint32_t begin = (task >> 20) & 0xFFFFF;
+  uint32_t end = task & 0xFFFFF;
+  // Hand the upper half of a large range to the deque, where an idle
+  // worker can steal it, and keep splitting the lower half.
+  while (end - begin > SPLIT_FRAMES) {
+    uint32_t mid = begin + (end - begin) / 2;
+    if (!scheduler.spawn(w, make_task(chunk, mid, end))) break;
+    end = mid;
+  }
+  job.checksum[chunk].fetch_add(decode_frames(chunk, begin, end),
+                                std::memory_order_relaxed);
+  job.decoded[chunk].fetch_add(end - begin, std::memory_order_relaxed);
+}
+
+void worker_process(DecodeSegment* segment, uint32_t w) {
+  TaskScheduler& scheduler = segment->scheduler;
+  LogJob& job = segment->job;
+  auto handle = [&](uint32_t worker, uint64_t task) {
+    decode_task(scheduler, job, worker, task);
+  };
+  auto seed = [&](uint32_t worker) {
+    for (uint32_t c = worker; c < job.chunks; c += scheduler.workers) {
+      scheduler.push_initial(worker, make_task(c, 0, job.frames[c]), handle);
+    }
+  };
+  while (scheduler.worker_phase(w, seed, handle)) {
+  }
+}
+
+int main(int argc, char* argv[]) {
+  uint32_t workers = default_worker_count();
+  uint32_t chunks = 256;
+  int phases = 3;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "w:n:p:")) != -1) {
+    switch (opt) {
+      case 'w':
+        workers = std::strtoul(optarg, nullptr, 0);
+        break;
+      case 'n':
+        chunks = std::strtoul(optarg, nullptr, 0);
+        break;
+      case 'p':
+        phases = std::atoi(optarg);
+        break;
+      default:
+        std::cerr << "Usage: " << argv[0]
+                  << " [-w workers] [-n chunks] [-p phases]" << std::endl;
+        return 1;
+    }
+  }
+  if (workers < 1 || workers > SCHEDULER_MAX_WORKERS || chunks < 1 ||
+      chunks > MAX_CHUNKS || phases < 1) {
+    std::cerr << "Workers must be 1-" << SCHEDULER_MAX_WORKERS
+              << ", chunks 1-" << MAX_CHUNKS << ", phases at least 1"
+              << std::endl;
+    return 1;
+  }
+
+  ShmObject<DecodeSegment> segment;
+  if (!segment.create(DECODE_SEGMENT)) {
+    std::cerr << "Failed to create decode segment: " << strerror(errno)
+              << std::endl;
+    return 1;
+  }
+  LogJob& job = segment->job;
+  job.chunks = chunks;
+  uint64_t total_frames = 0;
+  for (uint32_t c = 0; c < chunks; ++c) {
+    job.frames[c] = chunk_frames(c);
+    total_frames += job.frames[c];
+  }
+
+  std::cout << "Decoding " << total_frames << " frames in " << chunks
+            << " chunks with " << workers << " worker processes"
+            << std::endl;
+
+  // Serial reference for the checksum and the speedup.
+  uint64_t start = wire_timestamp_ns();
+  uint64_t expected = 0;
+  for (uint32_t c = 0; c < chunks; ++c) {
+    expected += decode_frames(c, 0, job.frames[c]);
+  }
+  double serial_ms = (wire_timestamp_ns() - start) / 1e6;
+  std::cout << "Serial decode: " << std::fixed << std::setprecision(1)
+            << serial_ms << " ms" << std::endl;
+
+  segment->scheduler.init(workers);
+  std::vector<pid_t> pids;
+  for (uint32_t w = 0; w < workers; ++w) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      worker_process(segment.get(), w);
+      _exit(0);
+    }
+    if (pid < 0) {
+      std::cerr << "Failed to fork worker " << w << ": " << strerror(errno)
+                << std::endl;
+      for (pid_t p : pids) kill(p, SIGKILL);
+      for (pid_t p : pids) waitpid(p, nullptr, 0);
+      ShmObject<DecodeSegment>::unlink(DECODE_SEGMENT);
+      return 1;
+    }
+    pids.push_back(pid);
+  }
+
+  int result = 0;
+  for (int phase = 0; phase < phases; ++phase) {
+    for (uint32_t c = 0; c < chunks; ++c) {
+      job.decoded[c].store(0, std::memory_order_relaxed);
+      job.checksum[c].store(0, std::memory_order_relaxed);
+    }
+    start = wire_timestamp_ns();
+    segment->scheduler.run_phase(chunks);
+    double ms = (wire_timestamp_ns() - start) / 1e6;
+
+    uint64_t checksum = 0;
+    bool complete = true;
+    for (uint32_t c = 0; c < chunks; ++c) {
+      checksum += job.checksum[c].load(std::memory_order_relaxed);
+      if (job.decoded[c].load(std::memory_order_relaxed) != job.frames[c]) {
+        complete = false;
+      }
+    }
+    bool ok = complete && checksum == expected;
+    if (!ok) result = 1;
+    std::cout << "Phase " << phase + 1 << ": " << std::setprecision(1) << ms
+              << " ms (" << std::setprecision(2) << serial_ms / ms
+              << "x serial) " << (ok ? "checksum ok" : "MISMATCH")
+              << std::endl;
+  }
+  segment->scheduler.shutdown();
+
+  for (pid_t pid : pids) {
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) result = 1;
+  }
+
+  std::cout << std::setw(8) << "worker" << std::setw(10) << "tasks"
+            << std::setw(10) << "stolen" << std::setw(14) << "failed steals"
+            << std::endl;
+  for (uint32_t w = 0; w < workers; ++w) {
+    const TaskWorkerStats& stats = segment->scheduler.stats[w];
+    std::cout << std::setw(8) << w << std::setw(10) << stats.executed.load()
+              << std::setw(10) << stats.stolen.load() << std::setw(14)
+              << stats.failed_steals.load() << std::endl;
+  }
+
+  segment.close();
+  ShmObject<DecodeSegment>::unlink(DECODE_SEGMENT);
+  return result;
+}
@@ -1,20 +1,36 @@
-#include <fcntl.h>
-#include <semaphore.h>
-#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <atomic>
 #include <chrono>
 #include <csignal>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <thread>
 
-constexpr const char* SEM_RESOURCE = "/automotive_resource_sem";
-constexpr const char* SEM_MUTEX = "/automotive_mutex_sem";
-constexpr const char* SEM_BARRIER = "/automotive_barrier_sem";
+#include "lock_profile.h"
+#include "rt_profile.h"
+#include "shm_sync.h"
+#include "slot_pool.h"
+
+constexpr const char* SYNC_SEGMENT = "/automotive_sync";
 constexpr int NUM_WORKERS = 3;
+constexpr uint32_t NUM_CHANNELS = 2;
+
+// A diagnostic channel a worker gets exclusive use of while it holds it.
+struct DiagChannel {
+  char name[16];
+  uint32_t uses;
+};
+
+struct SyncSegment {
+  ShmSlotPool<DiagChannel, NUM_CHANNELS> channels;
+  ShmMutex mutex;
+  ShmBarrier barrier;
+  ShmRwLock calibration_lock;
+  uint32_t calibration_version;
+};
 
 std::atomic<bool> running{true};
 
@@ -24,109 +40,155 @@ void signal_handler(int signal) {
   }
 }
 
+// With -k this worker dies while holding its channel, to show the parent
+// recovering it.
+int crashing_worker = 0;
+
+// With -p the workers time every acquire and release of the shared
+// primitives into SYNC_SEGMENT.profile, which is left behind for
+// lock_stats.
+bool profiling = false;
+
 void worker_process(int worker_id) {
   std::cout << "[Worker " << worker_id << "] Started (PID: " << getpid() << ")"
             << std::endl;
 
-  sem_t* sem_resource = sem_open(SEM_RESOURCE, 0);
-  sem_t* sem_mutex = sem_open(SEM_MUTEX, 0);
-  sem_t* sem_barrier = sem_open(SEM_BARRIER, 0);
-
-  if (sem_resource == SEM_FAILED || sem_mutex == SEM_FAILED ||
-      sem_barrier == SEM_FAILED) {
-    std::cerr << "[Worker " << worker_id << "] Failed to open semaphores"
-              << std::endl;
+  ShmObject<SyncSegment> sync;
+  if (!sync.open(SYNC_SEGMENT)) {
+    std::cerr << "[Worker " << worker_id << "] Failed to open sync segment: "
+              << strerror(errno) << std::endl;
     return;
   }
 
+  LockProfileMap profile;
+  if (profiling && !profile.open(SYNC_SEGMENT)) {
+    std::cerr << "[Worker " << worker_id << "] Failed to open lock profile: "
+              << strerror(errno) << std::endl;
+  }
+  auto entry = [&](const char* name) {
+    return profile ? profile.entry(name) : nullptr;
+  };
+  Profiled<decltype(sync->channels)> channels(sync->channels,
+                                              entry("diag_channels"));
+  Profiled<ShmMutex> log_mutex(sync->mutex, entry("log_mutex"));
+  Profiled<ShmRwLock> calibration_lock(sync->calibration_lock,
+                                       entry("calibration_lock"));
+
   std::cout << "[Worker " << worker_id << "] Waiting at barrier..."
             << std::endl;
-  sem_wait(sem_barrier);
+  sync->barrier.arrive_and_wait();
   std::cout << "[Worker " << worker_id << "] Passed barrier, starting work"
             << std::endl;
 
   for (int task = 0; task < 5 && running; ++task) {
     std::cout << "[Worker " << worker_id << "] Task " << task
-              << " - Waiting for resource..." << std::endl;
+              << " - Waiting for a diagnostic channel..." << std::endl;
 
-    sem_wait(sem_resource);
+    auto channel = channels.acquire();
+    channel->uses++;
 
     std::cout << "[Worker " << worker_id << "] Task " << task
-              << " - Acquired resource, processing..." << std::endl;
+              << " - Acquired " << channel->name << ", processing..."
+              << std::endl;
+
+    if (worker_id == crashing_worker && task == 1) {
+      std::cout << "[Worker " << worker_id << "] Task " << task
+                << " - Crashing while holding " << channel->name
+                << std::endl;
+      _exit(3);
+    }
 
-    sem_wait(sem_mutex);
+    // Any number of workers may read the calibration table at once; an
+    // update excludes them all.
+    if (task == worker_id) {
+      calibration_lock.lock();
+      sync->calibration_version++;
+      std::cout << "[Worker " << worker_id << "] Task " << task
+                << " - Updated calibration to version "
+                << sync->calibration_version << std::endl;
+      calibration_lock.unlock();
+    }
+    calibration_lock.lock_shared();
     std::cout << "[Worker " << worker_id << "] Task " << task
-              << " - Critical section: Reading sensor data" << std::endl;
+              << " - Reading sensor data (calibration version "
+              << sync->calibration_version << ")" << std::endl;
     std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    calibration_lock.unlock_shared();
+
+    log_mutex.lock();
     std::cout << "[Worker " << worker_id << "] Task " << task
               << " - Critical section: Writing to log" << std::endl;
-    sem_post(sem_mutex);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    log_mutex.unlock();
 
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
     std::cout << "[Worker " << worker_id << "] Task " << task
-              << " - Releasing resource" << std::endl;
-    sem_post(sem_resource);
+              << " - Releasing " << channel->name << std::endl;
+    channels.release(channel);
 
     std::this_thread::sleep_for(std::chrono::milliseconds(200));
   }
 
-  sem_close(sem_resource);
-  sem_close(sem_mutex);
-  sem_close(sem_barrier);
-
   std::cout << "[Worker " << worker_id << "] Completed all tasks" << std::endl;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
   std::signal(SIGINT, signal_handler);
   std::signal(SIGTERM, signal_handler);
+  rt_setup("semaphore_demo");
+
+  int opt;
+  while ((opt = getopt(argc, argv, "kp")) != -1) {
+    if (opt == 'k') {
+      crashing_worker = 1;
+    } else if (opt == 'p') {
+      profiling = true;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-k] [-p]" << std::endl;
+      return 1;
+    }
+  }
 
   std::cout << "Semaphore Demo - Automotive Resource Management" << std::endl;
   std::cout << "Main process PID: " << getpid() << std::endl;
   std::cout << std::string(80, '=') << std::endl;
 
-  sem_unlink(SEM_RESOURCE);
-  sem_unlink(SEM_MUTEX);
-  sem_unlink(SEM_BARRIER);
-
-  sem_t* sem_resource = sem_open(SEM_RESOURCE, O_CREAT | O_EXCL, 0666, 2);
-  if (sem_resource == SEM_FAILED) {
-    std::cerr << "Failed to create resource semaphore: " << strerror(errno)
+  ShmObject<SyncSegment> sync;
+  if (!sync.create(SYNC_SEGMENT)) {
+    std::cerr << "Failed to create sync segment: " << strerror(errno)
               << std::endl;
     return 1;
   }
-
-  sem_t* sem_mutex = sem_open(SEM_MUTEX, O_CREAT | O_EXCL, 0666, 1);
-  if (sem_mutex == SEM_FAILED) {
-    std::cerr << "Failed to create mutex semaphore: " << strerror(errno)
+  LockProfileMap profile;
+  if (profiling && !profile.create(SYNC_SEGMENT)) {
+    std::cerr << "Failed to create lock profile: " << strerror(errno)
               << std::endl;
-    sem_close(sem_resource);
-    sem_unlink(SEM_RESOURCE);
     return 1;
   }
+  profile.close();
 
-  sem_t* sem_barrier = sem_open(SEM_BARRIER, O_CREAT | O_EXCL, 0666, 0);
-  if (sem_barrier == SEM_FAILED) {
-    std::cerr << "Failed to create barrier semaphore: " << strerror(errno)
-              << std::endl;
-    sem_close(sem_resource);
-    sem_close(sem_mutex);
-    sem_unlink(SEM_RESOURCE);
-    sem_unlink(SEM_MUTEX);
-    return 1;
+  sync->channels.init();
+  for (uint32_t i = 0; i < NUM_CHANNELS; ++i) {
+    snprintf(sync->channels.resources[i].name,
+             sizeof(sync->channels.resources[i].name), "CAN-DIAG-%u", i);
   }
-
-  std::cout << "Semaphores created:" << std::endl;
-  std::cout << "  - Resource semaphore (initial value: 2) - Limits concurrent "
-               "resource access"
+  sync->mutex.init();
+  sync->barrier.init(NUM_WORKERS + 1);
+  sync->calibration_lock.init();
+  sync->calibration_version = 1;
+
+  std::cout << "Primitives created in shared memory (" << SYNC_SEGMENT
+            << "):" << std::endl;
+  std::cout << "  - Slot pool (" << NUM_CHANNELS
+            << " diagnostic channels) - Hands each worker a specific channel"
+            << std::endl;
+  std::cout << "  - Futex mutex - Protects the log critical section"
+            << std::endl;
+  std::cout << "  - Barrier (" << NUM_WORKERS + 1
+            << " parties) - Synchronizes worker start" << std::endl;
+  std::cout << "  - Reader/writer lock - Guards the shared calibration table"
             << std::endl;
-  std::cout
-      << "  - Mutex semaphore (initial value: 1) - Protects critical section"
-      << std::endl;
-  std::cout
-      << "  - Barrier semaphore (initial value: 0) - Synchronizes worker start"
-      << std::endl;
   std::cout << std::string(80, '-') << std::endl;
 
   pid_t worker_pids[NUM_WORKERS];
@@ -140,10 +202,13 @@ int main() {
       for (int j = 0; j < i; ++j) {
         kill(worker_pids[j], SIGTERM);
       }
+      ShmObject<SyncSegment>::unlink(SYNC_SEGMENT);
+      LockProfileMap::unlink(SYNC_SEGMENT);
       return 1;
     }
 
     if (pid == 0) {
+      sync.close();
       worker_process(i + 1);
       return 0;
     }
@@ -154,41 +219,62 @@ int main() {
   std::cout << "[Main] All workers spawned, waiting 2 seconds..." << std::endl;
   std::this_thread::sleep_for(std::chrono::seconds(2));
 
-  std::cout << "[Main] Releasing barrier - all workers can now proceed"
+  std::cout << "[Main] Arriving at barrier - all workers can now proceed"
             << std::endl;
-  for (int i = 0; i < NUM_WORKERS; ++i) {
-    sem_post(sem_barrier);
-  }
+  sync->barrier.arrive_and_wait();
 
   std::cout << "[Main] Monitoring worker progress..." << std::endl;
   std::cout << std::string(80, '-') << std::endl;
 
-  for (int i = 0; i < NUM_WORKERS; ++i) {
+  // Workers are reaped in exit order so a channel left behind by one that
+  // died goes back to the pool while the others still need it.
+  for (int finished = 0; finished < NUM_WORKERS;) {
     int status;
-    pid_t pid = waitpid(worker_pids[i], &status, 0);
-    if (pid > 0) {
-      std::cout << "[Main] Worker " << (i + 1) << " (PID: " << pid
-                << ") finished with status: " << WEXITSTATUS(status)
-                << std::endl;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    finished++;
+    int worker = 0;
+    for (int i = 0; i < NUM_WORKERS; ++i) {
+      if (worker_pids[i] == pid) worker = i + 1;
+    }
+    std::cout << "[Main] Worker " << worker << " (PID: " << pid
+              << ") finished with status: " << WEXITSTATUS(status)
+              << std::endl;
+    unsigned leaked = sync->channels.reclaim(pid);
+    if (leaked > 0) {
+      std::cout << "[Main] Reclaimed " << leaked
+                << " channel(s) leaked by PID " << pid << std::endl;
     }
   }
 
-  sem_close(sem_resource);
-  sem_close(sem_mutex);
-  sem_close(sem_barrier);
-  sem_unlink(SEM_RESOURCE);
-  sem_unlink(SEM_MUTEX);
-  sem_unlink(SEM_BARRIER);
+  for (uint32_t i = 0; i < NUM_CHANNELS; ++i) {
+    std::cout << "[Main] " << sync->channels.resources[i].name << " used "
+              << sync->channels.resources[i].uses << " times" << std::endl;
+  }
+
+  sync.close();
+  ShmObject<SyncSegment>::unlink(SYNC_SEGMENT);
 
   std::cout << std::string(80, '=') << std::endl;
-  std::cout << "[Main] All workers completed. Semaphores cleaned up."
+  std::cout << "[Main] All workers completed. Shared memory cleaned up."
             << std::endl;
+  if (profiling) {
+    std::cout << "[Main] Lock profile kept in "
+              << lock_profile_name(SYNC_SEGMENT)
+              << "; run lock_stats -u to print and remove it" << std::endl;
+  }
   std::cout << "\nDemonstrated concepts:" << std::endl;
-  std::cout << "  1. Resource limiting (max 2 concurrent accesses)"
+  std::cout << "  1. Resource allocation (2 specific channels, dead holders "
+               "reclaimed)"
             << std::endl;
   std::cout << "  2. Mutual exclusion (critical section protection)"
             << std::endl;
   std::cout << "  3. Barrier synchronization (coordinated start)" << std::endl;
+  std::cout << "  4. Shared reads, exclusive updates (reader/writer lock)"
+            << std::endl;
 
   return 0;
 }
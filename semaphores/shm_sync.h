@@ -0,0 +1,316 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <new>
+
+#include "futex.h"
+#include "rt_profile.h"
+#include "shm_map.h"
+
+// Process-shared synchronization primitives built on futexes. Each one is
+// a plain struct of atomics meant to be placed in shared memory and
+// initialized once with init(); the shared (non-private) futex ops let
+// waiters in different processes find each other through the mapping.
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Spins this many times before parking on the futex; long enough to cover
+// a short critical section on another core, short enough not to matter
+// when the holder is descheduled. On a single CPU the holder cannot run
+// while we spin, so waiters park immediately.
+inline int sync_spin_limit() {
+  static const int limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 100 : 0;
+  return limit;
+}
+
+// The mutex and semaphore keep their value in the low half of a 64-bit
+// word and the number of parked waiters in the high half (as glibc's
+// sem_t does), so the fast paths are one atomic each and post/unlock only
+// make the wake call when somebody is parked. The futex is the low half.
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "futex word must be the low half of the 64-bit state");
+
+constexpr uint64_t SYNC_WAITER = 1ULL << 32;
+
+inline std::atomic<uint32_t>* sync_futex_word(std::atomic<uint64_t>& word) {
+  return reinterpret_cast<std::atomic<uint32_t>*>(&word);
+}
+
+struct alignas(64) ShmMutex {
+  std::atomic<uint64_t> state;
+
+  void init() { state.store(0, std::memory_order_relaxed); }
+
+  bool try_lock() {
+    uint64_t value = state.load(std::memory_order_relaxed);
+    return (value & 1) == 0 &&
+           state.compare_exchange_strong(value, value | 1,
+                                         std::memory_order_acquire);
+  }
+
+  void lock() {
+    for (int spin = 0; spin < sync_spin_limit(); ++spin) {
+      if (try_lock()) return;
+      cpu_relax();
+    }
+    if (try_lock()) return;
+
+    // Register as a waiter; taking the lock also deregisters.
+    uint64_t value =
+        state.fetch_add(SYNC_WAITER, std::memory_order_relaxed) + SYNC_WAITER;
+    while (true) {
+      if ((value & 1) == 0) {
+        if (state.compare_exchange_weak(value, (value | 1) - SYNC_WAITER,
+                                        std::memory_order_acquire)) {
+          return;
+        }
+        continue;
+      }
+      futex_wait(sync_futex_word(state), 1);
+      value = state.load(std::memory_order_relaxed);
+    }
+  }
+
+  void unlock() {
+    if (state.fetch_sub(1, std::memory_order_release) >= SYNC_WAITER) {
+      futex_wake(sync_futex_word(state), 1);
+    }
+  }
+};
+
+// Counting semaphore in the same layout as ShmMutex.
+struct alignas(64) ShmSemaphore {
+  std::atomic<uint64_t> state;
+
+  void init(uint32_t initial) {
+    state.store(initial, std::memory_order_relaxed);
+  }
+
+  bool try_wait() {
+    uint64_t value = state.load(std::memory_order_relaxed);
+    while (static_cast<uint32_t>(value) > 0) {
+      if (state.compare_exchange_weak(value, value - 1,
+                                      std::memory_order_acquire)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void wait() {
+    for (int spin = 0; spin < sync_spin_limit(); ++spin) {
+      if (try_wait()) return;
+      cpu_relax();
+    }
+    if (try_wait()) return;
+
+    uint64_t value =
+        state.fetch_add(SYNC_WAITER, std::memory_order_relaxed) + SYNC_WAITER;
+    while (true) {
+      if (static_cast<uint32_t>(value) > 0) {
+        if (state.compare_exchange_weak(value, value - 1 - SYNC_WAITER,
+                                        std::memory_order_acquire)) {
+          return;
+        }
+        continue;
+      }
+      futex_wait(sync_futex_word(state), 0);
+      value = state.load(std::memory_order_relaxed);
+    }
+  }
+
+  void post() {
+    if (state.fetch_add(1, std::memory_order_release) >= SYNC_WAITER) {
+      futex_wake(sync_futex_word(state), 1);
+    }
+  }
+};
+
+// Reusable barrier for a fixed number of parties. The last one to arrive
+// resets the count and flips the generation, which releases the others;
+// they compare against the generation they saw on arrival, so a fast
+// party re-entering the next round cannot be confused with this one.
+struct alignas(64) ShmBarrier {
+  std::atomic<uint32_t> remaining;
+  std::atomic<uint32_t> generation;
+  uint32_t parties;
+
+  void init(uint32_t count) {
+    parties = count;
+    remaining.store(count, std::memory_order_relaxed);
+    generation.store(0, std::memory_order_relaxed);
+  }
+
+  void arrive_and_wait() {
+    uint32_t sense = generation.load(std::memory_order_acquire);
+    if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      remaining.store(parties, std::memory_order_relaxed);
+      generation.fetch_add(1, std::memory_order_release);
+      futex_wake(&generation, INT_MAX);
+      return;
+    }
+
+    for (int spin = 0; spin < sync_spin_limit(); ++spin) {
+      if (generation.load(std::memory_order_acquire) != sense) return;
+      cpu_relax();
+    }
+    while (generation.load(std::memory_order_acquire) == sense) {
+      futex_wait(&generation, sense);
+    }
+  }
+};
+
+// Reader/writer lock with writer preference: once a writer is waiting, new
+// readers queue behind it so writers cannot starve. The state word holds
+// the reader count plus two flag bits and is also the futex word.
+struct alignas(64) ShmRwLock {
+  static constexpr uint32_t WRITER = 1U << 31;
+  static constexpr uint32_t WRITER_WAITING = 1U << 30;
+  static constexpr uint32_t READERS = WRITER_WAITING - 1;
+
+  std::atomic<uint32_t> state;
+
+  void init() { state.store(0, std::memory_order_relaxed); }
+
+  bool try_lock_shared() {
+    uint32_t value = state.load(std::memory_order_relaxed);
+    return (value & (WRITER | WRITER_WAITING)) == 0 &&
+           state.compare_exchange_strong(value, value + 1,
+                                         std::memory_order_acquire);
+  }
+
+  bool try_lock() {
+    uint32_t value = state.load(std::memory_order_relaxed);
+    return (value & (WRITER | READERS)) == 0 &&
+           state.compare_exchange_strong(value, WRITER,
+                                         std::memory_order_acquire);
+  }
+
+  void lock_shared() {
+    int spin = 0;
+    uint32_t value = state.load(std::memory_order_relaxed);
+    while (true) {
+      if ((value & (WRITER | WRITER_WAITING)) == 0) {
+        if (state.compare_exchange_weak(value, value + 1,
+                                        std::memory_order_acquire)) {
+          return;
+        }
+        continue;
+      }
+      if (spin++ < sync_spin_limit()) {
+        cpu_relax();
+      } else {
+        futex_wait(&state, value);
+      }
+      value = state.load(std::memory_order_relaxed);
+    }
+  }
+
+  void unlock_shared() {
+    uint32_t value = state.fetch_sub(1, std::memory_order_release) - 1;
+    if ((value & READERS) == 0 && (value & WRITER_WAITING)) {
+      futex_wake(&state, INT_MAX);
+    }
+  }
+
+  void lock() {
+    int spin = 0;
+    uint32_t value = state.load(std::memory_order_relaxed);
+    while (true) {
+      if ((value & (WRITER | READERS)) == 0) {
+        if (state.compare_exchange_weak(value, WRITER,
+                                        std::memory_order_acquire)) {
+          return;
+        }
+        continue;
+      }
+      if (spin++ < sync_spin_limit()) {
+        cpu_relax();
+      } else if ((value & WRITER_WAITING) == 0) {
+        state.compare_exchange_weak(value, value | WRITER_WAITING,
+                                    std::memory_order_relaxed);
+        continue;
+      } else {
+        futex_wait(&state, value);
+      }
+      value = state.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Clears WRITER_WAITING as well; writers still waiting set it again.
+  void unlock() {
+    state.store(0, std::memory_order_release);
+    futex_wake(&state, INT_MAX);
+  }
+};
+
+// Named shared-memory segment holding one T, so unrelated processes can
+// attach to the same primitives by name.
+template <typename T>
+class ShmObject {
+ public:
+  ShmObject() = default;
+  ShmObject(const ShmObject&) = delete;
+  ShmObject& operator=(const ShmObject&) = delete;
+  ~ShmObject() { close(); }
+
+  bool create(const char* name) {
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd < 0) return false;
+    bool mapped = ftruncate(fd, sizeof(T)) == 0 && map(fd);
+    ::close(fd);
+    if (!mapped) {
+      shm_unlink(name);
+      return false;
+    }
+    rt_shared_region(object_, sizeof(T), true);
+    object_ = new (object_) T();
+    return true;
+  }
+
+  bool open(const char* name) {
+    void* base;
+    if (!shm_map_existing(name, sizeof(T), true, &base, &size_)) return false;
+    object_ = static_cast<T*>(base);
+    rt_shared_region(object_, size_, false);
+    return true;
+  }
+
+  void close() {
+    if (object_) munmap(object_, size_);
+    object_ = nullptr;
+  }
+
+  static void unlink(const char* name) { shm_unlink(name); }
+
+  T* get() const { return object_; }
+  T* operator->() const { return object_; }
+
+ private:
+  bool map(int fd) {
+    void* base = mmap(nullptr, sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    if (base == MAP_FAILED) return false;
+    object_ = static_cast<T*>(base);
+    size_ = sizeof(T);
+    return true;
+  }
+
+  T* object_ = nullptr;
+  size_t size_ = 0;
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+
+#include "shm_sync.h"
+
+// Hands out specific resources from a fixed set instead of just counting
+// them. Free slots form a singly linked list of indices; the list head
+// carries a tag that is bumped on every change, so a pop that read a head
+// which was popped and pushed back in between fails its compare-exchange
+// instead of installing a stale next index (the ABA problem). The
+// semaphore counts free slots, which lets acquire() sleep while the pool
+// is empty.
+//
+// A slot is always either on the free list or marked with a PID in owner,
+// so one whose process dies can be found and recovered. Taking a slot
+// marks it TAKING before unlinking it, returning one marks it RETURNING
+// until it is linked back; reclaim() settles either state by checking
+// whether the slot made it onto the list, then tops the count up to the
+// free slots, which also repays a wait its process died right after. The
+// count may run above the free slots (a taker that finds the list empty
+// waits again) but not stay below them.
+template <typename T, uint32_t N>
+struct ShmSlotPool {
+  static_assert(N > 0 && N < UINT32_MAX, "slot count out of range");
+  static constexpr uint32_t NIL = UINT32_MAX;
+  static constexpr pid_t TAKING = 1 << 30;
+  static constexpr pid_t RETURNING = 1 << 29;
+  static constexpr pid_t PID_MASK = RETURNING - 1;
+
+  struct Slot {
+    uint32_t index;
+    T* resource;
+
+    explicit operator bool() const { return resource != nullptr; }
+    T* operator->() const { return resource; }
+  };
+
+  ShmSemaphore available;
+  alignas(64) std::atomic<uint64_t> head;
+  std::atomic<uint32_t> next[N];
+  std::atomic<pid_t> owner[N];
+  T resources[N];
+
+  void init() {
+    available.init(N);
+    for (uint32_t i = 0; i < N; ++i) {
+      next[i].store(i + 1 < N ? i + 1 : NIL, std::memory_order_relaxed);
+      owner[i].store(0, std::memory_order_relaxed);
+    }
+    head.store(0, std::memory_order_release);
+  }
+
+  // Blocks until a slot is free.
+  Slot acquire() {
+    while (true) {
+      available.wait();
+      Slot slot = pop();
+      if (slot) return slot;
+    }
+  }
+
+  // Returns an empty Slot with errno set to EAGAIN if none is free.
+  Slot try_acquire() {
+    while (available.try_wait()) {
+      Slot slot = pop();
+      if (slot) return slot;
+    }
+    errno = EAGAIN;
+    return Slot{NIL, nullptr};
+  }
+
+  void release(const Slot& slot) { release(slot.index); }
+
+  // Returns false (EINVAL) for a slot that is not held; that catches a
+  // double release and a slot already reclaimed from a dead owner.
+  bool release(uint32_t index) {
+    pid_t holder = index < N ? owner[index].load() : 0;
+    if (holder == 0 || (holder & (TAKING | RETURNING)) ||
+        !give_back(index, holder)) {
+      errno = EINVAL;
+      return false;
+    }
+    return true;
+  }
+
+  // Returns every slot held by pid to the pool, including one it was in
+  // the middle of taking or returning, for a parent that has reaped a
+  // worker. Returns the number of slots recovered.
+  unsigned reclaim(pid_t pid) {
+    unsigned recovered = 0;
+    for (uint32_t i = 0; i < N; ++i) {
+      pid_t holder = owner[i].load();
+      if (holder != 0 && (holder & PID_MASK) == pid && settle(i, holder)) {
+        recovered++;
+      }
+    }
+    top_up();
+    return recovered;
+  }
+
+  // Leak detection for holders nobody reaped for us: reclaims the slots of
+  // every owner that no longer exists. A recycled PID keeps its slots
+  // until the new process exits too.
+  unsigned reclaim_dead() {
+    unsigned recovered = 0;
+    for (uint32_t i = 0; i < N; ++i) {
+      pid_t holder = owner[i].load();
+      if (holder != 0 && kill(holder & PID_MASK, 0) < 0 && errno == ESRCH &&
+          settle(i, holder)) {
+        recovered++;
+      }
+    }
+    if (recovered > 0) top_up();
+    return recovered;
+  }
+
+  pid_t holder(uint32_t index) const {
+    return owner[index].load() & PID_MASK;
+  }
+
+ private:
+  static uint32_t index_of(uint64_t word) {
+    return static_cast<uint32_t>(word);
+  }
+
+  static uint64_t tagged(uint64_t word, uint32_t index) {
+    return ((word >> 32) + 1) << 32 | index;
+  }
+
+  // Takes the head slot, or returns an empty Slot if the list is empty.
+  // The slot is claimed before it is unlinked; while another process
+  // holds that claim, this one waits.
+  Slot pop() {
+    pid_t self = getpid();
+    while (true) {
+      uint64_t top = head.load(std::memory_order_acquire);
+      uint32_t index = index_of(top);
+      if (index == NIL) return Slot{NIL, nullptr};
+      uint32_t after = next[index].load(std::memory_order_relaxed);
+      pid_t free_slot = 0;
+      if (!owner[index].compare_exchange_strong(free_slot, self | TAKING)) {
+        sched_yield();
+        continue;
+      }
+      if (head.compare_exchange_strong(top, tagged(top, after),
+                                       std::memory_order_acquire)) {
+        owner[index].store(self);
+        return Slot{index, &resources[index]};
+      }
+      owner[index].store(0);
+    }
+  }
+
+  // Links a slot marked with holder back into the list, then clears the
+  // mark. False if the mark changed meanwhile.
+  bool give_back(uint32_t index, pid_t holder) {
+    if (!owner[index].compare_exchange_strong(holder,
+                                              getpid() | RETURNING)) {
+      return false;
+    }
+    uint64_t top = head.load(std::memory_order_relaxed);
+    do {
+      next[index].store(index_of(top), std::memory_order_relaxed);
+    } while (!head.compare_exchange_weak(top, tagged(top, index),
+                                         std::memory_order_release));
+    available.post();
+    owner[index].store(0, std::memory_order_release);
+    return true;
+  }
+
+  // Length of the free list, and whether index is on it. The walk only
+  // counts if the head (and with it its tag) is unchanged afterwards.
+  uint32_t free_list(uint32_t index, bool& found) const {
+    while (true) {
+      uint64_t top = head.load(std::memory_order_acquire);
+      uint32_t length = 0;
+      found = false;
+      for (uint32_t i = index_of(top); i != NIL && length < N;
+           i = next[i].load(std::memory_order_relaxed)) {
+        found |= i == index;
+        length++;
+      }
+      if (head.load(std::memory_order_acquire) == top) return length;
+    }
+  }
+
+  // Frees a slot whose marking process is gone. A slot still (or again)
+  // on the list only loses its mark; any other is given back.
+  bool settle(uint32_t index, pid_t holder) {
+    if (holder & (TAKING | RETURNING)) {
+      bool found = false;
+      free_list(index, found);
+      if (found) return owner[index].compare_exchange_strong(holder, 0);
+    }
+    return give_back(index, holder);
+  }
+
+  // Posts the counts a dead process took or never made, up to the number
+  // of free slots. A live taker between its wait and its pop can make
+  // this post one too many, which only costs a later taker a retry.
+  void top_up() {
+    bool found = false;
+    uint32_t free_slots = free_list(NIL, found);
+    uint32_t count = static_cast<uint32_t>(available.state.load());
+    for (; count < free_slots; ++count) available.post();
+  }
+};
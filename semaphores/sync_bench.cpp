@@ -0,0 +1,265 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "shm_sync.h"
+#include "wire_types.h"
+
+// Concurrent holders allowed by the counting-semaphore test.
+constexpr uint32_t SEMAPHORE_SLOTS = 4;
+
+enum class Primitive {
+  SEM_MUTEX,
+  FUTEX_MUTEX,
+  SEM_COUNT,
+  FUTEX_COUNT,
+  PTHREAD_BARRIER,
+  FUTEX_BARRIER
+};
+
+struct BenchShared {
+  ShmBarrier start;
+  sem_t sem;
+  pthread_barrier_t pthread_barrier;
+  ShmMutex mutex;
+  ShmSemaphore semaphore;
+  ShmBarrier barrier;
+  alignas(64) uint64_t counter;
+  std::atomic<uint64_t> holders;
+  std::atomic<uint64_t> max_holders;
+  std::atomic<uint64_t> first_start_ns;
+  std::atomic<uint64_t> last_end_ns;
+};
+
+void store_min(std::atomic<uint64_t>& target, uint64_t value) {
+  uint64_t current = target.load();
+  while (value < current && !target.compare_exchange_weak(current, value)) {
+  }
+}
+
+void store_max(std::atomic<uint64_t>& target, uint64_t value) {
+  uint64_t current = target.load();
+  while (value > current && !target.compare_exchange_weak(current, value)) {
+  }
+}
+
+// Workers time themselves: with fewer cores than workers the parent may
+// not run again until most of the work is done.
+void run_worker(BenchShared* shared, Primitive primitive, uint64_t ops) {
+  shared->start.arrive_and_wait();
+  store_min(shared->first_start_ns, wire_timestamp_ns());
+  for (uint64_t i = 0; i < ops; ++i) {
+    switch (primitive) {
+      case Primitive::SEM_MUTEX:
+        while (sem_wait(&shared->sem) < 0 && errno == EINTR) {
+        }
+        shared->counter++;
+        sem_post(&shared->sem);
+        break;
+      case Primitive::FUTEX_MUTEX:
+        shared->mutex.lock();
+        shared->counter++;
+        shared->mutex.unlock();
+        break;
+      case Primitive::SEM_COUNT:
+      case Primitive::FUTEX_COUNT: {
+        bool futex = primitive == Primitive::FUTEX_COUNT;
+        if (futex) {
+          shared->semaphore.wait();
+        } else {
+          while (sem_wait(&shared->sem) < 0 && errno == EINTR) {
+          }
+        }
+        uint64_t holding = shared->holders.fetch_add(1) + 1;
+        uint64_t max = shared->max_holders.load();
+        while (holding > max &&
+               !shared->max_holders.compare_exchange_weak(max, holding)) {
+        }
+        shared->holders.fetch_sub(1);
+        if (futex) {
+          shared->semaphore.post();
+        } else {
+          sem_post(&shared->sem);
+        }
+        break;
+      }
+      case Primitive::PTHREAD_BARRIER:
+        pthread_barrier_wait(&shared->pthread_barrier);
+        break;
+      case Primitive::FUTEX_BARRIER:
+        shared->barrier.arrive_and_wait();
+        break;
+    }
+  }
+  store_max(shared->last_end_ns, wire_timestamp_ns());
+}
+
+// Returns nanoseconds per operation across all workers, or a negative
+// value if a worker failed or the primitive broke its guarantee.
+double run_case(BenchShared* shared, Primitive primitive, int workers,
+                uint64_t ops) {
+  new (shared) BenchShared();
+  shared->first_start_ns.store(UINT64_MAX);
+  shared->start.init(static_cast<uint32_t>(workers) + 1);
+  shared->mutex.init();
+  shared->semaphore.init(SEMAPHORE_SLOTS);
+  shared->barrier.init(static_cast<uint32_t>(workers));
+  bool counting = primitive == Primitive::SEM_COUNT;
+  sem_init(&shared->sem, 1, counting ? SEMAPHORE_SLOTS : 1);
+  pthread_barrierattr_t attr;
+  pthread_barrierattr_init(&attr);
+  pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_barrier_init(&shared->pthread_barrier, &attr,
+                       static_cast<unsigned>(workers));
+  pthread_barrierattr_destroy(&attr);
+
+  std::vector<pid_t> pids;
+  for (int w = 0; w < workers; ++w) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      run_worker(shared, primitive, ops);
+      _exit(0);
+    }
+    if (pid < 0) {
+      std::cerr << "Failed to fork worker: " << strerror(errno) << std::endl;
+      break;
+    }
+    pids.push_back(pid);
+  }
+  if (pids.size() != static_cast<size_t>(workers)) {
+    for (pid_t pid : pids) kill(pid, SIGKILL);
+    for (pid_t pid : pids) waitpid(pid, nullptr, 0);
+    return -1;
+  }
+
+  shared->start.arrive_and_wait();
+  bool failed = false;
+  for (pid_t pid : pids) {
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = true;
+  }
+  double ns = static_cast<double>(shared->last_end_ns.load() -
+                                  shared->first_start_ns.load());
+
+  sem_destroy(&shared->sem);
+  pthread_barrier_destroy(&shared->pthread_barrier);
+
+  bool mutex = primitive == Primitive::SEM_MUTEX ||
+               primitive == Primitive::FUTEX_MUTEX;
+  bool semaphore = primitive == Primitive::SEM_COUNT ||
+                   primitive == Primitive::FUTEX_COUNT;
+  if (mutex && shared->counter != ops * workers) failed = true;
+  if (semaphore && shared->max_holders.load() > SEMAPHORE_SLOTS) {
+    failed = true;
+  }
+  if (failed) return -1;
+
+  // A barrier round is one operation however many parties take part.
+  bool barrier = primitive == Primitive::PTHREAD_BARRIER ||
+                 primitive == Primitive::FUTEX_BARRIER;
+  return ns / (barrier ? ops : ops * workers);
+}
+
+std::vector<int> parse_counts(const char* text) {
+  std::vector<int> counts;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    int count = std::atoi(item.c_str());
+    if (count > 0) counts.push_back(count);
+  }
+  return counts;
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<int> worker_counts = {2, 4, 8, 16, 32, 64};
+  uint64_t ops = 20000;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "w:n:")) != -1) {
+    switch (opt) {
+      case 'w':
+        worker_counts = parse_counts(optarg);
+        break;
+      case 'n':
+        ops = std::strtoull(optarg, nullptr, 0);
+        break;
+      default:
+        std::cerr << "Usage: " << argv[0]
+                  << " [-w workers,workers,...] [-n ops_per_worker]"
+                  << std::endl;
+        return 1;
+    }
+  }
+  if (worker_counts.empty() || ops == 0) {
+    std::cerr << "Worker counts and operation count must be positive"
+              << std::endl;
+    return 1;
+  }
+
+  BenchShared* shared = static_cast<BenchShared*>(
+      mmap(nullptr, sizeof(BenchShared), PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+  if (shared == MAP_FAILED) {
+    std::cerr << "Failed to map shared state: " << strerror(errno)
+              << std::endl;
+    return 1;
+  }
+
+  struct Case {
+    const char* name;
+    Primitive baseline;
+    Primitive futex;
+    uint64_t ops;
+  };
+  const Case cases[] = {
+      {"mutex", Primitive::SEM_MUTEX, Primitive::FUTEX_MUTEX, ops},
+      {"semaphore", Primitive::SEM_COUNT, Primitive::FUTEX_COUNT, ops},
+      {"barrier", Primitive::PTHREAD_BARRIER, Primitive::FUTEX_BARRIER,
+       ops / 10 > 0 ? ops / 10 : 1},
+  };
+
+  std::cout << "Contended cost per operation (" << ops
+            << " ops per worker; barrier rounds are ops/10)" << std::endl;
+  std::cout << "Baseline: sem_t for mutex/semaphore, pthread_barrier_t for "
+               "barrier"
+            << std::endl;
+  std::cout << std::setw(8) << "workers" << std::setw(11) << "primitive"
+            << std::setw(15) << "baseline ns" << std::setw(13) << "futex ns"
+            << std::setw(10) << "speedup" << std::endl;
+
+  int result = 0;
+  for (int workers : worker_counts) {
+    for (const Case& c : cases) {
+      double baseline = run_case(shared, c.baseline, workers, c.ops);
+      double futex = run_case(shared, c.futex, workers, c.ops);
+      std::cout << std::setw(8) << workers << std::setw(11) << c.name
+                << std::fixed << std::setprecision(1) << std::setw(15)
+                << baseline << std::setw(13) << futex << std::setw(9)
+                << std::setprecision(2) << baseline / futex << "x"
+                << std::endl;
+      if (baseline < 0 || futex < 0) {
+        std::cerr << "  " << c.name << " with " << workers
+                  << " workers failed" << std::endl;
+        result = 1;
+      }
+    }
+  }
+
+  munmap(shared, sizeof(BenchShared));
+  return result;
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <sched.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include "shm_sync.h"
+
+// Work-stealing task scheduler for forked workers. Every worker owns a
+// Chase-Lev deque in the shared segment: it pushes and pops its own tasks
+// at the bottom without contention, and idle workers in other processes
+// steal from the top. Tasks are 64-bit words (typically an index into a
+// job table in another shared segment), so a steal is one atomic load and
+// nothing in the segment depends on where a process mapped it.
+
+constexpr uint32_t SCHEDULER_MAX_WORKERS = 64;
+constexpr uint32_t TASK_DEQUE_CAPACITY = 4096;
+
+// Workers to start by default: one per CPU this process may run on.
+inline uint32_t default_worker_count() {
+  cpu_set_t set;
+  int count = sched_getaffinity(0, sizeof(set), &set) == 0 ? CPU_COUNT(&set)
+                                                           : 1;
+  if (count < 1) count = 1;
+  return count > static_cast<int>(SCHEDULER_MAX_WORKERS)
+             ? SCHEDULER_MAX_WORKERS
+             : static_cast<uint32_t>(count);
+}
+
+// Fixed-capacity Chase-Lev deque (in the C11 formulation of Le et al.).
+struct alignas(64) TaskDeque {
+  static_assert((TASK_DEQUE_CAPACITY & (TASK_DEQUE_CAPACITY - 1)) == 0,
+                "deque capacity must be a power of two");
+  static constexpr uint64_t MASK = TASK_DEQUE_CAPACITY - 1;
+
+  std::atomic<int64_t> top;
+  alignas(64) std::atomic<int64_t> bottom;
+  alignas(64) std::atomic<uint64_t> tasks[TASK_DEQUE_CAPACITY];
+
+  void init() {
+    top.store(0, std::memory_order_relaxed);
+    bottom.store(0, std::memory_order_relaxed);
+  }
+
+  // Owner only. Returns false when the deque is full.
+  bool push(uint64_t task) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= static_cast<int64_t>(TASK_DEQUE_CAPACITY)) return false;
+    tasks[b & MASK].store(task, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Owner only; takes the most recently pushed task.
+  bool pop(uint64_t& task) {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    task = tasks[b & MASK].load(std::memory_order_relaxed);
+    if (t == b) {
+      // Last task: race the thieves for it through top.
+      bool won = top.compare_exchange_strong(
+          t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // Any process; takes the oldest task. Fails when empty or when it lost
+  // a race for the top task.
+  bool steal(uint64_t& task) {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return false;
+    task = tasks[t & MASK].load(std::memory_order_relaxed);
+    return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed);
+  }
+
+  bool empty() const {
+    return top.load(std::memory_order_relaxed) >=
+           bottom.load(std::memory_order_relaxed);
+  }
+};
+
+struct alignas(64) TaskWorkerStats {
+  std::atomic<uint64_t> executed;
+  std::atomic<uint64_t> stolen;
+  std::atomic<uint64_t> failed_steals;
+};
+
+// Work runs in phases. The coordinator announces how many tasks a phase
+// starts with, then every worker and the coordinator pass the start
+// barrier; workers seed their deques, run until no task of the phase is
+// left anywhere, and meet the coordinator at the completion barrier.
+// Tasks may spawn further tasks with spawn(); the outstanding count
+// covers them, so the phase only ends when the whole tree has run.
+struct TaskScheduler {
+  uint32_t workers;
+  std::atomic<uint32_t> stopping;
+  alignas(64) std::atomic<uint64_t> outstanding;
+  ShmBarrier start;
+  ShmBarrier done;
+  TaskWorkerStats stats[SCHEDULER_MAX_WORKERS];
+  TaskDeque deques[SCHEDULER_MAX_WORKERS];
+
+  void init(uint32_t count) {
+    workers = count;
+    stopping.store(0, std::memory_order_relaxed);
+    outstanding.store(0, std::memory_order_relaxed);
+    start.init(count + 1);
+    done.init(count + 1);
+    for (uint32_t w = 0; w < count; ++w) {
+      deques[w].init();
+      stats[w].executed.store(0, std::memory_order_relaxed);
+      stats[w].stolen.store(0, std::memory_order_relaxed);
+      stats[w].failed_steals.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Coordinator side: runs one phase of initial_tasks tasks and returns
+  // once all of them (and everything they spawned) have completed.
+  void run_phase(uint64_t initial_tasks) {
+    outstanding.store(initial_tasks, std::memory_order_relaxed);
+    start.arrive_and_wait();
+    done.arrive_and_wait();
+  }
+
+  // Coordinator side: releases the workers from their phase loop.
+  void shutdown() {
+    stopping.store(1, std::memory_order_relaxed);
+    start.arrive_and_wait();
+  }
+
+  // Worker side; returns false once the coordinator shut down. seed(w)
+  // pushes this worker's share of the phase's initial tasks with
+  // push_initial(); handle(w, task) runs one task.
+  template <typename Seed, typename Handler>
+  bool worker_phase(uint32_t w, Seed&& seed, Handler&& handle) {
+    start.arrive_and_wait();
+    if (stopping.load(std::memory_order_relaxed)) return false;
+    seed(w);
+
+    uint32_t victim = w;
+    uint64_t task;
+    while (outstanding.load(std::memory_order_acquire) > 0) {
+      bool stolen = false;
+      bool found = deques[w].pop(task);
+      for (uint32_t i = 1; !found && i < workers; ++i) {
+        victim = (victim + 1) % workers;
+        if (victim == w) continue;
+        found = stolen = deques[victim].steal(task);
+      }
+      if (!found) {
+        stats[w].failed_steals.fetch_add(1, std::memory_order_relaxed);
+        sched_yield();
+        continue;
+      }
+
+      handle(w, task);
+      stats[w].executed.fetch_add(1, std::memory_order_relaxed);
+      if (stolen) stats[w].stolen.fetch_add(1, std::memory_order_relaxed);
+      outstanding.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    done.arrive_and_wait();
+    return true;
+  }
+
+  // Seeding only; the coordinator already counted these tasks. A task
+  // that does not fit runs inline.
+  template <typename Handler>
+  void push_initial(uint32_t w, uint64_t task, Handler&& handle) {
+    if (deques[w].push(task)) return;
+    handle(w, task);
+    stats[w].executed.fetch_add(1, std::memory_order_relaxed);
+    outstanding.fetch_sub(1, std::memory_order_acq_rel);
+  }
+
+  // From inside a task: queues a new task of the current phase on the
+  // calling worker's deque. Returns false when the deque is full; the
+  // caller should then run the work itself.
+  bool spawn(uint32_t w, uint64_t task) {
+    outstanding.fetch_add(1, std::memory_order_relaxed);
+    if (deques[w].push(task)) return true;
+    outstanding.fetch_sub(1, std::memory_order_relaxed);
+    return false;
+  }
+};
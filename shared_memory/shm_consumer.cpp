@@ -1,7 +1,3 @@
-#include <fcntl.h>
-#include <semaphore.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 #include <atomic>
@@ -10,9 +6,12 @@
 #include <iomanip>
 #include <iostream>
 
+#include "channel.h"
+#include "latency_histogram.h"
+#include "rt_profile.h"
+#include "wire_types.h"
+
 constexpr const char* SHM_NAME = "/automotive_shm";
-constexpr const char* SEM_WRITE_NAME = "/automotive_sem_write";
-constexpr const char* SEM_READ_NAME = "/automotive_sem_read";
 
 std::atomic<bool> running{true};
 
@@ -22,67 +21,32 @@ void signal_handler(int signal) {
   }
 }
 
-struct SensorData {
-  float temperature;
-  float pressure;
-  float voltage;
-  int error_code;
-  uint64_t timestamp;
-  uint32_t sequence_number;
-  bool valid;
-};
-
-struct SharedMemory {
-  SensorData data;
-  bool producer_active;
-};
+using SensorChannel = Channel<SensorData, ShmRingBackend>;
 
 int main() {
   std::signal(SIGINT, signal_handler);
   std::signal(SIGTERM, signal_handler);
+  rt_setup("shm_consumer");
 
   std::cout << "Waiting for producer to start..." << std::endl;
 
-  int shm_fd = -1;
+  SensorChannel channel;
+  bool connected = false;
   for (int i = 0; i < 10 && running; ++i) {
-    shm_fd = shm_open(SHM_NAME, O_RDONLY, 0666);
-    if (shm_fd >= 0) break;
+    connected = channel.open(SHM_NAME, ChannelRole::READER);
+    if (connected || errno == EPROTO) break;
     sleep(1);
   }
 
-  if (shm_fd < 0) {
-    std::cerr << "Failed to open shared memory: " << strerror(errno)
-              << std::endl;
-    std::cerr << "Make sure the producer is running first" << std::endl;
-    return 1;
-  }
-
-  SharedMemory* shared_mem = static_cast<SharedMemory*>(
-      mmap(nullptr, sizeof(SharedMemory), PROT_READ, MAP_SHARED, shm_fd, 0));
-
-  if (shared_mem == MAP_FAILED) {
-    std::cerr << "Failed to map shared memory: " << strerror(errno)
-              << std::endl;
-    close(shm_fd);
+  if (!connected && errno == EPROTO) {
+    std::cerr << "Producer writes a different SensorData layout (expected "
+              << "version " << SensorData::WIRE_VERSION << ")" << std::endl;
     return 1;
   }
-
-  sem_t* sem_write = sem_open(SEM_WRITE_NAME, 0);
-  if (sem_write == SEM_FAILED) {
-    std::cerr << "Failed to open write semaphore: " << strerror(errno)
+  if (!connected) {
+    std::cerr << "Failed to open shared memory channel: " << strerror(errno)
               << std::endl;
-    munmap(shared_mem, sizeof(SharedMemory));
-    close(shm_fd);
-    return 1;
-  }
-
-  sem_t* sem_read = sem_open(SEM_READ_NAME, 0);
-  if (sem_read == SEM_FAILED) {
-    std::cerr << "Failed to open read semaphore: " << strerror(errno)
-              << std::endl;
-    sem_close(sem_write);
-    munmap(shared_mem, sizeof(SharedMemory));
-    close(shm_fd);
+    std::cerr << "Make sure the producer is running first" << std::endl;
     return 1;
   }
 
@@ -92,40 +56,47 @@ int main() {
 
   uint32_t last_sequence = 0;
   int packets_received = 0;
+  LatencyReport latency("shm_consumer");
+  uint32_t generation = channel.backend().generation();
+  bool producer_lost = false;
 
+  // A restarted producer takes over the same ring, so the consumer only
+  // watches its heartbeat and the generation it is at.
   while (running) {
-    struct timespec timeout;
-    clock_gettime(CLOCK_REALTIME, &timeout);
-    timeout.tv_sec += 2;
-
-    if (sem_timedwait(sem_read, &timeout) < 0) {
-      if (errno == ETIMEDOUT) {
-        if (!shared_mem->producer_active) {
-          std::cout << "\nProducer has stopped" << std::endl;
-          break;
-        }
-        continue;
-      } else if (errno == EINTR) {
-        continue;
-      } else {
-        std::cerr << "\nSemaphore wait error: " << strerror(errno) << std::endl;
-        break;
-      }
-    }
-
-    if (!shared_mem->producer_active) {
+    SensorData data;
+    int received = channel.receive(data, SHM_RING_HEARTBEAT_MS);
+    if (received == 0) {
       std::cout << "\nProducer has stopped" << std::endl;
       break;
     }
+    if (received < 0) {
+      if (errno == EAGAIN && !producer_lost &&
+          channel.backend().heartbeat_age_ms() > SHM_RING_WRITER_TIMEOUT_MS) {
+        std::cout << "\n[WARNING] Producer is not responding; waiting for "
+                  << "it to restart" << std::endl;
+        producer_lost = true;
+      }
+      if (errno == EAGAIN || errno == EINTR) continue;
+      std::cerr << "\nChannel receive error: " << strerror(errno)
+                << std::endl;
+      break;
+    }
+    if (channel.backend().generation() != generation) {
+      generation = channel.backend().generation();
+      std::cout << "\n[INFO] Producer restarted (generation " << generation
+                << ")" << std::endl;
+    } else if (producer_lost) {
+      std::cout << "\n[INFO] Producer is responding again" << std::endl;
+    }
+    producer_lost = false;
 
-    SensorData data = shared_mem->data;
-
-    sem_post(sem_write);
-
+    channel.metrics().latency_ns(latency.record_since(data.timestamp));
+    if (!data.valid) channel.metrics().drop();
     if (data.valid) {
       packets_received++;
 
       if (data.sequence_number != last_sequence + 1 && last_sequence != 0) {
+        channel.metrics().gap(data.sequence_number - last_sequence - 1);
         std::cout << "\n[WARNING] Missed packets! Expected: "
                   << (last_sequence + 1) << ", Got: " << data.sequence_number
                   << std::endl;
@@ -145,15 +116,14 @@ int main() {
 
       std::cout << std::endl;
     }
+    if (latency.due()) latency.print_period(std::cout);
   }
 
-  sem_close(sem_write);
-  sem_close(sem_read);
-  munmap(shared_mem, sizeof(SharedMemory));
-  close(shm_fd);
+  channel.close();
 
   std::cout << "\nConsumer stopped (received " << packets_received
             << " packets)" << std::endl;
+  latency.print_total(std::cout);
 
   return 0;
 }
@@ -0,0 +1,185 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "rt_profile.h"
+#include "shm_history.h"
+#include "wire_types.h"
+
+// Queries the sensor history shm_producer keeps, in place and while it is
+// being written: the samples of the last few seconds or the last n, as a
+// summary or one line each, once or every few milliseconds.
+
+constexpr const char* SHM_HISTORY_NAME = "/automotive_shm_history";
+constexpr int QUERY_ATTEMPTS = 3;
+
+std::atomic<bool> running{true};
+
+void signal_handler(int signal) {
+  if (signal == SIGINT || signal == SIGTERM) {
+    running = false;
+  }
+}
+
+struct Summary {
+  uint64_t count = 0;
+  uint64_t errors = 0;
+  uint64_t gaps = 0;
+  uint64_t first_ns = 0;
+  uint64_t last_ns = 0;
+  float temp_min = 0;
+  float temp_max = 0;
+  double temp_sum = 0;
+  double pressure_sum = 0;
+  float voltage_min = 0;
+  uint32_t last_sequence = 0;
+
+  void add(const SensorData& data) {
+    if (count == 0) {
+      first_ns = data.timestamp;
+      temp_min = temp_max = data.temperature;
+      voltage_min = data.voltage;
+    } else if (data.sequence_number != last_sequence + 1) {
+      gaps++;
+    }
+    last_ns = data.timestamp;
+    last_sequence = data.sequence_number;
+    temp_min = std::min(temp_min, data.temperature);
+    temp_max = std::max(temp_max, data.temperature);
+    voltage_min = std::min(voltage_min, data.voltage);
+    temp_sum += data.temperature;
+    pressure_sum += data.pressure;
+    if (data.error_code != 0) errors++;
+    count++;
+  }
+};
+
+void print_sample(const SensorData& data, uint64_t now) {
+  std::cout << "[SEQ: " << std::setw(5) << data.sequence_number << "] "
+            << std::setw(8) << std::fixed << std::setprecision(3)
+            << (now - data.timestamp) / 1e9 << " s ago | Temp: "
+            << std::setprecision(2) << std::setw(6) << data.temperature
+            << "°C | Pressure: " << std::setw(5) << data.pressure
+            << " bar | Voltage: " << std::setw(5) << data.voltage
+            << "V | Error: " << std::setw(2) << data.error_code << std::endl;
+}
+
+void print_summary(const Summary& summary, uint64_t now, uint64_t query_ns,
+                   int attempts) {
+  std::cout << summary.count << " samples";
+  if (summary.count > 0) {
+    std::cout << std::fixed << std::setprecision(3) << " from "
+              << (now - summary.first_ns) / 1e9 << " to "
+              << (now - summary.last_ns) / 1e9 << " s ago"
+              << std::setprecision(2) << " | Temp " << summary.temp_min
+              << "/" << summary.temp_sum / summary.count << "/"
+              << summary.temp_max << "°C min/mean/max | Pressure "
+              << summary.pressure_sum / summary.count << " bar mean"
+              << " | Voltage " << summary.voltage_min << "V min | Errors "
+              << summary.errors << " | Gaps " << summary.gaps;
+  }
+  std::cout << " | query " << std::setprecision(1) << query_ns / 1e3 << " us";
+  if (attempts > 1) std::cout << " (" << attempts << " attempts)";
+  std::cout << std::endl;
+}
+
+// Takes the view and reads it; retries when the producer overwrote part
+// of it meanwhile. Returns false if every attempt was overrun.
+bool query(const ShmHistory<SensorData>& history, double seconds,
+           uint64_t last, bool print) {
+  for (int attempt = 1; attempt <= QUERY_ATTEMPTS; ++attempt) {
+    uint64_t start = wire_timestamp_ns();
+    HistoryView<SensorData> view;
+    if (last > 0) {
+      view = history.last(last);
+    } else {
+      uint64_t span = static_cast<uint64_t>(seconds * 1e9);
+      view = history.range(start > span ? start - span : 0, start);
+    }
+    Summary summary;
+    view.for_each([&](const SensorData& data) { summary.add(data); });
+    uint64_t query_ns = wire_timestamp_ns() - start;
+    if (!history.intact(view)) continue;
+
+    // Printing takes a while, so the lines are only trusted if the view
+    // is still intact afterwards.
+    if (print) {
+      view.for_each([&](const SensorData& data) { print_sample(data, start); });
+      if (!history.intact(view)) {
+        std::cout << "(overrun while printing; lines above may be mixed)"
+                  << std::endl;
+      }
+    }
+    print_summary(summary, start, query_ns, attempt);
+    return true;
+  }
+  std::cerr << "Producer overran the query " << QUERY_ATTEMPTS << " times"
+            << std::endl;
+  return false;
+}
+
+int main(int argc, char* argv[]) {
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+  rt_setup("shm_history");
+
+  double seconds = 10;
+  uint64_t last = 0;
+  long watch_ms = 0;
+  bool print = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:l:w:p")) != -1) {
+    switch (opt) {
+      case 's':
+        seconds = std::atof(optarg);
+        break;
+      case 'l':
+        last = std::strtoull(optarg, nullptr, 10);
+        break;
+      case 'w':
+        watch_ms = std::atol(optarg);
+        break;
+      case 'p':
+        print = true;
+        break;
+      default:
+        std::cerr << "Usage: " << argv[0]
+                  << " [-s seconds | -l samples] [-p] [-w interval_ms]"
+                  << std::endl;
+        std::cerr << "  -s summarizes the last seconds (default 10), -l the"
+                     " last samples; -p prints each one"
+                  << std::endl;
+        std::cerr << "  -w repeats the query until Ctrl+C" << std::endl;
+        return 1;
+    }
+  }
+
+  ShmHistory<SensorData> history;
+  if (!history.open(SHM_HISTORY_NAME)) {
+    if (errno == EPROTO) {
+      std::cerr << "Producer keeps a different SensorData layout (expected "
+                << "version " << SensorData::WIRE_VERSION << ")" << std::endl;
+    } else {
+      std::cerr << "Failed to open " << SHM_HISTORY_NAME << ": "
+                << strerror(errno) << std::endl;
+      std::cerr << "Make sure the producer is running first" << std::endl;
+    }
+    return 1;
+  }
+  std::cout << "History: " << history.appended() << " samples appended, "
+            << history.capacity() << " kept, index every "
+            << history.stride() << std::endl;
+
+  do {
+    if (!query(history, seconds, last, print)) return 1;
+    if (watch_ms > 0) usleep(static_cast<useconds_t>(watch_ms) * 1000);
+  } while (watch_ms > 0 && running);
+  return 0;
+}
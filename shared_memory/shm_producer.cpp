@@ -1,19 +1,20 @@
-#include <fcntl.h>
-#include <semaphore.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 #include <atomic>
 #include <chrono>
 #include <csignal>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <thread>
 
+#include "channel.h"
+#include "rt_profile.h"
+#include "shm_history.h"
+#include "wire_types.h"
+
 constexpr const char* SHM_NAME = "/automotive_shm";
-constexpr const char* SEM_WRITE_NAME = "/automotive_sem_write";
-constexpr const char* SEM_READ_NAME = "/automotive_sem_read";
+constexpr const char* SHM_HISTORY_NAME = "/automotive_shm_history";
 
 std::atomic<bool> running{true};
 
@@ -23,131 +24,180 @@ void signal_handler(int signal) {
   }
 }
 
-struct SensorData {
-  float temperature;
-  float pressure;
-  float voltage;
-  int error_code;
-  uint64_t timestamp;
-  uint32_t sequence_number;
-  bool valid;
-};
-
-struct SharedMemory {
-  SensorData data;
-  bool producer_active;
-};
-
-int main() {
-  std::signal(SIGINT, signal_handler);
-  std::signal(SIGTERM, signal_handler);
-
-  shm_unlink(SHM_NAME);
-  sem_unlink(SEM_WRITE_NAME);
-  sem_unlink(SEM_READ_NAME);
-
-  int shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
-  if (shm_fd < 0) {
-    std::cerr << "Failed to create shared memory: " << strerror(errno)
-              << std::endl;
-    return 1;
+// Switching transport only takes another backend here.
+using SensorChannel = Channel<SensorData, ShmRingBackend>;
+
+// Takes over the ring a previous producer left, so its consumers carry on
+// without reconnecting, or creates it.
+bool attach_channel(SensorChannel& channel, bool& resumed) {
+  resumed = channel.open(SHM_NAME, ChannelRole::WRITER);
+  if (resumed) return true;
+  if (errno == EBUSY) {
+    std::cerr << "Another producer is writing " << SHM_NAME << std::endl;
+    return false;
   }
+  if (!channel.create(SHM_NAME, ChannelRole::WRITER)) {
+    std::cerr << "Failed to create shared memory channel: "
+              << strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+}
 
-  if (ftruncate(shm_fd, sizeof(SharedMemory)) < 0) {
-    std::cerr << "Failed to set shared memory size: " << strerror(errno)
-              << std::endl;
-    close(shm_fd);
-    shm_unlink(SHM_NAME);
-    return 1;
+// The sequence number after the newest sample sent or kept. The history
+// also has the samples dropped on a full ring, so it usually decides.
+uint32_t next_sequence(SensorChannel& channel,
+                       const ShmHistory<SensorData>& history) {
+  uint32_t next = 0;
+  SensorData last;
+  if (channel.backend().last_record(&last)) next = last.sequence_number + 1;
+  HistoryView<SensorData> newest = history.last(1);
+  if (!newest.empty() && newest[0].sequence_number + 1 > next) {
+    next = newest[0].sequence_number + 1;
   }
+  return next;
+}
 
-  SharedMemory* shared_mem = static_cast<SharedMemory*>(
-      mmap(nullptr, sizeof(SharedMemory), PROT_READ | PROT_WRITE, MAP_SHARED,
-           shm_fd, 0));
+// Sleeps for the sample interval, beating for the consumers meanwhile.
+void idle(SensorChannel& channel, long interval_ms) {
+  for (long left = interval_ms; left > 0 && running;) {
+    long slice = left < SHM_RING_HEARTBEAT_MS ? left : SHM_RING_HEARTBEAT_MS;
+    std::this_thread::sleep_for(std::chrono::milliseconds(slice));
+    left -= slice;
+    channel.backend().heartbeat();
+  }
+}
 
-  if (shared_mem == MAP_FAILED) {
-    std::cerr << "Failed to map shared memory: " << strerror(errno)
-              << std::endl;
-    close(shm_fd);
-    shm_unlink(SHM_NAME);
-    return 1;
+int main(int argc, char* argv[]) {
+  std::signal(SIGINT, signal_handler);
+  std::signal(SIGTERM, signal_handler);
+  rt_setup("shm_producer");
+
+  long interval_ms = 1000;
+  bool quiet = false;
+  bool end_stream = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "i:qx")) != -1) {
+    if (opt == 'i') {
+      interval_ms = std::atol(optarg);
+    } else if (opt == 'q') {
+      quiet = true;
+    } else if (opt == 'x') {
+      end_stream = true;
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-i interval_ms] [-q] [-x]"
+                << std::endl;
+      std::cerr << "  -x ends the stream at exit instead of leaving it for"
+                   " a restarted producer"
+                << std::endl;
+      return 1;
+    }
   }
 
-  sem_t* sem_write = sem_open(SEM_WRITE_NAME, O_CREAT, 0666, 1);
-  if (sem_write == SEM_FAILED) {
-    std::cerr << "Failed to create write semaphore: " << strerror(errno)
+  SensorChannel channel;
+  bool resumed = false;
+  if (!attach_channel(channel, resumed)) return 1;
+  channel.backend().heartbeat();
+
+  // Every sample is also kept in the history, for late or analytic
+  // readers (shm_history); the channel only carries it to the consumer.
+  ShmHistory<SensorData> history;
+  if (!(resumed && history.open(SHM_HISTORY_NAME, true)) &&
+      !history.create(SHM_HISTORY_NAME)) {
+    std::cerr << "Failed to create sensor history: " << strerror(errno)
               << std::endl;
-    munmap(shared_mem, sizeof(SharedMemory));
-    close(shm_fd);
-    shm_unlink(SHM_NAME);
     return 1;
   }
 
-  sem_t* sem_read = sem_open(SEM_READ_NAME, O_CREAT, 0666, 0);
-  if (sem_read == SEM_FAILED) {
-    std::cerr << "Failed to create read semaphore: " << strerror(errno)
+  uint32_t sequence = resumed ? next_sequence(channel, history) : 0;
+  if (resumed) {
+    std::cout << "Resumed " << SHM_NAME << " as generation "
+              << channel.backend().generation() << " at SEQ " << sequence
               << std::endl;
-    sem_close(sem_write);
-    sem_unlink(SEM_WRITE_NAME);
-    munmap(shared_mem, sizeof(SharedMemory));
-    close(shm_fd);
-    shm_unlink(SHM_NAME);
-    return 1;
   }
-
-  memset(shared_mem, 0, sizeof(SharedMemory));
-  shared_mem->producer_active = true;
-
-  std::cout << "Shared memory producer started" << std::endl;
+  std::cout << "Shared memory producer started (history of "
+            << history.capacity() << " samples in " << SHM_HISTORY_NAME
+            << ")" << std::endl;
   std::cout << "Writing sensor data... (Press Ctrl+C to stop)" << std::endl;
   std::cout << std::string(80, '-') << std::endl;
 
-  uint32_t sequence = 0;
   float temp_base = 20.0f;
+  uint64_t dropped = 0;
+  bool superseded = false;
 
   while (running) {
-    sem_wait(sem_write);
-
-    shared_mem->data.temperature =
+    // A producer stalled long enough to be taken over must not write
+    // alongside the one that replaced it.
+    if (channel.backend().superseded()) {
+      std::cerr << "Another producer took over " << SHM_NAME << std::endl;
+      superseded = true;
+      break;
+    }
+
+    SensorData data;
+    data.temperature =
         temp_base +
         (static_cast<float>(rand()) / static_cast<float>(RAND_MAX)) * 10.0f;
-    shared_mem->data.pressure =
+    data.pressure =
         1.0f +
         (static_cast<float>(rand()) / static_cast<float>(RAND_MAX)) * 0.5f;
-    shared_mem->data.voltage =
+    data.voltage =
         12.0f +
         (static_cast<float>(rand()) / static_cast<float>(RAND_MAX)) * 2.0f;
-    shared_mem->data.error_code = (rand() % 100 < 5) ? (rand() % 10) : 0;
-    shared_mem->data.timestamp =
-        std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now().time_since_epoch())
-            .count();
-    shared_mem->data.sequence_number = sequence++;
-    shared_mem->data.valid = true;
-
-    std::cout << "[SEQ: " << shared_mem->data.sequence_number << "] "
-              << "Temp: " << shared_mem->data.temperature << "°C | "
-              << "Pressure: " << shared_mem->data.pressure << " bar | "
-              << "Voltage: " << shared_mem->data.voltage << "V | "
-              << "Error: " << shared_mem->data.error_code << std::endl;
-
-    sem_post(sem_read);
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    data.error_code = (rand() % 100 < 5) ? (rand() % 10) : 0;
+    data.timestamp = wire_timestamp_ns();
+    data.sequence_number = sequence++;
+    data.valid = true;
+    history.append(data);
+
+    // A full ring means the consumer stalled or is gone; the sample is
+    // dropped (the history still has it) rather than waited on.
+    if (channel.backend().queued() >= SHM_RING_CAPACITY) {
+      if (dropped++ == 0) {
+        std::cout << "[WARNING] Consumer is not reading; dropping samples"
+                  << std::endl;
+      }
+      channel.metrics().drop();
+    } else if (!channel.send(data)) {
+      std::cerr << "Failed to send sensor data: " << strerror(errno)
+                << std::endl;
+      break;
+    } else if (dropped > 0) {
+      std::cout << "[INFO] Consumer is reading again (" << dropped
+                << " samples dropped)" << std::endl;
+      dropped = 0;
+    }
+
+    if (!quiet) {
+      std::cout << "[SEQ: " << data.sequence_number << "] "
+                << "Temp: " << data.temperature << "°C | "
+                << "Pressure: " << data.pressure << " bar | "
+                << "Voltage: " << data.voltage << "V | "
+                << "Error: " << data.error_code << std::endl;
+    }
+
+    idle(channel, interval_ms);
   }
 
-  shared_mem->producer_active = false;
-  sem_post(sem_read);
-
-  sem_close(sem_write);
-  sem_close(sem_read);
-  sem_unlink(SEM_WRITE_NAME);
-  sem_unlink(SEM_READ_NAME);
-  munmap(shared_mem, sizeof(SharedMemory));
-  close(shm_fd);
-  shm_unlink(SHM_NAME);
-
-  std::cout << "\nProducer stopped" << std::endl;
+  // By default the ring and history stay for the next producer and the
+  // consumer waits for it; closing marks the end of the stream instead.
+  if (superseded) {
+    channel.backend().detach();
+    channel.close();
+    history.close();
+  } else if (end_stream) {
+    channel.close();
+    SensorChannel::unlink(SHM_NAME);
+    history.close();
+    ShmHistory<SensorData>::unlink(SHM_HISTORY_NAME);
+    std::cout << "\nProducer stopped" << std::endl;
+  } else {
+    channel.backend().detach();
+    channel.close();
+    history.close();
+    std::cout << "\nProducer stopped; restart it to resume SEQ " << sequence
+              << std::endl;
+  }
 
   return 0;
 }
@@ -1,5 +1,3 @@
-#include <sys/socket.h>
-#include <sys/un.h>
 #include <unistd.h>
 
 #include <atomic>
@@ -8,6 +6,11 @@
 #include <iomanip>
 #include <iostream>
 
+#include "channel.h"
+#include "latency_histogram.h"
+#include "rt_profile.h"
+#include "wire_types.h"
+
 constexpr const char* SOCKET_PATH = "/tmp/automotive_ipc_socket";
 
 std::atomic<bool> running{true};
@@ -18,37 +21,19 @@ void signal_handler(int signal) {
   }
 }
 
-struct VehicleData {
-  float speed;
-  float rpm;
-  float fuel_level;
-  int gear;
-  bool engine_on;
-  uint64_t timestamp;
-};
+using VehicleChannel = Channel<VehicleData, UdsBackend>;
 
 int main() {
   std::signal(SIGINT, signal_handler);
   std::signal(SIGTERM, signal_handler);
+  rt_setup("socket_client");
 
-  int client_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-  if (client_fd < 0) {
-    std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
-    return 1;
-  }
-
-  struct sockaddr_un server_addr;
-  memset(&server_addr, 0, sizeof(server_addr));
-  server_addr.sun_family = AF_UNIX;
-  strncpy(server_addr.sun_path, SOCKET_PATH, sizeof(server_addr.sun_path) - 1);
-
+  VehicleChannel channel;
   std::cout << "Connecting to server..." << std::endl;
-  if (connect(client_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) <
-      0) {
+  if (!channel.open(SOCKET_PATH, ChannelRole::READER)) {
     std::cerr << "Failed to connect to server: " << strerror(errno)
               << std::endl;
     std::cerr << "Make sure the server is running first" << std::endl;
-    close(client_fd);
     return 1;
   }
 
@@ -58,11 +43,16 @@ int main() {
 
   VehicleData vehicle_data;
   int packet_count = 0;
+  LatencyReport latency("socket_client");
 
   while (running) {
-    ssize_t received = recv(client_fd, &vehicle_data, sizeof(vehicle_data), 0);
+    int received = channel.receive(vehicle_data);
 
-    if (received < 0) {
+    if (received < 0 && errno == EPROTO) {
+      std::cerr << "\nServer sends a different VehicleData layout (expected "
+                << "version " << VehicleData::WIRE_VERSION << ")" << std::endl;
+      break;
+    } else if (received < 0) {
       std::cerr << "\nError receiving data: " << strerror(errno) << std::endl;
       break;
     } else if (received == 0) {
@@ -71,6 +61,7 @@ int main() {
     }
 
     packet_count++;
+    channel.metrics().latency_ns(latency.record_since(vehicle_data.timestamp));
     std::cout << "\r[Packet #" << std::setw(4) << packet_count << "] "
               << "Speed: " << std::fixed << std::setprecision(1) << std::setw(6)
               << vehicle_data.speed << " km/h | " << "RPM: " << std::setw(7)
@@ -80,10 +71,15 @@ int main() {
               << "Gear: " << vehicle_data.gear << " | "
               << "Engine: " << (vehicle_data.engine_on ? "ON " : "OFF") << " | "
               << "TS: " << vehicle_data.timestamp << std::flush;
+    if (latency.due()) {
+      std::cout << std::endl;
+      latency.print_period(std::cout);
+    }
   }
 
-  close(client_fd);
+  channel.close();
   std::cout << "\n\nClient stopped" << std::endl;
+  latency.print_total(std::cout);
 
   return 0;
 }
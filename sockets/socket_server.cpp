@@ -1,5 +1,3 @@
-#include <sys/socket.h>
-#include <sys/un.h>
 #include <unistd.h>
 
 #include <atomic>
@@ -9,8 +7,11 @@
 #include <iostream>
 #include <thread>
 
+#include "channel.h"
+#include "rt_profile.h"
+#include "wire_types.h"
+
 constexpr const char* SOCKET_PATH = "/tmp/automotive_ipc_socket";
-constexpr size_t BUFFER_SIZE = 1024;
 
 std::atomic<bool> running{true};
 
@@ -20,114 +21,64 @@ void signal_handler(int signal) {
   }
 }
 
-struct VehicleData {
-  float speed;
-  float rpm;
-  float fuel_level;
-  int gear;
-  bool engine_on;
-  uint64_t timestamp;
-};
+using VehicleChannel = Channel<VehicleData, UdsBackend>;
 
 int main() {
   std::signal(SIGINT, signal_handler);
   std::signal(SIGTERM, signal_handler);
+  rt_setup("socket_server");
 
-  int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-  if (server_fd < 0) {
+  VehicleChannel channel;
+  if (!channel.create(SOCKET_PATH, ChannelRole::WRITER)) {
     std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
     return 1;
   }
 
-  unlink(SOCKET_PATH);
-
-  struct sockaddr_un server_addr;
-  memset(&server_addr, 0, sizeof(server_addr));
-  server_addr.sun_family = AF_UNIX;
-  strncpy(server_addr.sun_path, SOCKET_PATH, sizeof(server_addr.sun_path) - 1);
-
-  if (bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) <
-      0) {
-    std::cerr << "Failed to bind socket: " << strerror(errno) << std::endl;
-    close(server_fd);
-    return 1;
-  }
-
-  if (listen(server_fd, 5) < 0) {
-    std::cerr << "Failed to listen on socket: " << strerror(errno) << std::endl;
-    close(server_fd);
-    unlink(SOCKET_PATH);
-    return 1;
-  }
-
   std::cout << "Socket server listening on " << SOCKET_PATH << std::endl;
   std::cout << "Press Ctrl+C to stop the server" << std::endl;
 
   while (running) {
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(server_fd, &read_fds);
+    if (!channel.wait_peer(1000)) {
+      if (errno != EAGAIN && errno != EINTR) {
+        std::cerr << "Failed to accept connection: " << strerror(errno)
+                  << std::endl;
+        break;
+      }
+      continue;
+    }
 
-    struct timeval timeout;
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 0;
+    std::cout << "Client connected" << std::endl;
 
-    int activity = select(server_fd + 1, &read_fds, nullptr, nullptr, &timeout);
+    VehicleData vehicle_data;
+    vehicle_data.speed = 0.0f;
+    vehicle_data.rpm = 800.0f;
+    vehicle_data.fuel_level = 75.0f;
+    vehicle_data.gear = 0;
+    vehicle_data.engine_on = true;
 
-    if (activity < 0 && errno != EINTR) {
-      std::cerr << "Select error: " << strerror(errno) << std::endl;
-      break;
-    }
+    while (running) {
+      vehicle_data.speed += 5.0f;
+      if (vehicle_data.speed > 120.0f) vehicle_data.speed = 0.0f;
 
-    if (activity > 0 && FD_ISSET(server_fd, &read_fds)) {
-      int client_fd = accept(server_fd, nullptr, nullptr);
-      if (client_fd < 0) {
-        if (errno != EINTR) {
-          std::cerr << "Failed to accept connection: " << strerror(errno)
-                    << std::endl;
-        }
-        continue;
-      }
+      vehicle_data.rpm = 800.0f + (vehicle_data.speed * 30.0f);
+      vehicle_data.fuel_level -= 0.1f;
+      if (vehicle_data.fuel_level < 0.0f) vehicle_data.fuel_level = 100.0f;
+
+      vehicle_data.gear = static_cast<int16_t>(vehicle_data.speed / 20.0f);
+      vehicle_data.timestamp = wire_timestamp_ns();
 
-      std::cout << "Client connected" << std::endl;
-
-      VehicleData vehicle_data;
-      vehicle_data.speed = 0.0f;
-      vehicle_data.rpm = 800.0f;
-      vehicle_data.fuel_level = 75.0f;
-      vehicle_data.gear = 0;
-      vehicle_data.engine_on = true;
-
-      while (running) {
-        vehicle_data.speed += 5.0f;
-        if (vehicle_data.speed > 120.0f) vehicle_data.speed = 0.0f;
-
-        vehicle_data.rpm = 800.0f + (vehicle_data.speed * 30.0f);
-        vehicle_data.fuel_level -= 0.1f;
-        if (vehicle_data.fuel_level < 0.0f) vehicle_data.fuel_level = 100.0f;
-
-        vehicle_data.gear = static_cast<int>(vehicle_data.speed / 20.0f);
-        vehicle_data.timestamp =
-            std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::system_clock::now().time_since_epoch())
-                .count();
-
-        ssize_t sent =
-            send(client_fd, &vehicle_data, sizeof(vehicle_data), MSG_NOSIGNAL);
-        if (sent < 0) {
-          std::cout << "Client disconnected" << std::endl;
-          break;
-        }
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+      if (!channel.send(vehicle_data)) {
+        std::cout << "Client disconnected" << std::endl;
+        break;
       }
 
-      close(client_fd);
+      std::this_thread::sleep_for(std::chrono::milliseconds(500));
     }
+
+    channel.backend().disconnect();
   }
 
-  close(server_fd);
-  unlink(SOCKET_PATH);
+  channel.close();
   std::cout << "\nServer stopped" << std::endl;
 
   return 0;